@@ -0,0 +1,31 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include "TarFormat.h"
+
+// Settings chosen in the Create panel for one archive job
+struct ArchiveOptions {
+    int compressionLevel{6};
+
+    // Train per-type preset dictionaries for small files (ZipFormat.h)
+    bool sharedDictionary{false};
+
+    // Compress files as one solid stream split into blocks of this size
+    bool solid{false};
+    uint64_t solidBlockSize{16ull * 1024 * 1024};
+
+    // Write a split archive of volumes no larger than volumeSize
+    bool split{false};
+    uint64_t volumeSize{650ull * 1024 * 1024};
+
+    // Reuse compressed bytes of unchanged files from CompressionCache
+    bool useCache{false};
+    uint64_t cacheCapacity{2ull * 1024 * 1024 * 1024};
+
+    // Write a tar archive, compressed this way, instead of a ZIP (TarWriter.h)
+    bool tar{false};
+    TarFormat::Compression tarCompression{TarFormat::Compression::None};
+};
@@ -0,0 +1,458 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ArchiveRepacker.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <thread>
+#include "ContentType.h"
+#include "PathOptimizer.h"
+#include "Trace.h"
+#include "ZipReader.h"
+#include "ZipWriter.h"
+
+namespace {
+    // Bytes a streamed entry may have in flight between decoder and writer
+    constexpr size_t kPipeBytes = 4 * 1024 * 1024;
+
+    // Hands data pushed by ZipReader's sinks to a writer that pulls it
+    class StreamPipe {
+    public:
+        bool Push(const char* data, size_t size)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return m_abandoned || m_queued < kPipeBytes; });
+            if (m_abandoned) return false;
+            m_chunks.emplace_back(data, size);
+            m_queued += size;
+            m_changed.notify_all();
+            return true;
+        }
+
+        // No more data is coming; after a failure the reader gets
+        // ZipWriter::kReadError instead of the end of the data
+        void Close(bool failed)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_failed = failed;
+            m_changed.notify_all();
+        }
+
+        // The writer is done, whether or not everything was read
+        void Abandon()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_abandoned = true;
+            m_changed.notify_all();
+        }
+
+        // Fills the whole buffer unless the data ends first
+        size_t Read(char* buffer, size_t size)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            size_t copied = 0;
+            while (copied < size) {
+                m_changed.wait(lock, [this]() { return m_closed || !m_chunks.empty(); });
+                if (m_chunks.empty()) return m_failed ? ZipWriter::kReadError : copied;
+
+                std::string& front = m_chunks.front();
+                size_t n = std::min(size - copied, front.size() - m_frontOffset);
+                std::memcpy(buffer + copied, front.data() + m_frontOffset, n);
+                copied += n;
+                m_frontOffset += n;
+                m_queued -= n;
+                if (m_frontOffset == front.size()) {
+                    m_chunks.pop_front();
+                    m_frontOffset = 0;
+                }
+                m_changed.notify_all();
+            }
+            return copied;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::deque<std::string> m_chunks;
+        size_t m_frontOffset{0};
+        size_t m_queued{0};
+        bool m_closed{false};
+        bool m_failed{false};
+        bool m_abandoned{false};
+    };
+
+    // The entry as it will be written when its data is copied unchanged
+    ZipWriterEntry copyOf(const ZipEntryInfo& source)
+    {
+        ZipWriterEntry entry;
+        entry.name = source.name;
+        entry.method = source.method;
+        // Sizes go in the local header. Encrypted entries keep the data
+        // descriptor flag, which decides whether ZipCrypto's password check
+        // byte comes from the CRC or the time; ZipWriter writes one for them.
+        entry.flags = source.flags;
+        if (!(source.flags & ZipFormat::kFlagEncrypted)) entry.flags &= ~ZipFormat::kFlagDataDescriptor;
+        entry.crc = source.crc;
+        entry.compressedSize = source.compressedSize;
+        entry.uncompressedSize = source.uncompressedSize;
+        entry.dosDateTime = source.dosDateTime;
+        entry.externalAttributes = source.externalAttributes;
+        entry.extra = ZipFormat::RemoveExtraField(source.extra, ZipFormat::kExtraZip64);
+        return entry;
+    }
+
+    // Re-encoded entries are plain DEFLATE or STORE
+    ZipWriterEntry recompressedOf(const ZipEntryInfo& source)
+    {
+        ZipWriterEntry entry = copyOf(source);
+        entry.flags = source.flags & ZipFormat::kFlagUtf8;
+        entry.extra = ZipFormat::RemoveExtraField(entry.extra, ZipFormat::kExtraDictionaryRef);
+        return entry;
+    }
+
+    bool dictionaryId(const ZipEntryInfo& entry, uint16_t field, uint32_t& id)
+    {
+        std::string payload;
+        if (!ZipFormat::FindExtraField(entry.extra, field, payload) || payload.size() < 4) return false;
+        id = ZipFormat::GetU32(reinterpret_cast<const unsigned char*>(payload.data()));
+        return true;
+    }
+
+    bool isLarge(const ZipEntryInfo& entry)
+    {
+        return std::max(entry.compressedSize, entry.uncompressedSize) > ArchiveRepacker::kStreamThreshold;
+    }
+
+    ContentType::Kind kindOf(const std::string& data, const std::string& name)
+    {
+        return ContentType::FromContent(reinterpret_cast<const unsigned char*>(data.data()),
+                                        std::min(data.size(), ContentType::kProbeSize), name);
+    }
+}
+
+struct ArchiveRepacker::Prepared {
+    ZipWriterEntry entry;
+    std::string data; // exactly what goes after the local header
+    bool copied{false};
+    bool ok{false};
+    std::string error;
+};
+
+ArchiveRepacker::ArchiveRepacker(RepackOptions options)
+    : m_options(options)
+{
+    m_options.threads = std::max(1u, m_options.threads);
+}
+
+bool ArchiveRepacker::fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = message;
+    return false;
+}
+
+std::string ArchiveRepacker::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
+
+ArchiveRepacker::Stats ArchiveRepacker::GetStats() const
+{
+    Stats stats;
+    stats.copied = m_copied;
+    stats.copiedBytes = m_copiedBytes;
+    stats.recompressed = m_recompressed;
+    stats.decodedBytes = m_decodedBytes;
+    stats.writtenBytes = m_writtenBytes;
+    stats.failed = m_failed;
+    return stats;
+}
+
+bool ArchiveRepacker::CanCopy(const ZipEntryInfo& entry) const
+{
+    using namespace ZipFormat;
+
+    // Nothing here can decode these, so they travel as they are
+    if (entry.flags & kFlagEncrypted) return true;
+    if (entry.solid) return false;
+    if (entry.IsDir()) return true;
+    if (m_options.recompressAll) return false;
+
+    if (m_options.compressionLevel == 0) return entry.method == kMethodStore;
+    return (entry.method == kMethodDeflate || entry.method == kMethodDeflateDictionary) &&
+           (entry.flags & kFlagDeflateOptionMask) == DeflateOptionFlags(m_options.compressionLevel);
+}
+
+std::vector<size_t> ArchiveRepacker::outputOrder(const ZipReader& reader, const std::vector<size_t>& entries) const
+{
+    // Dictionaries are brought along by copyDictionaries; solid blocks are
+    // replaced by their members
+    const auto& all = reader.GetEntries();
+    std::vector<size_t> order;
+    order.reserve(entries.size());
+    for (size_t index : entries) {
+        if (index < all.size() && !all[index].IsInternal()) order.push_back(index);
+    }
+    if (!m_options.optimizeOrder || order.size() < 3) return order;
+
+    // By name only: nothing is decoded just to pick an order
+    Trace::Span span("optimize");
+    PathOptimizer optimizer;
+    for (size_t index : order) {
+        optimizer.AddFile(index, static_cast<size_t>(all[index].uncompressedSize),
+                          ContentType::FromPath(all[index].name));
+    }
+    RefinedOrder refined = optimizer.RefineOrder(std::chrono::milliseconds(200), m_options.threads);
+    std::vector<size_t> optimized;
+    optimized.reserve(refined.order.size());
+    for (size_t node : refined.order) {
+        optimized.push_back(optimizer.GetFile(node).id);
+    }
+    return optimized;
+}
+
+bool ArchiveRepacker::copyDictionaries(ZipReader& reader, ZipWriter& writer, const std::vector<size_t>& order)
+{
+    const auto& all = reader.GetEntries();
+    std::set<uint32_t> needed;
+    for (size_t index : order) {
+        uint32_t id;
+        if (all[index].method == ZipFormat::kMethodDeflateDictionary && CanCopy(all[index]) &&
+            dictionaryId(all[index], ZipFormat::kExtraDictionaryRef, id)) {
+            needed.insert(id);
+        }
+    }
+
+    for (const auto& entry : all) {
+        uint32_t id;
+        if (!entry.IsInternal() || !dictionaryId(entry, ZipFormat::kExtraDictionary, id) || !needed.count(id)) {
+            continue;
+        }
+        std::string data;
+        bool ok = reader.ReadRaw(entry, [&data](const char* chunk, size_t size) {
+            data.append(chunk, size);
+            return true;
+        });
+        if (!ok) return fail(reader.GetLastError());
+        if (!writer.AddCompressed(copyOf(entry), data)) return fail(writer.GetLastError());
+    }
+    return true;
+}
+
+void ArchiveRepacker::prepare(ZipReader& reader, const ZipEntryInfo& source, Prepared& out)
+{
+    auto append = [](std::string& target) {
+        return [&target](const char* data, size_t size) {
+            target.append(data, size);
+            return true;
+        };
+    };
+
+    // Stored data is the content itself, so it is only read once either way
+    std::string content;
+    bool copy = CanCopy(source);
+    if (copy || (source.method == ZipFormat::kMethodStore && !source.solid)) {
+        out.data.reserve(static_cast<size_t>(source.compressedSize));
+        if (!reader.ReadRaw(source, append(out.data))) {
+            out.error = reader.GetLastError();
+            return;
+        }
+        // Stored content that is already compressed stays stored at any level
+        if (copy || ContentType::IsCompressed(kindOf(out.data, source.name))) {
+            out.entry = copyOf(source);
+            out.copied = true;
+            out.ok = true;
+            return;
+        }
+        content = std::move(out.data);
+        out.data.clear();
+    } else {
+        content.reserve(static_cast<size_t>(source.uncompressedSize));
+        if (!reader.ReadEntry(source, append(content))) {
+            out.error = reader.GetLastError();
+            return;
+        }
+    }
+
+    int level = m_options.compressionLevel;
+    if (level != 0 && ContentType::IsCompressed(kindOf(content, source.name))) level = 0;
+
+    out.entry = recompressedOf(source);
+    out.entry.method = level == 0 ? ZipFormat::kMethodStore : ZipFormat::kMethodDeflate;
+    if (level != 0) out.entry.flags |= ZipFormat::DeflateOptionFlags(level);
+    out.data.reserve(level == 0 ? content.size() : content.size() / 2);
+
+    size_t position = 0;
+    bool ok = ZipWriter::CompressStream(
+        [&content, &position](char* buffer, size_t size) {
+            size_t n = std::min(size, content.size() - position);
+            std::memcpy(buffer, content.data() + position, n);
+            position += n;
+            return n;
+        },
+        append(out.data), out.entry.method, level, {}, out.entry.crc, out.entry.uncompressedSize);
+    if (!ok) {
+        out.error = "Failed to compress: " + source.name;
+        return;
+    }
+    // ReadEntry checked decoded data; stored data is checked here
+    if (out.entry.crc != source.crc) {
+        out.error = "CRC mismatch: " + source.name;
+        return;
+    }
+    out.entry.compressedSize = out.data.size();
+    out.ok = true;
+}
+
+bool ArchiveRepacker::stream(ZipReader& reader, ZipWriter& writer, const ZipEntryInfo& source)
+{
+    Trace::Span span("repack stream");
+
+    // Too large to hold for a look at the content; the name decides
+    bool copy = CanCopy(source);
+    int level = m_options.compressionLevel;
+    if (!copy && source.method == ZipFormat::kMethodStore && !source.solid &&
+        ContentType::IsCompressed(ContentType::FromPath(source.name))) {
+        copy = true;
+    }
+    if (level != 0 && ContentType::IsCompressed(ContentType::FromPath(source.name))) level = 0;
+
+    StreamPipe pipe;
+    bool produced = false;
+    std::thread producer([&]() {
+        auto push = [&pipe](const char* data, size_t size) { return pipe.Push(data, size); };
+        produced = copy ? reader.ReadRaw(source, push) : reader.ReadEntry(source, push);
+        pipe.Close(!produced);
+    });
+
+    auto pull = [&pipe](char* buffer, size_t size) { return pipe.Read(buffer, size); };
+    ZipWriterEntry entry = copy ? copyOf(source) : recompressedOf(source);
+    uint64_t start = writer.GetBytesWritten();
+    bool written = copy ? writer.AddCompressed(entry, pull) : writer.AddStream(entry, pull, level, source.uncompressedSize);
+    pipe.Abandon();
+    producer.join();
+
+    // The writer takes a failed entry back out itself; one that failed its
+    // check only once all of it was written is removed here
+    if (!produced) {
+        if (written && !writer.RemoveLastEntry()) return fail(writer.GetLastError());
+        return fail(reader.GetLastError());
+    }
+    if (!written) return fail(writer.GetLastError());
+
+    if (copy) {
+        ++m_copied;
+        m_copiedBytes += source.compressedSize;
+    } else {
+        ++m_recompressed;
+        m_decodedBytes += source.uncompressedSize;
+        m_writtenBytes += writer.GetBytesWritten() - start;
+    }
+    return true;
+}
+
+bool ArchiveRepacker::Repack(ZipReader& reader, const std::vector<size_t>& entries, const std::string& outputPath,
+                             const ProgressFn& progress)
+{
+    Trace::Span span("repack");
+
+    // Opening the output truncates it, which must not be what reader reads
+    struct stat output{};
+    if (::stat(outputPath.c_str(), &output) == 0) {
+        for (uint32_t disk = 0; disk < reader.GetVolumeCount(); ++disk) {
+            std::string volume = reader.GetVolumePath(disk);
+            struct stat input{};
+            if (!volume.empty() && ::stat(volume.c_str(), &input) == 0 &&
+                input.st_dev == output.st_dev && input.st_ino == output.st_ino) {
+                return fail("Cannot repack an archive into itself: " + outputPath);
+            }
+        }
+    }
+
+    // Written beside the output and renamed over it once finished, so a
+    // failed repack leaves whatever was there before
+    std::string temporary = outputPath + ".tmp-" + std::to_string(::getpid());
+    ZipWriter writer;
+    if (!writer.Open(temporary)) {
+        std::remove(temporary.c_str());
+        return fail(writer.GetLastError());
+    }
+
+    std::vector<size_t> order = outputOrder(reader, entries);
+    const auto& all = reader.GetEntries();
+    bool ok = copyDictionaries(reader, writer, order);
+
+    std::vector<const ZipEntryInfo*> plan;
+    plan.reserve(order.size());
+    for (size_t index : order) {
+        plan.push_back(&all[index]);
+    }
+    reader.Prefetch(plan);
+
+    std::vector<Prepared> wave;
+    size_t next = 0;
+    while (next < order.size()) {
+        if (isLarge(all[order[next]])) {
+            if (!stream(reader, writer, all[order[next]])) {
+                ++m_failed;
+                ok = false;
+            }
+            ++next;
+            if (progress) progress(next, order.size());
+            continue;
+        }
+
+        // Small entries up to the next large one, decoded and compressed in parallel
+        size_t end = next;
+        uint64_t bytes = 0;
+        while (end < order.size() && end - next < kWaveEntries && bytes < kWaveBytes && !isLarge(all[order[end]])) {
+            bytes += all[order[end]].uncompressedSize;
+            ++end;
+        }
+        wave.clear();
+        wave.resize(end - next);
+        ParallelFor(wave.size(), m_options.threads, [&](size_t i) {
+            prepare(reader, all[order[next + i]], wave[i]);
+        });
+
+        for (auto& item : wave) {
+            uint64_t decoded = item.entry.uncompressedSize;
+            if (!item.ok || !writer.AddCompressed(std::move(item.entry), item.data)) {
+                fail(item.ok ? writer.GetLastError() : item.error);
+                ++m_failed;
+                ok = false;
+            } else if (item.copied) {
+                ++m_copied;
+                m_copiedBytes += item.data.size();
+            } else {
+                ++m_recompressed;
+                m_decodedBytes += decoded;
+                m_writtenBytes += item.data.size();
+            }
+            std::string().swap(item.data);
+        }
+        next = end;
+        if (progress) progress(next, order.size());
+    }
+
+    span.AddBytes(writer.GetBytesWritten());
+    if (!writer.Close()) {
+        std::remove(temporary.c_str());
+        return fail(writer.GetLastError());
+    }
+    if (std::rename(temporary.c_str(), outputPath.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return fail("Failed to replace " + outputPath + ": " + std::strerror(errno));
+    }
+    return ok;
+}
@@ -0,0 +1,91 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Parallel.h"
+
+class ZipReader;
+class ZipWriter;
+struct ZipEntryInfo;
+
+struct RepackOptions {
+    int compressionLevel{6};   // 0 stores every entry
+    bool optimizeOrder{false}; // group similar entries with PathOptimizer
+    bool recompressAll{false}; // re-encode even entries already in the target form
+    unsigned threads{DefaultThreadCount()};
+};
+
+// Converts an existing archive into a new plain ZIP without extracting it:
+// another compression level, STORE <-> DEFLATE, another entry order, or a
+// subset of the entries. Nothing is written anywhere but the new archive.
+//
+// Entries already in the target form are copied byte for byte: the same
+// method and, for DEFLATE, the same compression option in the entry flags
+// (ZipFormat::DeflateOptionFlags); stored entries whose content is already
+// compressed count as stored at any level. Entries using a shared
+// dictionary keep it. The rest are decoded and compressed again in parallel
+// waves and written in order; entries above kStreamThreshold are streamed
+// on their own, decoding on one thread while the writer compresses.
+// Solid members become ordinary entries; the solid blocks are dropped.
+class ArchiveRepacker {
+public:
+    struct Stats {
+        uint64_t copied{0};        // entries copied unchanged
+        uint64_t copiedBytes{0};
+        uint64_t recompressed{0};
+        uint64_t decodedBytes{0};  // uncompressed size of the recompressed entries
+        uint64_t writtenBytes{0};  // their size in the new archive
+        uint64_t failed{0};
+    };
+
+    // Uncompressed bytes and entry count held in memory per parallel wave
+    static constexpr uint64_t kWaveBytes = 128ull * 1024 * 1024;
+    static constexpr size_t kWaveEntries = 4096;
+    static constexpr uint64_t kStreamThreshold = 16ull * 1024 * 1024;
+
+    explicit ArchiveRepacker(RepackOptions options = {});
+
+    // Writes the given entries (indices into reader.GetEntries()) to
+    // outputPath. Entries that fail are left out and counted; the archive
+    // is still finished, and false is returned. The archive is written to a
+    // temporary file renamed to outputPath at the end; an outputPath that is
+    // one of reader's volumes is refused.
+    using ProgressFn = std::function<void(size_t done, size_t total)>;
+    bool Repack(ZipReader& reader, const std::vector<size_t>& entries, const std::string& outputPath,
+                const ProgressFn& progress = {});
+
+    // Whether the entry's stored bytes can be kept without looking at its
+    // content; stored entries may still turn out to be copied
+    bool CanCopy(const ZipEntryInfo& entry) const;
+
+    Stats GetStats() const;
+    std::string GetLastError() const;
+
+private:
+    struct Prepared;
+
+    std::vector<size_t> outputOrder(const ZipReader& reader, const std::vector<size_t>& entries) const;
+    bool copyDictionaries(ZipReader& reader, ZipWriter& writer, const std::vector<size_t>& order);
+    void prepare(ZipReader& reader, const ZipEntryInfo& entry, Prepared& out);
+    bool stream(ZipReader& reader, ZipWriter& writer, const ZipEntryInfo& entry);
+    bool fail(const std::string& message);
+
+    RepackOptions m_options;
+
+    std::atomic<uint64_t> m_copied{0};
+    std::atomic<uint64_t> m_copiedBytes{0};
+    std::atomic<uint64_t> m_recompressed{0};
+    std::atomic<uint64_t> m_decodedBytes{0};
+    std::atomic<uint64_t> m_writtenBytes{0};
+    std::atomic<uint64_t> m_failed{0};
+
+    mutable std::mutex m_errorMutex;
+    std::string m_lastError;
+};
@@ -0,0 +1,410 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ArchiveSource.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include "Trace.h"
+
+bool ArchiveSource::fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = message;
+    return false;
+}
+
+std::string ArchiveSource::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
+
+std::vector<ArchiveSource::Range> ArchiveSource::Coalesce(const std::vector<Range>& ranges, uint64_t maxGap)
+{
+    std::vector<Range> merged;
+    for (const auto& range : ranges) {
+        if (range.size == 0) continue;
+        if (!merged.empty()) {
+            Range& back = merged.back();
+            uint64_t backEnd = back.offset + back.size;
+            if (range.offset >= back.offset && range.offset <= backEnd + maxGap) {
+                back.size = std::max(backEnd, range.offset + range.size) - back.offset;
+                continue;
+            }
+        }
+        merged.push_back(range);
+    }
+    return merged;
+}
+
+FileSource::~FileSource()
+{
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+bool FileSource::Open(const std::string& path)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (m_fd < 0 || ::fstat(m_fd, &st) != 0) {
+        return fail("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+bool FileSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+    auto* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        ssize_t n = ::pread(m_fd, out, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return fail("Unexpected end of archive");
+        out += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void FileSource::Prefetch(const std::vector<Range>& ranges)
+{
+    uint64_t advised = 0;
+    for (const auto& range : Coalesce(ranges, 1 << 20)) {
+        if (advised >= kMaxAdvise) break;
+        ::posix_fadvise(m_fd, static_cast<off_t>(range.offset), static_cast<off_t>(range.size),
+                        POSIX_FADV_WILLNEED);
+        advised += range.size;
+    }
+}
+
+MappedSource::~MappedSource()
+{
+    if (m_data) ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+bool MappedSource::Open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        return fail("Failed to open " + path + ": " + std::strerror(errno));
+    }
+
+    m_size = static_cast<uint64_t>(st.st_size);
+    if (m_size > 0) {
+        void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            return fail("Failed to map " + path + ": " + std::strerror(errno));
+        }
+        m_data = static_cast<const char*>(data);
+    }
+    ::close(fd);
+    return true;
+}
+
+bool MappedSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+    if (offset > m_size || size > m_size - offset) return fail("Unexpected end of archive");
+    if (size > 0) std::memcpy(buffer, m_data + offset, size);
+    return true;
+}
+
+void MappedSource::Prefetch(const std::vector<Range>& ranges)
+{
+    const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    uint64_t advised = 0;
+    for (const auto& range : Coalesce(ranges, 1 << 20)) {
+        if (range.offset >= m_size || advised >= FileSource::kMaxAdvise) break;
+        uint64_t start = range.offset / page * page;
+        uint64_t end = std::min(m_size, range.offset + range.size);
+        ::madvise(const_cast<char*>(m_data) + start, end - start, MADV_WILLNEED);
+        advised += end - start;
+    }
+}
+
+bool MemorySource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+    if (offset > m_data.size() || size > m_data.size() - offset) return fail("Unexpected end of archive");
+    if (size > 0) std::memcpy(buffer, m_data.data() + offset, size);
+    return true;
+}
+
+LatencySource::LatencySource(std::unique_ptr<ArchiveSource> inner, uint32_t latencyUs, uint64_t bytesPerSecond)
+    : m_inner(std::move(inner))
+    , m_latencyUs(latencyUs)
+    , m_bytesPerSecond(std::max<uint64_t>(1, bytesPerSecond))
+{
+}
+
+bool LatencySource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+    ++m_requests;
+    m_bytes += size;
+    std::this_thread::sleep_for(std::chrono::microseconds(m_latencyUs + size * 1000000 / m_bytesPerSecond));
+    return m_inner->ReadAt(offset, buffer, size) || fail(m_inner->GetLastError());
+}
+
+LatencySource::Stats LatencySource::GetStats() const
+{
+    Stats stats;
+    stats.requests = m_requests;
+    stats.bytes = m_bytes;
+    return stats;
+}
+
+CachingSource::CachingSource(std::unique_ptr<ArchiveSource> inner, size_t capacityBytes,
+                             unsigned prefetchThreads, size_t blockSize)
+    : m_inner(std::move(inner))
+    , m_blockSize(std::max<size_t>(4096, blockSize))
+    , m_capacityBlocks(std::max<size_t>(4, capacityBytes / m_blockSize))
+    , m_blockCount((m_inner->Size() + m_blockSize - 1) / m_blockSize)
+    , m_prefetchThreads(std::max(1u, prefetchThreads))
+{
+}
+
+CachingSource::~CachingSource()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_runs.clear();
+    }
+    m_prefetchWake.notify_all();
+    for (auto& thread : m_prefetchers) {
+        thread.join();
+    }
+}
+
+CachingSource::Stats CachingSource::GetStats() const
+{
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.fetches = m_fetches;
+    stats.fetchedBytes = m_fetchedBytes;
+    stats.prefetchedBlocks = m_prefetchedBlocks;
+    return stats;
+}
+
+std::vector<CachingSource::Run> CachingSource::claimMissing(uint64_t first, uint64_t count)
+{
+    // Placeholders make other readers wait for this fetch instead of repeating it
+    std::vector<Run> runs;
+    uint64_t end = std::min(m_blockCount, first + count);
+    for (uint64_t index = first; index < end; ++index) {
+        if (m_blocks.count(index)) continue;
+        m_blocks.emplace(index, std::make_shared<Block>());
+        if (!runs.empty() && runs.back().first + runs.back().count == index) {
+            ++runs.back().count;
+        } else {
+            runs.push_back({index, 1});
+        }
+    }
+    return runs;
+}
+
+void CachingSource::evict()
+{
+    // Blocks still being copied out stay alive through their shared_ptr
+    while (m_lru.size() > m_capacityBlocks) {
+        // The oldest block that has been read, or else the oldest of all
+        auto victim = std::prev(m_lru.end());
+        for (auto it = victim;; --it) {
+            if (!m_blocks.find(*it)->second->unread) {
+                victim = it;
+                break;
+            }
+            if (it == m_lru.begin()) break;
+        }
+        m_blocks.erase(*victim);
+        m_lru.erase(victim);
+    }
+}
+
+bool CachingSource::fetchRun(const Run& run, bool prefetch)
+{
+    Trace::Span span(prefetch ? "prefetch" : "fetch");
+    uint64_t start = run.first * m_blockSize;
+    uint64_t end = std::min(m_inner->Size(), (run.first + run.count) * m_blockSize);
+    std::vector<char> data(static_cast<size_t>(end - start));
+    bool ok = m_inner->ReadAt(start, data.data(), data.size());
+    ++m_fetches;
+    m_fetchedBytes += data.size();
+    span.AddBytes(data.size());
+    if (prefetch) m_prefetchedBlocks += run.count;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (uint64_t i = 0; i < run.count; ++i) {
+            uint64_t index = run.first + i;
+            auto it = m_blocks.find(index);
+            if (it == m_blocks.end()) continue;
+            Block& block = *it->second;
+            if (!ok) {
+                // Waiting readers see the failure; later ones try again
+                block.failed = true;
+                m_blocks.erase(it);
+                continue;
+            }
+            size_t from = static_cast<size_t>(i * m_blockSize);
+            size_t to = std::min(data.size(), from + m_blockSize);
+            block.data.assign(data.begin() + static_cast<std::ptrdiff_t>(from),
+                              data.begin() + static_cast<std::ptrdiff_t>(to));
+            block.ready = true;
+            block.unread = prefetch;
+            m_lru.push_front(index);
+            block.lru = m_lru.begin();
+        }
+        evict();
+    }
+    m_blockReady.notify_all();
+    return ok || fail(m_inner->GetLastError());
+}
+
+bool CachingSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+    if (offset > Size() || size > Size() - offset) return fail("Unexpected end of archive");
+    if (size == 0) return true;
+
+    // A large read would only push everything else out
+    if (size > m_capacityBlocks * m_blockSize / 4) {
+        ++m_fetches;
+        m_fetchedBytes += size;
+        return m_inner->ReadAt(offset, buffer, size) || fail(m_inner->GetLastError());
+    }
+
+    uint64_t first = offset / m_blockSize;
+    uint64_t last = (offset + size - 1) / m_blockSize;
+    std::vector<Run> runs;
+    std::vector<BlockPtr> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        runs = claimMissing(first, last - first + 1);
+        // Reading on from where the last read ended: fetch further ahead too
+        bool sequential = m_lastRead != UINT64_MAX && (first == m_lastRead || first == m_lastRead + 1);
+        if (sequential && !runs.empty() && runs.back().first + runs.back().count == last + 1) {
+            uint64_t end = std::min(m_blockCount, last + 1 + kReadAhead);
+            for (uint64_t index = last + 1; index < end && !m_blocks.count(index); ++index) {
+                m_blocks.emplace(index, std::make_shared<Block>());
+                ++runs.back().count;
+            }
+        }
+        // Held from here on, so eviction cannot take a block before it is copied
+        for (uint64_t index = first; index <= last; ++index) {
+            blocks.push_back(m_blocks.find(index)->second);
+        }
+        m_lastRead = last;
+        if (last + 1 > m_readFrontier) {
+            m_readFrontier = last + 1;
+            m_prefetchWake.notify_all();
+        }
+    }
+
+    // Every claimed run is fetched, even after a failure, so nobody waits forever
+    bool ok = true;
+    for (const Run& run : runs) {
+        if (!fetchRun(run, false)) ok = false;
+    }
+    if (!ok) return false;
+
+    auto* out = static_cast<char*>(buffer);
+    for (uint64_t index = first; index <= last; ++index) {
+        const BlockPtr& block = blocks[index - first];
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (block->ready) {
+                ++m_hits;
+            } else {
+                ++m_misses;
+                m_blockReady.wait(lock, [&block]() { return block->ready || block->failed; });
+                if (block->failed) return fail(m_inner->GetLastError());
+            }
+            block->unread = false;
+            auto current = m_blocks.find(index);
+            if (current != m_blocks.end() && current->second == block) {
+                m_lru.splice(m_lru.begin(), m_lru, block->lru);
+            }
+        }
+
+        uint64_t blockStart = index * m_blockSize;
+        size_t from = static_cast<size_t>(std::max(offset, blockStart) - blockStart);
+        size_t to = static_cast<size_t>(std::min(offset + size, blockStart + block->data.size()) - blockStart);
+        std::memcpy(out, block->data.data() + from, to - from);
+        out += to - from;
+    }
+    return true;
+}
+
+void CachingSource::Prefetch(const std::vector<Range>& ranges)
+{
+    // Several runs have to fit in the window at once, or the threads take turns
+    const uint64_t maxRun = std::clamp<uint64_t>(m_capacityBlocks / 8, 1, kMaxRunBlocks);
+    std::deque<Run> runs;
+    for (const auto& range : ranges) {
+        if (range.size == 0 || range.offset >= Size()) continue;
+        uint64_t first = range.offset / m_blockSize;
+        uint64_t end = (std::min(Size(), range.offset + range.size) - 1) / m_blockSize + 1;
+
+        while (first < end) {
+            if (!runs.empty()) {
+                Run& back = runs.back();
+                uint64_t backEnd = back.first + back.count;
+                // Neighbours (or ranges a small gap apart) share one request
+                if (first >= back.first && first <= backEnd + kMaxGapBlocks && back.count < maxRun) {
+                    uint64_t newEnd = std::min(std::max(backEnd, end), back.first + maxRun);
+                    back.count = newEnd - back.first;
+                    first = std::max(first, newEnd);
+                    continue;
+                }
+            }
+            uint64_t count = std::min<uint64_t>(end - first, maxRun);
+            runs.push_back({first, count});
+            first += count;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // A new plan replaces what is left of the old one
+        m_runs = std::move(runs);
+        if (!m_runs.empty()) m_readFrontier = m_runs.front().first;
+        if (m_prefetchers.empty()) {
+            for (unsigned i = 0; i < m_prefetchThreads; ++i) {
+                m_prefetchers.emplace_back(&CachingSource::prefetchLoop, this);
+            }
+        }
+    }
+    m_prefetchWake.notify_all();
+}
+
+void CachingSource::prefetchLoop()
+{
+    const uint64_t window = m_capacityBlocks / 2;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_prefetchWake.wait(lock, [this, window]() {
+            return m_stopping ||
+                   (!m_runs.empty() && m_runs.front().first + m_runs.front().count <= m_readFrontier + window);
+        });
+        if (m_stopping) return;
+
+        Run run = m_runs.front();
+        m_runs.pop_front();
+        std::vector<Run> missing = claimMissing(run.first, run.count);
+        lock.unlock();
+        for (const Run& part : missing) {
+            fetchRun(part, true);
+        }
+        lock.lock();
+    }
+}
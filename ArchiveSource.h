@@ -0,0 +1,212 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Random-access bytes of one archive volume. ZipReader only ever asks for
+// ranges, so an archive can live in a local file, a memory map, a buffer or
+// behind a high-latency range-read service (NFS, an object store).
+//
+// ReadAt and Prefetch may be called from several threads at once.
+class ArchiveSource {
+public:
+    struct Range {
+        uint64_t offset{0};
+        uint64_t size{0};
+    };
+
+    virtual ~ArchiveSource() = default;
+
+    virtual uint64_t Size() const = 0;
+
+    // Reads exactly size bytes at offset; false past the end or on error
+    virtual bool ReadAt(uint64_t offset, void* buffer, size_t size) = 0;
+
+    // Hint that these ranges are about to be read, in this order. Sources
+    // that can fetch ahead do so in the background; the rest ignore it.
+    virtual void Prefetch(const std::vector<Range>& ranges) {}
+
+    std::string GetLastError() const;
+
+    // Merges ranges (in order) that overlap or are at most maxGap apart
+    static std::vector<Range> Coalesce(const std::vector<Range>& ranges, uint64_t maxGap);
+
+protected:
+    bool fail(const std::string& message);
+
+private:
+    mutable std::mutex m_errorMutex;
+    std::string m_lastError;
+};
+
+// pread() on a descriptor. Prefetch becomes posix_fadvise(WILLNEED) on the
+// coalesced ranges, for at most kMaxAdvise bytes so a huge plan does not
+// flood the page cache; that is what makes NFS read ahead.
+class FileSource : public ArchiveSource {
+public:
+    static constexpr uint64_t kMaxAdvise = 256ull << 20;
+
+    FileSource() = default;
+    ~FileSource() override;
+
+    bool Open(const std::string& path);
+
+    uint64_t Size() const override { return m_size; }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size) override;
+    void Prefetch(const std::vector<Range>& ranges) override;
+
+private:
+    int m_fd{-1};
+    uint64_t m_size{0};
+};
+
+// The whole file mapped read-only; Prefetch becomes madvise(WILLNEED), with
+// the same limit as FileSource
+class MappedSource : public ArchiveSource {
+public:
+    MappedSource() = default;
+    ~MappedSource() override;
+
+    bool Open(const std::string& path);
+
+    uint64_t Size() const override { return m_size; }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size) override;
+    void Prefetch(const std::vector<Range>& ranges) override;
+
+private:
+    const char* m_data{nullptr};
+    uint64_t m_size{0};
+};
+
+// An archive already in memory (downloaded, embedded, or built by a test)
+class MemorySource : public ArchiveSource {
+public:
+    explicit MemorySource(std::string data) : m_data(std::move(data)) {}
+
+    uint64_t Size() const override { return m_data.size(); }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size) override;
+
+private:
+    std::string m_data;
+};
+
+// Wraps another source and makes every request cost a round trip plus
+// transfer time, like a range GET against an object store. Concurrent
+// requests overlap, as they would there. For tests and benchmarks.
+class LatencySource : public ArchiveSource {
+public:
+    struct Stats {
+        uint64_t requests{0};
+        uint64_t bytes{0};
+    };
+
+    LatencySource(std::unique_ptr<ArchiveSource> inner, uint32_t latencyUs, uint64_t bytesPerSecond);
+
+    uint64_t Size() const override { return m_inner->Size(); }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size) override;
+
+    Stats GetStats() const;
+
+private:
+    std::unique_ptr<ArchiveSource> m_inner;
+    uint32_t m_latencyUs;
+    uint64_t m_bytesPerSecond;
+    std::atomic<uint64_t> m_requests{0};
+    std::atomic<uint64_t> m_bytes{0};
+};
+
+// A bounded block cache in front of a slow source:
+//
+//  - the file is read in aligned blocks; the blocks a read misses, plus a
+//    few more when the reads are sequential, are fetched in one request
+//  - Prefetch() coalesces the given ranges into runs of neighbouring blocks
+//    (small gaps are read rather than paying another round trip) and
+//    background threads fetch the runs in order, in parallel, staying at
+//    most half the cache ahead of what has actually been read
+//  - the least recently used blocks are dropped once the cache is full,
+//    prefetched blocks nobody has read yet only when nothing else is left
+//
+// Reads larger than a quarter of the cache go straight to the source.
+class CachingSource : public ArchiveSource {
+public:
+    struct Stats {
+        uint64_t hits{0};           // blocks found in the cache
+        uint64_t misses{0};         // blocks a read had to wait for
+        uint64_t fetches{0};        // requests sent to the source
+        uint64_t fetchedBytes{0};
+        uint64_t prefetchedBlocks{0};
+    };
+
+    static constexpr size_t kDefaultBlockSize = 1 << 20;
+    static constexpr size_t kReadAhead = 4;      // blocks, for sequential misses
+    static constexpr size_t kMaxRunBlocks = 16;  // longest single request
+    static constexpr size_t kMaxGapBlocks = 1;   // bridged when coalescing
+
+    CachingSource(std::unique_ptr<ArchiveSource> inner, size_t capacityBytes,
+                  unsigned prefetchThreads = 4, size_t blockSize = kDefaultBlockSize);
+    ~CachingSource() override;
+
+    uint64_t Size() const override { return m_inner->Size(); }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size) override;
+    void Prefetch(const std::vector<Range>& ranges) override;
+
+    Stats GetStats() const;
+
+private:
+    struct Block {
+        std::vector<char> data;
+        bool ready{false};
+        bool failed{false};
+        bool unread{false}; // prefetched, not read yet; evicted last
+        std::list<uint64_t>::iterator lru;
+    };
+    using BlockPtr = std::shared_ptr<Block>;
+
+    struct Run {
+        uint64_t first{0};
+        uint64_t count{0};
+    };
+
+    // Both expect m_mutex to be held
+    std::vector<Run> claimMissing(uint64_t first, uint64_t count);
+    void evict();
+
+    bool fetchRun(const Run& run, bool prefetch);
+    void prefetchLoop();
+
+    std::unique_ptr<ArchiveSource> m_inner;
+    size_t m_blockSize;
+    size_t m_capacityBlocks;
+    uint64_t m_blockCount;
+
+    std::mutex m_mutex;
+    std::condition_variable m_blockReady;
+    std::unordered_map<uint64_t, BlockPtr> m_blocks;
+    std::list<uint64_t> m_lru;     // ready blocks, most recent first
+    uint64_t m_lastRead{UINT64_MAX};
+    uint64_t m_readFrontier{0};    // one past the furthest block read
+
+    std::condition_variable m_prefetchWake;
+    std::deque<Run> m_runs;
+    bool m_stopping{false};
+    std::vector<std::thread> m_prefetchers;
+    unsigned m_prefetchThreads;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_fetches{0};
+    std::atomic<uint64_t> m_fetchedBytes{0};
+    std::atomic<uint64_t> m_prefetchedBlocks{0};
+};
@@ -0,0 +1,216 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "Codec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include "zlib.h"
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+    // What zlib means by Z_DEFAULT_COMPRESSION
+    constexpr int kDefaultLevel = 6;
+
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+    std::atomic<Codec::Backend> g_active{Codec::Backend::Libdeflate};
+
+    // Allocating a compressor costs more than compressing a small file, so
+    // each thread keeps one per level it has used
+    struct LibdeflateState {
+        libdeflate_compressor* compressors[10]{};
+        libdeflate_decompressor* decompressor{nullptr};
+
+        ~LibdeflateState()
+        {
+            for (auto* compressor : compressors) {
+                if (compressor) libdeflate_free_compressor(compressor);
+            }
+            if (decompressor) libdeflate_free_decompressor(decompressor);
+        }
+    };
+
+    LibdeflateState& libdeflateState()
+    {
+        thread_local LibdeflateState state;
+        return state;
+    }
+#else
+    std::atomic<Codec::Backend> g_active{Codec::Backend::Zlib};
+#endif
+
+    bool zlibCompress(const char* data, size_t size, int level, std::string& out)
+    {
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        out.resize(deflateBound(&zs, static_cast<uLong>(size)));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zs.avail_in = static_cast<uInt>(size);
+        zs.next_out = reinterpret_cast<Bytef*>(out.data());
+        zs.avail_out = static_cast<uInt>(out.size());
+        int status = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return status == Z_STREAM_END;
+    }
+
+    bool zlibDecompress(const char* data, size_t size, char* out, size_t outSize)
+    {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            return false;
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zs.avail_in = static_cast<uInt>(size);
+        zs.next_out = reinterpret_cast<Bytef*>(out);
+        zs.avail_out = static_cast<uInt>(outSize);
+        int status = inflate(&zs, Z_FINISH);
+        bool ok = status == Z_STREAM_END && zs.total_out == outSize;
+        inflateEnd(&zs);
+        return ok;
+    }
+}
+
+namespace Codec {
+
+const char* Name(Backend backend)
+{
+    return backend == Backend::Libdeflate ? "libdeflate" : "zlib";
+}
+
+bool Parse(const std::string& name, Backend& backend)
+{
+    if (name == "zlib") {
+        backend = Backend::Zlib;
+        return true;
+    }
+    if (name == "libdeflate") {
+        backend = Backend::Libdeflate;
+        return true;
+    }
+    return false;
+}
+
+std::vector<Backend> Available()
+{
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+    return {Backend::Zlib, Backend::Libdeflate};
+#else
+    return {Backend::Zlib};
+#endif
+}
+
+Backend Active()
+{
+    return g_active.load(std::memory_order_relaxed);
+}
+
+bool Select(Backend backend)
+{
+    auto available = Available();
+    if (std::find(available.begin(), available.end(), backend) == available.end()) {
+        return false;
+    }
+    g_active.store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+bool SelectFromEnvironment()
+{
+    const char* name = std::getenv("ARCHIVEMANAGER_CODEC");
+    if (!name || !*name) return true;
+    Backend backend;
+    return Parse(name, backend) && Select(backend);
+}
+
+bool PrefersWholeBuffers()
+{
+    return Active() != Backend::Zlib;
+}
+
+std::string CpuFeatures()
+{
+    std::string features;
+    auto add = [&features](bool present, const char* name) {
+        if (!present) return;
+        if (!features.empty()) features += ' ';
+        features += name;
+    };
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    add(__builtin_cpu_supports("sse4.2"), "sse4.2");
+    add(__builtin_cpu_supports("pclmul"), "pclmul");
+    add(__builtin_cpu_supports("avx2"), "avx2");
+    add(__builtin_cpu_supports("bmi2"), "bmi2");
+    add(__builtin_cpu_supports("avx512f"), "avx512f");
+    add(__builtin_cpu_supports("vpclmulqdq"), "vpclmulqdq");
+#elif defined(__aarch64__) && defined(__linux__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    add(hwcap & HWCAP_ASIMD, "neon");
+    add(hwcap & HWCAP_PMULL, "pmull");
+    add(hwcap & HWCAP_CRC32, "crc32");
+#endif
+    return features.empty() ? "none detected" : features;
+}
+
+uint32_t Crc32(uint32_t crc, const void* data, size_t size)
+{
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+    if (Active() == Backend::Libdeflate) {
+        return libdeflate_crc32(crc, data, size);
+    }
+#endif
+    // zlib takes 32-bit lengths
+    const auto* bytes = static_cast<const Bytef*>(data);
+    uLong running = crc;
+    while (size > 0) {
+        uInt n = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+        running = crc32(running, bytes, n);
+        bytes += n;
+        size -= n;
+    }
+    return static_cast<uint32_t>(running);
+}
+
+bool Compress(const char* data, size_t size, int level, std::string& out)
+{
+    level = level < 0 ? kDefaultLevel : std::min(level, 9);
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+    if (Active() == Backend::Libdeflate) {
+        auto& compressor = libdeflateState().compressors[level];
+        if (!compressor) compressor = libdeflate_alloc_compressor(level);
+        // Releases before 1.8 have no level 0; zlib stores it then
+        if (compressor) {
+            out.resize(libdeflate_deflate_compress_bound(compressor, size));
+            size_t written = libdeflate_deflate_compress(compressor, data, size, out.data(), out.size());
+            out.resize(written);
+            return written > 0;
+        }
+    }
+#endif
+    return zlibCompress(data, size, level, out);
+}
+
+bool Decompress(const char* data, size_t size, char* out, size_t outSize)
+{
+#ifdef ARCHIVEMANAGER_LIBDEFLATE
+    if (Active() == Backend::Libdeflate) {
+        auto& decompressor = libdeflateState().decompressor;
+        if (!decompressor) decompressor = libdeflate_alloc_decompressor();
+        if (!decompressor) return false;
+        return libdeflate_deflate_decompress(decompressor, data, size, out, outSize, nullptr) == LIBDEFLATE_SUCCESS;
+    }
+#endif
+    return zlibDecompress(data, size, out, outSize);
+}
+
+}
@@ -0,0 +1,54 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw DEFLATE and CRC-32 for the archive engines, behind a backend chosen at
+// runtime. Every backend reads and writes plain RFC 1951 streams, so
+// archives written with one are read by any other and by every unzip.
+//
+//   Zlib        streaming; also the only one with preset dictionaries
+//   Libdeflate  whole buffers only, several times faster on both sides and
+//               picks its own SIMD code paths (PCLMUL/AVX2/AVX-512, NEON,
+//               ...) for the CPU it runs on
+//
+// Libdeflate is compiled in with ARCHIVEMANAGER_LIBDEFLATE (CMake finds it
+// when installed). The backend is process-wide: the fastest one compiled in,
+// unless the ARCHIVEMANAGER_CODEC environment variable or Select() names
+// another. Entries larger than kWholeBufferLimit, and dictionary streams,
+// always go through zlib's streaming interface.
+namespace Codec {
+
+    enum class Backend : uint8_t { Zlib, Libdeflate };
+
+    // Uncompressed bytes a whole-buffer backend is given in one piece
+    constexpr size_t kWholeBufferLimit = 16 * 1024 * 1024;
+
+    const char* Name(Backend backend);
+    bool Parse(const std::string& name, Backend& backend); // "zlib", "libdeflate"
+    std::vector<Backend> Available();
+
+    Backend Active();
+    bool Select(Backend backend); // false if it is not compiled in
+    bool SelectFromEnvironment(); // false for an unknown or unavailable name
+
+    // Whether Active() handles whole buffers better than zlib streams them
+    bool PrefersWholeBuffers();
+
+    // Instruction set extensions the CPU reports, for benchmark output
+    std::string CpuFeatures();
+
+    uint32_t Crc32(uint32_t crc, const void* data, size_t size);
+
+    // Raw DEFLATE of a whole buffer at zlib levels 0-9; out is replaced
+    bool Compress(const char* data, size_t size, int level, std::string& out);
+
+    // Inflates a whole raw DEFLATE stream that must decode to exactly
+    // outSize bytes; false for corrupt or truncated data
+    bool Decompress(const char* data, size_t size, char* out, size_t outSize);
+}
@@ -0,0 +1,494 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+// archive-cli: the archive engine without the GUI, for scripts.
+//
+//   archive-cli list    <archive> [filter...] [source...]
+//   archive-cli extract <archive> [-d dir] [-j threads] [--skip-unchanged]
+//                       [--hardlink-duplicates] [filter...] [source...]
+//   archive-cli repack  <archive> <output> [-l level] [--optimize-order]
+//                       [--recompress] [-j threads] [filter...] [source...]
+//   archive-cli watch   <archive> <dir>... [--window S] [--rotate MB] [-l level]
+//                       [--no-optimize]
+//   archive-cli tar     <archive> <path>... [--compress none|gzip|zstd|seekable]
+//                       [-l level] [-j threads]
+//
+// list and extract read tar, tar.gz and tar.zst archives as well, whatever
+// their names; see TarReader.h
+// repack writes the selected entries to a new archive; see ArchiveRepacker.h
+// watch appends files written under the directories to the archive until
+// SIGINT or SIGTERM; see WatchArchiver.h
+// tar writes the files and directory trees given; see TarWriter.h
+// --skip-unchanged leaves files that already hold an entry's data as they
+// are, for re-extracting over an earlier extraction, and --hardlink-duplicates
+// links identical entries to one file instead of copying it; see
+// ExtractionWriter.h
+//
+// Filters (all must match): --prefix P, --glob G, --regex R; see EntryFilter.h
+// Sources: --source file|mmap|memory, --latency MS and --bandwidth MB/s to
+// simulate remote storage, --cache MB for the block cache (on by default
+// with --latency); see ArchiveSource.h
+// --codec zlib|libdeflate picks the DEFLATE backend, for comparing them; the
+// default is the fastest compiled in, or ARCHIVEMANAGER_CODEC; see Codec.h
+
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ArchiveRepacker.h"
+#include "ArchiveSource.h"
+#include "Codec.h"
+#include "EntryFilter.h"
+#include "ExtractionWriter.h"
+#include "Parallel.h"
+#include "TarReader.h"
+#include "TarWriter.h"
+#include "Trace.h"
+#include "WatchArchiver.h"
+#include "ZipReader.h"
+
+namespace {
+    struct Options {
+        std::string command;
+        std::string archive;
+        std::string destDir{"."};
+        bool skipUnchanged{false}; // extract: leave files already holding an entry alone
+        bool hardlinkDuplicates{false};
+        std::string output; // repack
+        RepackOptions repack;
+        std::vector<std::string> paths; // watch: directories; tar: files and directories
+        WatchOptions watch;
+        TarFormat::Compression tarCompression{TarFormat::Compression::None};
+        unsigned threads{DefaultThreadCount()};
+        EntryFilter filter;
+        std::string source{"file"};
+        uint32_t latencyMs{0};
+        uint64_t bandwidthMBps{100};
+        int64_t cacheMB{-1}; // -1: 64 MB with --latency, none otherwise
+    };
+
+    // The sources opened for the archive's volumes, to report on at the end
+    struct OpenedSources {
+        std::vector<LatencySource*> remote;
+        std::vector<CachingSource*> caches;
+    };
+
+    int usage()
+    {
+        std::fprintf(stderr,
+                     "usage: archive-cli list <archive> [filter...] [source...]\n"
+                     "       archive-cli extract <archive> [-d dir] [-j threads] [--skip-unchanged]\n"
+                     "                       [--hardlink-duplicates] [filter...] [source...]\n"
+                     "       archive-cli repack <archive> <output> [-l level] [--optimize-order] [--recompress]\n"
+                     "                          [-j threads] [filter...] [source...]\n"
+                     "       archive-cli watch <archive> <dir>... [--window S] [--rotate MB] [-l level] [--no-optimize]\n"
+                     "       archive-cli tar <archive> <path>... [--compress none|gzip|zstd|seekable] [-l level]\n"
+                     "                       [-j threads]\n"
+                     "filters: --prefix P  --glob G  --regex R  (all must match)\n"
+                     "sources: --source file|mmap|memory  --latency MS  --bandwidth MB/s  --cache MB\n"
+                     "codec:   --codec zlib|libdeflate\n");
+        return 2;
+    }
+
+    bool parse(int argc, char** argv, Options& options)
+    {
+        if (argc < 3) return false;
+        options.command = argv[1];
+        options.archive = argv[2];
+        int first = 3;
+        if (options.command == "repack") {
+            if (argc < 4) return false;
+            options.output = argv[first++];
+        }
+        for (int i = first; i < argc; ++i) {
+            std::string arg = argv[i];
+            if ((options.command == "watch" || options.command == "tar") && arg[0] != '-') {
+                options.paths.push_back(arg);
+                continue;
+            }
+            if (arg == "--optimize-order") {
+                options.repack.optimizeOrder = true;
+                continue;
+            } else if (arg == "--recompress") {
+                options.repack.recompressAll = true;
+                continue;
+            } else if (arg == "--no-optimize") {
+                options.watch.optimizeOrder = false;
+                continue;
+            } else if (arg == "--skip-unchanged") {
+                options.skipUnchanged = true;
+                continue;
+            } else if (arg == "--hardlink-duplicates") {
+                options.hardlinkDuplicates = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "%s needs a value\n", arg.c_str());
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "-d") {
+                options.destDir = value;
+            } else if (arg == "-j") {
+                options.threads = static_cast<unsigned>(std::max(1, std::atoi(value.c_str())));
+            } else if (arg == "-l") {
+                options.repack.compressionLevel = std::clamp(std::atoi(value.c_str()), 0, 9);
+                options.watch.compressionLevel = options.repack.compressionLevel;
+            } else if (arg == "--window") {
+                options.watch.windowSeconds = static_cast<unsigned>(std::max(0, std::atoi(value.c_str())));
+            } else if (arg == "--rotate") {
+                options.watch.rotateBytes = static_cast<uint64_t>(std::max(0, std::atoi(value.c_str()))) << 20;
+            } else if (arg == "--compress") {
+                using Compression = TarFormat::Compression;
+                if (value == "none") options.tarCompression = Compression::None;
+                else if (value == "gzip") options.tarCompression = Compression::Gzip;
+                else if (value == "zstd") options.tarCompression = Compression::Zstd;
+                else if (value == "seekable") options.tarCompression = Compression::SeekableZstd;
+                else {
+                    std::fprintf(stderr, "Unknown compression %s\n", value.c_str());
+                    return false;
+                }
+            } else if (arg == "--prefix") {
+                options.filter.AddPrefix(value);
+            } else if (arg == "--glob") {
+                options.filter.AddGlob(value);
+            } else if (arg == "--regex") {
+                if (!options.filter.AddRegex(value)) {
+                    std::fprintf(stderr, "%s\n", options.filter.GetLastError().c_str());
+                    return false;
+                }
+            } else if (arg == "--source") {
+                options.source = value;
+                if (value != "file" && value != "mmap" && value != "memory") {
+                    std::fprintf(stderr, "Unknown source %s\n", value.c_str());
+                    return false;
+                }
+            } else if (arg == "--latency") {
+                options.latencyMs = static_cast<uint32_t>(std::max(0, std::atoi(value.c_str())));
+            } else if (arg == "--bandwidth") {
+                options.bandwidthMBps = static_cast<uint64_t>(std::max(1, std::atoi(value.c_str())));
+            } else if (arg == "--cache") {
+                options.cacheMB = std::max(0, std::atoi(value.c_str()));
+            } else if (arg == "--codec") {
+                Codec::Backend backend;
+                if (!Codec::Parse(value, backend) || !Codec::Select(backend)) {
+                    std::fprintf(stderr, "Codec %s is not available\n", value.c_str());
+                    return false;
+                }
+            } else {
+                std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+                return false;
+            }
+        }
+        options.repack.threads = options.threads;
+        if (options.command == "watch" || options.command == "tar") return !options.paths.empty();
+        return options.command == "list" || options.command == "extract" || options.command == "repack";
+    }
+
+    std::unique_ptr<ArchiveSource> openVolume(const Options& options, const std::string& path,
+                                              OpenedSources& opened)
+    {
+        std::unique_ptr<ArchiveSource> source;
+        if (options.source == "mmap") {
+            auto mapped = std::make_unique<MappedSource>();
+            if (!mapped->Open(path)) return nullptr;
+            source = std::move(mapped);
+        } else if (options.source == "memory") {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return nullptr;
+            std::ostringstream data;
+            data << in.rdbuf();
+            source = std::make_unique<MemorySource>(std::move(data).str());
+        } else {
+            auto file = std::make_unique<FileSource>();
+            if (!file->Open(path)) return nullptr;
+            source = std::move(file);
+        }
+
+        if (options.latencyMs > 0) {
+            auto remote = std::make_unique<LatencySource>(std::move(source), options.latencyMs * 1000,
+                                                          options.bandwidthMBps << 20);
+            opened.remote.push_back(remote.get());
+            source = std::move(remote);
+        }
+
+        int64_t cacheMB = options.cacheMB >= 0 ? options.cacheMB : options.latencyMs > 0 ? 64 : 0;
+        if (cacheMB > 0) {
+            auto cache = std::make_unique<CachingSource>(std::move(source), static_cast<size_t>(cacheMB) << 20,
+                                                         options.threads);
+            opened.caches.push_back(cache.get());
+            source = std::move(cache);
+        }
+        return source;
+    }
+
+    void reportSources(const OpenedSources& opened)
+    {
+        for (const LatencySource* remote : opened.remote) {
+            auto stats = remote->GetStats();
+            std::fprintf(stderr, "Remote: %llu requests, %.1f MB\n", static_cast<unsigned long long>(stats.requests),
+                         static_cast<double>(stats.bytes) / (1 << 20));
+        }
+        for (const CachingSource* cache : opened.caches) {
+            auto stats = cache->GetStats();
+            std::fprintf(stderr, "Cache: %llu hits, %llu misses, %llu fetches, %llu blocks prefetched\n",
+                         static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+                         static_cast<unsigned long long>(stats.fetches),
+                         static_cast<unsigned long long>(stats.prefetchedBlocks));
+        }
+    }
+
+    std::atomic<bool> stopWatching{false};
+
+    void requestStop(int)
+    {
+        stopWatching = true;
+    }
+
+    int watch(const Options& options)
+    {
+        WatchArchiver archiver(options.archive, options.watch);
+        for (const auto& dir : options.paths) {
+            if (!archiver.AddDirectory(dir)) {
+                std::fprintf(stderr, "%s\n", archiver.GetLastError().c_str());
+                return 1;
+            }
+        }
+
+        // No SA_RESTART, so a signal wakes the watcher's poll() at once
+        struct sigaction action{};
+        action.sa_handler = requestStop;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        std::fprintf(stderr, "Watching %zu directories; archiving to %s\n", options.paths.size(),
+                     options.archive.c_str());
+        bool ok = archiver.Run(stopWatching, [](const std::string& message) {
+            std::fprintf(stderr, "%s\n", message.c_str());
+        });
+
+        auto stats = archiver.GetStats();
+        std::fprintf(stderr, "Archived %llu files (%.1f MB) in %llu batches; %llu unchanged, %llu failed, "
+                     "%llu rotations, %llu overflows\n",
+                     static_cast<unsigned long long>(stats.files), static_cast<double>(stats.bytes) / (1 << 20),
+                     static_cast<unsigned long long>(stats.batches), static_cast<unsigned long long>(stats.unchanged),
+                     static_cast<unsigned long long>(stats.failed), static_cast<unsigned long long>(stats.rotations),
+                     static_cast<unsigned long long>(stats.overflows));
+        if (!ok) {
+            std::fprintf(stderr, "%s\n", archiver.GetLastError().c_str());
+        }
+        Trace::Dump();
+        return ok ? 0 : 1;
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int createTar(const Options& options)
+    {
+        namespace fs = std::filesystem;
+        auto start = std::chrono::steady_clock::now();
+        TarWriter writer(options.tarCompression, options.repack.compressionLevel, options.threads);
+        if (!writer.Open(options.archive)) {
+            std::fprintf(stderr, "%s: %s\n", options.archive.c_str(), writer.GetLastError().c_str());
+            return 1;
+        }
+
+        // Named from the given path's last component down, as tar does;
+        // directories get entries of their own so empty ones are kept
+        size_t files = 0;
+        size_t directories = 0;
+        size_t failed = 0;
+        auto add = [&](const fs::path& file, const fs::path& base, bool directory) {
+            std::string name = file.lexically_relative(base).generic_string();
+            if (directory ? writer.AddDirectory(file.string(), name) : writer.AddFile(file.string(), name)) {
+                ++(directory ? directories : files);
+            } else {
+                ++failed;
+                std::fprintf(stderr, "%s\n", writer.GetLastError().c_str());
+            }
+        };
+        for (const auto& path : options.paths) {
+            fs::path root = fs::path(path).lexically_normal();
+            if (!root.has_filename()) root = root.parent_path();
+            std::error_code ec;
+            if (!fs::is_directory(root, ec)) {
+                add(root, root.parent_path(), false);
+                continue;
+            }
+            // Sorted, a directory comes before everything in it
+            std::vector<std::pair<fs::path, bool>> found{{root, true}};
+            for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+                if (it->is_directory(ec) && !it->is_symlink(ec)) {
+                    found.emplace_back(it->path(), true);
+                } else if (it->is_regular_file(ec)) {
+                    found.emplace_back(it->path(), false);
+                }
+            }
+            std::sort(found.begin(), found.end());
+            for (const auto& [file, directory] : found) {
+                add(file, root.parent_path(), directory);
+            }
+        }
+
+        bool ok = writer.Close();
+        std::fprintf(stderr, "Wrote %zu files and %zu directories as %s: %.1f MB -> %.1f MB in %.1f ms\n", files,
+                     directories, TarFormat::Name(options.tarCompression), static_cast<double>(writer.GetTarBytes()) / (1 << 20),
+                     static_cast<double>(writer.GetBytesWritten()) / (1 << 20), millisecondsSince(start));
+        if (!ok) {
+            std::fprintf(stderr, "%s\n", writer.GetLastError().c_str());
+        }
+        Trace::Dump();
+        return ok && failed == 0 ? 0 : 1;
+    }
+
+    int readTar(const Options& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+        TarReader reader;
+        if (!reader.Open(options.archive)) {
+            std::fprintf(stderr, "%s: %s\n", options.archive.c_str(), reader.GetLastError().c_str());
+            return 1;
+        }
+        EntryIndex index(reader.GetEntries());
+        std::vector<size_t> selected = index.Select(options.filter, options.threads);
+        std::fprintf(stderr, "%s: %zu of %zu entries match (%llu links and special files skipped, listed in %.1f ms)\n",
+                     TarFormat::Name(reader.GetCompression()), selected.size(), index.Size(),
+                     static_cast<unsigned long long>(reader.GetSkippedCount()), millisecondsSince(start));
+
+        if (options.command == "list") {
+            for (size_t i : selected) {
+                const auto& entry = reader.GetEntries()[i];
+                std::printf("%12llu  %s\n", static_cast<unsigned long long>(entry.uncompressedSize), entry.name.c_str());
+            }
+            Trace::Dump();
+            return 0;
+        }
+        if (options.command != "extract") {
+            std::fprintf(stderr, "%s reads ZIP archives only\n", options.command.c_str());
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        ExtractionWriter writer(options.destDir);
+        bool ok = reader.ExtractEntries(selected, writer, options.threads);
+        auto stats = writer.GetStats();
+        std::fprintf(stderr, "Extracted %llu files, %llu MB in %.1f ms\n", static_cast<unsigned long long>(stats.files),
+                     static_cast<unsigned long long>(stats.bytes >> 20), millisecondsSince(start));
+        if (!ok) {
+            std::fprintf(stderr, "%llu entries failed: %s\n", static_cast<unsigned long long>(reader.GetFailedCount()),
+                         reader.GetLastError().c_str());
+        }
+        Trace::Dump();
+        return ok ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Trace::EnableFromEnvironment();
+    if (!Codec::SelectFromEnvironment()) {
+        std::fprintf(stderr, "ARCHIVEMANAGER_CODEC names no available codec; using %s\n",
+                     Codec::Name(Codec::Active()));
+    }
+
+    Options options;
+    if (!parse(argc, argv, options)) return usage();
+    if (options.command != "list") {
+        std::fprintf(stderr, "Codec: %s (CPU: %s)\n", Codec::Name(Codec::Active()), Codec::CpuFeatures().c_str());
+    }
+    if (options.command == "watch") return watch(options);
+    if (options.command == "tar") return createTar(options);
+
+    // Tar archives are recognised by content, not by name
+    TarFormat::Compression compression;
+    if (TarReader::Detect(options.archive, compression)) return readTar(options);
+
+    OpenedSources opened;
+    ZipReader reader;
+    auto openVolumeFor = [&options, &opened](const std::string& path) { return openVolume(options, path, opened); };
+    if (!reader.Open(options.archive, openVolumeFor)) {
+        std::fprintf(stderr, "%s: %s\n", options.archive.c_str(), reader.GetLastError().c_str());
+        return 1;
+    }
+
+    // Only the central directory has been read so far
+    auto start = std::chrono::steady_clock::now();
+    EntryIndex index(reader.GetEntries());
+    std::vector<size_t> selected = index.Select(options.filter, options.threads);
+    std::fprintf(stderr, "%zu of %zu entries match (%zu names examined, %.1f ms)\n", selected.size(),
+                 index.Size(), index.GetCandidateCount(options.filter), millisecondsSince(start));
+
+    if (options.command == "list") {
+        for (size_t i : selected) {
+            const auto& entry = reader.GetEntries()[i];
+            std::printf("%12llu  %s\n", static_cast<unsigned long long>(entry.uncompressedSize), entry.name.c_str());
+        }
+        reportSources(opened);
+        Trace::Dump();
+        return 0;
+    }
+
+    if (options.command == "repack") {
+        start = std::chrono::steady_clock::now();
+        ArchiveRepacker repacker(options.repack);
+        bool ok = repacker.Repack(reader, selected, options.output);
+        auto stats = repacker.GetStats();
+        std::fprintf(stderr, "Copied %llu entries (%.1f MB), recompressed %llu (%.1f MB -> %.1f MB) in %.1f ms\n",
+                     static_cast<unsigned long long>(stats.copied), static_cast<double>(stats.copiedBytes) / (1 << 20),
+                     static_cast<unsigned long long>(stats.recompressed),
+                     static_cast<double>(stats.decodedBytes) / (1 << 20),
+                     static_cast<double>(stats.writtenBytes) / (1 << 20), millisecondsSince(start));
+        if (!ok && stats.failed == 0) {
+            std::fprintf(stderr, "%s\n", repacker.GetLastError().c_str());
+        } else if (!ok) {
+            std::fprintf(stderr, "%llu entries failed: %s\n", static_cast<unsigned long long>(stats.failed),
+                         repacker.GetLastError().c_str());
+        }
+        reportSources(opened);
+        Trace::Dump();
+        return ok ? 0 : 1;
+    }
+
+    start = std::chrono::steady_clock::now();
+    ExtractionWriter writer(options.destDir);
+    writer.SetSkipUnchanged(options.skipUnchanged);
+    writer.SetHardlinkDuplicates(options.hardlinkDuplicates);
+    bool ok = writer.ExtractEntries(reader, selected, options.threads);
+    auto stats = writer.GetStats();
+    std::fprintf(stderr, "Extracted %llu files, %llu MB (%llu MB sparse) in %.1f ms\n",
+                 static_cast<unsigned long long>(stats.files), static_cast<unsigned long long>(stats.bytes >> 20),
+                 static_cast<unsigned long long>(stats.sparseBytes >> 20), millisecondsSince(start));
+    if (options.skipUnchanged) {
+        std::fprintf(stderr, "Skipped %llu unchanged files, %.1f MB (%.1f MB of them read to compare CRCs)\n",
+                     static_cast<unsigned long long>(stats.unchanged),
+                     static_cast<double>(stats.unchangedBytes) / (1 << 20),
+                     static_cast<double>(stats.hashedBytes) / (1 << 20));
+    }
+    if (stats.duplicates > 0) {
+        std::fprintf(stderr, "Made %llu duplicates, %.1f MB, from their first copy: %llu reflinked, %llu hardlinked, "
+                     "%llu copied\n", static_cast<unsigned long long>(stats.duplicates),
+                     static_cast<double>(stats.duplicateBytes) / (1 << 20),
+                     static_cast<unsigned long long>(stats.reflinked),
+                     static_cast<unsigned long long>(stats.hardlinked),
+                     static_cast<unsigned long long>(stats.duplicates - stats.reflinked - stats.hardlinked));
+    }
+    if (!ok) {
+        std::fprintf(stderr, "%llu entries failed: %s\n", static_cast<unsigned long long>(stats.failed),
+                     writer.GetLastError().c_str());
+    }
+    reportSources(opened);
+    Trace::Dump();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,405 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "CompressionCache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "zlib.h"
+#include "ZipFormat.h"
+#include "ZipWriter.h"
+#include "Trace.h"
+
+namespace {
+    constexpr uint32_t kIndexMagic = 0x43434D41; // "AMCC"
+    constexpr uint16_t kIndexVersion = 2;
+    constexpr size_t kIndexHeaderSize = 18;
+    constexpr size_t kItemFixedSize = 2 + 8 + 8 + 8 + 8 + 4 + 4 + 8 + 8 + 2 + 8 + 2;
+
+    // Payloads no index entry uses older than this were replaced or left
+    // behind by a crashed job
+    constexpr std::time_t kOrphanAge = 60 * 60;
+
+    bool sameFile(const CompressionCache::Key& a, const CompressionCache::Key& b)
+    {
+        return a.size == b.size && a.mtimeNs == b.mtimeNs &&
+               a.inode == b.inode && a.device == b.device;
+    }
+
+    // Serialises Flush() across processes sharing the cache directory
+    class DirectoryLock {
+    public:
+        explicit DirectoryLock(const std::string& path)
+            : m_fd(::open(path.c_str(), O_RDWR | O_CREAT, 0644))
+        {
+            if (m_fd >= 0 && ::flock(m_fd, LOCK_EX) != 0) {
+                ::close(m_fd);
+                m_fd = -1;
+            }
+        }
+        ~DirectoryLock()
+        {
+            if (m_fd >= 0) {
+                ::flock(m_fd, LOCK_UN);
+                ::close(m_fd);
+            }
+        }
+        bool IsLocked() const { return m_fd >= 0; }
+
+    private:
+        int m_fd;
+    };
+}
+
+CompressionCache::CompressionCache(const std::string& directory, uint64_t capacity)
+    : m_directory(directory)
+    , m_capacity(capacity)
+{
+}
+
+std::string CompressionCache::DefaultDirectory()
+{
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/ArchiveManager";
+    }
+    const char* home = std::getenv("HOME");
+    return std::string(home ? home : ".") + "/.cache/ArchiveManager";
+}
+
+bool CompressionCache::MakeKey(const std::string& path, Key& key)
+{
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key.path = path;
+    key.size = static_cast<uint64_t>(st.st_size);
+    key.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    key.inode = static_cast<uint64_t>(st.st_ino);
+    key.device = static_cast<uint64_t>(st.st_dev);
+    key.mode = static_cast<uint32_t>(st.st_mode);
+    return true;
+}
+
+bool CompressionCache::fail(const std::string& message)
+{
+    m_lastError = message;
+    return false;
+}
+
+std::string CompressionCache::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+CompressionCache::Stats CompressionCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string CompressionCache::indexKey(const std::string& path, int level)
+{
+    return path + '\0' + std::to_string(level);
+}
+
+std::string CompressionCache::payloadPath(const std::string& payload) const
+{
+    return m_directory + "/objects/" + payload;
+}
+
+bool CompressionCache::Open()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory + "/objects", ec);
+    if (ec) {
+        return fail("Failed to create cache directory: " + m_directory);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_items.clear();
+    return load(m_items, m_clock);
+}
+
+bool CompressionCache::load(std::unordered_map<std::string, Item>& items, uint64_t& clock) const
+{
+    using namespace ZipFormat;
+
+    std::ifstream in(m_directory + "/index", std::ios::binary);
+    if (!in) return true; // first run
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string data = buffer.str();
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    const auto* end = p + data.size();
+
+    // The cache is disposable: an unreadable index is treated as empty
+    if (data.size() < kIndexHeaderSize || GetU32(p) != kIndexMagic || GetU16(p + 4) != kIndexVersion) {
+        return true;
+    }
+    clock = std::max(clock, GetU64(p + 6));
+    uint32_t count = GetU32(p + 14);
+    p += kIndexHeaderSize;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (static_cast<size_t>(end - p) < kItemFixedSize ||
+            static_cast<size_t>(end - p) < kItemFixedSize + GetU16(p)) {
+            break;
+        }
+        Item item;
+        uint16_t pathLength = GetU16(p);
+        item.key.path.assign(reinterpret_cast<const char*>(p + 2), pathLength);
+        p += 2 + pathLength;
+        item.key.size = GetU64(p);
+        item.key.mtimeNs = static_cast<int64_t>(GetU64(p + 8));
+        item.key.inode = GetU64(p + 16);
+        item.key.device = GetU64(p + 24);
+        item.level = static_cast<int32_t>(GetU32(p + 32));
+        item.record.crc = GetU32(p + 36);
+        item.record.uncompressedSize = GetU64(p + 40);
+        item.record.compressedSize = GetU64(p + 48);
+        item.record.method = GetU16(p + 56);
+        item.lastUsed = GetU64(p + 58);
+        uint16_t payloadLength = GetU16(p + 66);
+        p += kItemFixedSize - 2;
+        if (static_cast<size_t>(end - p) < payloadLength) break;
+        item.payload.assign(reinterpret_cast<const char*>(p), payloadLength);
+        p += payloadLength;
+
+        // Names are only ever ones Store made; anything else is not followed
+        if (item.payload.empty() || item.payload.find('/') != std::string::npos || item.payload[0] == '.') {
+            continue;
+        }
+
+        items[indexKey(item.key.path, item.level)] = std::move(item);
+    }
+    return true;
+}
+
+bool CompressionCache::save(const std::unordered_map<std::string, Item>& items, uint64_t clock)
+{
+    using namespace ZipFormat;
+
+    std::string data;
+    PutU32(data, kIndexMagic);
+    PutU16(data, kIndexVersion);
+    PutU64(data, clock);
+    PutU32(data, static_cast<uint32_t>(items.size()));
+    for (const auto& [name, item] : items) {
+        PutU16(data, static_cast<uint16_t>(item.key.path.size()));
+        data += item.key.path;
+        PutU64(data, item.key.size);
+        PutU64(data, static_cast<uint64_t>(item.key.mtimeNs));
+        PutU64(data, item.key.inode);
+        PutU64(data, item.key.device);
+        PutU32(data, static_cast<uint32_t>(item.level));
+        PutU32(data, item.record.crc);
+        PutU64(data, item.record.uncompressedSize);
+        PutU64(data, item.record.compressedSize);
+        PutU16(data, item.record.method);
+        PutU64(data, item.lastUsed);
+        PutU16(data, static_cast<uint16_t>(item.payload.size()));
+        data += item.payload;
+    }
+
+    // Readers see either the old or the new index, never half of one
+    std::string temporary = m_directory + "/index.tmp-" + std::to_string(::getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out.flush()) {
+            std::remove(temporary.c_str());
+            return fail("Failed to write cache index");
+        }
+    }
+    if (std::rename(temporary.c_str(), (m_directory + "/index").c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return fail("Failed to replace cache index");
+    }
+    return true;
+}
+
+bool CompressionCache::Lookup(const Key& key, int level, Record& record, std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_items.find(indexKey(key.path, level));
+    if (it == m_items.end() || !sameFile(it->second.key, key)) {
+        ++m_stats.misses;
+        return false;
+    }
+
+    // Another job may have evicted the payload since the index was loaded;
+    // one of another size is not the one this record describes
+    path = payloadPath(it->second.payload);
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0 || static_cast<uint64_t>(st.st_size) != it->second.record.compressedSize) {
+        m_items.erase(it);
+        ++m_stats.misses;
+        return false;
+    }
+
+    it->second.lastUsed = ++m_clock;
+    record = it->second.record;
+    ++m_stats.hits;
+    m_stats.bytesReused += record.uncompressedSize;
+    return true;
+}
+
+bool CompressionCache::Store(const Key& key, int level, Record& record, std::string& path)
+{
+    std::FILE* in = std::fopen(key.path.c_str(), "rb");
+    if (!in) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return fail("Failed to open: " + key.path);
+    }
+
+    // A name of its own; until the index refers to it Flush leaves it alone
+    // for an hour, then takes it for one a crashed job left behind
+    path = m_directory + "/objects/XXXXXX";
+    int fd = ::mkstemp(path.data());
+    std::FILE* out = fd >= 0 ? ::fdopen(fd, "wb") : nullptr;
+    if (!out) {
+        if (fd >= 0) ::close(fd);
+        std::fclose(in);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return fail("Failed to create cache payload in " + m_directory);
+    }
+
+    record = Record{};
+    record.method = level == Z_NO_COMPRESSION ? ZipFormat::kMethodStore : ZipFormat::kMethodDeflate;
+    bool ok = ZipWriter::CompressStream(
+        [in](char* buffer, size_t size) { return std::fread(buffer, 1, size, in); },
+        [out, &record](const char* data, size_t size) {
+            record.compressedSize += size;
+            return std::fwrite(data, 1, size, out) == size;
+        },
+        record.method, level, {}, record.crc, record.uncompressedSize);
+
+    std::fclose(in);
+    if (std::fclose(out) != 0) ok = false;
+
+    if (!ok) {
+        std::remove(path.c_str());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return fail("Failed to compress into cache: " + key.path);
+    }
+
+    Key after;
+    bool unchanged = MakeKey(key.path, after) && sameFile(key, after) &&
+                     record.uncompressedSize == key.size;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (unchanged) {
+        Item item;
+        item.key = key;
+        item.level = level;
+        item.record = record;
+        item.payload = path.substr(path.find_last_of('/') + 1);
+        item.lastUsed = ++m_clock;
+        m_items[indexKey(key.path, level)] = std::move(item);
+    }
+    return true;
+}
+
+void CompressionCache::evict(std::unordered_map<std::string, Item>& items)
+{
+    // The capacity bounds what objects/ holds, not what the index lists
+    struct File {
+        uint64_t size{0};
+        std::time_t mtime{0};
+        size_t users{0};
+    };
+    std::unordered_map<std::string, File> files;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(m_directory + "/objects", ec)) {
+        struct stat st{};
+        if (::stat(file.path().c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            files[file.path().filename().string()] = {static_cast<uint64_t>(st.st_size), st.st_mtime, 0};
+        }
+    }
+
+    // Entries whose payload is gone or of another size are dropped
+    std::vector<std::pair<uint64_t, std::string>> order;
+    for (auto it = items.begin(); it != items.end();) {
+        auto file = files.find(it->second.payload);
+        if (file == files.end() || file->second.size != it->second.record.compressedSize) {
+            it = items.erase(it);
+            continue;
+        }
+        ++file->second.users;
+        order.emplace_back(it->second.lastUsed, it->first);
+        ++it;
+    }
+
+    // Payloads nothing uses (replaced, or being written) are deleted once
+    // they are old enough not to be another job's, stored but not flushed yet
+    uint64_t total = 0;
+    std::time_t now = std::time(nullptr);
+    for (const auto& [name, file] : files) {
+        if (file.users == 0 && now - file.mtime > kOrphanAge &&
+            std::filesystem::remove(payloadPath(name), ec)) {
+            continue;
+        }
+        total += file.size;
+    }
+    if (total <= m_capacity) return;
+
+    std::sort(order.begin(), order.end());
+    for (const auto& [lastUsed, name] : order) {
+        if (total <= m_capacity) break;
+        auto it = items.find(name);
+        const std::string& payload = it->second.payload;
+        File& file = files[payload];
+        if (--file.users == 0) {
+            std::remove(payloadPath(payload).c_str());
+            total -= file.size;
+            ++m_stats.evictions;
+        }
+        items.erase(it);
+    }
+}
+
+bool CompressionCache::Flush()
+{
+    Trace::Span span("cache flush");
+    DirectoryLock directoryLock(m_directory + "/lock");
+    if (!directoryLock.IsLocked()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return fail("Failed to lock cache directory: " + m_directory);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Entries stored by other jobs since Open() survive; for the same file
+    // the most recently used record wins
+    std::unordered_map<std::string, Item> merged;
+    uint64_t clock = m_clock;
+    load(merged, clock);
+    for (auto& [name, item] : m_items) {
+        auto it = merged.find(name);
+        if (it == merged.end() || it->second.lastUsed <= item.lastUsed) {
+            merged[name] = item;
+        }
+    }
+    m_clock = clock;
+
+    evict(merged);
+
+    if (!save(merged, m_clock)) return false;
+    m_items = std::move(merged);
+    return true;
+}
@@ -0,0 +1,103 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Persistent cache of compressed file contents, so re-archiving a mostly
+// unchanged tree only compresses what changed. Files are identified by
+// (path, size, mtime, inode, device) plus the compression level; a hit hands
+// back the raw DEFLATE payload to splice into the archive without reading the
+// source at all.
+//
+// Layout under the cache directory:
+//   index    binary index, see save()
+//   lock     flock()ed while the index is merged and rewritten
+//   objects/ one payload per index entry, under a unique name the entry
+//            records. Identical files are not made to share one: nothing
+//            short of comparing the content proves them identical, and a
+//            forged CRC-32/Adler-32 match would splice another file's bytes.
+//
+// Payloads are created under names no other job can take, and the
+// index is merged with the on-disk copy under the lock before it is replaced,
+// so several jobs (threads or processes) can use one cache directory. A job
+// whose payload was evicted by another job simply sees a miss.
+class CompressionCache {
+public:
+    struct Key {
+        std::string path;
+        uint64_t size{0};
+        int64_t mtimeNs{0};
+        uint64_t inode{0};
+        uint64_t device{0};
+        uint32_t mode{0}; // not part of the identity
+    };
+
+    struct Record {
+        uint32_t crc{0};
+        uint64_t uncompressedSize{0};
+        uint64_t compressedSize{0};
+        uint16_t method{0};
+    };
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t bytesReused{0}; // uncompressed bytes not read or compressed again
+        uint64_t evictions{0};
+    };
+
+    CompressionCache(const std::string& directory, uint64_t capacity);
+
+    // $XDG_CACHE_HOME/ArchiveManager, falling back to ~/.cache/ArchiveManager
+    static std::string DefaultDirectory();
+    static bool MakeKey(const std::string& path, Key& key);
+
+    // Creates the directory if needed and loads the index
+    bool Open();
+
+    // On a hit fills record and the payload path to splice from
+    bool Lookup(const Key& key, int level, Record& record, std::string& path);
+
+    // Compresses the file into the cache. Not inserted (but still usable for
+    // this run) if the file changed while it was being read.
+    bool Store(const Key& key, int level, Record& record, std::string& path);
+
+    // Merges with the on-disk index, deletes payloads no entry uses any more
+    // (after an hour, so other jobs' unflushed ones survive), evicts least
+    // recently used payloads until objects/ fits the capacity and writes the
+    // index back
+    bool Flush();
+
+    Stats GetStats() const;
+    std::string GetLastError() const;
+
+private:
+    struct Item {
+        Key key;
+        int level{0};
+        Record record;
+        std::string payload; // file name under objects/
+        uint64_t lastUsed{0};
+    };
+
+    static std::string indexKey(const std::string& path, int level);
+    std::string payloadPath(const std::string& payload) const;
+    bool load(std::unordered_map<std::string, Item>& items, uint64_t& clock) const;
+    bool save(const std::unordered_map<std::string, Item>& items, uint64_t clock);
+    void evict(std::unordered_map<std::string, Item>& items);
+    bool fail(const std::string& message);
+
+    std::string m_directory;
+    uint64_t m_capacity;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Item> m_items;
+    uint64_t m_clock{0}; // LRU stamp, bumped on every hit and store
+    Stats m_stats;
+    std::string m_lastError;
+};
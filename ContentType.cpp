@@ -0,0 +1,126 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ContentType.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ContentType {
+
+namespace {
+    // Plain 7-bit text with line breaks (UTF-16LE/BE of ASCII) has every
+    // other byte zero
+    bool looksLikeUtf16(const unsigned char* data, size_t size)
+    {
+        if (size < 8) return false;
+        size_t zeros[2] = {0, 0};
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == 0) ++zeros[i & 1];
+        }
+        size_t half = size / 2;
+        return (zeros[1] * 10 >= half * 9 && zeros[0] == 0) ||
+               (zeros[0] * 10 >= half * 9 && zeros[1] == 0);
+    }
+
+    // No NUL bytes and hardly any control characters other than whitespace;
+    // bytes above 0x7f are allowed so UTF-8 and Latin-1 both pass
+    bool looksLikeText(const unsigned char* data, size_t size)
+    {
+        size_t control = 0;
+        for (size_t i = 0; i < size; ++i) {
+            unsigned char c = data[i];
+            if (c == 0) return false;
+            if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != 0x1b) ++control;
+        }
+        return control * 32 <= size;
+    }
+
+    bool startsWithNoCase(const unsigned char* data, size_t size, std::string_view prefix)
+    {
+        if (size < prefix.size()) return false;
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            unsigned char c = data[i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+            if (c != static_cast<unsigned char>(prefix[i])) return false;
+        }
+        return true;
+    }
+
+    Kind sniffText(const unsigned char* data, size_t size)
+    {
+        size_t i = 0;
+        while (i < size && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) ++i;
+        data += i;
+        size -= i;
+        if (startsWithNoCase(data, size, "<?xml")) return Kind::Xml;
+        if (startsWithNoCase(data, size, "<!doctype html") || startsWithNoCase(data, size, "<html")) {
+            return Kind::Html;
+        }
+        if (startsWithNoCase(data, size, "#!")) return Kind::Source;
+        if (size > 0 && (data[0] == '{' || data[0] == '[')) return Kind::Json;
+        return Kind::Text;
+    }
+}
+
+const char* Name(Kind kind)
+{
+    static constexpr const char* kNames[] = {
+        "unknown",
+        "text", "UTF-16 text", "JSON", "XML", "HTML", "CSV", "source code",
+        "ZIP", "gzip", "Zstandard", "xz", "bzip2", "7-Zip", "RAR", "LZ4",
+        "PNG", "JPEG", "GIF", "WebP", "TIFF", "BMP",
+        "MP4", "Matroska", "AVI", "WAV", "MP3", "Ogg", "FLAC",
+        "PDF", "ELF", "PE", "Mach-O", "Java class", "WebAssembly", "SQLite", "tar",
+        "binary",
+    };
+    static_assert(std::size(kNames) == static_cast<size_t>(Kind::Count), "a Kind has no name");
+    size_t index = static_cast<size_t>(kind);
+    return index < std::size(kNames) ? kNames[index] : "unknown";
+}
+
+Kind FromContent(const unsigned char* data, size_t size, std::string_view path)
+{
+    Kind byName = FromPath(path);
+    if (size == 0) return byName;
+
+    const Signature* signature = MatchSignature(data, size);
+    Kind byMagic = signature ? signature->kind : Kind::Unknown;
+    if (byMagic == Kind::Text) {
+        // A UTF-8 byte order mark says nothing about what the text is
+        return IsText(byName) ? byName : sniffText(data + 3, size - 3);
+    }
+    // "ID3 tags" in a notes.txt is text; an MP3 has binary right after "ID3"
+    bool weak = signature && IsShort(*signature) && !IsText(byMagic) && byName != byMagic;
+    if (byMagic != Kind::Unknown && !(weak && looksLikeText(data, size))) return byMagic;
+
+    if (looksLikeUtf16(data, size)) return Kind::Utf16Text;
+    if (looksLikeText(data, size)) {
+        return IsText(byName) ? byName : sniffText(data, size);
+    }
+
+    // Binary without a known signature: trust a non-text name
+    return byName != Kind::Unknown && !IsText(byName) ? byName : Kind::Binary;
+}
+
+Kind Classify(const std::string& path)
+{
+    unsigned char probe[kProbeSize];
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return FromPath(path);
+    ssize_t got = ::pread(fd, probe, sizeof(probe), 0);
+    ::close(fd);
+    if (got < 0) return FromPath(path);
+    return FromContent(probe, static_cast<size_t>(got), path);
+}
+
+std::vector<Kind> ClassifyAll(const std::vector<std::string>& paths, unsigned threads)
+{
+    std::vector<Kind> kinds(paths.size(), Kind::Unknown);
+    ParallelFor(paths.size(), threads, [&](size_t i) {
+        kinds[i] = Classify(paths[i]);
+    });
+    return kinds;
+}
+
+}
@@ -0,0 +1,338 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Parallel.h"
+
+// Content classification of files to archive. Classify reads the first
+// kProbeSize bytes and matches them against a signature table; only when no
+// signature matches does it fall back to a text sniffer and then to the file
+// name. FromPath looks at the name alone, for callers that must not touch
+// the disk.
+//
+// Both tables are plain constexpr arrays. At compile time the signatures are
+// bucketed by their first byte and the extensions packed into integers and
+// sorted, so a probe checks only the few signatures that can match and a
+// name costs one binary search over integers.
+namespace ContentType {
+
+    enum class Kind : uint8_t {
+        Unknown,
+        // Text
+        Text, Utf16Text, Json, Xml, Html, Csv, Source,
+        // Compressed containers and streams
+        Zip, Gzip, Zstd, Xz, Bzip2, SevenZip, Rar, Lz4,
+        // Images
+        Png, Jpeg, Gif, Webp, Tiff, Bmp,
+        // Audio and video
+        Mp4, Mkv, Avi, Wav, Mp3, Ogg, Flac,
+        // Other binary formats
+        Pdf, Elf, Pe, MachO, JavaClass, Wasm, Sqlite, Tar,
+        Binary,
+        Count
+    };
+
+    // Bytes read from the start of a file; enough for the tar magic at 257
+    constexpr size_t kProbeSize = 512;
+
+    // Coarse class used by PathOptimizer's benefit model (FileNode::compressionType)
+    enum Class { kClassText = 0, kClassImage = 1, kClassMedia = 2, kClassBinary = 3 };
+
+    constexpr int CompressionClass(Kind kind) {
+        switch (kind) {
+            case Kind::Text: case Kind::Utf16Text: case Kind::Json: case Kind::Xml:
+            case Kind::Html: case Kind::Csv: case Kind::Source:
+                return kClassText;
+            case Kind::Png: case Kind::Jpeg: case Kind::Gif: case Kind::Webp:
+            case Kind::Tiff: case Kind::Bmp:
+                return kClassImage;
+            case Kind::Mp4: case Kind::Mkv: case Kind::Avi: case Kind::Wav:
+            case Kind::Mp3: case Kind::Ogg: case Kind::Flac:
+                return kClassMedia;
+            default:
+                return kClassBinary;
+        }
+    }
+
+    // Already entropy coded: deflating these again costs time and saves
+    // next to nothing, so writers store them
+    constexpr bool IsCompressed(Kind kind) {
+        switch (kind) {
+            case Kind::Zip: case Kind::Gzip: case Kind::Zstd: case Kind::Xz:
+            case Kind::Bzip2: case Kind::SevenZip: case Kind::Rar: case Kind::Lz4:
+            case Kind::Png: case Kind::Jpeg: case Kind::Gif: case Kind::Webp:
+            case Kind::Mp4: case Kind::Mkv: case Kind::Mp3: case Kind::Ogg: case Kind::Flac:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    constexpr bool IsText(Kind kind) { return CompressionClass(kind) == kClassText; }
+
+    const char* Name(Kind kind);
+
+    // Magic bytes at an offset, optionally with a second part (RIFF and
+    // friends name the actual format 8 bytes in)
+    struct Signature {
+        std::string_view magic;
+        uint16_t offset;
+        Kind kind;
+        std::string_view magic2{};
+        uint16_t offset2{0};
+    };
+
+    using namespace std::string_view_literals;
+
+    constexpr Signature kSignatures[] = {
+        {"PK\x03\x04"sv, 0, Kind::Zip},
+        {"PK\x05\x06"sv, 0, Kind::Zip},            // empty archive
+        {"PK\x07\x08"sv, 0, Kind::Zip},            // first volume of a split archive
+        {"\x1f\x8b"sv, 0, Kind::Gzip},
+        {"\x28\xb5\x2f\xfd"sv, 0, Kind::Zstd},
+        {"\xfd" "7zXZ\x00"sv, 0, Kind::Xz},
+        {"BZh"sv, 0, Kind::Bzip2},
+        {"7z\xbc\xaf\x27\x1c"sv, 0, Kind::SevenZip},
+        {"Rar!\x1a\x07"sv, 0, Kind::Rar},
+        {"\x04\x22\x4d\x18"sv, 0, Kind::Lz4},
+        {"\x89PNG\r\n\x1a\n"sv, 0, Kind::Png},
+        {"\xff\xd8\xff"sv, 0, Kind::Jpeg},
+        {"GIF87a"sv, 0, Kind::Gif},
+        {"GIF89a"sv, 0, Kind::Gif},
+        {"RIFF"sv, 0, Kind::Webp, "WEBP"sv, 8},
+        {"RIFF"sv, 0, Kind::Avi, "AVI "sv, 8},
+        {"RIFF"sv, 0, Kind::Wav, "WAVE"sv, 8},
+        {"II*\x00"sv, 0, Kind::Tiff},
+        {"MM\x00*"sv, 0, Kind::Tiff},
+        {"ftyp"sv, 4, Kind::Mp4},                   // MP4, MOV, M4A, HEIC
+        {"\x1a\x45\xdf\xa3"sv, 0, Kind::Mkv},       // Matroska and WebM
+        {"ID3"sv, 0, Kind::Mp3},
+        {"\xff\xfb"sv, 0, Kind::Mp3},
+        {"\xff\xf3"sv, 0, Kind::Mp3},
+        {"OggS"sv, 0, Kind::Ogg},
+        {"fLaC"sv, 0, Kind::Flac},
+        {"%PDF-"sv, 0, Kind::Pdf},
+        {"\x7f" "ELF"sv, 0, Kind::Elf},
+        {"MZ"sv, 0, Kind::Pe},
+        {"\xfe\xed\xfa\xce"sv, 0, Kind::MachO},
+        {"\xfe\xed\xfa\xcf"sv, 0, Kind::MachO},
+        {"\xce\xfa\xed\xfe"sv, 0, Kind::MachO},
+        {"\xcf\xfa\xed\xfe"sv, 0, Kind::MachO},
+        {"\xca\xfe\xba\xbe"sv, 0, Kind::JavaClass},  // also fat Mach-O; both binary
+        {"\x00" "asm"sv, 0, Kind::Wasm},
+        {"SQLite format 3\x00"sv, 0, Kind::Sqlite},
+        {"ustar"sv, 257, Kind::Tar},
+        {"\xef\xbb\xbf"sv, 0, Kind::Text},           // UTF-8 byte order mark
+        {"\xff\xfe"sv, 0, Kind::Utf16Text},
+        {"\xfe\xff"sv, 0, Kind::Utf16Text},
+        {"BM"sv, 0, Kind::Bmp},
+    };
+    constexpr size_t kSignatureCount = std::size(kSignatures);
+
+    namespace detail {
+        // Signatures at offset 0 grouped by first byte, in table order (so
+        // longer, more specific entries listed first still win); the others
+        // are checked for every probe
+        struct SignatureIndex {
+            std::array<uint16_t, 257> start{};   // bucket b is [start[b], start[b + 1])
+            std::array<uint16_t, kSignatureCount> order{};
+            std::array<uint16_t, kSignatureCount> other{};
+            size_t otherCount{0};
+        };
+
+        constexpr SignatureIndex BuildSignatureIndex() {
+            SignatureIndex index;
+            std::array<uint16_t, 256> count{};
+            for (const auto& s : kSignatures) {
+                if (s.offset == 0) ++count[static_cast<unsigned char>(s.magic[0])];
+            }
+            for (size_t b = 0; b < 256; ++b) index.start[b + 1] = index.start[b] + count[b];
+
+            std::array<uint16_t, 256> next{};
+            for (size_t b = 0; b < 256; ++b) next[b] = index.start[b];
+            for (size_t i = 0; i < kSignatureCount; ++i) {
+                const auto& s = kSignatures[i];
+                if (s.offset == 0) {
+                    index.order[next[static_cast<unsigned char>(s.magic[0])]++] = static_cast<uint16_t>(i);
+                } else {
+                    index.other[index.otherCount++] = static_cast<uint16_t>(i);
+                }
+            }
+            return index;
+        }
+
+        constexpr bool SignaturesFitProbe() {
+            for (const auto& s : kSignatures) {
+                if (s.magic.empty() || s.offset + s.magic.size() > kProbeSize) return false;
+                if (s.offset2 + s.magic2.size() > kProbeSize) return false;
+            }
+            return true;
+        }
+
+        struct Extension {
+            std::string_view name; // lower case
+            Kind kind;
+        };
+
+        constexpr Extension kExtensions[] = {
+            {"txt", Kind::Text}, {"log", Kind::Text}, {"md", Kind::Text}, {"rst", Kind::Text},
+            {"ini", Kind::Text}, {"cfg", Kind::Text}, {"conf", Kind::Text}, {"yaml", Kind::Text},
+            {"yml", Kind::Text}, {"toml", Kind::Text}, {"tex", Kind::Text}, {"svg", Kind::Xml},
+            {"json", Kind::Json}, {"geojson", Kind::Json}, {"ndjson", Kind::Json},
+            {"xml", Kind::Xml}, {"xsd", Kind::Xml}, {"plist", Kind::Xml},
+            {"html", Kind::Html}, {"htm", Kind::Html}, {"xhtml", Kind::Html},
+            {"csv", Kind::Csv}, {"tsv", Kind::Csv},
+            {"c", Kind::Source}, {"h", Kind::Source}, {"cc", Kind::Source}, {"cpp", Kind::Source},
+            {"cxx", Kind::Source}, {"hpp", Kind::Source}, {"hh", Kind::Source}, {"java", Kind::Source},
+            {"kt", Kind::Source}, {"cs", Kind::Source}, {"go", Kind::Source}, {"rs", Kind::Source},
+            {"py", Kind::Source}, {"rb", Kind::Source}, {"js", Kind::Source}, {"ts", Kind::Source},
+            {"css", Kind::Source}, {"sh", Kind::Source}, {"sql", Kind::Source}, {"php", Kind::Source},
+            {"pl", Kind::Source}, {"swift", Kind::Source}, {"cmake", Kind::Source},
+            {"zip", Kind::Zip}, {"jar", Kind::Zip}, {"apk", Kind::Zip}, {"docx", Kind::Zip},
+            {"xlsx", Kind::Zip}, {"pptx", Kind::Zip}, {"odt", Kind::Zip}, {"epub", Kind::Zip},
+            {"gz", Kind::Gzip}, {"tgz", Kind::Gzip}, {"zst", Kind::Zstd}, {"xz", Kind::Xz},
+            {"txz", Kind::Xz}, {"bz2", Kind::Bzip2}, {"7z", Kind::SevenZip}, {"rar", Kind::Rar},
+            {"lz4", Kind::Lz4},
+            {"png", Kind::Png}, {"jpg", Kind::Jpeg}, {"jpeg", Kind::Jpeg}, {"gif", Kind::Gif},
+            {"webp", Kind::Webp}, {"tif", Kind::Tiff}, {"tiff", Kind::Tiff}, {"bmp", Kind::Bmp},
+            {"mp4", Kind::Mp4}, {"m4v", Kind::Mp4}, {"m4a", Kind::Mp4}, {"mov", Kind::Mp4},
+            {"heic", Kind::Mp4}, {"mkv", Kind::Mkv}, {"webm", Kind::Mkv}, {"avi", Kind::Avi},
+            {"wav", Kind::Wav}, {"mp3", Kind::Mp3}, {"ogg", Kind::Ogg}, {"opus", Kind::Ogg},
+            {"flac", Kind::Flac},
+            {"pdf", Kind::Pdf}, {"so", Kind::Elf}, {"o", Kind::Elf}, {"exe", Kind::Pe},
+            {"dll", Kind::Pe}, {"dylib", Kind::MachO}, {"class", Kind::JavaClass},
+            {"wasm", Kind::Wasm}, {"sqlite", Kind::Sqlite}, {"db", Kind::Sqlite}, {"tar", Kind::Tar},
+            {"bin", Kind::Binary}, {"dat", Kind::Binary},
+        };
+
+        // Extension-less names that are text by convention
+        constexpr std::string_view kTextNames[] = {
+            "authors", "changelog", "changes", "copying", "dockerfile", "license",
+            "makefile", "news", "notice", "readme", "todo",
+        };
+
+        // Up to eight lower-cased characters packed into one integer, so an
+        // extension lookup is a binary search over integers; 0 if too long
+        constexpr uint64_t PackLower(std::string_view name) {
+            if (name.empty() || name.size() > 8) return 0;
+            uint64_t key = 0;
+            for (char c : name) {
+                if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+                key = (key << 8) | static_cast<unsigned char>(c);
+            }
+            return key;
+        }
+
+        struct PackedExtension {
+            uint64_t key;
+            Kind kind;
+        };
+
+        constexpr auto BuildExtensionTable() {
+            std::array<PackedExtension, std::size(kExtensions)> table{};
+            for (size_t i = 0; i < table.size(); ++i) {
+                table[i] = {PackLower(kExtensions[i].name), kExtensions[i].kind};
+            }
+            std::sort(table.begin(), table.end(), [](const PackedExtension& a, const PackedExtension& b) {
+                return a.key < b.key;
+            });
+            return table;
+        }
+
+        constexpr auto BuildTextNameTable() {
+            std::array<std::string_view, std::size(kTextNames)> table{};
+            for (size_t i = 0; i < table.size(); ++i) table[i] = kTextNames[i];
+            std::sort(table.begin(), table.end());
+            return table;
+        }
+
+        constexpr auto kExtensionTable = BuildExtensionTable();
+        constexpr auto kTextNameTable = BuildTextNameTable();
+        constexpr SignatureIndex kSignatureIndex = BuildSignatureIndex();
+
+        static_assert(SignaturesFitProbe(), "signature outside the probe window");
+        static_assert(std::none_of(kExtensionTable.begin(), kExtensionTable.end(),
+                          [](const PackedExtension& e) { return e.key == 0; }), "extension too long");
+        static_assert(std::adjacent_find(kExtensionTable.begin(), kExtensionTable.end(),
+                          [](const PackedExtension& a, const PackedExtension& b) { return a.key == b.key; })
+                      == kExtensionTable.end(), "duplicate extension");
+    }
+
+    // By file name only. A leading dot (".bashrc") does not start an
+    // extension; a few extension-less names such as README count as text.
+    constexpr Kind FromPath(std::string_view path) {
+        size_t slash = path.find_last_of('/');
+        std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+
+        if (dot == std::string_view::npos || dot == 0) {
+            if (name.size() > 16) return Kind::Unknown;
+            std::array<char, 16> lower{};
+            for (size_t i = 0; i < name.size(); ++i) {
+                char c = name[i];
+                lower[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+            return std::binary_search(detail::kTextNameTable.begin(), detail::kTextNameTable.end(),
+                                      std::string_view(lower.data(), name.size()))
+                   ? Kind::Text : Kind::Unknown;
+        }
+
+        uint64_t key = detail::PackLower(name.substr(dot + 1));
+        auto it = std::lower_bound(detail::kExtensionTable.begin(), detail::kExtensionTable.end(), key,
+                                   [](const detail::PackedExtension& e, uint64_t k) { return e.key < k; });
+        return key != 0 && it != detail::kExtensionTable.end() && it->key == key ? it->kind : Kind::Unknown;
+    }
+
+    // By content: the first signature that matches, else nullptr
+    constexpr const Signature* MatchSignature(const unsigned char* data, size_t size) {
+        auto matches = [&](std::string_view magic, size_t offset) {
+            if (offset + magic.size() > size) return false;
+            for (size_t i = 0; i < magic.size(); ++i) {
+                if (data[offset + i] != static_cast<unsigned char>(magic[i])) return false;
+            }
+            return true;
+        };
+        auto check = [&](const Signature& s) {
+            return matches(s.magic, s.offset) && (s.magic2.empty() || matches(s.magic2, s.offset2));
+        };
+
+        const auto& index = detail::kSignatureIndex;
+        if (size > 0) {
+            for (size_t i = index.start[data[0]]; i < index.start[data[0] + 1]; ++i) {
+                if (check(kSignatures[index.order[i]])) return &kSignatures[index.order[i]];
+            }
+        }
+        for (size_t i = 0; i < index.otherCount; ++i) {
+            if (check(kSignatures[index.other[i]])) return &kSignatures[index.other[i]];
+        }
+        return nullptr;
+    }
+
+    // The kind of the first signature that matches, else Unknown
+    constexpr Kind FromMagic(const unsigned char* data, size_t size) {
+        const Signature* signature = MatchSignature(data, size);
+        return signature ? signature->kind : Kind::Unknown;
+    }
+
+    // Two or three bytes such as "ID3", "BZh" or "MZ" also begin ordinary
+    // text, so on their own they are weak evidence
+    constexpr bool IsShort(const Signature& signature) {
+        return signature.magic.size() + signature.magic2.size() < 4;
+    }
+
+    // Signature first, then text sniffing, then the name. A short signature
+    // counts only when the name agrees or the data is not text
+    Kind FromContent(const unsigned char* data, size_t size, std::string_view path);
+
+    // Reads the probe window; files that cannot be read are classified by name
+    Kind Classify(const std::string& path);
+    std::vector<Kind> ClassifyAll(const std::vector<std::string>& paths,
+                                  unsigned threads = DefaultThreadCount());
+}
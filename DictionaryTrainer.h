@@ -0,0 +1,116 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+// Trains a DEFLATE preset dictionary from sample contents of similar files.
+// Simplified COVER selection: 8-byte "d-mers" are scored by the number of
+// samples they occur in, the sample data is split into epochs, and from each
+// epoch the segment with the highest score is kept. Because DEFLATE favours
+// short distances, the best segments are placed at the end of the dictionary.
+class DictionaryTrainer {
+private:
+    static constexpr size_t kDmer = 8;
+    static constexpr size_t kSegment = 64;
+
+    std::vector<std::string> samples;
+
+    static uint64_t HashDmer(const char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v * 0x9E3779B97F4A7C15ull;
+    }
+
+public:
+    // Deflate can only reference the last 32 KB, so larger dictionaries are useless
+    static constexpr size_t kMaxDictionarySize = 32 * 1024;
+    static constexpr size_t kMaxSampleSize = 16 * 1024;
+
+    void AddSample(std::string data) {
+        if (data.size() > kMaxSampleSize) data.resize(kMaxSampleSize);
+        if (data.size() >= kSegment) samples.push_back(std::move(data));
+    }
+
+    size_t SampleCount() const { return samples.size(); }
+
+    void Clear() { samples.clear(); }
+
+    std::string Train(size_t capacity = kMaxDictionarySize) {
+        capacity = std::min(capacity, kMaxDictionarySize);
+        if (samples.size() < 2) return {};
+
+        // Document frequency of every d-mer
+        std::unordered_map<uint64_t, uint32_t> frequency;
+        std::unordered_map<uint64_t, uint32_t> lastSample;
+        for (uint32_t s = 0; s < samples.size(); ++s) {
+            const std::string& data = samples[s];
+            for (size_t i = 0; i + kDmer <= data.size(); ++i) {
+                uint64_t h = HashDmer(data.data() + i);
+                auto it = lastSample.find(h);
+                if (it == lastSample.end() || it->second != s + 1) {
+                    lastSample[h] = s + 1;
+                    ++frequency[h];
+                }
+            }
+        }
+
+        // Split the samples into one epoch per segment that fits the dictionary
+        std::vector<std::pair<size_t, size_t>> positions; // {sample, offset}
+        for (size_t s = 0; s < samples.size(); ++s) {
+            for (size_t i = 0; i + kSegment <= samples[s].size(); i += kSegment / 4) {
+                positions.push_back({s, i});
+            }
+        }
+        if (positions.empty()) return {};
+
+        size_t epochs = std::max<size_t>(1, capacity / kSegment);
+        size_t epochSize = std::max<size_t>(1, positions.size() / epochs);
+
+        std::vector<std::pair<double, std::string>> segments;
+        for (size_t begin = 0; begin < positions.size() && segments.size() < epochs;
+             begin += epochSize) {
+            size_t end = std::min(positions.size(), begin + epochSize);
+            double bestScore = 0.0;
+            size_t best = SIZE_MAX;
+
+            for (size_t p = begin; p < end; ++p) {
+                const char* seg = samples[positions[p].first].data() + positions[p].second;
+                double score = 0.0;
+                for (size_t i = 0; i + kDmer <= kSegment; ++i) {
+                    auto it = frequency.find(HashDmer(seg + i));
+                    // A d-mer seen in only one sample does not help other files
+                    if (it != frequency.end() && it->second > 1) score += it->second;
+                }
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = p;
+                }
+            }
+            if (best == SIZE_MAX) continue;
+
+            const char* seg = samples[positions[best].first].data() + positions[best].second;
+            for (size_t i = 0; i + kDmer <= kSegment; ++i) {
+                frequency[HashDmer(seg + i)] = 0; // Do not pick the same content twice
+            }
+            segments.push_back({bestScore, std::string(seg, kSegment)});
+        }
+
+        // Ascending score: the most valuable content ends up closest to the data
+        std::stable_sort(segments.begin(), segments.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::string dictionary;
+        dictionary.reserve(segments.size() * kSegment);
+        for (const auto& segment : segments) {
+            dictionary += segment.second;
+        }
+        return dictionary;
+    }
+};
@@ -0,0 +1,156 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "DirectoryWatcher.h"
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    // Files are reported once written and closed, or moved in; creating a
+    // directory only matters for watching it
+    constexpr uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    constexpr size_t kEventBufferSize = 64 * 1024;
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool DirectoryWatcher::fail(const std::string& message)
+{
+    m_lastError = message;
+    return false;
+}
+
+bool DirectoryWatcher::Add(const std::string& root)
+{
+    if (m_fd < 0) {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0) {
+            return fail("inotify unavailable: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::is_directory(root, ec)) {
+        return fail("Not a directory: " + root);
+    }
+    std::vector<std::string> ignored;
+    if (!watchTree(root, false, ignored)) return false;
+    m_roots.push_back(root);
+    return true;
+}
+
+bool DirectoryWatcher::watchTree(const std::string& dir, bool report, std::vector<std::string>& changed)
+{
+    namespace fs = std::filesystem;
+
+    // The watch goes on before the listing, so a file created in between
+    // is seen at least once
+    auto watch = [this](const std::string& path) {
+        int wd = inotify_add_watch(m_fd, path.c_str(), kWatchMask);
+        if (wd < 0) {
+            // Gone again already, or not a directory after all
+            if (errno == ENOENT || errno == ENOTDIR) return true;
+            if (errno == ENOSPC) {
+                return fail("Out of inotify watches at " + path + "; raise fs.inotify.max_user_watches");
+            }
+            return fail("Cannot watch " + path + ": " + std::strerror(errno));
+        }
+        // A directory moved within the tree keeps its descriptor
+        m_paths[wd] = path;
+        return true;
+    };
+
+    if (!watch(dir)) return false;
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        const auto& entry = *it;
+        std::error_code typeError;
+        if (entry.is_symlink(typeError)) continue;
+        if (entry.is_directory(typeError)) {
+            if (!watch(entry.path().string())) return false;
+        } else if (report && entry.is_regular_file(typeError)) {
+            changed.push_back(entry.path().string());
+        }
+    }
+    return true;
+}
+
+DirectoryWatcher::Result DirectoryWatcher::Wait(int timeoutMs, std::vector<std::string>& changed)
+{
+    if (m_fd < 0) {
+        fail("Nothing is watched");
+        return Result::Error;
+    }
+
+    pollfd descriptor{m_fd, POLLIN, 0};
+    int ready = ::poll(&descriptor, 1, timeoutMs);
+    if (ready < 0) {
+        if (errno == EINTR) return Result::Interrupted;
+        fail("poll failed: " + std::string(std::strerror(errno)));
+        return Result::Error;
+    }
+    if (ready == 0) return Result::Timeout;
+
+    bool overflowed = false;
+    alignas(inotify_event) char buffer[kEventBufferSize];
+    for (;;) {
+        ssize_t length = ::read(m_fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            fail("Reading inotify events failed: " + std::string(std::strerror(errno)));
+            return Result::Error;
+        }
+
+        for (ssize_t pos = 0; pos < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                m_paths.erase(event->wd);
+                continue;
+            }
+            auto dir = m_paths.find(event->wd);
+            if (dir == m_paths.end() || event->len == 0) continue;
+
+            std::string path = dir->second + "/" + event->name;
+            if (event->mask & IN_ISDIR) {
+                // A new or moved-in directory: its contents are news as well
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !watchTree(path, true, changed)) {
+                    return Result::Error;
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                changed.push_back(std::move(path));
+            }
+        }
+    }
+    if (!overflowed) return Result::Changes;
+
+    // Directories created while events were dropped have no watch yet.
+    // Adding a watch again returns a directory's existing descriptor, so
+    // walking the roots covers the missing ones and refreshes moved paths;
+    // files already in them are left to the caller's catch-up.
+    std::vector<std::string> ignored;
+    for (const auto& root : m_roots) {
+        if (!watchTree(root, false, ignored)) return Result::Error;
+    }
+    return Result::Overflowed;
+}
@@ -0,0 +1,51 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Recursive inotify watch over directory trees, reporting files that were
+// written and closed or moved in. Subdirectories that appear later are
+// watched as they are created, and the files already inside them reported,
+// so nothing is lost between a mkdir and its watch being added.
+//
+// Waiting blocks in poll(), so a watcher costs no CPU while nothing changes.
+// When the kernel's event queue overflows, changes are lost; Wait() then
+// watches any directories it missed and reports Overflowed, and the caller
+// decides how to catch up on files.
+class DirectoryWatcher {
+public:
+    enum class Result { Changes, Timeout, Interrupted, Overflowed, Error };
+
+    DirectoryWatcher() = default;
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Watches root and every directory below it
+    bool Add(const std::string& root);
+
+    // Waits up to timeoutMs (-1: for ever) and appends the paths of changed
+    // regular files to changed; a path may be reported more than once.
+    // Interrupted means a signal arrived first.
+    Result Wait(int timeoutMs, std::vector<std::string>& changed);
+
+    const std::vector<std::string>& GetRoots() const { return m_roots; }
+    size_t GetWatchCount() const { return m_paths.size(); }
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    // Adds watches for dir and its subdirectories; with report, files found
+    // in them are appended to changed
+    bool watchTree(const std::string& dir, bool report, std::vector<std::string>& changed);
+    bool fail(const std::string& message);
+
+    int m_fd{-1};
+    std::vector<std::string> m_roots;
+    std::unordered_map<int, std::string> m_paths; // watch descriptor -> directory
+    std::string m_lastError;
+};
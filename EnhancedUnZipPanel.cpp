@@ -3,11 +3,70 @@
 // Date: 2025.06.06
 
 #include "EnhancedUnZipPanel.h"
+#include "ZipReader.h"
+#include "TarReader.h"
+#include "ExtractionWriter.h"
+#include "EntryFilter.h"
+#include "EntryPreview.h"
+#include "ArchiveRepacker.h"
+#include "Trace.h"
+#include "Parallel.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+namespace {
+    // Decoded per step: shown when an entry is selected, and again each
+    // time the view scrolls to within kPreviewMargin characters of the end
+    constexpr uint64_t kPreviewChunk = 64 * 1024;
+    constexpr long kPreviewMargin = 16 * 1024;
+
+    constexpr const char* kArchiveWildcard =
+        "Archives (*.zip;*.tar;*.tar.gz;*.tgz;*.tar.zst)|*.zip;*.tar;*.tar.gz;*.tgz;*.tar.zst|All files (*.*)|*.*";
+
+    // Length of data without a multi-byte UTF-8 character cut off at the end
+    size_t completeUtf8(const std::string& data)
+    {
+        size_t end = data.size();
+        for (size_t back = 1; back <= 3 && back <= end; ++back) {
+            unsigned char c = static_cast<unsigned char>(data[end - back]);
+            if ((c & 0xC0) == 0x80) continue;
+            size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+            return length > back ? end - back : end;
+        }
+        return end;
+    }
+
+    // Offset, 16 bytes in hex and the printable ones as text, per line
+    std::string formatHex(const std::string& data, size_t size, uint64_t offset)
+    {
+        std::string text;
+        text.reserve(size / 16 * 80 + 80);
+        char line[96];
+        for (size_t row = 0; row < size; row += 16) {
+            int n = std::snprintf(line, sizeof(line), "%08llx ", static_cast<unsigned long long>(offset + row));
+            for (size_t i = 0; i < 16; ++i) {
+                if (row + i < size)
+                    n += std::snprintf(line + n, sizeof(line) - n, " %02x", static_cast<unsigned char>(data[row + i]));
+                else
+                    n += std::snprintf(line + n, sizeof(line) - n, "   ");
+            }
+            text.append(line, n);
+            text += "  ";
+            for (size_t i = row; i < std::min(size, row + 16); ++i)
+                text += data[i] >= 0x20 && data[i] < 0x7F ? data[i] : '.';
+            text += '\n';
+        }
+        return text;
+    }
+}
 
 wxBEGIN_EVENT_TABLE(EnhancedUnZipPanel, wxPanel)
     EVT_BUTTON(ID_LOAD_ZIP, EnhancedUnZipPanel::OnLoadZip)
     EVT_BUTTON(ID_EXTRACT_ALL, EnhancedUnZipPanel::OnExtractAll)
     EVT_BUTTON(ID_EXTRACT_SELECTED, EnhancedUnZipPanel::OnExtractSelected)
+    EVT_BUTTON(ID_EXTRACT_MATCHING, EnhancedUnZipPanel::OnExtractMatching)
+    EVT_BUTTON(ID_REPACK, EnhancedUnZipPanel::OnRepack)
     EVT_LIST_ITEM_SELECTED(ID_FILE_LIST, EnhancedUnZipPanel::OnItemSelect)
 wxEND_EVENT_TABLE();
 
@@ -18,6 +77,12 @@ EnhancedUnZipPanel::EnhancedUnZipPanel(wxWindow* parent)
     EnableControls(false);
 }
 
+EnhancedUnZipPanel::~EnhancedUnZipPanel()
+{
+    // Stops the decoding thread before the callback's target goes away
+    m_preview.reset();
+}
+
 void EnhancedUnZipPanel::SetupUI()
 {
     auto* mainSizer = new wxBoxSizer(wxVERTICAL);
@@ -25,14 +90,37 @@ void EnhancedUnZipPanel::SetupUI()
     SetupFileList();
     SetupButtons();
     SetupProgressBar();
+    SetupFilter();
+    SetupRepack();
+    SetupPreview();
 
     m_statusText = std::make_unique<wxStaticText>(this, wxID_ANY, "Ready");
 
-    mainSizer->Add(m_fileList.get(), 1, wxEXPAND | wxALL, 5);
+    auto* browseSizer = new wxBoxSizer(wxHORIZONTAL);
+    browseSizer->Add(m_fileList.get(), 1, wxEXPAND | wxRIGHT, 5);
+    browseSizer->Add(m_previewText.get(), 1, wxEXPAND);
+    mainSizer->Add(browseSizer, 1, wxEXPAND | wxALL, 5);
     mainSizer->Add(m_progressBar.get(), 0, wxEXPAND | wxALL, 5);
     mainSizer->Add(m_loadZipButton.get(), 0, wxEXPAND | wxALL, 5);
     mainSizer->Add(m_extractButton.get(), 0, wxEXPAND | wxALL, 5);
     mainSizer->Add(m_extractAllButton.get(), 0, wxEXPAND | wxALL, 5);
+    auto* optionSizer = new wxBoxSizer(wxHORIZONTAL);
+    optionSizer->Add(m_skipUnchanged.get(), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+    optionSizer->Add(m_hardlinkDuplicates.get(), 0, wxALIGN_CENTER_VERTICAL);
+    mainSizer->Add(optionSizer, 0, wxALL, 5);
+
+    auto* filterSizer = new wxBoxSizer(wxHORIZONTAL);
+    filterSizer->Add(m_filterMode.get(), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    filterSizer->Add(m_filterText.get(), 1, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    filterSizer->Add(m_extractMatchingButton.get(), 0, wxALIGN_CENTER_VERTICAL);
+    mainSizer->Add(filterSizer, 0, wxEXPAND | wxALL, 5);
+
+    auto* repackSizer = new wxBoxSizer(wxHORIZONTAL);
+    repackSizer->Add(new wxStaticText(this, wxID_ANY, "Level:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    repackSizer->Add(m_repackLevel.get(), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    repackSizer->Add(m_repackOptimize.get(), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    repackSizer->Add(m_repackButton.get(), 1, wxALIGN_CENTER_VERTICAL);
+    mainSizer->Add(repackSizer, 0, wxEXPAND | wxALL, 5);
     mainSizer->Add(m_statusText.get(), 0, wxEXPAND | wxALL, 5);
 
     SetSizer(mainSizer);
@@ -50,6 +138,12 @@ void EnhancedUnZipPanel::SetupButtons()
     m_loadZipButton = std::make_unique<wxButton>(this, ID_LOAD_ZIP, "Load Zip File");
     m_extractButton = std::make_unique<wxButton>(this, ID_EXTRACT_SELECTED, "Extract Selected");
     m_extractAllButton = std::make_unique<wxButton>(this, ID_EXTRACT_ALL, "Extract All");
+    m_skipUnchanged = std::make_unique<wxCheckBox>(this, wxID_ANY, "Skip unchanged files");
+    m_skipUnchanged->SetToolTip("Leave files already in the destination alone when their size and time, "
+                                "or failing that their CRC-32, match the archive. ZIP archives only.");
+    m_hardlinkDuplicates = std::make_unique<wxCheckBox>(this, wxID_ANY, "Hard link duplicates");
+    m_hardlinkDuplicates->SetToolTip("Identical entries are decoded once either way. Checked, the copies become "
+                                     "hard links to one file: changing one changes all.");
 }
 
 void EnhancedUnZipPanel::SetupProgressBar()
@@ -57,57 +151,346 @@ void EnhancedUnZipPanel::SetupProgressBar()
     m_progressBar = std::make_unique<wxGauge>(this, wxID_ANY, 100);
 }
 
+void EnhancedUnZipPanel::SetupFilter()
+{
+    m_filterMode = std::make_unique<wxChoice>(this, wxID_ANY);
+    m_filterMode->Append(std::vector<wxString>{"Glob", "Prefix", "Regex"});
+    m_filterMode->SetSelection(0);
+    m_filterText = std::make_unique<wxTextCtrl>(this, wxID_ANY, "");
+    m_filterText->SetHint("e.g. 2026/10/**/*.log");
+    m_extractMatchingButton = std::make_unique<wxButton>(this, ID_EXTRACT_MATCHING, "Extract Matching");
+}
+
+void EnhancedUnZipPanel::SetupRepack()
+{
+    m_repackLevel = std::make_unique<wxSpinCtrl>(this, wxID_ANY, "6", wxDefaultPosition, wxDefaultSize,
+                                                 wxSP_ARROW_KEYS, 0, 9, 6);
+    m_repackOptimize = std::make_unique<wxCheckBox>(this, wxID_ANY, "Group similar files");
+    m_repackButton = std::make_unique<wxButton>(this, ID_REPACK, "Repack...");
+    m_repackButton->SetToolTip("Write the loaded entries, or those matching the filter, to a new archive");
+}
+
+void EnhancedUnZipPanel::SetupPreview()
+{
+    m_previewText = std::make_unique<wxTextCtrl>(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize,
+                                                 wxTE_MULTILINE | wxTE_READONLY | wxTE_RICH2 | wxHSCROLL);
+    m_previewText->SetFont(wxFont(10, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+
+    // Scroll and key events stay with the text control, so they are bound there
+    m_previewText->Bind(wxEVT_MOUSEWHEEL, &EnhancedUnZipPanel::OnPreviewScroll, this);
+    m_previewText->Bind(wxEVT_KEY_UP, &EnhancedUnZipPanel::OnPreviewScroll, this);
+    m_previewText->Bind(wxEVT_SCROLLWIN_LINEDOWN, &EnhancedUnZipPanel::OnPreviewScroll, this);
+    m_previewText->Bind(wxEVT_SCROLLWIN_PAGEDOWN, &EnhancedUnZipPanel::OnPreviewScroll, this);
+    m_previewText->Bind(wxEVT_SCROLLWIN_THUMBRELEASE, &EnhancedUnZipPanel::OnPreviewScroll, this);
+    m_previewText->Bind(wxEVT_SCROLLWIN_BOTTOM, &EnhancedUnZipPanel::OnPreviewScroll, this);
+
+    m_preview = std::make_unique<EntryPreview>();
+    m_preview->SetUpdateCallback([this]() { CallAfter([this]() { AppendPreview(); }); });
+}
+
 bool EnhancedUnZipPanel::LoadArchiveEntries()
 {
-    wxFileInputStream input(m_archivePath);
-    if (!input.IsOk())
-        return false;
+    // Tar archives are recognised by content, whatever their names
+    std::shared_ptr<ZipReader> reader;
+    std::shared_ptr<TarReader> tarReader;
+    TarFormat::Compression compression;
+    if (TarReader::Detect(m_archivePath.ToStdString(), compression))
+    {
+        tarReader = std::make_shared<TarReader>();
+        if (!tarReader->Open(m_archivePath.ToStdString()))
+            return false;
+    }
+    else
+    {
+        reader = std::make_shared<ZipReader>();
+        if (!reader->Open(m_archivePath.ToStdString()))
+            return false;
+    }
 
-    wxZipInputStream zipStream(input);
-    std::unique_ptr<wxZipEntry> entry(zipStream.GetNextEntry());
-    m_fileList->DeleteAllItems();
+    // Whatever was previewed under this path may have been replaced since
+    m_preview->Forget(m_archivePath.ToStdString());
+    m_previewEntry = SIZE_MAX;
+    m_previewText->Clear();
 
-    while (entry)
+    m_fileList->DeleteAllItems();
+    m_itemEntries.clear();
+    m_reader = reader;
+    m_tarReader = tarReader;
+    m_archiveIsZip64 = reader && reader->IsZip64();
+    m_archiveVolumes = reader ? reader->GetVolumeCount() : 1;
+
+    const auto& entries = reader ? reader->GetEntries() : tarReader->GetEntries();
+    for (size_t i = 0; i < entries.size(); ++i)
     {
-        long index = m_fileList->InsertItem(m_fileList->GetItemCount(), entry->GetName());
-        m_fileList->SetItem(index, 1, wxString::Format("%ld", entry->GetSize()));
-        entry.reset(zipStream.GetNextEntry());
+        // Shared dictionaries and other bookkeeping entries are not user files
+        if (entries[i].IsInternal())
+            continue;
+
+        long index = m_fileList->InsertItem(m_fileList->GetItemCount(), wxString::FromUTF8(entries[i].name));
+        m_fileList->SetItem(index, 1, std::to_string(entries[i].uncompressedSize));
+        m_itemEntries.push_back(i);
     }
     return true;
 }
 
+void EnhancedUnZipPanel::ShowPreview(size_t entry)
+{
+    m_previewText->Clear();
+    m_previewEntry = SIZE_MAX;
+    if (m_reader->GetEntries()[entry].IsDir())
+        return;
+
+    m_previewEntry = entry;
+    m_previewShown = 0;
+    m_previewWanted = kPreviewChunk;
+    m_previewBinary = false;
+    RequestPreview();
+}
+
+void EnhancedUnZipPanel::RequestPreview()
+{
+    // Already decoded parts are shown at once; the rest arrives through AppendPreview
+    if (m_preview->Request(m_reader, m_archivePath.ToStdString(), m_previewEntry, m_previewShown,
+                           m_previewWanted - m_previewShown))
+        AppendPreview();
+}
+
+void EnhancedUnZipPanel::AppendPreview()
+{
+    if (m_previewEntry == SIZE_MAX)
+        return;
+
+    const ZipEntryInfo& entry = m_reader->GetEntries()[m_previewEntry];
+    std::string data;
+    m_preview->Read(m_archivePath.ToStdString(), m_previewEntry, m_previewShown,
+                    m_previewWanted - m_previewShown, data);
+    std::string error = m_preview->GetLastError();
+    if (!error.empty())
+        m_statusText->SetLabel("Preview failed: " + wxString::FromUTF8(error));
+    if (data.empty())
+        return;
+
+    // Decided by the first chunk: NUL bytes or invalid UTF-8 mean a hex dump
+    if (m_previewShown == 0)
+        m_previewBinary = data.find('\0') != std::string::npos ||
+                          wxString::FromUTF8(data.substr(0, completeUtf8(data))).IsEmpty();
+
+    bool last = m_previewShown + data.size() >= entry.uncompressedSize;
+    size_t used = last ? data.size() : m_previewBinary ? data.size() / 16 * 16 : completeUtf8(data);
+    if (used == 0)
+        return;
+
+    m_previewText->AppendText(m_previewBinary ? wxString(formatHex(data, used, m_previewShown))
+                                              : wxString::FromUTF8(data.substr(0, used)));
+    m_previewShown += used;
+    m_statusText->SetLabel(wxString::Format("Previewing %s: %llu of %llu bytes", wxString::FromUTF8(entry.name),
+                                            static_cast<unsigned long long>(m_previewShown),
+                                            static_cast<unsigned long long>(entry.uncompressedSize)));
+}
+
+void EnhancedUnZipPanel::RunExtraction(ZipReader* reader, const std::vector<size_t>& entries,
+                                       const wxString& destPath, const wxString& title)
+{
+    wxProgressDialog progress(title, "Please wait...", 100, this, wxPD_APP_MODAL | wxPD_AUTO_HIDE);
+    ExtractionWriter writer(destPath.ToStdString());
+    writer.SetSkipUnchanged(m_skipUnchanged->GetValue());
+    writer.SetHardlinkDuplicates(m_hardlinkDuplicates->GetValue());
+
+    // Entries are written on worker threads; only this thread touches the dialog
+    std::atomic<int> percent{0};
+    std::atomic<bool> finished{false};
+    bool ok = false;
+    std::thread worker([&]() {
+        auto onProgress = [&percent](size_t done, size_t total) {
+            percent = static_cast<int>(done * 99 / total);
+        };
+        ok = reader ? writer.ExtractEntries(*reader, entries, DefaultThreadCount(), onProgress)
+                    : m_tarReader->ExtractEntries(entries, writer, DefaultThreadCount(), onProgress);
+        finished = true;
+    });
+    while (!finished)
+    {
+        progress.Update(percent);
+        wxMilliSleep(50);
+    }
+    worker.join();
+
+    auto stats = writer.GetStats();
+    if (!ok)
+        m_statusText->SetLabel(wxString::Format("Extraction finished with %llu errors: %s",
+                                                static_cast<unsigned long long>(
+                                                    reader ? stats.failed : m_tarReader->GetFailedCount()),
+                                                reader ? writer.GetLastError() : m_tarReader->GetLastError()));
+    else if (stats.unchanged > 0)
+        m_statusText->SetLabel(wxString::Format("Extracted %llu entries; %llu unchanged files (%llu MB) skipped",
+                                                static_cast<unsigned long long>(entries.size() - stats.unchanged),
+                                                static_cast<unsigned long long>(stats.unchanged),
+                                                static_cast<unsigned long long>(stats.unchangedBytes >> 20)));
+    else if (stats.duplicates > 0)
+        m_statusText->SetLabel(wxString::Format("Extracted %zu entries (%llu duplicates, %llu MB, copied "
+                                                "rather than decoded)", entries.size(),
+                                                static_cast<unsigned long long>(stats.duplicates),
+                                                static_cast<unsigned long long>(stats.duplicateBytes >> 20)));
+    else if (stats.sparseBytes > 0)
+        m_statusText->SetLabel(wxString::Format("Extracted %zu entries (%llu MB left sparse)", entries.size(),
+                                                static_cast<unsigned long long>(stats.sparseBytes >> 20)));
+    else
+        m_statusText->SetLabel(wxString::Format("Extracted %zu entries", entries.size()));
+}
+
 void EnhancedUnZipPanel::ExtractAll(const wxString& destPath)
 {
-    wxFileInputStream input(m_archivePath);
-    wxZipInputStream zipStream(input);
-    std::unique_ptr<wxZipEntry> entry(zipStream.GetNextEntry());
+    Trace::Span span("extract all");
+    if (m_tarReader)
+    {
+        std::vector<size_t> entries(m_tarReader->GetEntries().size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            entries[i] = i;
+        RunExtraction(nullptr, entries, destPath, "Extracting All");
+        return;
+    }
 
-    wxProgressDialog progress("Extracting All", "Please wait...", 100, this, wxPD_APP_MODAL | wxPD_AUTO_HIDE);
+    ZipReader reader;
+    if (!reader.Open(m_archivePath.ToStdString()))
+    {
+        m_statusText->SetLabel("Failed to load zip file");
+        return;
+    }
 
-    while (entry)
+    std::vector<size_t> entries(reader.GetEntries().size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        entries[i] = i;
+    RunExtraction(&reader, entries, destPath, "Extracting All");
+}
+
+bool EnhancedUnZipPanel::BuildFilter(EntryFilter& filter)
+{
+    std::string pattern(m_filterText->GetValue().ToUTF8());
+    switch (m_filterMode->GetSelection())
     {
-        wxString name = entry->GetName();
-        wxFileName destFile(destPath, name);
+    case 1:
+        filter.AddPrefix(pattern);
+        break;
+    case 2:
+        if (!filter.AddRegex(pattern))
+        {
+            m_statusText->SetLabel(wxString::FromUTF8(filter.GetLastError()));
+            return false;
+        }
+        break;
+    default:
+        filter.AddGlob(pattern);
+        break;
+    }
+    return true;
+}
 
-        if (!wxFileName::DirExists(destFile.GetPath()))
-            wxFileName::Mkdir(destFile.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+void EnhancedUnZipPanel::ExtractMatching(const wxString& destPath)
+{
+    Trace::Span span("extract matching");
+    EntryFilter filter;
+    if (!BuildFilter(filter))
+        return;
 
-        if (!entry->IsDir())
+    if (m_tarReader)
+    {
+        EntryIndex index(m_tarReader->GetEntries());
+        std::vector<size_t> selected = index.Select(filter);
+        if (selected.empty())
         {
-            wxFileOutputStream out(destFile.GetFullPath());
-            if (out.IsOk())
-                zipStream.Read(out);
+            m_statusText->SetLabel("No entries match " + m_filterText->GetValue());
+            return;
         }
+        RunExtraction(nullptr, selected, destPath, wxString::Format("Extracting %zu of %zu entries",
+                                                                    selected.size(), index.Size()));
+        return;
+    }
 
-        entry.reset(zipStream.GetNextEntry());
-        progress.Pulse(name);
+    ZipReader reader;
+    if (!reader.Open(m_archivePath.ToStdString()))
+    {
+        m_statusText->SetLabel("Failed to load zip file");
+        return;
+    }
+
+    // Matched against the central directory; no entry data is read for the rest
+    EntryIndex index(reader.GetEntries());
+    std::vector<size_t> selected = index.Select(filter);
+    if (selected.empty())
+    {
+        m_statusText->SetLabel("No entries match " + m_filterText->GetValue());
+        return;
+    }
+    RunExtraction(&reader, selected, destPath, wxString::Format("Extracting %zu of %zu entries",
+                                                               selected.size(), index.Size()));
+}
+
+void EnhancedUnZipPanel::Repack(const wxString& outputPath)
+{
+    Trace::Span span("repack");
+    if (!m_reader)
+    {
+        m_statusText->SetLabel(m_tarReader ? "Only zip files can be repacked" : "Load a zip file first");
+        return;
+    }
+
+    // Everything, or only what the filter matches when one is entered
+    std::vector<size_t> entries;
+    if (m_filterText->IsEmpty())
+    {
+        entries.resize(m_reader->GetEntries().size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            entries[i] = i;
+    }
+    else
+    {
+        EntryFilter filter;
+        if (!BuildFilter(filter))
+            return;
+        entries = EntryIndex(m_reader->GetEntries()).Select(filter);
+        if (entries.empty())
+        {
+            m_statusText->SetLabel("No entries match " + m_filterText->GetValue());
+            return;
+        }
+    }
+
+    RepackOptions options;
+    options.compressionLevel = m_repackLevel->GetValue();
+    options.optimizeOrder = m_repackOptimize->GetValue();
+    ArchiveRepacker repacker(options);
+
+    wxProgressDialog progress("Repacking", "Please wait...", 100, this, wxPD_APP_MODAL | wxPD_AUTO_HIDE);
+    std::atomic<int> percent{0};
+    std::atomic<bool> finished{false};
+    bool ok = false;
+    std::thread worker([&]() {
+        ok = repacker.Repack(*m_reader, entries, outputPath.ToStdString(), [&percent](size_t done, size_t total) {
+            percent = static_cast<int>(done * 99 / total);
+        });
+        finished = true;
+    });
+    while (!finished)
+    {
+        progress.Update(percent);
+        wxMilliSleep(50);
     }
-    m_statusText->SetLabel("Extraction complete");
+    worker.join();
+
+    auto stats = repacker.GetStats();
+    if (!ok)
+        m_statusText->SetLabel(wxString::Format("Repack finished with %llu errors: %s",
+                                                static_cast<unsigned long long>(stats.failed),
+                                                repacker.GetLastError()));
+    else
+        m_statusText->SetLabel(wxString::Format("Repacked %zu entries: %llu copied, %llu recompressed",
+                                                entries.size(), static_cast<unsigned long long>(stats.copied),
+                                                static_cast<unsigned long long>(stats.recompressed)));
 }
 
 void EnhancedUnZipPanel::ExtractSelected(const wxString& destPath)
 {
-    wxString selectedPath = wxFileSelector("Choose zip file to extract from", "", "", "zip", "Zip files (*.zip)|*.zip");
+    wxString selectedPath = wxFileSelector("Choose archive to extract from", "", "", "zip", kArchiveWildcard);
     if (selectedPath.IsEmpty())
     {
         m_statusText->SetLabel("No zip file selected");
@@ -129,28 +512,67 @@ void EnhancedUnZipPanel::ExtractSelected(const wxString& destPath)
     }
 
     wxString fileName = m_fileList->GetItemText(item);
-    wxFileInputStream input(m_archivePath);
-    wxZipInputStream zipStream(input);
-    std::unique_ptr<wxZipEntry> entry(zipStream.GetNextEntry());
-
-    while (entry)
+    if (m_tarReader)
     {
-        if (entry->GetName() == fileName)
+        std::vector<size_t> entries;
+        const auto& tarEntries = m_tarReader->GetEntries();
+        for (size_t i = 0; i < tarEntries.size() && entries.empty(); ++i)
+            if (wxString::FromUTF8(tarEntries[i].name) == fileName)
+                entries.push_back(i);
+        if (entries.empty())
         {
-            wxFileName destFile(destPath, fileName);
-
-            if (!wxFileName::DirExists(destFile.GetPath()))
-                wxFileName::Mkdir(destFile.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+            m_statusText->SetLabel("Not in the archive: " + fileName);
+            return;
+        }
+        ExtractionWriter writer(destPath.ToStdString());
+        if (!m_tarReader->ExtractEntries(entries, writer))
+        {
+            m_statusText->SetLabel("Extraction failed, archive kept: " +
+                                   wxString::FromUTF8(m_tarReader->GetLastError()));
+            return;
+        }
+        if (wxRemoveFile(m_archivePath))
+            m_statusText->SetLabel("Archive extracted and deleted: " + fileName);
+        else
+            m_statusText->SetLabel("Archive extracted but could not be deleted");
+        return;
+    }
 
-            wxFileOutputStream out(destFile.GetFullPath());
-            if (out.IsOk())
-                zipStream.Read(out);
+    ZipReader reader;
+    if (!reader.Open(m_archivePath.ToStdString()))
+    {
+        m_statusText->SetLabel("Failed to load zip file");
+        return;
+    }
 
-            m_statusText->SetLabel("Extracted: " + fileName);
+    const ZipEntryInfo* selected = nullptr;
+    for (const auto& entry : reader.GetEntries())
+    {
+        if (wxString::FromUTF8(entry.name) == fileName)
+        {
+            selected = &entry;
             break;
         }
-        entry.reset(zipStream.GetNextEntry());
     }
+    if (!selected)
+    {
+        m_statusText->SetLabel("Not in the archive: " + fileName);
+        return;
+    }
+
+    // The archive is deleted below, so only once its entry is safely out
+    ExtractionWriter writer(destPath.ToStdString());
+    bool extracted = writer.Extract(reader, *selected);
+    extracted = writer.Finish() && extracted;
+    if (!extracted)
+    {
+        m_statusText->SetLabel("Extraction failed, zip file kept: " + wxString::FromUTF8(writer.GetLastError()));
+        return;
+    }
+
+    // The .z01, .z02, ... volumes of a split archive go with it
+    for (uint32_t disk = 0; disk + 1 < m_archiveVolumes; ++disk)
+        wxRemoveFile(ZipFormat::SplitVolumePath(m_archivePath.ToStdString(), disk));
 
     if (wxRemoveFile(m_archivePath))
         m_statusText->SetLabel("Zip file extracted and deleted: " + fileName);
@@ -160,13 +582,16 @@ void EnhancedUnZipPanel::ExtractSelected(const wxString& destPath)
 
 void EnhancedUnZipPanel::OnLoadZip(wxCommandEvent&)
 {
-    wxString selectedPath = wxFileSelector("Choose zip file", "", "", "zip", "Zip files (*.zip)|*.zip");
+    wxString selectedPath = wxFileSelector("Choose archive", "", "", "zip", kArchiveWildcard);
     if (!selectedPath.IsEmpty())
     {
         m_archivePath = selectedPath;
         if (LoadArchiveEntries())
         {
-            m_statusText->SetLabel("Loaded: " + m_archivePath);
+            wxString details = m_archiveIsZip64 ? " (ZIP64)" : "";
+            if (m_archiveVolumes > 1)
+                details += wxString::Format(" (%u volumes)", m_archiveVolumes);
+            m_statusText->SetLabel("Loaded: " + m_archivePath + details);
             EnableControls(true);
         }
         else
@@ -185,7 +610,10 @@ void EnhancedUnZipPanel::OnExtractAll(wxCommandEvent&)
 {
     wxDirDialog dirDialog(this, "Choose extraction directory");
     if (dirDialog.ShowModal() == wxID_OK)
+    {
         ExtractAll(dirDialog.GetPath());
+        Trace::Dump();
+    }
 }
 
 void EnhancedUnZipPanel::OnExtractSelected(wxCommandEvent&)
@@ -195,9 +623,66 @@ void EnhancedUnZipPanel::OnExtractSelected(wxCommandEvent&)
         ExtractSelected(dirDialog.GetPath());
 }
 
+void EnhancedUnZipPanel::OnExtractMatching(wxCommandEvent&)
+{
+    if (m_filterText->IsEmpty())
+    {
+        m_statusText->SetLabel("Enter a pattern to match entry names against");
+        return;
+    }
+
+    wxDirDialog dirDialog(this, "Choose extraction directory");
+    if (dirDialog.ShowModal() == wxID_OK)
+    {
+        ExtractMatching(dirDialog.GetPath());
+        Trace::Dump();
+    }
+}
+
+void EnhancedUnZipPanel::OnRepack(wxCommandEvent&)
+{
+    wxFileDialog saveDialog(this, "Save repacked archive", "", "", "Zip files (*.zip)|*.zip",
+                            wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveDialog.ShowModal() != wxID_OK)
+        return;
+    if (saveDialog.GetPath() == m_archivePath)
+    {
+        m_statusText->SetLabel("Choose a different file; the archive is read while it is repacked");
+        return;
+    }
+
+    Repack(saveDialog.GetPath());
+    Trace::Dump();
+}
+
 void EnhancedUnZipPanel::OnItemSelect(wxListEvent& event)
 {
     EnableControls(true);
+
+    long item = event.GetIndex();
+    if (m_reader && item >= 0 && static_cast<size_t>(item) < m_itemEntries.size())
+        ShowPreview(m_itemEntries[item]);
+}
+
+void EnhancedUnZipPanel::OnPreviewScroll(wxEvent& event)
+{
+    event.Skip();
+
+    // Checked once the scroll has been applied
+    CallAfter([this]() {
+        if (m_previewEntry == SIZE_MAX || m_previewShown < m_previewWanted ||
+            m_previewShown >= m_reader->GetEntries()[m_previewEntry].uncompressedSize)
+            return;
+
+        long bottom = 0;
+        wxSize client = m_previewText->GetClientSize();
+        if (m_previewText->HitTest(wxPoint(0, client.GetHeight() - 1), &bottom) != wxTE_HT_UNKNOWN &&
+            bottom < m_previewText->GetLastPosition() - kPreviewMargin)
+            return;
+
+        m_previewWanted += kPreviewChunk;
+        RequestPreview();
+    });
 }
 
 void EnhancedUnZipPanel::EnableControls(bool enable)
@@ -206,4 +691,12 @@ void EnhancedUnZipPanel::EnableControls(bool enable)
         m_extractButton->Enable(enable);
     if (m_extractAllButton)
         m_extractAllButton->Enable(enable);
+    if (m_extractMatchingButton)
+        m_extractMatchingButton->Enable(enable);
+    if (m_skipUnchanged)
+        m_skipUnchanged->Enable(enable && !m_tarReader);
+    if (m_hardlinkDuplicates)
+        m_hardlinkDuplicates->Enable(enable && !m_tarReader);
+    if (m_repackButton)
+        m_repackButton->Enable(enable && !m_tarReader);
 }
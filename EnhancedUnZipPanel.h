@@ -13,18 +13,28 @@
 #include <wx/filename.h>
 #include <wx/progdlg.h>
 #include <wx/dir.h>
+#include <wx/spinctrl.h>
 #include <memory>
+#include <vector>
 
 // Control IDs
 constexpr int ID_LOAD_ZIP = 1001;
 constexpr int ID_EXTRACT_ALL = 1002;
 constexpr int ID_EXTRACT_SELECTED = 1003;
 constexpr int ID_FILE_LIST = 1004;
+constexpr int ID_EXTRACT_MATCHING = 1005;
+constexpr int ID_REPACK = 1006;
+
+class ZipReader;
+class TarReader;
+class EntryFilter;
+class EntryPreview;
 
 class EnhancedUnZipPanel : public wxPanel
 {
 public:
     EnhancedUnZipPanel(wxWindow* parent);
+    ~EnhancedUnZipPanel() override;
 
 private:
     // UI setup helpers
@@ -32,29 +42,67 @@ private:
     void SetupFileList();
     void SetupButtons();
     void SetupProgressBar();
+    void SetupFilter();
+    void SetupRepack();
+    void SetupPreview();
 
     // Functional logic
     bool LoadArchiveEntries();
     void ExtractAll(const wxString& destPath);
     void ExtractSelected(const wxString& destPath);
+    void ExtractMatching(const wxString& destPath);
+    void Repack(const wxString& outputPath);
+    bool BuildFilter(EntryFilter& filter);
+    // Without a reader the entries are those of the loaded tar archive
+    void RunExtraction(ZipReader* reader, const std::vector<size_t>& entries, const wxString& destPath,
+                       const wxString& title);
     void EnableControls(bool enable);
 
+    // Preview of the selected entry, decoded in the background as it scrolls
+    void ShowPreview(size_t entry);
+    void RequestPreview();
+    void AppendPreview();
+
     // Event handlers
     void OnLoadZip(wxCommandEvent& event);
     void OnExtractAll(wxCommandEvent& event);
     void OnExtractSelected(wxCommandEvent& event);
+    void OnExtractMatching(wxCommandEvent& event);
+    void OnRepack(wxCommandEvent& event);
     void OnItemSelect(wxListEvent& event);
+    void OnPreviewScroll(wxEvent& event);
 
     // UI components
     std::unique_ptr<wxListCtrl> m_fileList;
     std::unique_ptr<wxButton> m_loadZipButton;
     std::unique_ptr<wxButton> m_extractButton;
     std::unique_ptr<wxButton> m_extractAllButton;
+    std::unique_ptr<wxCheckBox> m_skipUnchanged;
+    std::unique_ptr<wxCheckBox> m_hardlinkDuplicates;
+    std::unique_ptr<wxButton> m_extractMatchingButton;
+    std::unique_ptr<wxTextCtrl> m_filterText;
+    std::unique_ptr<wxChoice> m_filterMode;
+    std::unique_ptr<wxButton> m_repackButton;
+    std::unique_ptr<wxSpinCtrl> m_repackLevel;
+    std::unique_ptr<wxCheckBox> m_repackOptimize;
     std::unique_ptr<wxGauge> m_progressBar;
     std::unique_ptr<wxStaticText> m_statusText;
+    std::unique_ptr<wxTextCtrl> m_previewText;
 
     // Internal state
     wxString m_archivePath;
+    bool m_archiveIsZip64{false};
+    uint32_t m_archiveVolumes{1};
+
+    // Kept open while the archive is loaded, for previews
+    std::shared_ptr<ZipReader> m_reader;
+    std::shared_ptr<TarReader> m_tarReader; // instead of m_reader for tar archives
+    std::unique_ptr<EntryPreview> m_preview;
+    std::vector<size_t> m_itemEntries; // list item -> entry index
+    size_t m_previewEntry{SIZE_MAX};
+    uint64_t m_previewShown{0};        // bytes of the entry appended so far
+    uint64_t m_previewWanted{0};
+    bool m_previewBinary{false};
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -10,15 +10,109 @@
 #include <fstream>
 #include <filesystem>
 #include <thread>
+#include <atomic>
 #include <wx/textctrl.h>
 #include <wx/choice.h>
 #include <wx/gauge.h>
 #include <wx/stattext.h>
 #include <wx/button.h>
 #include <wx/listctrl.h>
+#include <wx/checkbox.h>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <iterator>
 
-#include "zip.h"
 #include "zlib.h"
+#include "ZipWriter.h"
+#include "DictionaryTrainer.h"
+#include "SolidArchive.h"
+#include "SplitArchive.h"
+#include "CompressionCache.h"
+#include "ContentType.h"
+#include "Parallel.h"
+#include "SizeEstimator.h"
+#include "TarWriter.h"
+#include "Trace.h"
+
+namespace {
+    // Dictionaries only pay off for small files; larger ones build their own window
+    constexpr size_t kDictionaryFileLimit = 64 * 1024;
+    constexpr size_t kMinDictionaryFiles = 8;
+    constexpr size_t kDictionarySamples = 256;
+
+    std::string formatBytes(double bytes)
+    {
+        const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+        size_t unit = 0;
+        while (bytes >= 1024 && unit + 1 < std::size(units)) {
+            bytes /= 1024;
+            ++unit;
+        }
+        return wxString::Format(unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]).ToStdString();
+    }
+
+    std::string formatDuration(double seconds)
+    {
+        if (seconds < 60) return wxString::Format("%.0f s", std::ceil(seconds)).ToStdString();
+        if (seconds < 3600) return wxString::Format("%.0f min", std::ceil(seconds / 60)).ToStdString();
+        return wxString::Format("%.1f h", seconds / 3600).ToStdString();
+    }
+
+    std::string readPrefix(const std::string& path, size_t limit)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string data(limit, '\0');
+        in.read(data.data(), static_cast<std::streamsize>(limit));
+        data.resize(static_cast<size_t>(in.gcount()));
+        return data;
+    }
+
+    // Per-type dictionaries for the small files a dictionary archive primes
+    // with one; typeOf is each file's dictionary type, -1 for none
+    struct SharedDictionaries {
+        std::map<int, std::string> byType;
+        std::vector<int> typeOf;
+    };
+
+    SharedDictionaries trainDictionaries(const std::vector<std::string>& files,
+                                         const std::vector<ContentType::Kind>& kinds)
+    {
+        // Group small files by compressionType; already compressed files are stored
+        std::map<int, std::vector<size_t>> buckets;
+        for (size_t i = 0; i < files.size(); ++i) {
+            std::error_code ec;
+            auto fileSize = std::filesystem::file_size(files[i], ec);
+            if (ec || fileSize > kDictionaryFileLimit || ContentType::IsCompressed(kinds[i])) continue;
+
+            FileNode node(files[i], fileSize, kinds[i]);
+            if (node.compressionType == 0 || node.compressionType == 3) {
+                buckets[node.compressionType].push_back(i);
+            }
+        }
+
+        SharedDictionaries shared;
+        shared.typeOf.assign(files.size(), -1);
+        for (const auto& [type, members] : buckets) {
+            if (members.size() < kMinDictionaryFiles) continue;
+
+            DictionaryTrainer trainer;
+            size_t stride = std::max<size_t>(1, members.size() / kDictionarySamples);
+            for (size_t k = 0; k < members.size(); k += stride) {
+                trainer.AddSample(readPrefix(files[members[k]], DictionaryTrainer::kMaxSampleSize));
+            }
+
+            std::string dictionary = trainer.Train();
+            if (dictionary.empty()) continue;
+
+            shared.byType[type] = std::move(dictionary);
+            for (size_t idx : members) {
+                shared.typeOf[idx] = type;
+            }
+        }
+        return shared;
+    }
+}
 
 wxBEGIN_EVENT_TABLE(EnhancedZipPanel, wxPanel)
     EVT_BUTTON(ID_BROWSE_FILES, EnhancedZipPanel::OnBrowseFiles)
@@ -29,6 +123,12 @@ wxBEGIN_EVENT_TABLE(EnhancedZipPanel, wxPanel)
     EVT_BUTTON(ID_BROWSE_OUTPUT, EnhancedZipPanel::OnBrowseOutput)
     EVT_CHOICE(ID_COMPRESSION_CHANGE, EnhancedZipPanel::OnCompressionChange)
     EVT_BUTTON(ID_OPTIMIZE_ORDER, EnhancedZipPanel::OnOptimizeOrder)
+    EVT_BUTTON(ID_ESTIMATE_SIZE, EnhancedZipPanel::OnEstimateSize)
+    EVT_CHECKBOX(ID_SOLID_MODE, EnhancedZipPanel::OnArchiveModeChange)
+    EVT_CHECKBOX(ID_SPLIT_MODE, EnhancedZipPanel::OnArchiveModeChange)
+    EVT_CHECKBOX(ID_SHARED_DICTIONARY, EnhancedZipPanel::OnArchiveModeChange)
+    EVT_CHECKBOX(ID_USE_CACHE, EnhancedZipPanel::OnArchiveModeChange)
+    EVT_CHOICE(ID_FORMAT_CHANGE, EnhancedZipPanel::OnFormatChange)
 wxEND_EVENT_TABLE()
 
 EnhancedZipPanel::EnhancedZipPanel(wxWindow* parent)
@@ -38,16 +138,30 @@ EnhancedZipPanel::EnhancedZipPanel(wxWindow* parent)
     setupUI();
 }
 
-EnhancedZipPanel::~EnhancedZipPanel() = default;
+EnhancedZipPanel::~EnhancedZipPanel()
+{
+    // The estimate posts its result back to this panel, so it ends first;
+    // anything it already posted is dropped with the panel's event queue
+    m_closing = true;
+    if (m_estimateThread.joinable()) {
+        m_estimateThread.join();
+    }
+}
 
 void EnhancedZipPanel::updateFileList()
 {
+    // The list is rebuilt anyway, so this is the time to drop removed paths
+    if (m_selection.GetRemovedCount() > m_selection.Size()) {
+        m_selection.Compact();
+    }
+
     m_fileList->DeleteAllItems();
-    for (size_t i = 0; i < m_selectedFiles.size(); ++i) {
-        const auto& filePath = m_selectedFiles[i];
-        auto filename = std::filesystem::path(filePath).filename().string();
+    auto ids = m_selection.Ids();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        std::string_view filePath = m_selection.Get(ids[i]).Path();
+        auto filename = std::string(filePath.substr(filePath.find_last_of('/') + 1));
         m_fileList->InsertItem(i, filename);
-        m_fileList->SetItem(i, 1, filePath);
+        m_fileList->SetItem(i, 1, std::string(filePath));
     }
 }
 
@@ -55,7 +169,7 @@ void EnhancedZipPanel::OnOptimizeOrder(wxCommandEvent& event)
 {
     wxMutexLocker lock(m_mutex);
 
-    if (m_selectedFiles.empty()) {
+    if (m_selection.Empty()) {
         wxMessageBox("Please add files to optimize", "No Files Selected",
                     wxOK | wxICON_INFORMATION);
         return;
@@ -67,29 +181,38 @@ void EnhancedZipPanel::OnOptimizeOrder(wxCommandEvent& event)
     m_browseFolderBtn->Disable();
     updateProgress(0, "Optimizing file order...");
 
-    m_pathOptimizer->Clear();
-
-    // Add files to optimizer
-    for (const auto& filePath : m_selectedFiles) {
-        std::error_code ec;
-        auto fileSize = std::filesystem::file_size(filePath, ec);
-        if (!ec) {
-            m_pathOptimizer->AddFile(filePath, fileSize);
+    RefinedOrder refined;
+    {
+        Trace::Span span("optimize");
+        m_pathOptimizer->Clear();
+
+        // Size and content kind are cached in the selection; only files
+        // added since the last run are opened
+        m_selection.Resolve();
+        for (FileSet::Id id : m_selection.Ids()) {
+            const auto& entry = m_selection.Get(id);
+            if (entry.exists) {
+                m_pathOptimizer->AddFile(id, entry.size, entry.kind);
+            }
         }
-    }
 
-    // Build graph and get optimized order
-    m_pathOptimizer->BuildCompressionGraph();
-    auto optimizedFiles = m_pathOptimizer->GetOptimizedFileOrder();
+        // Best constructive order, refined within a fixed time budget
+        refined = m_pathOptimizer->RefineOrder(std::chrono::milliseconds(200));
 
-    // Update file list with new order
-    m_selectedFiles.clear();
-    for (const auto& fileNode : optimizedFiles) {
-        m_selectedFiles.push_back(fileNode.path);
+        // Update file list with new order; missing files go last
+        std::vector<FileSet::Id> order;
+        order.reserve(refined.order.size());
+        for (size_t index : refined.order) {
+            order.push_back(static_cast<FileSet::Id>(m_pathOptimizer->GetFile(index).id));
+        }
+        m_selection.Reorder(order);
+        m_pathOptimizer->Clear();
     }
+    Trace::Dump();
 
     updateFileList();
-    updateProgress(100, "File order optimized for compression");
+    updateProgress(100, wxString::Format("File order optimized for compression (score %.3f, %zu passes)",
+                                         refined.score, refined.passes).ToStdString());
 
     m_optimizeBtn->Enable();
     m_createBtn->Enable();
@@ -100,11 +223,90 @@ void EnhancedZipPanel::OnOptimizeOrder(wxCommandEvent& event)
                 wxOK | wxICON_INFORMATION);
 }
 
+void EnhancedZipPanel::OnEstimateSize(wxCommandEvent& event)
+{
+    wxMutexLocker lock(m_mutex);
+
+    if (m_selection.Empty()) {
+        wxMessageBox("Please add files to estimate", "No Files Selected",
+                    wxOK | wxICON_INFORMATION);
+        return;
+    }
+
+    m_estimateBtn->Disable();
+    updateProgress(0, "Estimating archive size...");
+
+    // Solid, split, cached and compressed tar archives compress on every
+    // core; plain and dictionary archives add one file at a time
+    ArchiveOptions options = getArchiveOptions();
+    bool parallel = options.split || options.solid || options.useCache ||
+                    (options.tar && options.tarCompression != TarFormat::Compression::None);
+    std::vector<std::string> files = m_selection.Paths();
+    uint64_t version = m_selection.GetVersion();
+
+    // Started only once the last estimate has posted its result
+    if (m_estimateThread.joinable()) {
+        m_estimateThread.join();
+    }
+    m_estimateThread = std::thread([this, options, parallel, files, version]() {
+        SizeEstimator estimator(options, parallel ? DefaultThreadCount() : 1);
+
+        // The dictionaries createZipArchive would train, when it trains any
+        std::vector<int> dictionaryOf(files.size(), -1);
+        if (!options.tar && !options.split && !options.solid && options.sharedDictionary &&
+            options.compressionLevel != Z_NO_COMPRESSION) {
+            SharedDictionaries shared = trainDictionaries(files, ContentType::ClassifyAll(files));
+            std::map<int, int> added;
+            for (const auto& [type, dictionary] : shared.byType) {
+                added[type] = estimator.AddDictionary(dictionary);
+            }
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (shared.typeOf[i] >= 0) dictionaryOf[i] = added[shared.typeOf[i]];
+            }
+        }
+        for (size_t i = 0; i < files.size(); ++i) {
+            estimator.AddFile(files[i], dictionaryOf[i]);
+        }
+
+        SizeEstimator::Estimate estimate;
+        bool success = estimator.Run(estimate, &m_closing);
+        Trace::Dump();
+        if (m_closing) return;
+
+        std::map<std::string, std::string> perFile;
+        for (const auto& file : estimator.GetFiles()) {
+            perFile[file.path] = (file.sampled ? "" : "~") + formatBytes(file.compressed);
+        }
+        std::string status = success
+            ? "Estimated archive size " + formatBytes(estimate.compressed) +
+              " (" + formatBytes(estimate.compressedLow) + " - " + formatBytes(estimate.compressedHigh) +
+              ") from " + formatBytes(static_cast<double>(estimate.uncompressedBytes)) +
+              "; compressing takes about " + formatDuration(estimate.seconds) +
+              " (" + formatDuration(estimate.secondsLow) + " - " + formatDuration(estimate.secondsHigh) +
+              "). Sampled " + formatBytes(static_cast<double>(estimate.sampledBytes)) + "."
+            : estimator.GetLastError();
+
+        CallAfter([this, version, perFile, status]() {
+            m_estimateBtn->Enable();
+            m_progressBar->SetValue(100);
+            m_statusText->SetLabel(status);
+
+            // The list may have changed while the estimate ran
+            if (version != m_selection.GetVersion()) return;
+            auto ids = m_selection.Ids();
+            for (size_t i = 0; i < ids.size(); ++i) {
+                auto it = perFile.find(std::string(m_selection.Get(ids[i]).Path()));
+                if (it != perFile.end()) m_fileList->SetItem(i, 2, it->second);
+            }
+        });
+    });
+}
+
 void EnhancedZipPanel::OnCreateArchive(wxCommandEvent& event)
 {
     wxMutexLocker lock(m_mutex);
 
-    if (m_selectedFiles.empty()) {
+    if (m_selection.Empty()) {
         wxMessageBox("Please add files to create archive", "No Files Selected",
                     wxOK | wxICON_INFORMATION);
         return;
@@ -122,19 +324,16 @@ void EnhancedZipPanel::OnCreateArchive(wxCommandEvent& event)
     m_browseFolderBtn->Disable();
     m_optimizeBtn->Disable();
 
-    int compressionLevel = 6;
-    switch (m_compressionLevel->GetSelection()) {
-        case 0: compressionLevel = Z_NO_COMPRESSION; break;
-        case 1: compressionLevel = 1; break;
-        case 2: compressionLevel = 3; break;
-        case 3: compressionLevel = 6; break;
-        case 4: compressionLevel = Z_BEST_COMPRESSION; break;
-    }
-
-    std::vector<std::string> files = m_selectedFiles;
+    ArchiveOptions options = getArchiveOptions();
+    std::vector<std::string> files = m_selection.Paths();
 
-    std::thread([this, outputPath, compressionLevel, files]() {
-        bool success = createZipArchive(outputPath.ToStdString(), files, compressionLevel);
+    std::thread([this, outputPath, options, files]() {
+        bool success;
+        {
+            Trace::Span span("create archive");
+            success = createZipArchive(outputPath.ToStdString(), files, options);
+        }
+        Trace::Dump();
 
         CallAfter([this, success]() {
             m_createBtn->Enable();
@@ -149,61 +348,313 @@ void EnhancedZipPanel::OnCreateArchive(wxCommandEvent& event)
         });
     }).detach();
 }
-#include <zip.h>
 
 bool EnhancedZipPanel::createZipArchive(const std::string& outputPath,
                                        const std::vector<std::string>& files,
-                                       int compressionLevel)
+                                       const ArchiveOptions& options)
 {
-    int error;
-    zip_t *archive = zip_open(outputPath.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
-    if (!archive) {
-        char errorMsg[100];
-        zip_error_to_str(errorMsg, sizeof(errorMsg), error, errno);
-        updateProgress(0, std::string("Failed to create archive: ") + errorMsg);
+    // Modes that share a stream between files, prime deflate with a
+    // dictionary, span volumes or reuse cached payloads have their own writers
+    if (options.tar) {
+        return createTarArchive(outputPath, files, options);
+    }
+    if (options.split) {
+        return createSplitArchive(outputPath, files, options);
+    }
+    if (options.solid) {
+        return createSolidArchive(outputPath, files, options);
+    }
+    if (options.sharedDictionary && options.compressionLevel != Z_NO_COMPRESSION) {
+        return createDictionaryArchive(outputPath, files, options);
+    }
+    if (options.useCache) {
+        return createCachedArchive(outputPath, files, options);
+    }
+
+    // Plain archives go through ZipWriter too, not libzip, so they are
+    // deflated by the Codec backend (libdeflate when built in)
+    ZipWriter writer;
+    if (!writer.Open(outputPath)) {
+        updateProgress(0, writer.GetLastError());
         return false;
     }
 
+    // Already compressed content is stored rather than deflated again
+    auto kinds = ContentType::ClassifyAll(files);
+
+    // Entries are named by basename; the last file with a name replaces the
+    // earlier ones, as it did when libzip wrote these with ZIP_FL_OVERWRITE
+    std::map<std::string, size_t> lastWithName;
+    for (size_t i = 0; i < files.size(); ++i) {
+        lastWithName[std::filesystem::path(files[i]).filename().string()] = i;
+    }
+
     int filesAdded = 0;
-    for (const auto& filePath : files) {
-        std::error_code ec;
-        if (!std::filesystem::exists(filePath, ec)) {
-            updateProgress(0, "File not found: " + filePath);
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto& filePath = files[i];
+        auto filename = std::filesystem::path(filePath).filename().string();
+        if (lastWithName[filename] != i) continue;
+
+        int level = ContentType::IsCompressed(kinds[i]) ? Z_NO_COMPRESSION : options.compressionLevel;
+        if (!writer.AddFile(filePath, filename, level)) {
+            updateProgress(0, writer.GetLastError());
             continue;
         }
 
+        filesAdded++;
+        updateProgress((filesAdded * 100) / files.size(), "Added: " + filename);
+    }
+
+    if (!writer.Close()) {
+        updateProgress(0, "Failed to finalize archive");
+        return false;
+    }
+
+    updateProgress(100, "Archive created successfully");
+    return filesAdded > 0;
+}
+
+bool EnhancedZipPanel::createDictionaryArchive(const std::string& outputPath,
+                                              const std::vector<std::string>& files,
+                                              const ArchiveOptions& options)
+{
+    ZipWriter writer;
+    if (!writer.Open(outputPath)) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    updateProgress(0, "Training shared dictionaries...");
+
+    auto kinds = ContentType::ClassifyAll(files);
+    SharedDictionaries shared = trainDictionaries(files, kinds);
+    for (const auto& [type, dictionary] : shared.byType) {
+        if (!writer.AddDictionary("dict-" + std::to_string(type) + ".bin", dictionary)) {
+            updateProgress(0, writer.GetLastError());
+            return false;
+        }
+    }
+
+    const std::string noDictionary;
+    int filesAdded = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto& filePath = files[i];
         auto filename = std::filesystem::path(filePath).filename().string();
 
-        zip_source_t *source = zip_source_file(archive, filePath.c_str(), 0, -1);
-        if (!source) {
-            updateProgress(0, "Failed to create source for: " + filename);
+        const std::string& dictionary = shared.typeOf[i] >= 0 ? shared.byType[shared.typeOf[i]] : noDictionary;
+        int level = ContentType::IsCompressed(kinds[i]) ? Z_NO_COMPRESSION : options.compressionLevel;
+        if (!writer.AddFile(filePath, filename, level, dictionary)) {
+            updateProgress(0, writer.GetLastError());
             continue;
         }
 
-        zip_int64_t index = zip_file_add(archive, filename.c_str(), source, ZIP_FL_OVERWRITE);
-        if (index < 0) {
-            zip_source_free(source);
+        filesAdded++;
+        updateProgress((filesAdded * 100) / files.size(), "Added: " + filename);
+    }
+
+    if (!writer.Close()) {
+        updateProgress(0, "Failed to finalize archive");
+        return false;
+    }
+
+    updateProgress(100, "Archive created successfully");
+    return filesAdded > 0;
+}
+
+bool EnhancedZipPanel::createSolidArchive(const std::string& outputPath,
+                                          const std::vector<std::string>& files,
+                                          const ArchiveOptions& options)
+{
+    ZipWriter writer;
+    if (!writer.Open(outputPath)) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    // Files keep the list order, which is what makes "Optimize Order" pay off here
+    SolidArchiveWriter solid(options.solidBlockSize, options.compressionLevel);
+    for (const auto& filePath : files) {
+        if (!solid.AddFile(filePath, std::filesystem::path(filePath).filename().string())) {
+            updateProgress(0, solid.GetLastError());
+        }
+    }
+
+    bool written = solid.WriteTo(writer, [this](int percent, const std::string& status) {
+        updateProgress(percent, status);
+    });
+    if (!written) {
+        updateProgress(0, solid.GetLastError());
+        return false;
+    }
+
+    if (!writer.Close()) {
+        updateProgress(0, "Failed to finalize archive");
+        return false;
+    }
+
+    updateProgress(100, "Archive created successfully");
+    return solid.GetMemberCount() > 0;
+}
+
+bool EnhancedZipPanel::createCachedArchive(const std::string& outputPath,
+                                           const std::vector<std::string>& files,
+                                           const ArchiveOptions& options)
+{
+    CompressionCache cache(CompressionCache::DefaultDirectory(), options.cacheCapacity);
+    if (!cache.Open()) {
+        updateProgress(0, cache.GetLastError());
+        return false;
+    }
+
+    ZipWriter writer;
+    if (!writer.Open(outputPath)) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    // Misses are compressed into the cache in parallel; hits are not read at all
+    struct Prepared {
+        ZipWriterEntry entry;
+        std::string payload;
+        bool ok{false};
+    };
+    std::vector<Prepared> prepared(files.size());
+    auto kinds = ContentType::ClassifyAll(files);
+    auto levelFor = [&](size_t i) {
+        return ContentType::IsCompressed(kinds[i]) ? Z_NO_COMPRESSION : options.compressionLevel;
+    };
+    std::atomic<size_t> done{0};
+    ParallelFor(files.size(), DefaultThreadCount(), [&](size_t i) {
+        CompressionCache::Key key;
+        CompressionCache::Record record;
+        auto& item = prepared[i];
+        if (CompressionCache::MakeKey(files[i], key) &&
+            (cache.Lookup(key, levelFor(i), record, item.payload) ||
+             cache.Store(key, levelFor(i), record, item.payload))) {
+            item.entry.name = std::filesystem::path(files[i]).filename().string();
+            item.entry.method = record.method;
+            if (record.method == ZipFormat::kMethodDeflate) {
+                item.entry.flags |= ZipFormat::DeflateOptionFlags(levelFor(i));
+            }
+            item.entry.crc = record.crc;
+            item.entry.compressedSize = record.compressedSize;
+            item.entry.uncompressedSize = record.uncompressedSize;
+            item.entry.dosDateTime = ZipFormat::ToDosDateTime(
+                static_cast<std::time_t>(key.mtimeNs / 1000000000));
+            item.entry.externalAttributes = (key.mode & 0xffff) << 16;
+            item.ok = true;
+        }
+
+        size_t count = ++done;
+        if (count % 64 == 0) {
+            updateProgress(static_cast<int>(count * 90 / files.size()), "Compressing...");
+        }
+    });
+
+    int filesAdded = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto filename = std::filesystem::path(files[i]).filename().string();
+        if (!prepared[i].ok) {
             updateProgress(0, "Failed to add file: " + filename);
             continue;
         }
 
-        // Set compression level
-        if (zip_set_file_compression(archive, index, ZIP_CM_DEFLATE,
-                                   static_cast<uint32_t>(compressionLevel)) < 0) {
-            updateProgress(0, "Failed to set compression for: " + filename);
+        // Another job may have evicted the payload in the meantime
+        bool added = false;
+        if (std::FILE* payload = std::fopen(prepared[i].payload.c_str(), "rb")) {
+            added = writer.AddCompressed(prepared[i].entry, [payload](char* buffer, size_t size) {
+                return std::fread(buffer, 1, size, payload);
+            });
+            std::fclose(payload);
+        } else {
+            added = writer.AddFile(files[i], filename, levelFor(i));
+        }
+        if (!added) {
+            updateProgress(0, writer.GetLastError());
             continue;
-                                   }
-
+        }
         filesAdded++;
-        updateProgress((filesAdded * 100) / files.size(), "Added: " + filename);
     }
 
-    if (zip_close(archive) < 0) {
+    if (!writer.Close()) {
         updateProgress(0, "Failed to finalize archive");
         return false;
     }
 
-    updateProgress(100, "Archive created successfully");
+    bool flushed = cache.Flush();
+    auto stats = cache.GetStats();
+    updateProgress(100, "Archive created: " + std::to_string(stats.hits) + " cached, " +
+                        std::to_string(stats.misses) + " compressed, " +
+                        std::to_string(stats.bytesReused >> 20) + " MB reused" +
+                        (flushed ? "" : " (cache not saved: " + cache.GetLastError() + ")"));
+    return filesAdded > 0;
+}
+
+bool EnhancedZipPanel::createSplitArchive(const std::string& outputPath,
+                                          const std::vector<std::string>& files,
+                                          const ArchiveOptions& options)
+{
+    SplitArchiveWriter writer(outputPath, options.volumeSize, options.compressionLevel);
+    auto kinds = ContentType::ClassifyAll(files);
+    size_t filesAdded = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto& filePath = files[i];
+        if (writer.AddFile(filePath, std::filesystem::path(filePath).filename().string(),
+                           ContentType::IsCompressed(kinds[i]))) {
+            ++filesAdded;
+        } else {
+            updateProgress(0, writer.GetLastError());
+        }
+    }
+
+    bool written = writer.Write(
+        [this](int percent, const std::string& status) {
+            updateProgress(percent, status);
+        },
+        [this](const std::string& volumePath) {
+            CallAfter([this, volumePath]() {
+                m_statusText->SetLabel("Finished volume " + volumePath);
+            });
+        });
+    if (!written) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    filesAdded -= writer.GetSkippedCount();
+    updateProgress(100, "Archive created in " + std::to_string(writer.GetVolumeCount()) + " volumes");
+    return filesAdded > 0;
+}
+
+bool EnhancedZipPanel::createTarArchive(const std::string& outputPath,
+                                        const std::vector<std::string>& files,
+                                        const ArchiveOptions& options)
+{
+    TarWriter writer(options.tarCompression, options.compressionLevel);
+    if (!writer.Open(outputPath)) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    size_t filesAdded = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto filename = std::filesystem::path(files[i]).filename().string();
+        if (writer.AddFile(files[i], filename)) {
+            ++filesAdded;
+            updateProgress(static_cast<int>((i + 1) * 100 / files.size()), "Added: " + filename);
+        } else {
+            updateProgress(0, writer.GetLastError());
+        }
+    }
+
+    if (!writer.Close()) {
+        updateProgress(0, writer.GetLastError());
+        return false;
+    }
+
+    updateProgress(100, std::string("Created ") + TarFormat::Name(options.tarCompression) + ": " +
+                        formatBytes(static_cast<double>(writer.GetTarBytes())) + " -> " +
+                        formatBytes(static_cast<double>(writer.GetBytesWritten())));
     return filesAdded > 0;
 }
 
@@ -232,6 +683,7 @@ void EnhancedZipPanel::setupUI() {
                                wxLC_REPORT | wxLC_SINGLE_SEL);
     m_fileList->InsertColumn(0, "File Name", wxLIST_FORMAT_LEFT, 500);
     m_fileList->InsertColumn(1, "Path", wxLIST_FORMAT_LEFT, 300);
+    m_fileList->InsertColumn(2, "Estimated Size", wxLIST_FORMAT_RIGHT, 120);
     mainSizer->Add(m_fileList, 1, wxEXPAND | wxALL, 5);
 
     // Buttons panel
@@ -243,12 +695,16 @@ void EnhancedZipPanel::setupUI() {
     m_removeBtn = new wxButton(buttonPanel, ID_REMOVE_SELECTED, "Remove");
     m_clearBtn = new wxButton(buttonPanel, ID_CLEAR_ALL, "Clear All");
     m_optimizeBtn = new wxButton(buttonPanel, ID_OPTIMIZE_ORDER, "Optimize Order");
+    m_estimateBtn = new wxButton(buttonPanel, ID_ESTIMATE_SIZE, "Estimate Size");
+    m_estimateBtn->SetToolTip("Trial-compress samples of the selection with the chosen "
+                              "settings to predict the archive size and compression time.");
 
     buttonSizer->Add(m_browseFilesBtn, 0, wxRIGHT, 5);
     buttonSizer->Add(m_browseFolderBtn, 0, wxRIGHT, 5);
     buttonSizer->Add(m_removeBtn, 0, wxRIGHT, 5);
     buttonSizer->Add(m_clearBtn, 0, wxRIGHT, 5);
-    buttonSizer->Add(m_optimizeBtn, 0);
+    buttonSizer->Add(m_optimizeBtn, 0, wxRIGHT, 5);
+    buttonSizer->Add(m_estimateBtn, 0);
 
     buttonPanel->SetSizer(buttonSizer);
     mainSizer->Add(buttonPanel, 0, wxALL, 5);
@@ -261,8 +717,23 @@ void EnhancedZipPanel::setupUI() {
     m_outputPath = new wxTextCtrl(outputPanel, wxID_ANY, getDefaultOutputPath());
     m_browseOutputBtn = new wxButton(outputPanel, ID_BROWSE_OUTPUT, "Browse");
 
+    // zstd formats are only offered when built with libzstd
+    m_format = new wxChoice(outputPanel, ID_FORMAT_CHANGE);
+    m_format->Append("ZIP");
+    for (auto compression : {TarFormat::Compression::None, TarFormat::Compression::Gzip,
+                             TarFormat::Compression::Zstd, TarFormat::Compression::SeekableZstd}) {
+        if (TarWriter::Supports(compression)) {
+            m_format->Append(TarFormat::Name(compression));
+            m_tarFormats.push_back(compression);
+        }
+    }
+    m_format->SetSelection(0);
+    m_format->SetToolTip("tar.gz is compressed in parallel blocks any gunzip reads; seekable "
+                         "tar.zst lets single files be extracted without decoding the rest.");
+
     outputSizer->Add(m_outputLabel, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
     outputSizer->Add(m_outputPath, 1, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    outputSizer->Add(m_format, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
     outputSizer->Add(m_browseOutputBtn, 0, wxALIGN_CENTER_VERTICAL);
 
     outputPanel->SetSizer(outputSizer);
@@ -278,7 +749,37 @@ void EnhancedZipPanel::setupUI() {
     m_compressionLevel->SetSelection(3); // Normal compression by default
 
     compressionSizer->Add(m_compressionLabel, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
-    compressionSizer->Add(m_compressionLevel, 0, wxALIGN_CENTER_VERTICAL);
+    compressionSizer->Add(m_compressionLevel, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+
+    m_sharedDictionary = new wxCheckBox(compressionPanel, ID_SHARED_DICTIONARY, "Shared dictionary for small files");
+    m_sharedDictionary->SetToolTip("Train a dictionary per file type and store it in the archive. "
+                                   "Only ArchiveManager can extract these entries.");
+    compressionSizer->Add(m_sharedDictionary, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+
+    m_solidMode = new wxCheckBox(compressionPanel, ID_SOLID_MODE, "Solid blocks:");
+    m_solidMode->SetToolTip("Compress consecutive files as one stream so similar neighbours "
+                            "share a window. Only ArchiveManager can extract the files.");
+    m_solidBlockSize = new wxChoice(compressionPanel, wxID_ANY);
+    m_solidBlockSize->Append(std::vector<wxString>{"1 MB", "4 MB", "16 MB", "64 MB"});
+    m_solidBlockSize->SetSelection(2);
+    m_solidBlockSize->Disable();
+    compressionSizer->Add(m_solidMode, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    compressionSizer->Add(m_solidBlockSize, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+
+    m_splitMode = new wxCheckBox(compressionPanel, ID_SPLIT_MODE, "Split into volumes:");
+    m_splitMode->SetToolTip("Write name.z01, name.z02, ... and name.zip, each no larger "
+                            "than the chosen size.");
+    m_volumeSize = new wxChoice(compressionPanel, wxID_ANY);
+    m_volumeSize->Append(std::vector<wxString>{"100 MB", "650 MB", "2 GB", "4 GB (FAT32)"});
+    m_volumeSize->SetSelection(1);
+    m_volumeSize->Disable();
+    compressionSizer->Add(m_splitMode, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    compressionSizer->Add(m_volumeSize, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+
+    m_useCache = new wxCheckBox(compressionPanel, ID_USE_CACHE, "Reuse compression cache");
+    m_useCache->SetToolTip("Keep compressed copies of files in " + CompressionCache::DefaultDirectory() +
+                           " and reuse them for unchanged files next time.");
+    compressionSizer->Add(m_useCache, 0, wxALIGN_CENTER_VERTICAL);
 
     compressionPanel->SetSizer(compressionSizer);
     mainSizer->Add(compressionPanel, 0, wxALL, 5);
@@ -298,10 +799,57 @@ void EnhancedZipPanel::setupUI() {
 }
 
 void EnhancedZipPanel::addFilesToList(const std::vector<std::string>& files) {
+    size_t added = 0;
     for (const auto& file : files) {
-        m_selectedFiles.push_back(file);
+        added += m_selection.Add(file);
     }
     updateFileList();
+    reportAdded(added, files.size() - added);
+}
+
+void EnhancedZipPanel::reportAdded(size_t added, size_t duplicates) {
+    wxString status = wxString::Format("Added %zu files", added);
+    if (duplicates > 0) {
+        status += wxString::Format(" (%zu already selected)", duplicates);
+    }
+    m_statusText->SetLabel(status);
+}
+
+ArchiveOptions EnhancedZipPanel::getArchiveOptions() const
+{
+    ArchiveOptions options;
+    int format = m_format->GetSelection();
+    if (format > 0) {
+        options.tar = true;
+        options.tarCompression = m_tarFormats[format - 1];
+    }
+
+    switch (m_compressionLevel->GetSelection()) {
+        case 0: options.compressionLevel = Z_NO_COMPRESSION; break;
+        case 1: options.compressionLevel = 1; break;
+        case 2: options.compressionLevel = 3; break;
+        case 3: options.compressionLevel = 6; break;
+        case 4: options.compressionLevel = Z_BEST_COMPRESSION; break;
+    }
+
+    options.sharedDictionary = m_sharedDictionary->GetValue();
+    options.solid = m_solidMode->GetValue();
+    switch (m_solidBlockSize->GetSelection()) {
+        case 0: options.solidBlockSize = 1ull << 20; break;
+        case 1: options.solidBlockSize = 4ull << 20; break;
+        case 2: options.solidBlockSize = 16ull << 20; break;
+        case 3: options.solidBlockSize = 64ull << 20; break;
+    }
+
+    options.useCache = m_useCache->GetValue();
+    options.split = m_splitMode->GetValue();
+    switch (m_volumeSize->GetSelection()) {
+        case 0: options.volumeSize = 100ull << 20; break;
+        case 1: options.volumeSize = 650ull << 20; break;
+        case 2: options.volumeSize = 2048ull << 20; break;
+        case 3: options.volumeSize = (4096ull << 20) - 1; break;
+    }
+    return options;
 }
 
 std::string EnhancedZipPanel::getDefaultOutputPath() const {
@@ -313,7 +861,7 @@ std::string EnhancedZipPanel::getDefaultOutputPath() const {
 void EnhancedZipPanel::OnClearAll(wxCommandEvent& event) {
     if (m_fileList) {
         m_fileList->DeleteAllItems();
-        m_selectedFiles.clear();
+        m_selection.Clear();
     }
 }
 
@@ -329,10 +877,12 @@ void EnhancedZipPanel::OnBrowseFiles(wxCommandEvent& event) {
     wxArrayString paths;
     dialog.GetPaths(paths);
 
+    size_t added = 0;
     for (const auto& path : paths) {
-        m_selectedFiles.push_back(path.ToStdString());
+        added += m_selection.Add(path.ToStdString());
     }
     updateFileList();
+    reportAdded(added, paths.size() - added);
 }
 
 void EnhancedZipPanel::OnBrowseFolder(wxCommandEvent& event) {
@@ -347,20 +897,30 @@ void EnhancedZipPanel::OnBrowseFolder(wxCommandEvent& event) {
     std::filesystem::path folder(dirPath.ToStdString());
 
     try {
+        Trace::Span span("scan");
+        size_t added = 0;
+        size_t duplicates = 0;
         for (const auto& entry : std::filesystem::recursive_directory_iterator(folder)) {
             if (entry.is_regular_file()) {
-                m_selectedFiles.push_back(entry.path().string());
+                if (m_selection.Add(entry.path().native())) {
+                    ++added;
+                } else {
+                    ++duplicates;
+                }
             }
         }
         updateFileList();
+        reportAdded(added, duplicates);
     } catch (const std::filesystem::filesystem_error& e) {
         wxMessageBox(e.what(), "Error", wxOK | wxICON_ERROR);
     }
 }
 
 void EnhancedZipPanel::OnBrowseOutput(wxCommandEvent& event) {
-    wxFileDialog dialog(this, "Save ZIP file", "", "",
-                       "ZIP files (*.zip)|*.zip",
+    ArchiveOptions options = getArchiveOptions();
+    wxString extension = options.tar ? TarFormat::Extension(options.tarCompression) : ".zip";
+    wxFileDialog dialog(this, "Save archive", "", "",
+                       "Archives (*" + extension + ")|*" + extension,
                        wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
 
     if (dialog.ShowModal() == wxID_CANCEL) {
@@ -381,14 +941,48 @@ void EnhancedZipPanel::OnRemoveSelected(wxCommandEvent& event) {
     }
 
     wxString path = m_fileList->GetItemText(item, 1);
-    auto it = std::find(m_selectedFiles.begin(), m_selectedFiles.end(), path.ToStdString());
-    if (it != m_selectedFiles.end()) {
-        m_selectedFiles.erase(it);
-    }
+    m_selection.Remove(path.ToStdString());
 
     m_fileList->DeleteItem(item);
 }
 
+void EnhancedZipPanel::OnArchiveModeChange(wxCommandEvent& event) {
+    // Within a solid stream a shared dictionary brings nothing, and split
+    // archives are plain DEFLATE so other tools can join and read them.
+    // Tar archives are one stream already and take none of the ZIP modes.
+    // Cached payloads are plain DEFLATE, so the cache and a shared
+    // dictionary exclude each other.
+    bool zip = m_format->GetSelection() == 0;
+    bool split = m_splitMode->GetValue();
+    bool solid = m_solidMode->GetValue() && !split;
+    bool dictionary = m_sharedDictionary->GetValue();
+    bool cache = m_useCache->GetValue() && !dictionary;
+    m_splitMode->Enable(zip);
+    m_volumeSize->Enable(zip && split);
+    m_solidMode->Enable(zip && !split);
+    m_solidBlockSize->Enable(zip && solid);
+    m_sharedDictionary->Enable(zip && !solid && !split && !cache);
+    m_useCache->Enable(zip && !solid && !split && !dictionary);
+}
+
+void EnhancedZipPanel::OnFormatChange(wxCommandEvent& event) {
+    ArchiveOptions options = getArchiveOptions();
+
+    // Swap the extension of the output path for the new format's
+    std::string path = m_outputPath->GetValue().ToStdString();
+    for (const char* known : {".tar.gz", ".tgz", ".tar.zst", ".tar", ".zip"}) {
+        size_t length = std::strlen(known);
+        if (path.size() > length && path.compare(path.size() - length, length, known) == 0) {
+            path.resize(path.size() - length);
+            path += options.tar ? TarFormat::Extension(options.tarCompression) : ".zip";
+            m_outputPath->SetValue(path);
+            break;
+        }
+    }
+
+    OnArchiveModeChange(event);
+}
+
 void EnhancedZipPanel::OnCompressionChange(wxCommandEvent& event) {
     // Nothing special needed here as the compression level is read directly
     // when creating the archive
@@ -10,10 +10,14 @@
 #include <wx/filedlg.h>
 #include <wx/dirdlg.h>
 #include <wx/thread.h>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
 #include <memory>
+#include "FileSet.h"
 #include "PathOptimizer.h"
+#include "ArchiveOptions.h"
 
 class EnhancedZipPanel : public wxPanel {
 public:
@@ -34,6 +38,9 @@ private:
     void OnBrowseOutput(wxCommandEvent& event);
     void OnCompressionChange(wxCommandEvent& event);
     void OnOptimizeOrder(wxCommandEvent& event);
+    void OnEstimateSize(wxCommandEvent& event);
+    void OnArchiveModeChange(wxCommandEvent& event);
+    void OnFormatChange(wxCommandEvent& event);
 
     // UI Components
     wxStaticText* m_titleLabel{nullptr};
@@ -43,31 +50,59 @@ private:
     wxButton* m_removeBtn{nullptr};
     wxButton* m_clearBtn{nullptr};
     wxButton* m_optimizeBtn{nullptr};
+    wxButton* m_estimateBtn{nullptr};
 
     wxStaticText* m_outputLabel{nullptr};
     wxTextCtrl* m_outputPath{nullptr};
     wxButton* m_browseOutputBtn{nullptr};
+    wxChoice* m_format{nullptr};
 
     wxStaticText* m_compressionLabel{nullptr};
     wxChoice* m_compressionLevel{nullptr};
+    wxCheckBox* m_sharedDictionary{nullptr};
+    wxCheckBox* m_solidMode{nullptr};
+    wxChoice* m_solidBlockSize{nullptr};
+    wxCheckBox* m_splitMode{nullptr};
+    wxChoice* m_volumeSize{nullptr};
+    wxCheckBox* m_useCache{nullptr};
 
     wxButton* m_createBtn{nullptr};
     wxGauge* m_progressBar{nullptr};
     wxStaticText* m_statusText{nullptr};
 
     // Data members
-    std::vector<std::string> m_selectedFiles;
+    FileSet m_selection;
     std::unique_ptr<PathOptimizer> m_pathOptimizer;
+    std::vector<TarFormat::Compression> m_tarFormats; // behind "ZIP" in m_format
     wxMutex m_mutex; // For thread safety
+    std::thread m_estimateThread;
+    std::atomic<bool> m_closing{false}; // stops the estimate when the panel goes
 
     // Helper methods
     void setupUI();
     void updateFileList();
     void addFilesToList(const std::vector<std::string>& files);
+    void reportAdded(size_t added, size_t duplicates);
     bool createZipArchive(const std::string& outputPath,
                          const std::vector<std::string>& files,
-                         int compressionLevel);
+                         const ArchiveOptions& options);
+    bool createDictionaryArchive(const std::string& outputPath,
+                                 const std::vector<std::string>& files,
+                                 const ArchiveOptions& options);
+    bool createSolidArchive(const std::string& outputPath,
+                            const std::vector<std::string>& files,
+                            const ArchiveOptions& options);
+    bool createCachedArchive(const std::string& outputPath,
+                             const std::vector<std::string>& files,
+                             const ArchiveOptions& options);
+    bool createSplitArchive(const std::string& outputPath,
+                            const std::vector<std::string>& files,
+                            const ArchiveOptions& options);
+    bool createTarArchive(const std::string& outputPath,
+                          const std::vector<std::string>& files,
+                          const ArchiveOptions& options);
     void updateProgress(int percent, const std::string& status);
+    ArchiveOptions getArchiveOptions() const;
     std::string getDefaultOutputPath() const;
 
     enum {
@@ -78,7 +113,13 @@ private:
         ID_CREATE_ARCHIVE,
         ID_BROWSE_OUTPUT,
         ID_COMPRESSION_CHANGE,
-        ID_OPTIMIZE_ORDER
+        ID_OPTIMIZE_ORDER,
+        ID_ESTIMATE_SIZE,
+        ID_SOLID_MODE,
+        ID_SPLIT_MODE,
+        ID_FORMAT_CHANGE,
+        ID_SHARED_DICTIONARY,
+        ID_USE_CACHE
     };
 
     wxDECLARE_EVENT_TABLE();
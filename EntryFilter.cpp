@@ -0,0 +1,237 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "EntryFilter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Matches c against the class starting after '['; p is left after the ']'
+    bool matchClass(const char*& p, char c)
+    {
+        const char* q = p;
+        bool negate = *q == '!' || *q == '^';
+        if (negate) ++q;
+
+        bool found = false;
+        bool first = true;
+        for (; *q && (*q != ']' || first); first = false) {
+            char low = *q == '\\' && q[1] ? *++q : *q;
+            ++q;
+            char high = low;
+            if (q[0] == '-' && q[1] && q[1] != ']') {
+                high = q[1] == '\\' && q[2] ? q[2] : q[1];
+                q += q[1] == '\\' && q[2] ? 3 : 2;
+            }
+            if (c >= low && c <= high) found = true;
+        }
+        p = *q ? q + 1 : q;
+        return found != negate && c != '/';
+    }
+
+    // n runs to end; the pattern is NUL-terminated
+    bool globMatch(const char* p, const char* n, const char* end)
+    {
+        for (;;) {
+            switch (*p) {
+            case '\0':
+                return n == end;
+            case '*':
+                if (p[1] == '*') {
+                    // "**/" may also stand for no directory at all
+                    const char* rest = p + 2;
+                    if (*rest == '/' && globMatch(rest + 1, n, end)) return true;
+                    for (const char* s = n;; ++s) {
+                        if (globMatch(rest, s, end)) return true;
+                        if (s == end) return false;
+                    }
+                }
+                for (const char* s = n;; ++s) {
+                    if (globMatch(p + 1, s, end)) return true;
+                    if (s == end || *s == '/') return false;
+                }
+            case '?':
+                if (n == end || *n == '/') return false;
+                ++p;
+                ++n;
+                break;
+            case '[': {
+                // An unterminated '[' is an ordinary character; a ']' right
+                // after it is a member, so the search starts one further
+                if (p[1] == '\0' || !std::strchr(p + 2, ']')) {
+                    if (n == end || *n != '[') return false;
+                    ++p;
+                    ++n;
+                    break;
+                }
+                if (n == end) return false;
+                ++p;
+                if (!matchClass(p, *n)) return false;
+                ++n;
+                break;
+            }
+            case '\\':
+                if (p[1]) ++p;
+                [[fallthrough]];
+            default:
+                if (n == end || *p != *n) return false;
+                ++p;
+                ++n;
+                break;
+            }
+        }
+    }
+
+    std::string globLiteralPrefix(const std::string& pattern)
+    {
+        size_t end = pattern.find_first_of("*?[\\");
+        return pattern.substr(0, end);
+    }
+
+    // "^abc" and "^abc+" need names starting with "abc"; anything less
+    // certain (alternation, an optional last character) gives no prefix
+    std::string regexLiteralPrefix(const std::string& pattern)
+    {
+        if (pattern.empty() || pattern[0] != '^' || pattern.find('|') != std::string::npos) return "";
+        std::string literal;
+        for (size_t i = 1; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            if (std::strchr(".[]()*+?{}\\^$", c)) {
+                if ((c == '*' || c == '?' || c == '{') && !literal.empty()) literal.pop_back();
+                break;
+            }
+            literal += c;
+        }
+        return literal;
+    }
+}
+
+bool EntryFilter::GlobMatches(const char* pattern, std::string_view name)
+{
+    return globMatch(pattern, name.data(), name.data() + name.size());
+}
+
+void EntryFilter::narrowPrefix(const std::string& literal)
+{
+    // Every clause has to hold, so the longest literal is the tightest range
+    if (literal.size() > m_literalPrefix.size()) m_literalPrefix = literal;
+}
+
+void EntryFilter::AddPrefix(const std::string& prefix)
+{
+    m_prefixes.push_back(prefix);
+    narrowPrefix(prefix);
+}
+
+void EntryFilter::AddGlob(const std::string& pattern)
+{
+    Glob glob;
+    glob.pattern = pattern;
+    glob.basename = pattern.find('/') == std::string::npos;
+    if (!glob.basename) narrowPrefix(globLiteralPrefix(pattern));
+    m_globs.push_back(std::move(glob));
+}
+
+bool EntryFilter::AddRegex(const std::string& pattern)
+{
+    try {
+        m_regexes.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& e) {
+        m_lastError = "Invalid regular expression " + pattern + ": " + e.what();
+        return false;
+    }
+    narrowPrefix(regexLiteralPrefix(pattern));
+    return true;
+}
+
+bool EntryFilter::Matches(std::string_view name) const
+{
+    for (const auto& prefix : m_prefixes) {
+        if (!name.starts_with(prefix)) return false;
+    }
+
+    for (const auto& glob : m_globs) {
+        std::string_view subject = name;
+        if (glob.basename) {
+            // Directory entries end in '/'; their last segment is the one before it
+            if (subject.size() > 1 && subject.back() == '/') subject.remove_suffix(1);
+            size_t slash = subject.find_last_of('/');
+            if (slash != std::string_view::npos) subject.remove_prefix(slash + 1);
+        }
+        if (!globMatch(glob.pattern.c_str(), subject.data(), subject.data() + subject.size())) return false;
+    }
+
+    for (const auto& regex : m_regexes) {
+        if (!std::regex_search(name.begin(), name.end(), regex)) return false;
+    }
+    return true;
+}
+
+EntryIndex::EntryIndex(const std::vector<ZipEntryInfo>& entries, unsigned threads)
+{
+    m_sorted.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].IsInternal()) m_sorted.push_back({entries[i].name, static_cast<uint32_t>(i)});
+    }
+    // Some writers add entries in sorted order already
+    if (std::is_sorted(m_sorted.begin(), m_sorted.end())) return;
+
+    // Sorted in slices on all threads, then merged pairwise
+    size_t slices = m_sorted.size() < 65536 ? 1 : std::max(1u, threads);
+    std::vector<size_t> bounds(slices + 1);
+    for (size_t i = 0; i <= slices; ++i) bounds[i] = m_sorted.size() * i / slices;
+    ParallelFor(slices, threads, [&](size_t i) {
+        std::sort(m_sorted.begin() + bounds[i], m_sorted.begin() + bounds[i + 1]);
+    });
+    for (size_t width = 1; width < slices; width *= 2) {
+        for (size_t i = 0; i + width < slices; i += 2 * width) {
+            std::inplace_merge(m_sorted.begin() + bounds[i], m_sorted.begin() + bounds[i + width],
+                               m_sorted.begin() + bounds[std::min(slices, i + 2 * width)]);
+        }
+    }
+}
+
+std::pair<size_t, size_t> EntryIndex::prefixRange(const std::string& prefix) const
+{
+    if (prefix.empty()) return {0, m_sorted.size()};
+
+    auto first = std::lower_bound(m_sorted.begin(), m_sorted.end(), prefix,
+        [](const Name& item, const std::string& key) { return item.name < key; });
+    // Names with the prefix sort together, straight after first
+    auto last = std::partition_point(first, m_sorted.end(), [&prefix](const Name& item) {
+        return item.name.starts_with(prefix);
+    });
+    return {static_cast<size_t>(first - m_sorted.begin()), static_cast<size_t>(last - m_sorted.begin())};
+}
+
+size_t EntryIndex::GetCandidateCount(const EntryFilter& filter) const
+{
+    auto range = prefixRange(filter.LiteralPrefix());
+    return range.second - range.first;
+}
+
+std::vector<size_t> EntryIndex::Select(const EntryFilter& filter, unsigned threads) const
+{
+    auto range = prefixRange(filter.LiteralPrefix());
+    size_t count = range.second - range.first;
+
+    std::vector<char> hit(count, 1);
+    if (!filter.Empty()) {
+        constexpr size_t kChunk = 4096;
+        size_t chunks = (count + kChunk - 1) / kChunk;
+        ParallelFor(chunks, chunks > 1 ? threads : 1, [&](size_t chunk) {
+            size_t end = std::min(count, (chunk + 1) * kChunk);
+            for (size_t i = chunk * kChunk; i < end; ++i) {
+                hit[i] = filter.Matches(m_sorted[range.first + i].name);
+            }
+        });
+    }
+
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < count; ++i) {
+        if (hit[i]) selected.push_back(m_sorted[range.first + i].index);
+    }
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
@@ -0,0 +1,79 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Parallel.h"
+#include "ZipReader.h"
+
+// Selects archive entries by name. Clauses are ANDed:
+//
+//   prefix  the name starts with it ("2026/10/")
+//   glob    '*' matches within one path segment, '**' across segments, '?'
+//           one character other than '/', [abc] / [a-z] / [!abc] a class and
+//           '\' escapes. A glob without '/' is matched against the last
+//           segment only, so "*.log" finds logs at any depth.
+//   regex   ECMAScript, searched anywhere in the name unless anchored
+//
+// LiteralPrefix() is what every matching name must start with, so an
+// EntryIndex can restrict the search to one range of its sorted names
+// before any clause is evaluated.
+class EntryFilter {
+public:
+    void AddPrefix(const std::string& prefix);
+    void AddGlob(const std::string& pattern);
+    bool AddRegex(const std::string& pattern); // false for an invalid pattern
+
+    bool Empty() const { return m_prefixes.empty() && m_globs.empty() && m_regexes.empty(); }
+    bool Matches(std::string_view name) const;
+    const std::string& LiteralPrefix() const { return m_literalPrefix; }
+
+    static bool GlobMatches(const char* pattern, std::string_view name);
+
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct Glob {
+        std::string pattern;
+        bool basename{false};
+    };
+
+    void narrowPrefix(const std::string& literal);
+
+    std::vector<std::string> m_prefixes;
+    std::vector<Glob> m_globs;
+    std::vector<std::regex> m_regexes;
+    std::string m_literalPrefix;
+    std::string m_lastError;
+};
+
+// The user-visible entries of an archive sorted by name, so a filter with a
+// literal prefix only looks at the names in that prefix's range.
+class EntryIndex {
+public:
+    // entries must outlive the index; the names are not copied
+    explicit EntryIndex(const std::vector<ZipEntryInfo>& entries, unsigned threads = DefaultThreadCount());
+
+    // Indices into entries of the matching ones, in ascending order. Clauses
+    // are evaluated on `threads` threads once the candidate range is large.
+    std::vector<size_t> Select(const EntryFilter& filter, unsigned threads = DefaultThreadCount()) const;
+
+    size_t GetCandidateCount(const EntryFilter& filter) const;
+    size_t Size() const { return m_sorted.size(); }
+
+private:
+    struct Name {
+        std::string_view name; // saves a hop through the entry on every comparison
+        uint32_t index;
+        bool operator<(const Name& other) const { return name < other.name; }
+    };
+
+    std::pair<size_t, size_t> prefixRange(const std::string& prefix) const;
+
+    std::vector<Name> m_sorted;
+};
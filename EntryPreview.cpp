@@ -0,0 +1,218 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "EntryPreview.h"
+#include <algorithm>
+#include "Trace.h"
+#include "ZipReader.h"
+
+size_t EntryPreview::KeyHash::operator()(const Key& key) const
+{
+    size_t hash = std::hash<std::string>()(key.archive);
+    hash ^= std::hash<uint64_t>()(key.entry * 0x9E3779B97F4A7C15ull + key.offset) + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+EntryPreview::EntryPreview(size_t capacityBytes, size_t blockSize)
+    : m_capacity(capacityBytes)
+    , m_blockSize(std::max<size_t>(4096, blockSize))
+{
+}
+
+EntryPreview::~EntryPreview()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    stopStream(lock);
+}
+
+void EntryPreview::SetUpdateCallback(UpdateFn onUpdate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_onUpdate = std::move(onUpdate);
+}
+
+std::string EntryPreview::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+EntryPreview::Stats EntryPreview::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+uint64_t EntryPreview::firstMissing(const std::string& archive, size_t entry, uint64_t offset, uint64_t end) const
+{
+    Key key{archive, entry, offset / m_blockSize * m_blockSize};
+    for (; key.offset < end; key.offset += m_blockSize) {
+        if (!m_blocks.count(key)) return key.offset;
+    }
+    return end;
+}
+
+void EntryPreview::insert(Key key, std::string data)
+{
+    auto it = m_blocks.find(key);
+    if (it != m_blocks.end()) {
+        m_cachedBytes -= it->second.data.size();
+        m_lru.erase(it->second.lru);
+        m_blocks.erase(it);
+    }
+
+    m_cachedBytes += data.size();
+    m_lru.push_front(key);
+    m_blocks.emplace(std::move(key), Block{std::move(data), m_lru.begin()});
+
+    // The block just added always stays, however small the capacity
+    while (m_cachedBytes > m_capacity && m_lru.size() > 1) {
+        auto victim = m_blocks.find(m_lru.back());
+        m_cachedBytes -= victim->second.data.size();
+        m_blocks.erase(victim);
+        m_lru.pop_back();
+    }
+}
+
+void EntryPreview::stopStream(std::unique_lock<std::mutex>& lock)
+{
+    if (!m_thread.joinable()) return;
+    m_cancel = true;
+    m_wake.notify_all();
+    std::thread thread = std::move(m_thread);
+    lock.unlock();
+    thread.join();
+    lock.lock();
+}
+
+bool EntryPreview::Request(const std::shared_ptr<ZipReader>& reader, const std::string& archive, size_t entry,
+                           uint64_t offset, uint64_t size)
+{
+    uint64_t entrySize = reader->GetEntries()[entry].uncompressedSize;
+    uint64_t through = offset + std::min(size, entrySize - std::min(offset, entrySize));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t missing = firstMissing(archive, entry, offset, through);
+    if (missing >= through) return true;
+
+    // The running stream will get there; it only has to be let on
+    bool streaming = m_thread.joinable() && !m_finished && m_streamArchive == archive && m_streamEntry == entry;
+    if (streaming && missing >= m_decoded) {
+        m_wanted = std::max(m_wanted, through);
+        m_wake.notify_all();
+        return false;
+    }
+
+    // Another entry, or a block behind the stream was evicted: start over
+    stopStream(lock);
+    m_streamArchive = archive;
+    m_streamEntry = entry;
+    m_decoded = 0;
+    m_wanted = through;
+    m_finished = false;
+    m_cancel = false;
+    m_lastError.clear();
+    ++m_stats.streams;
+    m_thread = std::thread(&EntryPreview::decode, this, reader, archive, entry);
+    return false;
+}
+
+void EntryPreview::decode(std::shared_ptr<ZipReader> reader, std::string archive, size_t entry)
+{
+    Trace::Span span("preview");
+    const ZipEntryInfo& info = reader->GetEntries()[entry];
+    std::string pending;
+    uint64_t offset = 0;
+
+    // Hands a block over, then (unless it was the last) pauses until more is wanted
+    auto publish = [&](bool last) {
+        UpdateFn onUpdate;
+        uint64_t size = pending.size();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_cancel) return false;
+            insert({archive, entry, offset}, std::move(pending));
+            offset += size;
+            m_decoded = offset;
+            m_stats.decodedBytes += size;
+            onUpdate = m_onUpdate;
+        }
+        pending.clear();
+        span.AddBytes(size);
+        if (onUpdate) onUpdate();
+        if (last) return true;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this, &info]() {
+            return m_cancel || m_decoded < m_wanted || m_decoded >= info.uncompressedSize;
+        });
+        return !m_cancel;
+    };
+
+    bool ok = reader->ReadEntry(info, [&](const char* data, size_t size) {
+        while (size > 0) {
+            size_t n = std::min(size, m_blockSize - pending.size());
+            pending.append(data, n);
+            data += n;
+            size -= n;
+            if (pending.size() == m_blockSize && !publish(false)) return false;
+        }
+        return true;
+    });
+    if (ok && !pending.empty()) ok = publish(true);
+
+    UpdateFn onUpdate;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancel) return;
+        if (!ok) m_lastError = reader->GetLastError();
+        m_finished = true;
+        onUpdate = m_onUpdate;
+    }
+    if (onUpdate) onUpdate();
+}
+
+size_t EntryPreview::Read(const std::string& archive, size_t entry, uint64_t offset, size_t size, std::string& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t copied = 0;
+    Key key{archive, entry, 0};
+    while (copied < size) {
+        uint64_t position = offset + copied;
+        key.offset = position / m_blockSize * m_blockSize;
+        auto it = m_blocks.find(key);
+        if (it == m_blocks.end()) {
+            ++m_stats.misses;
+            break;
+        }
+        ++m_stats.hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+
+        const std::string& data = it->second.data;
+        size_t from = static_cast<size_t>(position - key.offset);
+        if (from >= data.size()) break;
+        size_t n = std::min(data.size() - from, size - copied);
+        out.append(data, from, n);
+        copied += n;
+        // A short block is the entry's last
+        if (data.size() < m_blockSize) break;
+    }
+    return copied;
+}
+
+void EntryPreview::Forget(const std::string& archive)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_streamArchive == archive) stopStream(lock);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        if (it->archive != archive) {
+            ++it;
+            continue;
+        }
+        auto block = m_blocks.find(*it);
+        m_cachedBytes -= block->second.data.size();
+        m_blocks.erase(block);
+        it = m_lru.erase(it);
+    }
+}
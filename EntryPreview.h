@@ -0,0 +1,114 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ZipReader;
+
+// Decompressed contents of archive entries for previewing, never written to
+// disk. An entry is inflated on a background thread only as far as has been
+// asked for; the stream then pauses until more is wanted, so scrolling on
+// through a large entry continues where decoding stopped.
+//
+// The output is kept in fixed-size blocks in a bounded LRU keyed by
+// (archive, entry, offset). DEFLATE cannot seek, so a block that has been
+// evicted again is only found by decoding the entry from the start.
+class EntryPreview {
+public:
+    static constexpr size_t kDefaultCapacity = 32 << 20;
+    static constexpr size_t kDefaultBlockSize = 64 << 10;
+
+    struct Stats {
+        uint64_t hits{0};          // blocks served from the cache
+        uint64_t misses{0};        // blocks a Read found missing
+        uint64_t decodedBytes{0};
+        uint64_t streams{0};       // entries (re)started from the beginning
+    };
+
+    explicit EntryPreview(size_t capacityBytes = kDefaultCapacity, size_t blockSize = kDefaultBlockSize);
+    ~EntryPreview();
+
+    EntryPreview(const EntryPreview&) = delete;
+    EntryPreview& operator=(const EntryPreview&) = delete;
+
+    // Called on the decoding thread whenever more data is available, the
+    // entry has been decoded completely, or decoding failed. Must not block.
+    using UpdateFn = std::function<void()>;
+    void SetUpdateCallback(UpdateFn onUpdate);
+
+    // Makes [offset, offset + size) of the entry available. Returns true
+    // when it already is; otherwise it is decoded in the background and the
+    // update callback fires as it arrives. Asking for another entry abandons
+    // the previous stream; what it decoded stays cached.
+    bool Request(const std::shared_ptr<ZipReader>& reader, const std::string& archive, size_t entry,
+                 uint64_t offset, uint64_t size);
+
+    // Appends the cached bytes of [offset, offset + size) to out, stopping at
+    // the first block that has not been decoded; returns how many were copied
+    size_t Read(const std::string& archive, size_t entry, uint64_t offset, size_t size, std::string& out);
+
+    // Drops everything cached for an archive, e.g. after it was replaced
+    void Forget(const std::string& archive);
+
+    // The error that stopped the current stream, or "" while it is healthy
+    std::string GetLastError() const;
+    Stats GetStats() const;
+
+private:
+    struct Key {
+        std::string archive;
+        size_t entry{0};
+        uint64_t offset{0};
+        bool operator==(const Key& other) const
+        {
+            return entry == other.entry && offset == other.offset && archive == other.archive;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct Block {
+        std::string data;
+        std::list<Key>::iterator lru;
+    };
+
+    // All expect m_mutex to be held
+    uint64_t firstMissing(const std::string& archive, size_t entry, uint64_t offset, uint64_t end) const;
+    void insert(Key key, std::string data);
+    void stopStream(std::unique_lock<std::mutex>& lock);
+
+    void decode(std::shared_ptr<ZipReader> reader, std::string archive, size_t entry);
+
+    size_t m_capacity;
+    size_t m_blockSize;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<Key, Block, KeyHash> m_blocks;
+    std::list<Key> m_lru; // most recent first
+    size_t m_cachedBytes{0};
+    UpdateFn m_onUpdate;
+
+    // The one entry being decoded
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    std::string m_streamArchive;
+    size_t m_streamEntry{SIZE_MAX};
+    uint64_t m_decoded{0}; // bytes of the entry decoded so far
+    uint64_t m_wanted{0};
+    bool m_finished{true};
+    bool m_cancel{false};
+    std::string m_lastError;
+
+    Stats m_stats;
+};
@@ -0,0 +1,645 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ExtractionWriter.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include "Codec.h"
+#include "Trace.h"
+
+namespace {
+    // One buffer per thread, reused for every file the thread writes or reads
+    struct AlignedBuffer {
+        char* data{nullptr};
+        ~AlignedBuffer() { std::free(data); }
+    };
+
+    char* threadBuffer()
+    {
+        thread_local AlignedBuffer buffer;
+        if (!buffer.data) {
+            buffer.data = static_cast<char*>(std::aligned_alloc(ExtractionWriter::kPageSize,
+                                                                ExtractionWriter::kBufferSize));
+        }
+        return buffer.data;
+    }
+
+    bool isZero(const char* data, size_t size)
+    {
+        return data[0] == 0 && std::memcmp(data, data + 1, size - 1) == 0;
+    }
+
+    // A new file in place of whatever is at path, so a hard link from an
+    // earlier extraction (SetHardlinkDuplicates) is replaced, not written through
+    int createFile(const std::string& path, uint32_t mode)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+        if (fd < 0 && errno == EEXIST && ::unlink(path.c_str()) == 0) {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+        }
+        return fd;
+    }
+
+    // mktime() re-reads the time zone file on every call, a stat per entry.
+    // DST only changes on the hour, so the start of each hour is converted
+    // once and minutes and seconds are added to it.
+    std::time_t toTime(uint32_t dosDateTime)
+    {
+        thread_local std::unordered_map<uint32_t, std::time_t> hours;
+        uint32_t hour = dosDateTime >> 11;
+        auto it = hours.find(hour);
+        if (it == hours.end()) {
+            it = hours.emplace(hour, ZipFormat::FromDosDateTime(hour << 11)).first;
+        }
+        return it->second + ((dosDateTime >> 5) & 0x3f) * 60 + (dosDateTime & 0x1f) * 2;
+    }
+}
+
+ExtractionWriter::ExtractionWriter(const std::string& destDir)
+    : m_destDir(destDir)
+{
+    while (m_destDir.size() > 1 && m_destDir.back() == '/') {
+        m_destDir.pop_back();
+    }
+}
+
+bool ExtractionWriter::fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = message;
+    return false;
+}
+
+std::string ExtractionWriter::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
+
+ExtractionWriter::Stats ExtractionWriter::GetStats() const
+{
+    Stats stats;
+    stats.files = m_files;
+    stats.directories = m_directories;
+    stats.bytes = m_bytes;
+    stats.sparseBytes = m_sparseBytes;
+    stats.writeCalls = m_writeCalls;
+    stats.skipped = m_skipped;
+    stats.failed = m_failed;
+    stats.unchanged = m_unchanged;
+    stats.unchangedBytes = m_unchangedBytes;
+    stats.hashedBytes = m_hashedBytes;
+    stats.duplicates = m_duplicates;
+    stats.duplicateBytes = m_duplicateBytes;
+    stats.reflinked = m_reflinked;
+    stats.hardlinked = m_hardlinked;
+    return stats;
+}
+
+uint32_t ExtractionWriter::permissionsOf(const ZipEntryInfo& entry)
+{
+    // Unix mode in the high word, as ZipWriter stores it; set-id bits are dropped
+    uint32_t mode = entry.externalAttributes >> 16;
+    uint32_t type = mode & S_IFMT;
+    if (type != 0 && type != S_IFREG && type != S_IFDIR) return 0;
+    return mode & 0777;
+}
+
+std::string ExtractionWriter::destinationFor(const std::string& name)
+{
+    if (name.empty() || name[0] == '/') return "";
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos) end = name.size();
+        if (name.compare(start, end - start, "..") == 0) return "";
+        start = end + 1;
+    }
+
+    std::string path = m_destDir + "/" + name;
+    while (path.back() == '/') path.pop_back();
+    return path;
+}
+
+bool ExtractionWriter::ensureDirectory(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_dirMutex);
+        if (m_knownDirs.count(path)) return true;
+    }
+
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !ensureDirectory(path.substr(0, slash))) {
+        return false;
+    }
+
+    if (::mkdir(path.c_str(), 0755) == 0) {
+        ++m_directories;
+    } else if (errno != EEXIST) {
+        return fail("Failed to create directory " + path + ": " + std::strerror(errno));
+    }
+
+    std::lock_guard<std::mutex> lock(m_dirMutex);
+    m_knownDirs.insert(path);
+    return true;
+}
+
+bool ExtractionWriter::isUnchanged(const ZipEntryInfo& entry)
+{
+    std::string path = destinationFor(entry.name);
+    struct stat st;
+    if (path.empty() || ::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<uint64_t>(st.st_size) != entry.uncompressedSize) {
+        return false;
+    }
+    // A file linked to others (SetHardlinkDuplicates) may hold what one of
+    // them was given last time, with its time too; it is written again
+    if (st.st_nlink > 1) return false;
+
+    // DOS times are even seconds, so a file written at 13 s was stored as 12 s
+    std::time_t mtime = toTime(entry.dosDateTime);
+    bool sameTime = st.st_mtime >= mtime && st.st_mtime - mtime < 2;
+    if (!sameTime) {
+        char* data = threadBuffer();
+        int fd = data ? ::open(path.c_str(), O_RDONLY | O_CLOEXEC) : -1;
+        if (fd < 0) return false;
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        uint32_t crc = 0;
+        uint64_t total = 0;
+        ssize_t n;
+        while ((n = ::read(fd, data, kBufferSize)) != 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            crc = Codec::Crc32(crc, data, static_cast<size_t>(n));
+            total += static_cast<uint64_t>(n);
+        }
+        ::close(fd);
+        m_hashedBytes += total;
+        if (n != 0 || total != entry.uncompressedSize || crc != entry.crc) return false;
+    }
+
+    ++m_unchanged;
+    m_unchangedBytes += entry.uncompressedSize;
+
+    // Kept, but with the time and permissions an extraction would give it
+    uint32_t mode = permissionsOf(entry);
+    if (mode && (st.st_mode & 07777) == mode) mode = 0;
+    if (!sameTime || mode) {
+        Pending pending;
+        pending.path = path;
+        pending.mtime = mtime;
+        pending.mode = mode;
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.push_back(std::move(pending));
+    }
+    return true;
+}
+
+void ExtractionWriter::queue(const ZipEntryInfo& entry, const std::string& path, bool directory)
+{
+    Pending pending;
+    pending.path = path;
+    pending.mtime = toTime(entry.dosDateTime);
+    // Skipped when the item was created with that mode already
+    uint32_t mode = permissionsOf(entry);
+    pending.mode = mode == (directory ? 0755u : 0644u) ? 0 : mode;
+    pending.directory = directory;
+
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    m_pending.push_back(std::move(pending));
+}
+
+std::string ExtractionWriter::Prepare(const ZipEntryInfo& entry)
+{
+    std::string path = destinationFor(entry.name);
+    if (path.empty()) {
+        ++m_skipped;
+        fail("Refusing to extract outside the destination: " + entry.name);
+        return "";
+    }
+
+    if (entry.IsDir()) {
+        if (!ensureDirectory(path)) return "";
+        queue(entry, path, true);
+        return path;
+    }
+
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !ensureDirectory(path.substr(0, slash))) {
+        return "";
+    }
+    // Its writer truncates what is there, which would write through a hard link
+    ::unlink(path.c_str());
+    queue(entry, path, false);
+    ++m_files;
+    m_bytes += entry.uncompressedSize;
+    return path;
+}
+
+bool ExtractionWriter::Extract(ZipReader& reader, const ZipEntryInfo& entry)
+{
+    std::string path = destinationFor(entry.name);
+    if (path.empty()) {
+        ++m_skipped;
+        return fail("Refusing to extract outside the destination: " + entry.name);
+    }
+
+    if (entry.IsDir()) {
+        if (!ensureDirectory(path)) return false;
+        queue(entry, path, true);
+        return true;
+    }
+
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !ensureDirectory(path.substr(0, slash))) {
+        return false;
+    }
+    return writeFile(reader, entry, path);
+}
+
+bool ExtractionWriter::ExtractEntries(ZipReader& reader, const std::vector<size_t>& entries,
+                                      unsigned threads, const ProgressFn& progress)
+{
+    Trace::Span span("extract entries");
+    const auto& all = reader.GetEntries();
+
+    // A name can be in an archive more than once (appended to by watch mode,
+    // or by other tools); only its last entry in the central directory is
+    // extracted, as unzip does, instead of several writing one file at once
+    std::vector<size_t> selected;
+    {
+        std::unordered_map<std::string, size_t> slots;
+        selected.reserve(entries.size());
+        for (size_t index : entries) {
+            if (index >= all.size() || all[index].IsInternal()) continue;
+            std::string path = destinationFor(all[index].name);
+            if (path.empty()) {
+                selected.push_back(index); // refused when extracted
+                continue;
+            }
+            auto [it, inserted] = slots.emplace(std::move(path), selected.size());
+            if (inserted) {
+                selected.push_back(index);
+            } else if (index > selected[it->second]) {
+                selected[it->second] = index;
+            }
+        }
+    }
+
+    // Settled before anything is read, so the plan below only holds what changed
+    std::vector<char> unchanged(all.size(), 0);
+    size_t unchangedCount = 0;
+    if (m_skipUnchanged) {
+        Trace::Span compareSpan("compare existing");
+        std::vector<size_t> files;
+        for (size_t index : selected) {
+            if (!all[index].IsDir()) files.push_back(index);
+        }
+        ParallelFor(files.size(), threads, [&](size_t i) {
+            unchanged[files[i]] = isUnchanged(all[files[i]]);
+        });
+        unchangedCount = static_cast<size_t>(std::count(unchanged.begin(), unchanged.end(), 1));
+    }
+
+    std::vector<const ZipEntryInfo*> order;
+    std::vector<char> solidSelected(all.size(), 0);
+    order.reserve(selected.size());
+    for (size_t index : selected) {
+        if (unchanged[index]) continue;
+        if (all[index].solid) {
+            solidSelected[index] = 1;
+        } else {
+            order.push_back(&all[index]);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [](const ZipEntryInfo* a, const ZipEntryInfo* b) {
+        return a->disk != b->disk ? a->disk < b->disk : a->localHeaderOffset < b->localHeaderOffset;
+    });
+
+    // Only the first entry of each set of copies is decoded; files left
+    // unchanged already hold their data, so they serve as the first as well
+    std::vector<char> written(unchanged);
+    std::vector<std::pair<const ZipEntryInfo*, const ZipEntryInfo*>> duplicates; // copy, original
+    {
+        std::map<std::tuple<uint32_t, uint64_t, uint64_t, uint16_t>, const ZipEntryInfo*> originals;
+        auto keyOf = [](const ZipEntryInfo& entry) {
+            return std::make_tuple(entry.crc, entry.uncompressedSize, entry.compressedSize, entry.method);
+        };
+        for (size_t index = 0; index < all.size(); ++index) {
+            if (unchanged[index] && all[index].uncompressedSize > 0) originals.emplace(keyOf(all[index]), &all[index]);
+        }
+
+        std::vector<const ZipEntryInfo*> unique;
+        unique.reserve(order.size());
+        for (const ZipEntryInfo* entry : order) {
+            if (entry->IsDir() || entry->uncompressedSize == 0) {
+                unique.push_back(entry);
+                continue;
+            }
+            auto [it, inserted] = originals.emplace(keyOf(*entry), entry);
+            if (inserted) {
+                unique.push_back(entry);
+            } else {
+                duplicates.emplace_back(entry, it->second);
+            }
+        }
+        order.swap(unique);
+    }
+
+    size_t solidCount = static_cast<size_t>(std::count(solidSelected.begin(), solidSelected.end(), 1));
+    size_t total = order.size() + duplicates.size() + solidCount + unchangedCount;
+    std::atomic<size_t> done{unchangedCount};
+    if (unchangedCount > 0 && progress) progress(done, total);
+
+    if (solidCount > 0) {
+        bool ok = reader.ExtractSolid([&](const ZipEntryInfo& entry) {
+            size_t index = static_cast<size_t>(&entry - all.data());
+            if (!solidSelected[index]) return std::string();
+            std::string path = Prepare(entry);
+            if (path.empty()) ++m_failed;
+            return path;
+        }, threads);
+        if (!ok) {
+            m_failed += solidCount;
+            fail(reader.GetLastError());
+        }
+        done += solidCount;
+        if (progress) progress(done, total);
+    }
+
+    // Sources that can fetch ahead (a remote archive) get the whole plan up front
+    reader.Prefetch(order);
+    ParallelFor(order.size(), threads, [&](size_t i) {
+        if (Extract(reader, *order[i])) {
+            written[static_cast<size_t>(order[i] - all.data())] = 1;
+        } else {
+            ++m_failed;
+        }
+        size_t finished = ++done;
+        if (progress) progress(finished, total);
+    });
+
+    // Decoded after all when the original could not be written or copied, or
+    // its stored bytes turn out to differ: the key above can be forged
+    ParallelFor(duplicates.size(), threads, [&](size_t i) {
+        const auto& [entry, original] = duplicates[i];
+        bool copied = written[static_cast<size_t>(original - all.data())] &&
+                      reader.SameRawData(*entry, *original) && copyDuplicate(*entry, *original);
+        if (!copied && !Extract(reader, *entry)) ++m_failed;
+        size_t finished = ++done;
+        if (progress) progress(finished, total);
+    });
+
+    bool finished = Finish(threads);
+    return finished && m_failed == 0;
+}
+
+bool ExtractionWriter::copyDuplicate(const ZipEntryInfo& entry, const ZipEntryInfo& original)
+{
+    Trace::Span span("copy duplicate");
+    std::string path = destinationFor(entry.name);
+    std::string originalPath = destinationFor(original.name);
+    if (path.empty() || originalPath.empty()) return false;
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !ensureDirectory(path.substr(0, slash))) {
+        return false;
+    }
+
+    uint64_t size = entry.uncompressedSize;
+    auto count = [&]() {
+        ++m_files;
+        m_bytes += size;
+        ++m_duplicates;
+        m_duplicateBytes += size;
+        span.AddBytes(size);
+        return true;
+    };
+    if (path == originalPath) return count(); // the same name twice
+
+    if (m_hardlinkDuplicates && (::unlink(path.c_str()) == 0 || errno == ENOENT) &&
+        ::link(originalPath.c_str(), path.c_str()) == 0) {
+        ++m_hardlinked;
+        return count();
+    }
+
+    int in = ::open(originalPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    uint32_t mode = permissionsOf(entry);
+    int out = createFile(path, mode ? mode : 0666);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+
+    // Without reflinks copy_file_range still copies in the kernel, from the
+    // page cache the original was just written through; plain reads and
+    // writes are the last resort
+    bool ok = ::ioctl(out, FICLONE, in) == 0;
+    if (ok) {
+        ++m_reflinked;
+    } else {
+        uint64_t copied = 0;
+        while (copied < size) {
+            ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, size - copied, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            copied += static_cast<uint64_t>(n);
+        }
+        char* data = copied < size ? threadBuffer() : nullptr;
+        while (data && copied < size) {
+            ssize_t n = ::pread(in, data, static_cast<size_t>(std::min<uint64_t>(size - copied, kBufferSize)),
+                                static_cast<off_t>(copied));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || ::pwrite(out, data, static_cast<size_t>(n), static_cast<off_t>(copied)) != n) break;
+            ++m_writeCalls;
+            copied += static_cast<uint64_t>(n);
+        }
+        ok = copied == size;
+    }
+
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = toTime(entry.dosDateTime);
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    ::futimens(out, times);
+
+    ::close(in);
+    if (::close(out) != 0) ok = false;
+    return ok ? count() : false;
+}
+
+bool ExtractionWriter::punch(Output& out)
+{
+    if (out.holeEnd > out.holeStart && out.preallocated) {
+        // Without it the range is still allocated, though it reads as zeros
+        ++m_writeCalls;
+        ::fallocate(out.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(out.holeStart), static_cast<off_t>(out.holeEnd - out.holeStart));
+    }
+    out.holeStart = out.holeEnd = 0;
+    return true;
+}
+
+bool ExtractionWriter::flush(Output& out, const char* buffer)
+{
+    auto write = [&](size_t from, size_t to) {
+        while (from < to) {
+            ++m_writeCalls;
+            ssize_t n = ::pwrite(out.fd, buffer + from, to - from, static_cast<off_t>(out.offset + from));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            from += static_cast<size_t>(n);
+            out.dataEnd = out.offset + from;
+        }
+        return true;
+    };
+
+    // Buffers start at multiples of kBufferSize, so pages here are file pages
+    size_t dataStart = 0;
+    size_t pos = 0;
+    while (pos < out.used) {
+        if (out.used - pos < kPageSize || !isZero(buffer + pos, kPageSize)) {
+            pos = std::min(pos + kPageSize, out.used);
+            continue;
+        }
+
+        size_t zeroEnd = pos + kPageSize;
+        while (zeroEnd + kPageSize <= out.used && isZero(buffer + zeroEnd, kPageSize)) {
+            zeroEnd += kPageSize;
+        }
+        uint64_t holeStart = out.offset + pos;
+        bool extendsHole = out.holeEnd > out.holeStart && out.holeEnd == holeStart;
+        if (zeroEnd - pos >= kMinHole || extendsHole) {
+            if (!write(dataStart, pos)) return false;
+            if (!extendsHole) {
+                punch(out);
+                out.holeStart = holeStart;
+            }
+            out.holeEnd = out.offset + zeroEnd;
+            m_sparseBytes += zeroEnd - pos;
+            dataStart = zeroEnd;
+        }
+        pos = zeroEnd;
+    }
+
+    if (!write(dataStart, out.used)) return false;
+    out.offset += out.used;
+    out.used = 0;
+    return true;
+}
+
+bool ExtractionWriter::writeFile(ZipReader& reader, const ZipEntryInfo& entry, const std::string& path)
+{
+    Trace::Span span("write file");
+    uint32_t mode = permissionsOf(entry);
+    Output out;
+    out.fd = createFile(path, mode ? mode : 0666);
+    if (out.fd < 0) {
+        return fail("Failed to create " + path + ": " + std::strerror(errno));
+    }
+
+    // Anything written in a single pwrite is laid out in one go anyway
+    if (entry.uncompressedSize > kBufferSize) {
+        if (::fallocate(out.fd, 0, 0, static_cast<off_t>(entry.uncompressedSize)) == 0) {
+            out.preallocated = true;
+        } else if (errno == ENOSPC || errno == EFBIG) {
+            ::close(out.fd);
+            return fail("Not enough space for " + path);
+        }
+    }
+
+    char* data = threadBuffer();
+    if (!data) {
+        ::close(out.fd);
+        return fail("Out of memory");
+    }
+
+    bool ok = reader.ReadEntry(entry, [this, &out, data](const char* chunk, size_t size) {
+        while (size > 0) {
+            size_t n = std::min(size, kBufferSize - out.used);
+            std::memcpy(data + out.used, chunk, n);
+            out.used += n;
+            chunk += n;
+            size -= n;
+            if (out.used == kBufferSize && !flush(out, data)) return false;
+        }
+        return true;
+    });
+    if (!ok) {
+        ::close(out.fd);
+        return fail(reader.GetLastError());
+    }
+
+    bool written = flush(out, data) && punch(out);
+    // A trailing hole only exists once the size is set
+    bool resize = out.preallocated ? out.offset != entry.uncompressedSize : out.dataEnd < out.offset;
+    if (written && resize) {
+        written = ::ftruncate(out.fd, static_cast<off_t>(out.offset)) == 0;
+    }
+
+    // The descriptor is open anyway, so the time is set here rather than by path in Finish
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = toTime(entry.dosDateTime);
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    ::futimens(out.fd, times);
+
+    if (::close(out.fd) != 0) written = false;
+    if (!written) {
+        return fail("Failed to write " + path + ": " + std::strerror(errno));
+    }
+
+    ++m_files;
+    m_bytes += out.offset;
+    span.AddBytes(out.offset);
+    return true;
+}
+
+bool ExtractionWriter::Finish(unsigned threads)
+{
+    Trace::Span span("apply metadata");
+    std::vector<Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        pending.swap(m_pending);
+    }
+
+    auto apply = [](const Pending& item) {
+        if (item.mode && ::chmod(item.path.c_str(), item.mode) != 0) return false;
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = item.mtime;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        return ::utimensat(AT_FDCWD, item.path.c_str(), times, 0) == 0;
+    };
+
+    // Files first (in parallel), then directories from the deepest up
+    auto firstDir = std::stable_partition(pending.begin(), pending.end(),
+                                          [](const Pending& item) { return !item.directory; });
+    std::atomic<size_t> failed{0};
+    ParallelFor(static_cast<size_t>(firstDir - pending.begin()), threads, [&](size_t i) {
+        if (!apply(pending[i])) ++failed;
+    });
+
+    std::sort(firstDir, pending.end(), [](const Pending& a, const Pending& b) {
+        return std::count(a.path.begin(), a.path.end(), '/') > std::count(b.path.begin(), b.path.end(), '/');
+    });
+    for (auto it = firstDir; it != pending.end(); ++it) {
+        if (!apply(*it)) ++failed;
+    }
+
+    if (failed > 0) {
+        return fail("Failed to set times or permissions on " + std::to_string(failed.load()) + " items");
+    }
+    return true;
+}
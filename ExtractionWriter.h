@@ -0,0 +1,168 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "Parallel.h"
+#include "ZipReader.h"
+
+// Writes extracted entries below a destination directory with as few
+// syscalls, and as little fragmentation, as the data allows:
+//
+//  - each output is preallocated with fallocate() to its central-directory
+//    size, so the filesystem can lay it out in one extent (and a full disk
+//    is reported before anything is written)
+//  - data is gathered in 1 MB page-aligned buffers and written with pwrite
+//  - runs of 64 KB or more of zero pages are not written but punched out,
+//    leaving sparse files
+//  - directories are created once, remembered in a set shared by all threads
+//  - a file's time is set on its descriptor before closing; directory (and
+//    Prepare()d file) permissions and times are applied in a final pass,
+//    directories deepest first, since creating children would change them
+//
+// Names that are absolute or contain ".." are refused rather than written
+// outside the destination. Extract and Prepare may be called concurrently.
+//
+// With SetSkipUnchanged, ExtractEntries first compares every file entry with
+// what is already at its destination, on all threads: the same size and the
+// same time (to the 2 seconds DOS times resolve) count as unchanged without
+// reading anything; the same size at another time is settled by the CRC-32
+// of the existing file. Unchanged files are not written, only given the
+// entry's time and permissions where those differ.
+//
+// ExtractEntries decodes data shared by several entries only once: entries
+// with the same CRC-32, size, method and compressed size whose stored bytes
+// also compare equal are copies, and after the first one is written the
+// others are made from it by FICLONE, sharing its extents on filesystems
+// with reflinks (btrfs, XFS), or else copied in the kernel from the page
+// cache. With SetHardlinkDuplicates
+// they become hard links instead, which share the first copy's time and
+// permissions, and changes. Files already at a destination are replaced,
+// never written through, so such links do not carry a new extraction's
+// data to their other names, and a linked file is never taken as unchanged.
+class ExtractionWriter {
+public:
+    struct Stats {
+        uint64_t files{0};
+        uint64_t directories{0};     // created, not merely seen
+        uint64_t bytes{0};           // uncompressed size of the files
+        uint64_t sparseBytes{0};     // of those, left as holes
+        uint64_t writeCalls{0};
+        uint64_t skipped{0};         // unsafe names
+        uint64_t failed{0};          // entries ExtractEntries could not write
+        uint64_t unchanged{0};       // files left as they were (SetSkipUnchanged)
+        uint64_t unchangedBytes{0};
+        uint64_t hashedBytes{0};     // of existing files read to compare CRC-32s
+        uint64_t duplicates{0};      // files made from an identical entry's output
+        uint64_t duplicateBytes{0};
+        uint64_t reflinked{0};       // of those, sharing its extents
+        uint64_t hardlinked{0};      // of those, linked to it
+    };
+
+    static constexpr size_t kBufferSize = 1 << 20;
+    static constexpr size_t kPageSize = 4096;
+    static constexpr size_t kMinHole = 64 * 1024;
+
+    explicit ExtractionWriter(const std::string& destDir);
+
+    ExtractionWriter(const ExtractionWriter&) = delete;
+    ExtractionWriter& operator=(const ExtractionWriter&) = delete;
+
+    // Leave files already holding an entry's data alone in ExtractEntries
+    void SetSkipUnchanged(bool skip) { m_skipUnchanged = skip; }
+
+    // Hard link duplicate entries to the first copy rather than copying it
+    void SetHardlinkDuplicates(bool link) { m_hardlinkDuplicates = link; }
+
+    // Extracts one entry through reader: a directory is created, a file
+    // written as described above
+    bool Extract(ZipReader& reader, const ZipEntryInfo& entry);
+
+    // Extracts the given entries of reader (indices into GetEntries()), then
+    // calls Finish. Entries are written in archive offset order on `threads`
+    // threads, so reads move forward through the file (and the reader's
+    // sources are handed the plan to fetch ahead); solid members go
+    // through ZipReader::ExtractSolid, which only decodes the blocks they
+    // live in. A name given more than once is extracted from its last entry
+    // only. progress(done, total) is called from the worker threads.
+    using ProgressFn = std::function<void(size_t done, size_t total)>;
+    bool ExtractEntries(ZipReader& reader, const std::vector<size_t>& entries,
+                        unsigned threads = DefaultThreadCount(), const ProgressFn& progress = {});
+
+    // For outputs written by someone else (ZipReader::ExtractSolid): creates
+    // the parent directories and returns the destination path, queueing the
+    // entry's time and permissions for Finish. "" for unsafe names.
+    std::string Prepare(const ZipEntryInfo& entry);
+
+    // Applies the queued times and permissions; call once everything is written
+    bool Finish(unsigned threads = DefaultThreadCount());
+
+    Stats GetStats() const;
+    std::string GetLastError() const;
+
+private:
+    struct Pending {
+        std::string path;
+        std::time_t mtime{0};
+        uint32_t mode{0}; // permission bits, 0 to leave them alone
+        bool directory{false};
+    };
+
+    struct Output {
+        int fd{-1};
+        uint64_t offset{0};      // of the buffer's first byte in the file
+        size_t used{0};
+        uint64_t holeStart{0};   // pending hole, merged across flushes
+        uint64_t holeEnd{0};
+        uint64_t dataEnd{0};     // end of the last byte actually written
+        bool preallocated{false};
+    };
+
+    std::string destinationFor(const std::string& name);
+    bool ensureDirectory(const std::string& path);
+    bool isUnchanged(const ZipEntryInfo& entry);
+    bool copyDuplicate(const ZipEntryInfo& entry, const ZipEntryInfo& original);
+    bool writeFile(ZipReader& reader, const ZipEntryInfo& entry, const std::string& path);
+    bool flush(Output& out, const char* buffer);
+    bool punch(Output& out);
+    void queue(const ZipEntryInfo& entry, const std::string& path, bool directory);
+    bool fail(const std::string& message);
+
+    static uint32_t permissionsOf(const ZipEntryInfo& entry);
+
+    std::string m_destDir;
+    bool m_skipUnchanged{false};
+    bool m_hardlinkDuplicates{false};
+
+    std::mutex m_dirMutex;
+    std::unordered_set<std::string> m_knownDirs;
+
+    std::mutex m_pendingMutex;
+    std::vector<Pending> m_pending;
+
+    std::atomic<uint64_t> m_files{0};
+    std::atomic<uint64_t> m_directories{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_sparseBytes{0};
+    std::atomic<uint64_t> m_writeCalls{0};
+    std::atomic<uint64_t> m_skipped{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_unchanged{0};
+    std::atomic<uint64_t> m_unchangedBytes{0};
+    std::atomic<uint64_t> m_hashedBytes{0};
+    std::atomic<uint64_t> m_duplicates{0};
+    std::atomic<uint64_t> m_duplicateBytes{0};
+    std::atomic<uint64_t> m_reflinked{0};
+    std::atomic<uint64_t> m_hardlinked{0};
+
+    mutable std::mutex m_errorMutex;
+    std::string m_lastError;
+};
@@ -0,0 +1,242 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "FileSet.h"
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint32_t FileSet::hashPath(std::string_view path)
+{
+    uint64_t h = std::hash<std::string_view>{}(path);
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+const char* FileSet::intern(std::string_view path)
+{
+    size_t need = path.size() + 1;
+    char* dest;
+    if (need > kChunkSize / 4) {
+        // Rare long paths get their own block and leave the current chunk be
+        m_chunks.push_back(std::make_unique<char[]>(need));
+        dest = m_chunks.back().get();
+        m_arenaBytes += need;
+    } else {
+        if (m_chunkUsed + need > kChunkSize) {
+            m_chunks.push_back(std::make_unique<char[]>(kChunkSize));
+            m_chunk = m_chunks.back().get();
+            m_chunkUsed = 0;
+            m_arenaBytes += kChunkSize;
+        }
+        dest = m_chunk + m_chunkUsed;
+        m_chunkUsed += need;
+    }
+    std::memcpy(dest, path.data(), path.size());
+    dest[path.size()] = '\0';
+    return dest;
+}
+
+size_t FileSet::findSlot(std::string_view path, uint32_t hash, size_t* insertAt) const
+{
+    if (insertAt) *insertAt = kNoSlot;
+    if (m_slots.empty()) return kNoSlot;
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        Id id = m_slots[slot];
+        if (id == kNone) {
+            if (insertAt && *insertAt == kNoSlot) *insertAt = slot;
+            return kNoSlot;
+        }
+        if (id == kTombstone) {
+            if (insertAt && *insertAt == kNoSlot) *insertAt = slot;
+            continue;
+        }
+        const Entry& entry = m_entries[id];
+        if (entry.hash == hash && entry.length == path.size() &&
+            std::memcmp(entry.path, path.data(), path.size()) == 0) {
+            return slot;
+        }
+    }
+}
+
+void FileSet::rehash(size_t capacity)
+{
+    m_slots.assign(capacity, kNone);
+    m_used = 0;
+    size_t mask = capacity - 1;
+    for (Id id = 0; id < m_entries.size(); ++id) {
+        if (m_entries[id].removed) continue;
+        size_t slot = m_entries[id].hash & mask;
+        while (m_slots[slot] != kNone) slot = (slot + 1) & mask;
+        m_slots[slot] = id;
+        ++m_used;
+    }
+}
+
+bool FileSet::Add(std::string_view path)
+{
+    if ((m_used + 1) * 2 > m_slots.size()) {
+        // Tombstones count as used; growing only for live entries drops them
+        size_t capacity = 16;
+        while (capacity < (m_live + 1) * 4) capacity *= 2;
+        rehash(capacity);
+    }
+
+    uint32_t hash = hashPath(path);
+    size_t insertAt;
+    if (findSlot(path, hash, &insertAt) != kNoSlot) return false;
+
+    Entry entry;
+    entry.path = intern(path);
+    entry.length = static_cast<uint32_t>(path.size());
+    entry.hash = hash;
+
+    Id id = static_cast<Id>(m_entries.size());
+    m_entries.push_back(entry);
+    m_order.push_back(id);
+    if (m_slots[insertAt] == kNone) ++m_used;
+    m_slots[insertAt] = id;
+    ++m_live;
+    ++m_version;
+    return true;
+}
+
+FileSet::Id FileSet::Find(std::string_view path) const
+{
+    size_t slot = findSlot(path, hashPath(path));
+    return slot == kNoSlot ? kNone : m_slots[slot];
+}
+
+bool FileSet::Remove(std::string_view path)
+{
+    size_t slot = findSlot(path, hashPath(path));
+    if (slot == kNoSlot) return false;
+
+    m_entries[m_slots[slot]].removed = true;
+    m_slots[slot] = kTombstone;
+    --m_live;
+    ++m_version;
+    return true;
+}
+
+void FileSet::Clear()
+{
+    m_chunks.clear();
+    m_chunk = nullptr;
+    m_chunkUsed = kChunkSize;
+    m_arenaBytes = 0;
+    m_entries.clear();
+    m_order.clear();
+    m_slots.clear();
+    m_used = 0;
+    m_live = 0;
+    ++m_version;
+}
+
+void FileSet::Resolve(unsigned threads)
+{
+    std::vector<Id> pending;
+    for (Id id = 0; id < m_entries.size(); ++id) {
+        if (!m_entries[id].resolved && !m_entries[id].removed) pending.push_back(id);
+    }
+
+    ParallelFor(pending.size(), threads, [&](size_t i) {
+        Entry& entry = m_entries[pending[i]];
+        struct stat st{};
+        int fd = ::open(entry.path, O_RDONLY | O_CLOEXEC);
+        bool statted = fd >= 0 ? ::fstat(fd, &st) == 0 : ::stat(entry.path, &st) == 0;
+
+        entry.exists = statted && S_ISREG(st.st_mode);
+        if (entry.exists) {
+            entry.size = static_cast<uint64_t>(st.st_size);
+            entry.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        }
+
+        // Unreadable files still get a kind from their name
+        unsigned char probe[ContentType::kProbeSize];
+        ssize_t got = entry.exists && fd >= 0 ? ::pread(fd, probe, sizeof(probe), 0) : -1;
+        entry.kind = got >= 0 ? ContentType::FromContent(probe, static_cast<size_t>(got), entry.Path())
+                              : ContentType::FromPath(entry.Path());
+        entry.resolved = true;
+        if (fd >= 0) ::close(fd);
+    });
+}
+
+void FileSet::Reorder(const std::vector<Id>& ids)
+{
+    std::vector<char> placed(m_entries.size(), 0);
+    std::vector<Id> order;
+    order.reserve(m_live);
+    for (Id id : ids) {
+        if (id < m_entries.size() && !m_entries[id].removed && !placed[id]) {
+            placed[id] = 1;
+            order.push_back(id);
+        }
+    }
+    for (Id id : m_order) {
+        if (!m_entries[id].removed && !placed[id]) {
+            placed[id] = 1;
+            order.push_back(id);
+        }
+    }
+    m_order = std::move(order);
+    ++m_version;
+}
+
+void FileSet::Compact()
+{
+    std::vector<std::unique_ptr<char[]>> chunks = std::move(m_chunks);
+    std::vector<Entry> entries = std::move(m_entries);
+    std::vector<Id> order = std::move(m_order);
+
+    m_chunks.clear();
+    m_chunk = nullptr;
+    m_chunkUsed = kChunkSize;
+    m_arenaBytes = 0;
+    m_entries.clear();
+    m_entries.reserve(m_live);
+    m_order.clear();
+    m_order.reserve(m_live);
+    for (Id id : order) {
+        Entry entry = entries[id];
+        if (entry.removed) continue;
+        entry.path = intern(entry.Path());
+        m_order.push_back(static_cast<Id>(m_entries.size()));
+        m_entries.push_back(entry);
+    }
+
+    size_t capacity = 16;
+    while (capacity < (m_live + 1) * 4) capacity *= 2;
+    rehash(capacity);
+    ++m_version;
+}
+
+std::vector<FileSet::Id> FileSet::Ids() const
+{
+    std::vector<Id> ids;
+    ids.reserve(m_live);
+    for (Id id : m_order) {
+        if (!m_entries[id].removed) ids.push_back(id);
+    }
+    return ids;
+}
+
+std::vector<std::string> FileSet::Paths() const
+{
+    std::vector<std::string> paths;
+    paths.reserve(m_live);
+    for (Id id : m_order) {
+        if (!m_entries[id].removed) paths.emplace_back(m_entries[id].Path());
+    }
+    return paths;
+}
+
+size_t FileSet::GetMemoryUsage() const
+{
+    return m_arenaBytes + m_entries.capacity() * sizeof(Entry) +
+           m_order.capacity() * sizeof(Id) + m_slots.capacity() * sizeof(Id);
+}
@@ -0,0 +1,101 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ContentType.h"
+#include "Parallel.h"
+
+// The Create panel's selection: an ordered set of paths that stays cheap at
+// millions of files.
+//
+// Paths are copied once into a chunked arena (NUL-terminated, never moved),
+// and entries are small fixed-size records addressed by Id. An open-addressing
+// table of Ids, keyed by a hash kept in the entry, makes Add (with dedup),
+// Find and Remove O(1). Removal leaves a tombstone that Compact() reclaims;
+// Ids are stable until then, so they can be handed to PathOptimizer and
+// mapped back without copying strings.
+//
+// Size, mtime and content kind are cached per entry by Resolve(), which opens
+// each new file once (fstat plus a 512-byte probe) on several threads.
+class FileSet {
+public:
+    using Id = uint32_t;
+    static constexpr Id kNone = ~Id(0);
+
+    struct Entry {
+        const char* path{nullptr}; // in the arena, NUL-terminated
+        uint32_t length{0};
+        uint32_t hash{0};
+        uint64_t size{0};
+        int64_t mtimeNs{0};
+        ContentType::Kind kind{ContentType::Kind::Unknown};
+        bool resolved{false};
+        bool exists{false};   // a regular file when resolved
+        bool removed{false};
+
+        std::string_view Path() const { return {path, length}; }
+    };
+
+    FileSet() = default;
+    FileSet(const FileSet&) = delete;
+    FileSet& operator=(const FileSet&) = delete;
+
+    // false if the path is already selected
+    bool Add(std::string_view path);
+    Id Find(std::string_view path) const;
+    bool Remove(std::string_view path);
+    void Clear();
+
+    // Stats and classifies entries added since the last call
+    void Resolve(unsigned threads = DefaultThreadCount());
+
+    // Moves the given ids to the front in that order; the remaining
+    // selected entries follow in their current order
+    void Reorder(const std::vector<Id>& ids);
+
+    // Drops removed entries and their paths; renumbers Ids
+    void Compact();
+
+    size_t Size() const { return m_live; }
+    bool Empty() const { return m_live == 0; }
+    const Entry& Get(Id id) const { return m_entries[id]; }
+
+    // Selected ids in list order
+    std::vector<Id> Ids() const;
+    // Copy of the selected paths in list order, for worker threads
+    std::vector<std::string> Paths() const;
+
+    // Bumped by every change, so async results can tell the selection moved on
+    uint64_t GetVersion() const { return m_version; }
+    size_t GetRemovedCount() const { return m_entries.size() - m_live; }
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t kChunkSize = 1 << 20;
+    static constexpr Id kTombstone = kNone - 1;
+    static constexpr size_t kNoSlot = ~size_t(0);
+
+    static uint32_t hashPath(std::string_view path);
+    const char* intern(std::string_view path);
+    // Slot holding the path's Id, or kNoSlot with insertAt set to where it goes
+    size_t findSlot(std::string_view path, uint32_t hash, size_t* insertAt = nullptr) const;
+    void rehash(size_t capacity);
+
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    char* m_chunk{nullptr};       // the one being filled
+    size_t m_chunkUsed{kChunkSize};
+    size_t m_arenaBytes{0};
+
+    std::vector<Entry> m_entries; // by Id
+    std::vector<Id> m_order;      // may still hold removed ids
+    std::vector<Id> m_slots;      // power of two, at most half full
+    size_t m_used{0};             // slots holding an Id or a tombstone
+    size_t m_live{0};
+    uint64_t m_version{0};
+};
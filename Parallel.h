@@ -0,0 +1,43 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+inline unsigned DefaultThreadCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Runs body(i) for every i in [0, count) on up to `threads` workers.
+// Indices are handed out in increasing order, so early items finish first.
+inline void ParallelFor(size_t count, unsigned threads,
+                        const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(
+        std::min<size_t>(count, 1024))));
+
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                body(i);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -10,27 +10,38 @@
 #include <limits>
 #include <algorithm>
 #include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+#include "ContentType.h"
+#include "Parallel.h"
+#include "Trace.h"
 
 struct FileNode {
-    std::string path;
+    std::string path;    // empty for files added by id
+    size_t id{0};        // the caller's index for the file, e.g. a FileSet::Id
     size_t size;
-    int compressionType; // 0=text, 1=image, 2=video, 3=binary, etc.
-
-    FileNode(const std::string& p, size_t s) : path(p), size(s) {
-        // Determine compression type based on extension
-        std::string ext = path.substr(path.find_last_of('.') + 1);
-        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-        if (ext == "txt" || ext == "log" || ext == "xml" || ext == "json" || ext == "csv") {
-            compressionType = 0; // Text files - high compression ratio
-        } else if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "gif") {
-            compressionType = 1; // Images - already compressed
-        } else if (ext == "mp4" || ext == "avi" || ext == "mkv" || ext == "mp3") {
-            compressionType = 2; // Media - already compressed
-        } else {
-            compressionType = 3; // Binary/other
-        }
-    }
+    ContentType::Kind kind;
+    int compressionType; // ContentType::Class: 0=text, 1=image, 2=media, 3=binary
+
+    // Typed by extension; pass the kind from ContentType::Classify when the
+    // file's first bytes have been read
+    FileNode(const std::string& p, size_t s) : FileNode(p, s, ContentType::FromPath(p)) {}
+
+    FileNode(const std::string& p, size_t s, ContentType::Kind k)
+        : path(p), size(s), kind(k), compressionType(ContentType::CompressionClass(k)) {}
+
+    FileNode(size_t i, size_t s, ContentType::Kind k)
+        : id(i), size(s), kind(k), compressionType(ContentType::CompressionClass(k)) {}
+};
+
+// Result of PathOptimizer::RefineOrder
+struct RefinedOrder {
+    std::vector<size_t> order; // indices in the order the files were added
+    double score{1.0};         // EstimateCompressionRatio(order)
+    size_t passes{0};          // parallel improvement passes run
+    size_t moves{0};           // improving 2-opt and Or-opt moves applied
 };
 
 struct CompressionEdge {
@@ -48,19 +59,24 @@ private:
 
     // Calculate compression benefit when files are adjacent in zip
     double CalculateCompressionBenefit(const FileNode& current, const FileNode& next) {
+        return CompressionBenefit(current.compressionType, current.size, next.compressionType, next.size);
+    }
+
+    static double CompressionBenefit(int currentType, size_t currentSize, int nextType, size_t nextSize) {
         // Same type files benefit from being grouped together
-        double typeBonus = (current.compressionType == next.compressionType) ? 0.3 : 0.0;
+        double typeBonus = (currentType == nextType) ? 0.3 : 0.0;
 
         // Size similarity helps with compression dictionary
-        double sizeFactor = 1.0 - std::abs((double)current.size - (double)next.size) /
-                           std::max((double)current.size, (double)next.size);
+        double largest = std::max((double)currentSize, (double)nextSize);
+        double sizeFactor = largest == 0.0 ? 1.0 :
+                            1.0 - std::abs((double)currentSize - (double)nextSize) / largest;
         sizeFactor *= 0.2; // Weight this factor
 
         // Text files benefit most from being grouped
         double compressionMultiplier = 1.0;
-        if (current.compressionType == 0 && next.compressionType == 0) {
+        if (currentType == 0 && nextType == 0) {
             compressionMultiplier = 1.5; // Text files compress better when grouped
-        } else if (current.compressionType == 1 || next.compressionType == 1) {
+        } else if (currentType == 1 || nextType == 1) {
             compressionMultiplier = 0.5; // Images don't compress much more
         }
 
@@ -74,17 +90,209 @@ private:
         return 1.0 - benefit;
     }
 
+    // Local search below only looks at these instead of the full graph
+    std::vector<std::vector<size_t>> neighbours;
+
+    static constexpr size_t kFullGraphLimit = 1000; // greedy/MST need the O(n^2) graph
+    static constexpr size_t kMinChunk = 64;
+    static constexpr size_t kMaxSegment = 3;       // Or-opt moves 1..3 files
+    static constexpr double kMinGain = 1e-9;
+
+    double Benefit(size_t a, size_t b) {
+        return CalculateCompressionBenefit(nodes[a], nodes[b]);
+    }
+
+    // Files grouped by type, ascending size within a type. Sorts copies of
+    // the keys; comparing through nodes costs a cache miss per comparison.
+    std::vector<size_t> SortedByTypeAndSize(bool ignoreType = false) const {
+        std::vector<std::tuple<int, size_t, size_t>> keys(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            keys[i] = {ignoreType ? 0 : nodes[i].compressionType, nodes[i].size, i};
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<size_t> order(nodes.size());
+        for (size_t i = 0; i < keys.size(); ++i) order[i] = std::get<2>(keys[i]);
+        return order;
+    }
+
+    // The benefit only depends on type and size similarity, so the best
+    // partners of a file are among those closest in size, both within its
+    // type and overall. O(n log n + n*k) instead of the O(n^2) graph.
+    void BuildNeighbourLists(size_t k) {
+        Trace::Span span("neighbour lists");
+        size_t n = nodes.size();
+        neighbours.assign(n, {});
+
+        std::vector<size_t> byType = SortedByTypeAndSize();
+        std::vector<size_t> bySize = SortedByTypeAndSize(true);
+        std::vector<size_t> typeRank(n), sizeRank(n);
+        for (size_t i = 0; i < n; ++i) {
+            typeRank[byType[i]] = i;
+            sizeRank[bySize[i]] = i;
+        }
+
+        // Type and size copied in sorted order, so the windows below are
+        // scanned sequentially instead of hopping around nodes
+        std::vector<int> typeOf(n), sizeType(n);
+        std::vector<size_t> typeSize(n), sizeOf(n);
+        for (size_t i = 0; i < n; ++i) {
+            typeOf[i] = nodes[byType[i]].compressionType;
+            typeSize[i] = nodes[byType[i]].size;
+            sizeType[i] = nodes[bySize[i]].compressionType;
+            sizeOf[i] = nodes[bySize[i]].size;
+        }
+
+        ParallelFor(n, DefaultThreadCount(), [&](size_t a) {
+            thread_local std::vector<std::pair<double, size_t>> candidates;
+            candidates.clear();
+            int type = nodes[a].compressionType;
+            size_t size = nodes[a].size;
+
+            size_t r = typeRank[a];
+            for (size_t d = 1; d <= k / 2 && r >= d && typeOf[r - d] == type; ++d) {
+                candidates.emplace_back(-CompressionBenefit(type, size, type, typeSize[r - d]), byType[r - d]);
+            }
+            for (size_t d = 1; d <= k / 2 && r + d < n && typeOf[r + d] == type; ++d) {
+                candidates.emplace_back(-CompressionBenefit(type, size, type, typeSize[r + d]), byType[r + d]);
+            }
+            r = sizeRank[a];
+            for (size_t d = 1; d <= k / 4 && r >= d; ++d) {
+                candidates.emplace_back(-CompressionBenefit(type, size, sizeType[r - d], sizeOf[r - d]), bySize[r - d]);
+            }
+            for (size_t d = 1; d <= k / 4 && r + d < n; ++d) {
+                candidates.emplace_back(-CompressionBenefit(type, size, sizeType[r + d], sizeOf[r + d]), bySize[r + d]);
+            }
+
+            // Both windows can hold the same file
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+            auto& list = neighbours[a];
+            list.reserve(std::min(k, candidates.size()));
+            for (size_t i = 0; i < candidates.size() && list.size() < k; ++i) {
+                list.push_back(candidates[i].second);
+            }
+        });
+    }
+
+    // One worker's share of a refinement pass: first-improvement 2-opt and
+    // Or-opt on order[lo, hi). Only nodes owned by this chunk are touched, and
+    // an interior chunk keeps its first and last file so the edges to the
+    // neighbouring chunks stay valid while they are refined concurrently.
+    size_t RefineChunk(std::vector<size_t>& order, std::vector<size_t>& pos,
+                       const std::vector<unsigned>& owner, unsigned chunk,
+                       size_t lo, size_t hi,
+                       std::chrono::steady_clock::time_point deadline) {
+        size_t n = order.size();
+        size_t first = lo > 0 ? lo + 1 : lo;        // lowest position a move may change
+        size_t last = hi < n ? hi - 2 : hi - 1;     // highest position a move may change
+        if (hi - lo < 4 || first > last) return 0;
+
+        // Benefit of the edge between positions p and p + 1 (0 past either end)
+        auto edge = [&](size_t p) {
+            return p + 1 < n ? Benefit(order[p], order[p + 1]) : 0.0;
+        };
+        auto edgeBefore = [&](size_t p) { return p > 0 ? edge(p - 1) : 0.0; };
+        auto reindex = [&](size_t from, size_t to) {
+            for (size_t p = from; p <= to; ++p) pos[order[p]] = p;
+        };
+
+        // Reverses [s, e]: edges (s-1, s) and (e, e+1) become (s-1, e) and (s, e+1)
+        auto tryReverse = [&](size_t s, size_t e) {
+            if (s < first || e > last || s >= e) return false;
+            double before = edgeBefore(s) + edge(e);
+            double after = (s > 0 ? Benefit(order[s - 1], order[e]) : 0.0) +
+                           (e + 1 < n ? Benefit(order[s], order[e + 1]) : 0.0);
+            if (after - before <= kMinGain) return false;
+            std::reverse(order.begin() + s, order.begin() + e + 1);
+            reindex(s, e);
+            return true;
+        };
+
+        // Moves [s, e] between positions x and x + 1, optionally reversed
+        auto tryMove = [&](size_t s, size_t e, size_t x) {
+            if (s < first || e > last || x < lo || x + 1 >= hi) return false;
+            if (x + 1 >= s && x <= e) return false; // insertion edge touches the segment
+            double removed = edgeBefore(s) + edge(e) + edge(x);
+            double bridged = (s > 0 && e + 1 < n) ? Benefit(order[s - 1], order[e + 1]) : 0.0;
+            double forward = Benefit(order[x], order[s]) + Benefit(order[e], order[x + 1]);
+            double backward = Benefit(order[x], order[e]) + Benefit(order[s], order[x + 1]);
+            bool reversed = backward > forward;
+            if (bridged + std::max(forward, backward) - removed <= kMinGain) return false;
+
+            if (x > e) {
+                std::rotate(order.begin() + s, order.begin() + e + 1, order.begin() + x + 1);
+                size_t newStart = x - (e - s);
+                if (reversed) std::reverse(order.begin() + newStart, order.begin() + x + 1);
+                reindex(s, x);
+            } else {
+                std::rotate(order.begin() + x + 1, order.begin() + s, order.begin() + e + 1);
+                if (reversed) std::reverse(order.begin() + x + 1, order.begin() + x + 1 + (e - s) + 1);
+                reindex(x + 1, e);
+            }
+            return true;
+        };
+
+        size_t moves = 0;
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (size_t i = lo; i < hi; ++i) {
+                if ((i & 63) == 0 && std::chrono::steady_clock::now() >= deadline) return moves;
+
+                size_t a = order[i];
+                for (size_t c : neighbours[a]) {
+                    if (owner[c] != chunk) continue;
+                    size_t p = pos[a];
+                    size_t j = pos[c];
+                    if (j == p + 1 || p == j + 1) continue; // already adjacent
+
+                    bool applied = j > p ? tryReverse(p + 1, j) : tryReverse(j, p - 1);
+                    for (size_t len = 1; !applied && len <= kMaxSegment; ++len) {
+                        // Segment with a at one end, placed next to c
+                        if (p + len - 1 < n) {
+                            applied = tryMove(p, p + len - 1, j) || (j > 0 && tryMove(p, p + len - 1, j - 1));
+                        }
+                        if (!applied && p + 1 >= len) {
+                            applied = tryMove(p + 1 - len, p, j) || (j > 0 && tryMove(p + 1 - len, p, j - 1));
+                        }
+                    }
+                    if (applied) {
+                        ++moves;
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return moves;
+    }
+
 public:
     void AddFile(const std::string& path, size_t size) {
-        nodes.emplace_back(path, size);
+        nodes.emplace_back(path, size).id = nodes.size() - 1;
+    }
+
+    void AddFile(const std::string& path, size_t size, ContentType::Kind kind) {
+        nodes.emplace_back(path, size, kind).id = nodes.size() - 1;
+    }
+
+    // By the caller's own index, without copying the path; GetFile(i).id
+    // maps an order back
+    void AddFile(size_t id, size_t size, ContentType::Kind kind) {
+        nodes.emplace_back(id, size, kind);
     }
 
     void Clear() {
         nodes.clear();
         graph.clear();
+        neighbours.clear();
     }
 
+    size_t GetFileCount() const { return nodes.size(); }
+    const FileNode& GetFile(size_t index) const { return nodes[index]; }
+
     void BuildCompressionGraph() {
+        Trace::Span span("build graph");
         size_t n = nodes.size();
         if (n == 0) return;
 
@@ -105,6 +313,7 @@ public:
 
     // Use Dijkstra to find optimal file ordering for compression
     std::vector<size_t> FindOptimalCompressionOrder() {
+        Trace::Span span("order greedy");
         size_t n = nodes.size();
         if (n == 0) return {};
         if (n == 1) return {0};
@@ -167,6 +376,7 @@ public:
 
     // Alternative: Use full Dijkstra's algorithm to find minimum spanning tree approach
     std::vector<size_t> FindOptimalOrderDijkstra() {
+        Trace::Span span("order mst");
         size_t n = nodes.size();
         if (n <= 1) return n == 1 ? std::vector<size_t>{0} : std::vector<size_t>{};
 
@@ -253,8 +463,8 @@ public:
         auto order1 = FindOptimalCompressionOrder();
         auto order2 = FindOptimalOrderDijkstra();
 
-        // Use the simpler greedy approach for now
-        auto bestOrder = order1;
+        auto bestOrder = EstimateCompressionRatio(order2) > EstimateCompressionRatio(order1)
+                         ? order2 : order1;
 
         std::vector<FileNode> result;
         result.reserve(bestOrder.size());
@@ -268,6 +478,71 @@ public:
         return result;
     }
 
+    // Starts from the best constructive order (greedy, MST/DFS and the plain
+    // type/size sort) and improves it with 2-opt and Or-opt moves over
+    // neighbour lists until no move helps or the budget is spent. The order is
+    // split into one chunk per thread; chunk boundaries shift by half a chunk
+    // every pass so moves across them are found in the next pass.
+    RefinedOrder RefineOrder(std::chrono::milliseconds budget,
+                             unsigned threads = DefaultThreadCount(),
+                             size_t neighbourCount = 12) {
+        Trace::Span span("refine order");
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        RefinedOrder result;
+        size_t n = nodes.size();
+        if (n == 0) return result;
+
+        result.order = SortedByTypeAndSize();
+        result.score = EstimateCompressionRatio(result.order);
+        if (n <= kFullGraphLimit) {
+            if (graph.size() != n) BuildCompressionGraph();
+            for (auto candidate : {FindOptimalCompressionOrder(), FindOptimalOrderDijkstra()}) {
+                double score = EstimateCompressionRatio(candidate);
+                if (candidate.size() == n && score > result.score) {
+                    result.order = std::move(candidate);
+                    result.score = score;
+                }
+            }
+        }
+        if (n < 4) return result;
+
+        BuildNeighbourLists(neighbourCount);
+
+        std::vector<size_t>& order = result.order;
+        std::vector<size_t> pos(n);
+        std::vector<unsigned> owner(n);
+        for (size_t p = 0; p < n; ++p) pos[order[p]] = p;
+
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, n / kMinChunk));
+        size_t chunkSize = (n + chunks - 1) / chunks;
+        size_t idlePasses = 0;
+        while (std::chrono::steady_clock::now() < deadline && idlePasses < std::min<size_t>(chunks, 2)) {
+            // Odd passes shift the boundaries; the extra partial chunk wraps the start
+            size_t offset = (result.passes % 2) ? chunkSize / 2 : 0;
+            std::vector<std::pair<size_t, size_t>> ranges;
+            if (offset > 0) ranges.emplace_back(0, offset);
+            for (size_t lo = offset; lo < n; lo += chunkSize) {
+                ranges.emplace_back(lo, std::min(n, lo + chunkSize));
+            }
+            for (unsigned c = 0; c < ranges.size(); ++c) {
+                for (size_t p = ranges[c].first; p < ranges[c].second; ++p) owner[order[p]] = c;
+            }
+
+            std::atomic<size_t> moves{0};
+            ParallelFor(ranges.size(), threads, [&](size_t c) {
+                moves += RefineChunk(order, pos, owner, static_cast<unsigned>(c),
+                                     ranges[c].first, ranges[c].second, deadline);
+            });
+
+            ++result.passes;
+            result.moves += moves;
+            idlePasses = moves == 0 ? idlePasses + 1 : 0;
+        }
+
+        result.score = EstimateCompressionRatio(order);
+        return result;
+    }
+
     // Calculate estimated compression ratio for current order
     double EstimateCompressionRatio(const std::vector<size_t>& order) {
         if (order.size() <= 1) return 1.0;
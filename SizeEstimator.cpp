@@ -0,0 +1,541 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "SizeEstimator.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include "zlib.h"
+#ifdef ARCHIVEMANAGER_ZSTD
+#include <zstd.h>
+#endif
+#include "Codec.h"
+#include "ContentType.h"
+#include "Trace.h"
+#include "ZipFormat.h"
+
+namespace {
+    constexpr double kZ95 = 1.96;
+    // Local header (30) + central header (46) + name twice, per entry
+    constexpr uint64_t kEntryOverhead = 76;
+    constexpr uint64_t kEndRecordSize = 22;
+    // A solid member's index record besides its name (SolidArchive.cpp)
+    constexpr uint64_t kSolidRecordSize = 30;
+    // A ustar header is mostly zeros and octal digits; compressed in the
+    // stream it costs about its name and a few dozen bytes
+    constexpr uint64_t kTarHeaderCompressed = 48;
+
+    // History a block is primed with: deflate's whole window, and as much
+    // of zstd's far larger one as is worth reading for a sample
+    constexpr size_t kWindow = size_t(1) << MAX_WBITS;
+    constexpr size_t kZstdWindow = 256 * 1024;
+    // Opening a file costs about as much as compressing a few KB of it, so
+    // huge selections of tiny files are capped by count as well as bytes
+    constexpr size_t kMaxSampledFiles = 4096;
+
+    uint64_t threadCpuNs()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // Running mean and variance (Welford)
+    struct Spread {
+        double count{0};
+        double mean{0};
+        double m2{0};
+
+        void Add(double x)
+        {
+            count += 1;
+            double delta = x - mean;
+            mean += delta / count;
+            m2 += delta * (x - mean);
+        }
+        // -1 when there are too few values to tell
+        double Variance() const { return count >= 2 ? m2 / (count - 1) : -1; }
+    };
+
+    struct TypeStats {
+        uint64_t bytes{0};
+        uint64_t compressed{0};
+        uint64_t cpuNs{0};
+        Spread ratio;      // between representative files
+        Spread nsPerByte;  // between representative files
+        uint64_t unsampledBytes{0};
+    };
+}
+
+SizeEstimator::SizeEstimator(const ArchiveOptions& options, unsigned jobThreads, unsigned threads,
+                             uint64_t sampleBudget)
+    : m_options(options)
+    , m_level(std::clamp(options.compressionLevel, 0, 9))
+    , m_jobThreads(std::max(1u, jobThreads))
+    , m_threads(std::max(1u, threads))
+    , m_sampleBudget(std::max<uint64_t>(sampleBudget, kBlockSize))
+{
+}
+
+int SizeEstimator::AddDictionary(std::string dictionary)
+{
+    m_dictionaries.push_back(std::move(dictionary));
+    return static_cast<int>(m_dictionaries.size() - 1);
+}
+
+bool SizeEstimator::AddFile(const std::string& path, int dictionary)
+{
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        m_lastError = "File not found: " + path;
+        return false;
+    }
+
+    FileEstimate file;
+    file.path = path;
+    file.size = static_cast<uint64_t>(st.st_size);
+    m_files.push_back(std::move(file));
+    m_types.push_back(static_cast<int>(ContentType::FromPath(path)));
+    m_dictionaryOf.push_back(dictionary >= 0 && dictionary < static_cast<int>(m_dictionaries.size()) ? dictionary : -1);
+    return true;
+}
+
+SizeEstimator::Trial SizeEstimator::trialFor(size_t file) const
+{
+    if (m_options.tar) {
+        switch (m_options.tarCompression) {
+        case TarFormat::Compression::None: return Trial::Store;
+        case TarFormat::Compression::Gzip: return Trial::Zlib;
+        default: return Trial::Zstd;
+        }
+    }
+    // A solid block is deflated whole, stored kinds included
+    if (m_options.solid) return Trial::Whole;
+
+    auto kind = static_cast<ContentType::Kind>(m_types[file]);
+    if (m_level == Z_NO_COMPRESSION || ContentType::IsCompressed(kind)) return Trial::Store;
+    // As ZipWriter::CompressStream chooses
+    if (m_dictionaryOf[file] < 0 && Codec::PrefersWholeBuffers() && m_files[file].size <= Codec::kWholeBufferLimit) {
+        return Trial::Whole;
+    }
+    return Trial::Zlib;
+}
+
+std::string SizeEstimator::leadIn(size_t file, size_t window) const
+{
+    if (m_dictionaryOf[file] >= 0) {
+        const std::string& dictionary = m_dictionaries[m_dictionaryOf[file]];
+        return dictionary.substr(dictionary.size() - std::min(dictionary.size(), window));
+    }
+    if (!m_options.solid && !m_options.tar) return {};
+
+    // The stream runs on from the files added before this one
+    std::string lead;
+    for (size_t i = file; i-- > 0 && lead.size() < window;) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(m_files[i].size, window - lead.size()));
+        int fd = ::open(m_files[i].path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        std::string tail(want, '\0');
+        ssize_t got = ::pread(fd, tail.data(), want, static_cast<off_t>(m_files[i].size - want));
+        ::close(fd);
+        if (got > 0) lead.insert(0, tail.data(), static_cast<size_t>(got));
+    }
+    return lead;
+}
+
+double SizeEstimator::overheadOf(size_t file) const
+{
+    const FileEstimate& estimate = m_files[file];
+    double name = static_cast<double>(std::filesystem::path(estimate.path).filename().string().size());
+    if (m_options.tar && m_options.tarCompression == TarFormat::Compression::None) {
+        uint64_t padding = (TarFormat::kBlockSize - estimate.size % TarFormat::kBlockSize) % TarFormat::kBlockSize;
+        return static_cast<double>(TarFormat::kBlockSize + padding);
+    }
+    if (m_options.tar) return static_cast<double>(kTarHeaderCompressed) + name;
+    if (m_options.solid) return static_cast<double>(kSolidRecordSize) + name;
+    return static_cast<double>(kEntryOverhead) + 2 * name;
+}
+
+bool SizeEstimator::sampleFile(size_t index, size_t maxBlocks, Sample& sample) const
+{
+    const FileEstimate& file = m_files[index];
+    Trial trial = trialFor(index);
+    // Each block is primed with the window before it, as the real stream
+    // would have it, so matches into it are not lost; at the start of the
+    // file that is its dictionary or the files before it
+    size_t window = trial == Trial::Zstd ? kZstdWindow : kWindow;
+    std::string lead = leadIn(index, window);
+
+    uint64_t opened = threadCpuNs();
+    int fd = ::open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    z_stream stream{};
+    if (trial == Trial::Zlib && deflateInit2(&stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        ::close(fd);
+        return false;
+    }
+#ifdef ARCHIVEMANAGER_ZSTD
+    struct Context {
+        ZSTD_CCtx* cctx{ZSTD_createCCtx()};
+        ~Context() { ZSTD_freeCCtx(cctx); }
+    };
+    thread_local Context context;
+    if (trial == Trial::Zstd && !context.cctx) {
+        ::close(fd);
+        return false;
+    }
+    if (trial == Trial::Zstd) {
+        ZSTD_CCtx_reset(context.cctx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_compressionLevel, TarFormat::ZstdLevel(m_level));
+    }
+#else
+    if (trial == Trial::Zstd) {
+        ::close(fd);
+        return false;
+    }
+#endif
+    // The tar stream has no CRC-32 unless gzip wraps it; zstd checks its own
+    bool crc = !m_options.tar || m_options.tarCompression == TarFormat::Compression::Gzip;
+
+    // Whole file when it fits in the block budget, else evenly spaced blocks
+    size_t blocks = static_cast<size_t>((file.size + kBlockSize - 1) / kBlockSize);
+    bool whole = blocks <= maxBlocks;
+    blocks = std::min(blocks, maxBlocks);
+
+    std::string in;
+    std::string out;
+    std::string base;
+    Spread ratios;
+    uint64_t untimed = 0; // the job does not compress history on its own
+    bool ok = true;
+    for (size_t b = 0; b < blocks && ok; ++b) {
+        uint64_t offset = b * kBlockSize;
+        if (!whole) {
+            offset = blocks > 1 ? (file.size - kBlockSize) * b / (blocks - 1)
+                                : (file.size - kBlockSize) / 2;
+            offset &= ~uint64_t(4095);
+        }
+        uint64_t fromFile = std::min<uint64_t>(offset, window);
+        size_t fromLead = std::min(lead.size(), window - static_cast<size_t>(fromFile));
+        in.assign(lead, lead.size() - fromLead, fromLead);
+        in.resize(fromLead + fromFile + kBlockSize);
+
+        // Reading, CRC and compression all scale with the bytes; the job does the same
+        uint64_t start = threadCpuNs();
+        ssize_t got = ::pread(fd, in.data() + fromLead, fromFile + kBlockSize, static_cast<off_t>(offset - fromFile));
+        if (got <= static_cast<ssize_t>(fromFile)) {
+            ok = got >= 0 && whole; // file shrank since it was added
+            break;
+        }
+        got -= static_cast<ssize_t>(fromFile);
+        size_t history = fromLead + static_cast<size_t>(fromFile);
+        size_t size = static_cast<size_t>(got);
+        const char* block = in.data() + history;
+        if (crc) Codec::Crc32(0, block, size);
+
+        uint64_t compressed = size;
+        uint64_t elapsed = 0;
+        switch (trial) {
+        case Trial::Store:
+            elapsed = threadCpuNs() - start;
+            break;
+        case Trial::Zlib:
+            deflateReset(&stream);
+            if (history > 0) {
+                deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(in.data()), static_cast<uInt>(history));
+            }
+            out.resize(deflateBound(&stream, static_cast<uLong>(size)));
+            stream.next_in = reinterpret_cast<Bytef*>(in.data() + history);
+            stream.avail_in = static_cast<uInt>(size);
+            stream.next_out = reinterpret_cast<Bytef*>(out.data());
+            stream.avail_out = static_cast<uInt>(out.size());
+            ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+            compressed = out.size() - stream.avail_out;
+            elapsed = threadCpuNs() - start;
+            break;
+        case Trial::Whole: {
+            // Whole-buffer backends take no dictionary: the block's share is
+            // what compressing the history with it adds, and only the block's
+            // part of that call's time counts
+            ok = Codec::Compress(in.data(), history + size, m_level, out);
+            uint64_t spent = threadCpuNs() - start;
+            elapsed = spent * size / (history + size);
+            untimed += spent - elapsed;
+            compressed = out.size();
+            if (ok && history > 0) {
+                uint64_t before = threadCpuNs();
+                ok = Codec::Compress(in.data(), history, m_level, base);
+                compressed -= std::min(compressed, static_cast<uint64_t>(base.size()));
+                untimed += threadCpuNs() - before;
+            }
+            break;
+        }
+        case Trial::Zstd:
+#ifdef ARCHIVEMANAGER_ZSTD
+            if (history > 0) ZSTD_CCtx_refPrefix(context.cctx, in.data(), history);
+            out.resize(ZSTD_compressBound(size));
+            compressed = ZSTD_compress2(context.cctx, out.data(), out.size(), block, size);
+            ok = !ZSTD_isError(compressed);
+            elapsed = threadCpuNs() - start;
+#endif
+            break;
+        }
+        sample.cpuNs += elapsed;
+        if (!ok) break;
+
+        sample.bytes += size;
+        sample.compressed += compressed;
+        ratios.Add(static_cast<double>(compressed) / static_cast<double>(size));
+    }
+
+    if (trial == Trial::Zlib) deflateEnd(&stream);
+    ::close(fd);
+    uint64_t total = threadCpuNs() - opened - untimed;
+    sample.fileNs = total - std::min(sample.cpuNs, total);
+    sample.ratioVariance = ratios.Variance();
+    sample.ok = ok;
+    return ok;
+}
+
+bool SizeEstimator::Run(Estimate& estimate, const std::atomic<bool>* stop)
+{
+    Trace::Span span("estimate size");
+    estimate = Estimate{};
+    if (m_files.empty()) {
+        m_lastError = "No files to estimate";
+        return false;
+    }
+#ifndef ARCHIVEMANAGER_ZSTD
+    if (m_options.tar && m_options.tarCompression != TarFormat::Compression::None &&
+        m_options.tarCompression != TarFormat::Compression::Gzip) {
+        m_lastError = std::string("This build cannot write ") + TarFormat::Name(m_options.tarCompression);
+        return false;
+    }
+#endif
+
+    // The largest files hold most of the bytes, so they are sampled outright
+    // with up to half the budget. The rest are sampled systematically in
+    // proportion to size within each type: a file is read when its bytes
+    // cross the next multiple of step, so any file larger than step is always
+    // read, and each file read below that size stands for step bytes of its
+    // type. Files differ far more than blocks within a file do, so those
+    // representatives are only sampled with one block, to read more of them.
+    // Every type gets at least one file.
+    auto planned = [](const FileEstimate& file, size_t blocks) {
+        return std::min<uint64_t>(file.size, blocks * kBlockSize);
+    };
+    std::vector<size_t> bySize(m_files.size());
+    for (size_t i = 0; i < bySize.size(); ++i) bySize[i] = i;
+    std::sort(bySize.begin(), bySize.end(), [this](size_t a, size_t b) {
+        return m_files[a].size > m_files[b].size;
+    });
+
+    std::vector<size_t> chosen;
+    std::vector<bool> isChosen(m_files.size(), false);
+    uint64_t budget = m_sampleBudget / 2;
+    size_t largest = 0;
+    while (largest < bySize.size() && chosen.size() < kMaxSampledFiles / 2 &&
+           planned(m_files[bySize[largest]], kMaxBlocks) <= budget) {
+        budget -= planned(m_files[bySize[largest]], kMaxBlocks);
+        isChosen[bySize[largest]] = true;
+        chosen.push_back(bySize[largest++]);
+    }
+    budget += m_sampleBudget - m_sampleBudget / 2;
+
+    // Expected bytes read and files opened for a given step
+    auto expected = [&](double step, double& opened) {
+        double bytes = 0;
+        opened = 0;
+        for (size_t k = largest; k < bySize.size(); ++k) {
+            const FileEstimate& file = m_files[bySize[k]];
+            double p = std::min(1.0, static_cast<double>(file.size) / step);
+            bytes += p * static_cast<double>(planned(file, p < 1.0 ? 1 : kMaxBlocks));
+            opened += p;
+        }
+        return bytes;
+    };
+    double step = 1; // every file
+    double opened = 0;
+    if (expected(step, opened) > budget || opened > kMaxSampledFiles / 2) {
+        double lo = 1;
+        double hi = static_cast<double>(std::max<uint64_t>(m_files[bySize[0]].size, 1)) *
+                    static_cast<double>(m_files.size());
+        for (int i = 0; i < 48; ++i) {
+            double mid = std::sqrt(lo * hi);
+            bool fits = expected(mid, opened) <= budget && opened <= kMaxSampledFiles / 2;
+            (fits ? hi : lo) = mid;
+        }
+        step = hi;
+    }
+
+    std::vector<bool> representative(m_files.size(), false);
+    std::map<int, double> cumulative;
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        if (isChosen[i] || m_files[i].size == 0) continue;
+        auto [it, first] = cumulative.emplace(m_types[i], 0.0);
+        double before = it->second;
+        it->second += static_cast<double>(m_files[i].size);
+        if (first || std::floor(before / step) != std::floor(it->second / step)) {
+            chosen.push_back(i);
+            representative[i] = static_cast<double>(m_files[i].size) < step;
+        }
+    }
+
+    std::vector<Sample> samples(m_files.size());
+    ParallelFor(chosen.size(), m_threads, [&](size_t k) {
+        if (stop && *stop) return;
+        size_t i = chosen[k];
+        sampleFile(i, representative[i] ? 1 : kMaxBlocks, samples[i]);
+    });
+    if (stop && *stop) {
+        m_lastError = "Estimate cancelled";
+        return false;
+    }
+
+    std::map<int, TypeStats> types;
+    Spread blockSpread; // pooled within-file block variance
+    Spread allRatios;
+    Spread allRates;
+    Spread fileCost; // ns to open and set up a file, whatever its size
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        const Sample& sample = samples[i];
+        TypeStats& type = types[m_types[i]];
+        if (!sample.ok || sample.bytes == 0) {
+            type.unsampledBytes += m_files[i].size;
+            continue;
+        }
+        double ratio = static_cast<double>(sample.compressed) / static_cast<double>(sample.bytes);
+        double rate = static_cast<double>(sample.cpuNs) / static_cast<double>(sample.bytes);
+        type.bytes += sample.bytes;
+        type.compressed += sample.compressed;
+        type.cpuNs += sample.cpuNs;
+        if (representative[i]) {
+            type.ratio.Add(ratio);
+            type.nsPerByte.Add(rate);
+        }
+        allRatios.Add(ratio);
+        allRates.Add(rate);
+        fileCost.Add(static_cast<double>(sample.fileNs));
+        if (sample.ratioVariance >= 0) blockSpread.Add(sample.ratioVariance);
+        estimate.sampledBytes += sample.bytes;
+    }
+
+    double blockVariance = blockSpread.count > 0 ? blockSpread.mean : 0.0;
+    double globalRatio = 1.0; // nothing could be read: assume stored
+    double globalRate = 0;
+    {
+        uint64_t compressed = 0, cpuNs = 0;
+        for (const auto& [id, type] : types) {
+            compressed += type.compressed;
+            cpuNs += type.cpuNs;
+        }
+        if (estimate.sampledBytes > 0) {
+            globalRatio = static_cast<double>(compressed) / static_cast<double>(estimate.sampledBytes);
+            globalRate = static_cast<double>(cpuNs) / static_cast<double>(estimate.sampledBytes);
+        }
+    }
+    auto varianceOr = [](double variance, double fallback) {
+        return variance >= 0 ? variance : std::max(fallback, 0.0);
+    };
+
+    // Files compressed independently of each other contribute their own
+    // variance; a type's pooled ratio (and speed) is shared by all of its
+    // unsampled files, so its error counts once for their combined size
+    double sizeVariance = 0;
+    double timeVariance = 0;
+    double cpuNs = 0;
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        FileEstimate& file = m_files[i];
+        const Sample& sample = samples[i];
+        const TypeStats& type = types[m_types[i]];
+        double size = static_cast<double>(file.size);
+        double overhead = overheadOf(i);
+
+        double ratio;
+        double ratioVariance;
+        double rate;
+        file.sampled = sample.ok && sample.bytes > 0;
+        if (file.sampled) {
+            ratio = static_cast<double>(sample.compressed) / static_cast<double>(sample.bytes);
+            rate = static_cast<double>(sample.cpuNs) / static_cast<double>(sample.bytes);
+            double blocks = std::ceil(static_cast<double>(sample.bytes) / kBlockSize);
+            double unread = 1.0 - static_cast<double>(sample.bytes) / std::max(size, 1.0);
+            ratioVariance = std::max(unread, 0.0) *
+                            varianceOr(sample.ratioVariance, blockVariance) / blocks;
+        } else if (type.ratio.count > 0) {
+            // Each representative stands for the same number of bytes
+            ratio = type.ratio.mean;
+            rate = type.nsPerByte.mean;
+            ratioVariance = varianceOr(type.ratio.Variance(), allRatios.Variance());
+        } else if (type.bytes > 0) {
+            ratio = static_cast<double>(type.compressed) / static_cast<double>(type.bytes);
+            rate = static_cast<double>(type.cpuNs) / static_cast<double>(type.bytes);
+            ratioVariance = varianceOr(allRatios.Variance(), 0.0);
+        } else {
+            ratio = globalRatio;
+            rate = globalRate;
+            ratioVariance = varianceOr(allRatios.Variance(), 0.0);
+        }
+
+        double deviation = size * std::sqrt(ratioVariance);
+        file.compressed = size * ratio + overhead;
+        file.low = std::max(overhead, file.compressed - kZ95 * deviation);
+        file.high = file.compressed + kZ95 * deviation;
+
+        sizeVariance += deviation * deviation;
+        cpuNs += size * rate + fileCost.mean;
+        estimate.uncompressedBytes += file.size;
+        estimate.compressed += file.compressed;
+    }
+
+    for (const auto& [id, type] : types) {
+        double unsampled = static_cast<double>(type.unsampledBytes);
+        double files = std::max(type.ratio.count, 1.0);
+        sizeVariance += unsampled * unsampled *
+                        varianceOr(type.ratio.Variance(), allRatios.Variance()) / files;
+        timeVariance += unsampled * unsampled *
+                        varianceOr(type.nsPerByte.Variance(), allRates.Variance()) / files;
+    }
+
+    double files = static_cast<double>(m_files.size());
+    timeVariance += files * files * varianceOr(fileCost.Variance(), 0.0) / std::max(fileCost.count, 1.0);
+
+    // Dictionaries and solid blocks are entries of their own; a plain tar
+    // ends in two zero blocks padded to a whole record
+    estimate.files = m_files.size();
+    for (const auto& dictionary : m_dictionaries) {
+        estimate.compressed += static_cast<double>(dictionary.size() + kEntryOverhead);
+    }
+    if (m_options.solid && !m_options.tar) {
+        double blocks = std::ceil(static_cast<double>(estimate.uncompressedBytes) /
+                                  static_cast<double>(std::max<uint64_t>(m_options.solidBlockSize, 1)));
+        // Block names end in a six-digit number; the index is one more entry
+        double name = static_cast<double>(ZipFormat::kSolidBlockPrefix.size() + 6);
+        estimate.compressed += (blocks + 1) * (static_cast<double>(kEntryOverhead) + 2 * name);
+    }
+    if (!m_options.tar) {
+        estimate.compressed += kEndRecordSize;
+    } else if (m_options.tarCompression == TarFormat::Compression::None) {
+        double records = std::ceil((estimate.compressed + 2 * TarFormat::kBlockSize) / TarFormat::kRecordSize);
+        estimate.compressed = records * TarFormat::kRecordSize;
+    }
+    double sizeMargin = kZ95 * std::sqrt(sizeVariance);
+    estimate.compressedLow = std::max(0.0, estimate.compressed - sizeMargin);
+    estimate.compressedHigh = estimate.compressed + sizeMargin;
+
+    double toSeconds = 1e-9 / m_jobThreads;
+    double timeMargin = kZ95 * std::sqrt(timeVariance);
+    estimate.seconds = cpuNs * toSeconds;
+    estimate.secondsLow = std::max(0.0, cpuNs - timeMargin) * toSeconds;
+    estimate.secondsHigh = (cpuNs + timeMargin) * toSeconds;
+
+    span.AddBytes(estimate.sampledBytes);
+    return true;
+}
@@ -0,0 +1,110 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ArchiveOptions.h"
+#include "Parallel.h"
+
+// Predicts the compressed size of a selection, and how long compressing it
+// takes, by trial-compressing sampled blocks the way the job in the given
+// ArchiveOptions compresses them:
+//   ZIP entries   raw deflate through Codec: its whole-buffer backend up to
+//                 kWholeBufferLimit, zlib above that and with a dictionary;
+//                 already compressed kinds are stored
+//   dictionary    files added with a dictionary start primed with it
+//   solid, tar    files run on in one stream, in the order they were added,
+//                 so a file starts primed with the end of the ones before
+//   tar.gz        zlib; tar.zst with libzstd at TarFormat::ZstdLevel
+//
+// Each sampled file contributes evenly spaced 64 KB blocks (up to kMaxBlocks).
+// Its compressed size is extrapolated from the ratio of those blocks; the
+// spread between them gives its uncertainty. The largest files are always
+// sampled, since they hold most of the bytes. When the rest of the selection
+// is larger than the sample budget, only every k-th remaining file of each
+// type (ContentType kind by name) is read, and the others get their type's
+// pooled ratio, with the between-file spread as uncertainty. Bounds are 95%
+// intervals that assume files vary independently.
+//
+// Each block is compressed on its own, primed with the 32 KB before it, so
+// it sees the same window as deflate does in the real stream; zstd's window
+// is larger, so its estimates lean high for long-range repeats.
+// Times are CPU time (reading from the page cache, CRC and compression, plus
+// a fixed cost per file), so a cold disk slower than the codec is not seen.
+class SizeEstimator {
+public:
+    struct FileEstimate {
+        std::string path;
+        uint64_t size{0};
+        double compressed{0};
+        double low{0};
+        double high{0};
+        bool sampled{false};
+    };
+
+    struct Estimate {
+        uint64_t files{0};
+        uint64_t uncompressedBytes{0};
+        uint64_t sampledBytes{0};
+        double compressed{0}; // bytes
+        double compressedLow{0};
+        double compressedHigh{0};
+        double seconds{0};    // wall time on the given thread count
+        double secondsLow{0};
+        double secondsHigh{0};
+    };
+
+    static constexpr size_t kBlockSize = 64 * 1024;
+    static constexpr size_t kMaxBlocks = 8;
+
+    // threads compress the samples; jobThreads is how many threads the real
+    // job will compress on, used to turn CPU time into wall time
+    explicit SizeEstimator(const ArchiveOptions& options, unsigned jobThreads = 1,
+                           unsigned threads = DefaultThreadCount(), uint64_t sampleBudget = 64ull * 1024 * 1024);
+
+    // A preset dictionary the job stores in the archive; returns the index
+    // AddFile takes for the files primed with it
+    int AddDictionary(std::string dictionary);
+
+    bool AddFile(const std::string& path, int dictionary = -1);
+
+    // Once stop is set, files not yet sampled are skipped and Run fails
+    bool Run(Estimate& estimate, const std::atomic<bool>* stop = nullptr);
+
+    // Valid after Run, in the order files were added
+    const std::vector<FileEstimate>& GetFiles() const { return m_files; }
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct Sample {
+        uint64_t bytes{0};
+        uint64_t compressed{0};
+        uint64_t cpuNs{0};  // reading, checksumming and compressing the blocks
+        uint64_t fileNs{0}; // everything else: open, codec setup, close
+        double ratioVariance{-1}; // of the block ratios, -1 with one block
+        bool ok{false};
+    };
+
+    // How the job compresses a file
+    enum class Trial : uint8_t { Store, Zlib, Whole, Zstd };
+
+    Trial trialFor(size_t file) const;
+    std::string leadIn(size_t file, size_t window) const;
+    double overheadOf(size_t file) const;
+    bool sampleFile(size_t file, size_t maxBlocks, Sample& sample) const;
+
+    ArchiveOptions m_options;
+    int m_level;
+    unsigned m_jobThreads;
+    unsigned m_threads;
+    uint64_t m_sampleBudget;
+    std::vector<FileEstimate> m_files;
+    std::vector<int> m_types;
+    std::vector<int> m_dictionaryOf; // per file, -1 for none
+    std::vector<std::string> m_dictionaries;
+    std::string m_lastError;
+};
@@ -0,0 +1,197 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "SolidArchive.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include "zlib.h"
+#include "Codec.h"
+#include "Trace.h"
+
+namespace {
+    bool readFully(int fd, char* buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0) {
+            ssize_t n = ::pread(fd, buffer, size, static_cast<off_t>(offset));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return false;
+            }
+            buffer += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
+
+SolidArchiveWriter::SolidArchiveWriter(uint64_t blockSize, int level, unsigned threads)
+    : m_blockSize(std::max<uint64_t>(blockSize, 64 * 1024))
+    , m_level(level)
+    , m_threads(std::max(1u, threads))
+{
+}
+
+bool SolidArchiveWriter::AddFile(const std::string& sourcePath, const std::string& entryName)
+{
+    struct stat st{};
+    if (::stat(sourcePath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        m_lastError = "File not found: " + sourcePath;
+        return false;
+    }
+
+    Member member;
+    member.name = entryName;
+    member.sourcePath = sourcePath;
+    member.offset = m_totalSize;
+    member.size = static_cast<uint64_t>(st.st_size);
+    member.dosDateTime = ZipFormat::ToDosDateTime(st.st_mtime);
+    member.externalAttributes = static_cast<uint32_t>(st.st_mode & 0xffff) << 16;
+
+    m_totalSize += member.size;
+    m_members.push_back(std::move(member));
+    return true;
+}
+
+void SolidArchiveWriter::buildBlock(size_t index, Block& block)
+{
+    Trace::Span span("solid block");
+    uint64_t blockStart = index * m_blockSize;
+    uint64_t blockEnd = std::min(m_totalSize, blockStart + m_blockSize);
+    std::string data(static_cast<size_t>(blockEnd - blockStart), '\0');
+
+    // First member that ends inside or after this block
+    auto it = std::partition_point(m_members.begin(), m_members.end(),
+        [blockStart](const Member& m) { return m.offset + m.size <= blockStart; });
+
+    for (; it != m_members.end() && it->offset < blockEnd; ++it) {
+        if (it->size == 0) continue;
+
+        uint64_t from = std::max(blockStart, it->offset);
+        uint64_t to = std::min(blockEnd, it->offset + it->size);
+        char* dest = data.data() + (from - blockStart);
+
+        int fd = ::open(it->sourcePath.c_str(), O_RDONLY);
+        bool ok = fd >= 0 && readFully(fd, dest, static_cast<size_t>(to - from), from - it->offset);
+        if (fd >= 0) ::close(fd);
+        if (!ok) {
+            block.error = "Failed to read: " + it->sourcePath;
+            return;
+        }
+
+        size_t member = static_cast<size_t>(it - m_members.begin());
+        size_t slice = static_cast<size_t>(index - it->offset / m_blockSize);
+        m_sliceCrcs[member][slice] = Codec::Crc32(0, dest, static_cast<size_t>(to - from));
+    }
+
+    block.size = data.size();
+    span.AddBytes(block.size);
+    block.crc = Codec::Crc32(0, data.data(), data.size());
+    if (!Codec::Compress(data.data(), data.size(), m_level, block.compressed)) {
+        block.error = "Failed to compress solid block";
+        return;
+    }
+    block.ok = true;
+}
+
+std::string SolidArchiveWriter::buildIndex(size_t blockCount) const
+{
+    std::string index;
+    ZipFormat::PutU32(index, ZipFormat::kSolidIndexMagic);
+    ZipFormat::PutU16(index, ZipFormat::kSolidIndexVersion);
+    ZipFormat::PutU64(index, m_blockSize);
+    ZipFormat::PutU32(index, static_cast<uint32_t>(blockCount));
+    ZipFormat::PutU32(index, static_cast<uint32_t>(m_members.size()));
+    for (const auto& member : m_members) {
+        ZipFormat::PutU16(index, static_cast<uint16_t>(member.name.size()));
+        index += member.name;
+        ZipFormat::PutU64(index, member.offset);
+        ZipFormat::PutU64(index, member.size);
+        ZipFormat::PutU32(index, member.crc);
+        ZipFormat::PutU32(index, member.dosDateTime);
+        ZipFormat::PutU32(index, member.externalAttributes);
+    }
+    return index;
+}
+
+bool SolidArchiveWriter::WriteTo(ZipWriter& writer, const ProgressFn& progress)
+{
+    size_t blockCount = static_cast<size_t>((m_totalSize + m_blockSize - 1) / m_blockSize);
+
+    m_sliceCrcs.assign(m_members.size(), {});
+    for (size_t i = 0; i < m_members.size(); ++i) {
+        const auto& m = m_members[i];
+        if (m.size == 0) continue;
+        uint64_t first = m.offset / m_blockSize;
+        uint64_t last = (m.offset + m.size - 1) / m_blockSize;
+        m_sliceCrcs[i].assign(static_cast<size_t>(last - first + 1), 0);
+    }
+
+    // Compress a wave of blocks in parallel, then write them in order
+    std::vector<Block> wave;
+    for (size_t waveStart = 0; waveStart < blockCount; waveStart += m_threads) {
+        size_t waveSize = std::min<size_t>(m_threads, blockCount - waveStart);
+        wave.assign(waveSize, Block{});
+
+        ParallelFor(waveSize, m_threads, [this, waveStart, &wave](size_t i) {
+            buildBlock(waveStart + i, wave[i]);
+        });
+
+        for (size_t i = 0; i < waveSize; ++i) {
+            if (!wave[i].ok) {
+                m_lastError = wave[i].error;
+                return false;
+            }
+
+            char number[16];
+            std::snprintf(number, sizeof(number), "%06zu", waveStart + i);
+
+            ZipWriterEntry entry;
+            entry.name = ZipFormat::kSolidBlockPrefix + number;
+            entry.method = ZipFormat::kMethodDeflate;
+            entry.flags |= ZipFormat::DeflateOptionFlags(m_level);
+            entry.crc = wave[i].crc;
+            entry.uncompressedSize = wave[i].size;
+            entry.dosDateTime = ZipFormat::ToDosDateTime(std::time(nullptr));
+            entry.externalAttributes = static_cast<uint32_t>(S_IFREG | 0644) << 16;
+            if (!writer.AddCompressed(std::move(entry), wave[i].compressed)) {
+                m_lastError = writer.GetLastError();
+                return false;
+            }
+        }
+
+        if (progress) {
+            size_t done = waveStart + waveSize;
+            progress(static_cast<int>(done * 100 / blockCount),
+                     "Compressed solid block " + std::to_string(done) + " of " +
+                     std::to_string(blockCount));
+        }
+    }
+
+    // Stitch the per-block CRCs of members that span several blocks
+    for (size_t i = 0; i < m_members.size(); ++i) {
+        auto& m = m_members[i];
+        if (m.size == 0) continue;
+
+        uint64_t sliceStart = m.offset;
+        uLong crc = 0;
+        for (uint32_t sliceCrc : m_sliceCrcs[i]) {
+            uint64_t sliceEnd = std::min(m.offset + m.size, (sliceStart / m_blockSize + 1) * m_blockSize);
+            crc = crc32_combine(crc, sliceCrc, static_cast<z_off_t>(sliceEnd - sliceStart));
+            sliceStart = sliceEnd;
+        }
+        m.crc = static_cast<uint32_t>(crc);
+    }
+
+    if (!writer.AddBuffer(ZipFormat::kSolidIndexName, buildIndex(blockCount), Z_BEST_COMPRESSION)) {
+        m_lastError = writer.GetLastError();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Parallel.h"
+#include "ZipWriter.h"
+
+// Writes files as one solid stream cut into independently deflated blocks
+// (see ZipFormat.h). Consecutive files share a compression window, so the
+// PathOptimizer ordering actually improves the ratio, while every block can
+// still be decoded on its own for random access and parallelism.
+class SolidArchiveWriter {
+public:
+    SolidArchiveWriter(uint64_t blockSize, int level, unsigned threads = DefaultThreadCount());
+
+    bool AddFile(const std::string& sourcePath, const std::string& entryName);
+
+    // Compresses the blocks in parallel and appends them plus the index to writer
+    using ProgressFn = std::function<void(int percent, const std::string& status)>;
+    bool WriteTo(ZipWriter& writer, const ProgressFn& progress);
+
+    size_t GetMemberCount() const { return m_members.size(); }
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct Member {
+        std::string name;
+        std::string sourcePath;
+        uint64_t offset{0};
+        uint64_t size{0};
+        uint32_t crc{0};
+        uint32_t dosDateTime{0};
+        uint32_t externalAttributes{0};
+    };
+
+    struct Block {
+        std::string compressed;
+        uint32_t crc{0};
+        uint64_t size{0};
+        bool ok{false};
+        std::string error;
+    };
+
+    void buildBlock(size_t index, Block& block);
+    std::string buildIndex(size_t blockCount) const;
+
+    uint64_t m_blockSize;
+    int m_level;
+    unsigned m_threads;
+    uint64_t m_totalSize{0};
+    std::vector<Member> m_members;
+    std::vector<std::vector<uint32_t>> m_sliceCrcs; // per member, one per touched block
+    std::string m_lastError;
+};
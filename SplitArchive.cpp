@@ -0,0 +1,378 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "SplitArchive.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "zlib.h"
+#include "Trace.h"
+
+namespace {
+    // Entries above this size are compressed to a temporary file, not memory
+    constexpr uint64_t kSpillThreshold = 32ull * 1024 * 1024;
+    // Uncompressed bytes and entry count compressed per parallel wave
+    constexpr uint64_t kWaveBytes = 256ull * 1024 * 1024;
+    constexpr size_t kWaveEntries = 4096;
+    constexpr size_t kCopyBufferSize = 1024 * 1024;
+}
+
+SplitArchiveWriter::SplitArchiveWriter(const std::string& outputPath, uint64_t volumeSize,
+                                       int level, unsigned threads)
+    : m_outputPath(outputPath)
+    , m_volumeSize(std::max<uint64_t>(volumeSize, 256 * 1024))
+    , m_level(level)
+    , m_threads(std::max(1u, threads))
+{
+}
+
+SplitArchiveWriter::~SplitArchiveWriter()
+{
+    for (int fd : m_fds) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+bool SplitArchiveWriter::AddFile(const std::string& sourcePath, const std::string& entryName, bool store)
+{
+    struct stat st{};
+    if (::stat(sourcePath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        m_lastError = "File not found: " + sourcePath;
+        return false;
+    }
+
+    Source source;
+    source.path = sourcePath;
+    source.name = entryName;
+    source.size = static_cast<uint64_t>(st.st_size);
+    source.dosDateTime = ZipFormat::ToDosDateTime(st.st_mtime);
+    source.externalAttributes = static_cast<uint32_t>(st.st_mode & 0xffff) << 16;
+    source.store = store;
+    m_sources.push_back(std::move(source));
+    return true;
+}
+
+void SplitArchiveWriter::compress(const Source& source, size_t index, Compressed& out)
+{
+    int level = source.store ? Z_NO_COMPRESSION : m_level;
+    ZipWriterEntry& entry = out.entry;
+    entry.name = source.name;
+    entry.method = level == Z_NO_COMPRESSION ? ZipFormat::kMethodStore : ZipFormat::kMethodDeflate;
+    if (entry.method == ZipFormat::kMethodDeflate) entry.flags |= ZipFormat::DeflateOptionFlags(level);
+    entry.dosDateTime = source.dosDateTime;
+    entry.externalAttributes = source.externalAttributes;
+
+    std::FILE* in = std::fopen(source.path.c_str(), "rb");
+    if (!in) {
+        out.error = "Failed to open: " + source.path;
+        return;
+    }
+
+    std::FILE* spill = nullptr;
+    if (source.size > kSpillThreshold) {
+        out.spillPath = m_outputPath + ".spill-" + std::to_string(index);
+        spill = std::fopen(out.spillPath.c_str(), "wb");
+        if (!spill) {
+            std::fclose(in);
+            out.error = "Failed to create temporary file: " + out.spillPath;
+            return;
+        }
+    } else {
+        out.data.reserve(static_cast<size_t>(source.size / 2));
+    }
+
+    bool ok = ZipWriter::CompressStream(
+        [in](char* buffer, size_t size) { return std::fread(buffer, 1, size, in); },
+        [&out, spill](const char* data, size_t size) {
+            if (spill) return std::fwrite(data, 1, size, spill) == size;
+            out.data.append(data, size);
+            return true;
+        },
+        entry.method, level, {}, entry.crc, entry.uncompressedSize);
+
+    std::fclose(in);
+    if (spill) {
+        entry.compressedSize = static_cast<uint64_t>(ftello(spill));
+        if (std::fclose(spill) != 0) ok = false;
+    } else {
+        entry.compressedSize = out.data.size();
+    }
+
+    if (!ok) {
+        if (spill) std::remove(out.spillPath.c_str());
+        out.error = "Failed to compress: " + source.path;
+        return;
+    }
+
+    entry.zip64 = entry.compressedSize >= ZipFormat::kZip64Marker32 ||
+                  entry.uncompressedSize >= ZipFormat::kZip64Marker32;
+    out.header = ZipWriter::BuildLocalHeader(entry);
+    out.ok = true;
+}
+
+void SplitArchiveWriter::place(uint64_t recordSize)
+{
+    // Headers and end records never straddle two volumes
+    if (m_cursor.offset + recordSize > m_volumeSize) {
+        ++m_cursor.disk;
+        m_cursor.offset = 0;
+    }
+}
+
+void SplitArchiveWriter::advance(Cursor& cursor, uint64_t size) const
+{
+    while (size > 0) {
+        if (cursor.offset == m_volumeSize) {
+            ++cursor.disk;
+            cursor.offset = 0;
+        }
+        uint64_t step = std::min(size, m_volumeSize - cursor.offset);
+        cursor.offset += step;
+        size -= step;
+    }
+}
+
+int SplitArchiveWriter::volumeFd(uint32_t disk)
+{
+    std::lock_guard<std::mutex> lock(m_fdMutex);
+    if (disk >= m_fds.size()) {
+        m_fds.resize(disk + 1, -1);
+        m_created.resize(disk + 1, false);
+    }
+    if (m_fds[disk] < 0) {
+        m_fds[disk] = ::open(ZipFormat::SplitVolumePath(m_outputPath, disk).c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (m_fds[disk] >= 0) m_created[disk] = true;
+    }
+    return m_fds[disk];
+}
+
+bool SplitArchiveWriter::writeSpan(Cursor& cursor, const char* data, size_t size)
+{
+    while (size > 0) {
+        if (cursor.offset == m_volumeSize) {
+            ++cursor.disk;
+            cursor.offset = 0;
+        }
+        size_t step = static_cast<size_t>(std::min<uint64_t>(size, m_volumeSize - cursor.offset));
+        int fd = volumeFd(cursor.disk);
+        if (fd < 0) return false;
+
+        ssize_t n = ::pwrite(fd, data, step, static_cast<off_t>(cursor.offset));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        cursor.offset += static_cast<uint64_t>(n);
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool SplitArchiveWriter::writeCompressed(const Compressed& item, Cursor cursor)
+{
+    Trace::Span span("write volume");
+    span.AddBytes(item.header.size() + item.entry.compressedSize);
+    if (!writeSpan(cursor, item.header.data(), item.header.size())) return false;
+
+    if (item.spillPath.empty()) {
+        return writeSpan(cursor, item.data.data(), item.data.size());
+    }
+
+    std::FILE* spill = std::fopen(item.spillPath.c_str(), "rb");
+    if (!spill) return false;
+    std::vector<char> buffer(kCopyBufferSize);
+    bool ok = true;
+    size_t n;
+    while (ok && (n = std::fread(buffer.data(), 1, buffer.size(), spill)) > 0) {
+        ok = writeSpan(cursor, buffer.data(), n);
+    }
+    std::fclose(spill);
+    std::remove(item.spillPath.c_str());
+    return ok;
+}
+
+bool SplitArchiveWriter::finishVolumes(uint32_t upTo, const VolumeFn& volumeDone)
+{
+    for (; m_finishedVolumes < upTo; ++m_finishedVolumes) {
+        int fd = volumeFd(m_finishedVolumes);
+        int result = ::close(fd);
+        {
+            std::lock_guard<std::mutex> lock(m_fdMutex);
+            m_fds[m_finishedVolumes] = -1;
+        }
+        if (result != 0) {
+            m_lastError = "Failed to finalize volume " + std::to_string(m_finishedVolumes + 1);
+            return false;
+        }
+        if (volumeDone) {
+            volumeDone(ZipFormat::SplitVolumePath(m_outputPath, m_finishedVolumes));
+        }
+    }
+    return true;
+}
+
+void SplitArchiveWriter::discard(const std::vector<Compressed>& wave)
+{
+    for (const auto& item : wave) {
+        if (!item.spillPath.empty()) std::remove(item.spillPath.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(m_fdMutex);
+    for (uint32_t disk = 0; disk < m_fds.size(); ++disk) {
+        if (m_fds[disk] >= 0) ::close(m_fds[disk]);
+        m_fds[disk] = -1;
+        if (m_created[disk]) std::remove(ZipFormat::SplitVolumePath(m_outputPath, disk).c_str());
+    }
+}
+
+bool SplitArchiveWriter::Write(const ProgressFn& progress, const VolumeFn& volumeDone)
+{
+    m_cursor = Cursor{};
+    m_entries.clear();
+    m_entries.reserve(m_sources.size());
+    m_skipped = 0;
+
+    // A failed archive leaves neither temporary files nor partial volumes behind
+    std::vector<Compressed> wave;
+    struct Cleanup {
+        SplitArchiveWriter& writer;
+        const std::vector<Compressed>& wave;
+        bool keep{false};
+        ~Cleanup()
+        {
+            if (!keep) writer.discard(wave);
+        }
+    } cleanup{*this, wave};
+
+    std::string signature;
+    ZipFormat::PutU32(signature, ZipFormat::kSplitSignature);
+    if (!writeSpan(m_cursor, signature.data(), signature.size())) {
+        m_lastError = "Failed to create volume: " + ZipFormat::SplitVolumePath(m_outputPath, 0);
+        return false;
+    }
+
+    for (size_t waveStart = 0; waveStart < m_sources.size();) {
+        size_t waveEnd = waveStart;
+        uint64_t waveBytes = 0;
+        while (waveEnd < m_sources.size() && waveEnd - waveStart < kWaveEntries &&
+               (waveEnd == waveStart || waveBytes + m_sources[waveEnd].size <= kWaveBytes)) {
+            waveBytes += std::min(m_sources[waveEnd].size, kSpillThreshold);
+            ++waveEnd;
+        }
+
+        wave.assign(waveEnd - waveStart, Compressed{});
+        ParallelFor(wave.size(), m_threads, [this, waveStart, &wave](size_t i) {
+            compress(m_sources[waveStart + i], waveStart + i, wave[i]);
+        });
+
+        // Sizes are known now, so every entry gets its final position; files
+        // that could not be read are left out, like the other writers do
+        std::vector<Cursor> positions(wave.size());
+        for (size_t i = 0; i < wave.size(); ++i) {
+            if (!wave[i].ok) {
+                m_lastError = wave[i].error;
+                ++m_skipped;
+                if (progress) progress(static_cast<int>(waveStart * 100 / m_sources.size()), wave[i].error);
+                continue;
+            }
+            place(wave[i].header.size());
+            positions[i] = m_cursor;
+            wave[i].entry.disk = m_cursor.disk;
+            wave[i].entry.localHeaderOffset = m_cursor.offset;
+            advance(m_cursor, wave[i].header.size() + wave[i].entry.compressedSize);
+        }
+
+        std::atomic<bool> ok{true};
+        ParallelFor(wave.size(), m_threads, [this, &wave, &positions, &ok](size_t i) {
+            if (wave[i].ok && ok && !writeCompressed(wave[i], positions[i])) ok = false;
+        });
+        if (!ok) {
+            m_lastError = "Failed to write volume data";
+            return false;
+        }
+
+        for (auto& item : wave) {
+            if (item.ok) m_entries.push_back(std::move(item.entry));
+        }
+
+        uint32_t complete = m_cursor.offset == m_volumeSize ? m_cursor.disk + 1 : m_cursor.disk;
+        if (!finishVolumes(complete, volumeDone)) return false;
+
+        waveStart = waveEnd;
+        if (progress) {
+            progress(static_cast<int>(waveStart * 100 / m_sources.size()),
+                     "Written " + std::to_string(waveStart) + " files into " +
+                     std::to_string(m_cursor.disk + 1) + " volumes");
+        }
+    }
+
+    // Central directory, again without splitting a record between volumes
+    Cursor centralStart{};
+    uint64_t centralSize = 0;
+    uint64_t entriesOnLastDisk = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        std::string central = ZipWriter::BuildCentralHeader(m_entries[i]);
+        place(central.size());
+        if (i == 0) centralStart = m_cursor;
+        if (m_cursor.offset == 0) entriesOnLastDisk = 0;
+        ++entriesOnLastDisk;
+        centralSize += central.size();
+        if (!writeSpan(m_cursor, central.data(), central.size())) {
+            m_lastError = "Failed to write central directory";
+            return false;
+        }
+    }
+    if (m_entries.empty()) {
+        centralStart = m_cursor;
+    }
+
+    // The end records have a fixed size, so measure them before placing them
+    std::string end = ZipWriter::BuildEndRecords(m_entries.size(), entriesOnLastDisk, centralSize,
+                                                 centralStart.offset, centralStart.disk,
+                                                 m_cursor.disk, m_cursor.offset);
+    uint32_t diskBefore = m_cursor.disk;
+    place(end.size());
+    if (m_cursor.disk != diskBefore) {
+        end = ZipWriter::BuildEndRecords(m_entries.size(), 0, centralSize, centralStart.offset,
+                                         centralStart.disk, m_cursor.disk, m_cursor.offset);
+    }
+    if (!writeSpan(m_cursor, end.data(), end.size())) {
+        m_lastError = "Failed to write end of central directory";
+        return false;
+    }
+
+    // A single volume is an ordinary archive; the spec marks it with "PK00"
+    if (m_cursor.disk == 0) {
+        std::string marker;
+        ZipFormat::PutU32(marker, ZipFormat::kSingleSegmentMarker);
+        Cursor start{};
+        if (!writeSpan(start, marker.data(), marker.size())) {
+            m_lastError = "Failed to write archive header";
+            return false;
+        }
+    }
+
+    uint32_t last = m_cursor.disk;
+    if (!finishVolumes(last, volumeDone)) return false;
+
+    int result = ::close(volumeFd(last));
+    m_fds[last] = -1;
+    std::string lastVolume = ZipFormat::SplitVolumePath(m_outputPath, last);
+    if (result != 0 || std::rename(lastVolume.c_str(), m_outputPath.c_str()) != 0) {
+        m_lastError = "Failed to finalize archive";
+        return false;
+    }
+    cleanup.keep = true;
+    if (volumeDone) {
+        volumeDone(m_outputPath);
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Parallel.h"
+#include "ZipWriter.h"
+
+// Writes a PKWARE split archive (see ZipFormat.h), no volume larger than
+// the volume size. Entries are compressed in
+// parallel waves; once a wave's compressed sizes are known every entry has a
+// fixed (volume, offset) position, so the entries are written concurrently
+// into whichever volumes they land on. Volumes behind the write position are
+// closed and reported through VolumeFn, so uploads can start early.
+//
+// Files that cannot be read when their wave is compressed are left out and
+// reported through ProgressFn (and GetLastError); Write fails only when the
+// archive itself cannot be written, and then removes the volumes and
+// temporary files it made.
+class SplitArchiveWriter {
+public:
+    SplitArchiveWriter(const std::string& outputPath, uint64_t volumeSize, int level,
+                       unsigned threads = DefaultThreadCount());
+    ~SplitArchiveWriter();
+
+    SplitArchiveWriter(const SplitArchiveWriter&) = delete;
+    SplitArchiveWriter& operator=(const SplitArchiveWriter&) = delete;
+
+    // store keeps already compressed content as is, whatever the level
+    bool AddFile(const std::string& sourcePath, const std::string& entryName, bool store = false);
+
+    using ProgressFn = std::function<void(int percent, const std::string& status)>;
+    using VolumeFn = std::function<void(const std::string& volumePath)>;
+    bool Write(const ProgressFn& progress, const VolumeFn& volumeDone = {});
+
+    uint32_t GetVolumeCount() const { return m_cursor.disk + 1; }
+    // Files Write left out because they could not be read or compressed
+    size_t GetSkippedCount() const { return m_skipped; }
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct Source {
+        std::string path;
+        std::string name;
+        uint64_t size{0};
+        uint32_t dosDateTime{0};
+        uint32_t externalAttributes{0};
+        bool store{false};
+    };
+
+    struct Compressed {
+        ZipWriterEntry entry;
+        std::string header;
+        std::string data;      // compressed bytes of small entries
+        std::string spillPath; // large entries are compressed to a temporary file
+        bool ok{false};
+        std::string error;
+    };
+
+    struct Cursor {
+        uint32_t disk{0};
+        uint64_t offset{0};
+    };
+
+    void compress(const Source& source, size_t index, Compressed& out);
+    void place(uint64_t recordSize);
+    void advance(Cursor& cursor, uint64_t size) const;
+    bool writeSpan(Cursor& cursor, const char* data, size_t size);
+    bool writeCompressed(const Compressed& item, Cursor cursor);
+    int volumeFd(uint32_t disk);
+    bool finishVolumes(uint32_t upTo, const VolumeFn& volumeDone);
+    void discard(const std::vector<Compressed>& wave);
+
+    std::string m_outputPath;
+    uint64_t m_volumeSize;
+    int m_level;
+    unsigned m_threads;
+    std::vector<Source> m_sources;
+    std::vector<ZipWriterEntry> m_entries;
+    Cursor m_cursor;
+    size_t m_skipped{0};
+
+    std::mutex m_fdMutex;
+    std::vector<int> m_fds;
+    std::vector<bool> m_created; // volumes this writer made, removed if it fails
+    uint32_t m_finishedVolumes{0};
+    std::string m_lastError;
+};
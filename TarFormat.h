@@ -0,0 +1,187 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// On-disk constants of the tar family shared by TarWriter and TarReader.
+//
+// Tar: POSIX ustar (IEEE 1003.1-1988) 512-byte headers, each followed by the
+// file data padded to a multiple of 512 bytes, and two zero blocks at the
+// end. Names longer than the 100-byte name field are split into the 155-byte
+// prefix field where possible, otherwise carried in a pax extended header
+// ('x'). Sizes from 8 GB on use the GNU base-256 encoding. GNU long names
+// ('L') are read as well.
+//
+// Compression wraps the whole tar stream:
+//   Gzip          RFC 1952, one member; written pigz-style as independently
+//                 deflated blocks joined by sync flushes, so any gunzip
+//                 reads it, and decoded as one stream
+//   Zstd          one zstd frame, compressed on several threads by libzstd
+//   SeekableZstd  the zstd seekable format: independent frames of
+//                 kSeekableFrameSize uncompressed bytes, followed by a seek
+//                 table in a skippable frame; plain zstd decoders read it as
+//                 an ordinary .zst, and TarReader decodes only the frames
+//                 holding what it needs
+//     seek table: u32 magic kSeekTableFrameMagic, u32 frame size, then per
+//     frame u32 compressed size, u32 decompressed size; then the footer:
+//     u32 frame count, u8 descriptor (bit 7: per-frame checksums, not
+//     written), u32 kSeekableMagic
+namespace TarFormat {
+    constexpr size_t kBlockSize = 512;
+    constexpr size_t kRecordSize = 20 * kBlockSize; // what tar pads the end to
+
+    // ustar header fields: offset and length
+    constexpr size_t kNameOffset = 0, kNameSize = 100;
+    constexpr size_t kModeOffset = 100, kModeSize = 8;
+    constexpr size_t kUidOffset = 108, kUidSize = 8;
+    constexpr size_t kGidOffset = 116, kGidSize = 8;
+    constexpr size_t kSizeOffset = 124, kSizeSize = 12;
+    constexpr size_t kMtimeOffset = 136, kMtimeSize = 12;
+    constexpr size_t kChecksumOffset = 148, kChecksumSize = 8;
+    constexpr size_t kTypeOffset = 156;
+    constexpr size_t kLinkNameOffset = 157, kLinkNameSize = 100;
+    constexpr size_t kMagicOffset = 257;
+    constexpr size_t kVersionOffset = 263;
+    constexpr size_t kPrefixOffset = 345, kPrefixSize = 155;
+
+    constexpr char kMagic[] = "ustar"; // with its NUL, then version "00"
+
+    constexpr char kTypeFile = '0';
+    constexpr char kTypeFileOld = '\0';
+    constexpr char kTypeHardLink = '1';
+    constexpr char kTypeSymlink = '2';
+    constexpr char kTypeDirectory = '5';
+    constexpr char kTypeContiguous = '7'; // a regular file to everyone else
+    constexpr char kTypePax = 'x';
+    constexpr char kTypePaxGlobal = 'g';
+    constexpr char kTypeGnuLongName = 'L';
+    constexpr char kTypeGnuLongLink = 'K';
+
+    // Largest size the 11 octal digits of the size field hold
+    constexpr uint64_t kMaxOctalSize = (1ull << 33) - 1;
+
+    constexpr unsigned char kGzipMagic[] = {0x1f, 0x8b};
+    constexpr uint32_t kZstdMagic = 0xFD2FB528;
+    constexpr uint32_t kSkippableMagicMask = 0xFFFFFFF0;
+    constexpr uint32_t kSkippableMagic = 0x184D2A50;
+    constexpr uint32_t kSeekTableFrameMagic = 0x184D2A5E;
+    constexpr uint32_t kSeekableMagic = 0x8F92EAB1;
+    constexpr size_t kSeekTableFooterSize = 9;
+    constexpr size_t kSeekTableEntrySize = 8;
+    constexpr uint8_t kSeekTableChecksumFlag = 0x80;
+    constexpr size_t kSeekableFrameSize = 1 << 20;
+
+    enum class Compression : uint8_t { None, Gzip, Zstd, SeekableZstd };
+
+    inline const char* Name(Compression compression) {
+        switch (compression) {
+        case Compression::Gzip: return "tar.gz";
+        case Compression::Zstd: return "tar.zst";
+        case Compression::SeekableZstd: return "seekable tar.zst";
+        default: return "tar";
+        }
+    }
+
+    inline const char* Extension(Compression compression) {
+        switch (compression) {
+        case Compression::Gzip: return ".tar.gz";
+        case Compression::Zstd:
+        case Compression::SeekableZstd: return ".tar.zst";
+        default: return ".tar";
+        }
+    }
+
+    // zlib level -> zstd level; zstd cannot store, so 0 is its fastest
+    inline int ZstdLevel(int level) {
+        constexpr int kZstdLevels[10] = {1, 1, 2, 2, 3, 3, 3, 5, 9, 19};
+        return kZstdLevels[level < 0 ? 0 : level > 9 ? 9 : level];
+    }
+
+    inline uint32_t GetU32(const unsigned char* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline void PutU32(std::string& out, uint32_t v) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out.push_back(static_cast<char>((v >> shift) & 0xff));
+        }
+    }
+
+    // Header checksum: the sum of all bytes with the checksum field as spaces
+    inline uint32_t Checksum(const char* header) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            bool field = i >= kChecksumOffset && i < kChecksumOffset + kChecksumSize;
+            sum += field ? ' ' : static_cast<unsigned char>(header[i]);
+        }
+        return sum;
+    }
+
+    // Numeric field: octal digits, or GNU base-256 when the top bit is set
+    inline uint64_t GetNumber(const char* field, size_t size) {
+        const auto* p = reinterpret_cast<const unsigned char*>(field);
+        uint64_t value = 0;
+        if (p[0] & 0x80) {
+            value = p[0] & 0x3f;
+            for (size_t i = 1; i < size; ++i) value = (value << 8) | p[i];
+            return value;
+        }
+        size_t i = 0;
+        while (i < size && (p[i] == ' ' || p[i] == '\0')) ++i;
+        for (; i < size && p[i] >= '0' && p[i] <= '7'; ++i) value = (value << 3) | (p[i] - '0');
+        return value;
+    }
+
+    // Octal with a terminating NUL, or base-256 when it does not fit
+    inline void PutNumber(char* field, size_t size, uint64_t value) {
+        if (value >> (3 * (size - 1))) {
+            std::memset(field, 0, size);
+            for (size_t i = size; i-- > 1 && value; value >>= 8) {
+                field[i] = static_cast<char>(value & 0xff);
+            }
+            field[0] = static_cast<char>(0x80);
+            return;
+        }
+        field[size - 1] = '\0';
+        for (size_t i = size - 1; i-- > 0; value >>= 3) {
+            field[i] = static_cast<char>('0' + (value & 7));
+        }
+    }
+
+    inline uint64_t PaddedSize(uint64_t size) {
+        return (size + kBlockSize - 1) / kBlockSize * kBlockSize;
+    }
+
+    // Compression of an archive from its first bytes, and whether they start
+    // a tar stream at all when uncompressed; a seekable .zst is only told
+    // apart from a plain one by its footer (IsSeekTableFooter)
+    inline bool DetectCompression(const unsigned char* head, size_t size, Compression& compression) {
+        if (size >= 2 && head[0] == kGzipMagic[0] && head[1] == kGzipMagic[1]) {
+            compression = Compression::Gzip;
+            return true;
+        }
+        if (size >= 4 && (GetU32(head) == kZstdMagic ||
+                          (GetU32(head) & kSkippableMagicMask) == kSkippableMagic)) {
+            compression = Compression::Zstd;
+            return true;
+        }
+        if (size >= kBlockSize) {
+            const char* header = reinterpret_cast<const char*>(head);
+            bool ustar = std::memcmp(header + kMagicOffset, kMagic, 5) == 0;
+            uint32_t stored = static_cast<uint32_t>(GetNumber(header + kChecksumOffset, kChecksumSize));
+            if (ustar || (header[0] != '\0' && stored == Checksum(header))) {
+                compression = Compression::None;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool IsSeekTableFooter(const unsigned char* footer) {
+        return GetU32(footer + 5) == kSeekableMagic && (footer[4] & 0x7c) == 0;
+    }
+}
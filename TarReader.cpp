@@ -0,0 +1,689 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "TarReader.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "zlib.h"
+#ifdef ARCHIVEMANAGER_ZSTD
+#include <zstd.h>
+#endif
+#include "ExtractionWriter.h"
+#include "Trace.h"
+
+namespace {
+    constexpr size_t kChunkSize = 256 * 1024;
+
+    // pax records and GNU long names larger than this are not names
+    constexpr uint64_t kMaxMetadataSize = 1 << 20;
+
+    std::atomic<uint64_t> g_nextId{1};
+
+    bool readFully(int fd, char* buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0) {
+            ssize_t n = ::pread(fd, buffer, size, static_cast<off_t>(offset));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return false;
+            }
+            buffer += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool writeFully(int fd, const char* data, size_t size)
+    {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    std::string field(const char* header, size_t offset, size_t size)
+    {
+        return std::string(header + offset, strnlen(header + offset, size));
+    }
+
+    // "<length> <key>=<value>\n" records; only the ones that change the entry
+    void parsePax(const std::string& data, std::string& path, uint64_t& size, int64_t& mtime)
+    {
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t space = data.find(' ', pos);
+            if (space == std::string::npos) return;
+            size_t length = std::strtoull(data.c_str() + pos, nullptr, 10);
+            if (length == 0 || pos + length > data.size()) return;
+
+            std::string record = data.substr(space + 1, pos + length - space - 2);
+            size_t equals = record.find('=');
+            if (equals != std::string::npos) {
+                std::string key = record.substr(0, equals);
+                std::string value = record.substr(equals + 1);
+                if (key == "path") path = value;
+                else if (key == "size") size = std::strtoull(value.c_str(), nullptr, 10);
+                else if (key == "mtime") mtime = std::strtoll(value.c_str(), nullptr, 10);
+            }
+            pos += length;
+        }
+    }
+
+    // Tar keeps "./" and strips leading slashes; so does extraction here
+    std::string cleanName(std::string name)
+    {
+        while (name.compare(0, 2, "./") == 0) name.erase(0, 2);
+        size_t slashes = name.find_first_not_of('/');
+        name.erase(0, slashes == std::string::npos ? name.size() : slashes);
+        return name;
+    }
+}
+
+// The uncompressed tar stream, front to back
+class TarStream {
+public:
+    virtual ~TarStream() = default;
+
+    // Up to size bytes; fewer only at the end of the data or on an error
+    virtual size_t Read(char* data, size_t size) = 0;
+
+    virtual bool Skip(uint64_t size)
+    {
+        thread_local std::string scratch(kChunkSize, '\0');
+        while (size > 0) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(size, scratch.size()));
+            if (Read(scratch.data(), want) != want) return false;
+            size -= want;
+        }
+        return true;
+    }
+
+    std::string error;
+};
+
+namespace {
+    // Plain and seekable archives: reads are served from any offset, and
+    // skipping costs nothing
+    class RandomAccessStream : public TarStream {
+    public:
+        using ReadAtFn = std::function<bool(uint64_t offset, uint64_t size, const TarReader::Sink& sink)>;
+
+        RandomAccessStream(uint64_t size, ReadAtFn readAt)
+            : m_size(size), m_readAt(std::move(readAt)) {}
+
+        size_t Read(char* data, size_t size) override
+        {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size, m_size - m_position));
+            size_t copied = 0;
+            bool ok = m_readAt(m_position, take, [&](const char* piece, size_t length) {
+                std::memcpy(data + copied, piece, length);
+                copied += length;
+                return true;
+            });
+            if (!ok) error = "Reading the archive failed";
+            m_position += copied;
+            return copied;
+        }
+
+        bool Skip(uint64_t size) override
+        {
+            if (size > m_size - m_position) return false;
+            m_position += size;
+            return true;
+        }
+
+    private:
+        uint64_t m_size;
+        uint64_t m_position{0};
+        ReadAtFn m_readAt;
+    };
+
+    class GzipStream : public TarStream {
+    public:
+        explicit GzipStream(int fd) : m_fd(fd), m_in(kChunkSize, '\0')
+        {
+            // 16 + window bits: gzip wrapper, checked trailer
+            m_ready = inflateInit2(&m_zs, 16 + MAX_WBITS) == Z_OK;
+            if (!m_ready) error = "Out of memory";
+        }
+
+        ~GzipStream() override
+        {
+            if (m_ready) inflateEnd(&m_zs);
+        }
+
+        size_t Read(char* data, size_t size) override
+        {
+            size_t produced = 0;
+            while (produced < size && m_ready && !m_done) {
+                if (m_zs.avail_in == 0 && !refill()) break;
+
+                m_zs.next_out = reinterpret_cast<Bytef*>(data + produced);
+                m_zs.avail_out = static_cast<uInt>(std::min<size_t>(size - produced, 1u << 30));
+                uInt before = m_zs.avail_out;
+                int status = inflate(&m_zs, Z_NO_FLUSH);
+                produced += before - m_zs.avail_out;
+
+                if (status == Z_STREAM_END) {
+                    // Another member may follow, as when gzip files are concatenated
+                    m_memberEnded = true;
+                    if (m_zs.avail_in == 0 && !refill()) {
+                        m_done = true;
+                    } else if (m_zs.next_in[0] == TarFormat::kGzipMagic[0]) {
+                        inflateReset(&m_zs);
+                        m_memberEnded = false;
+                    } else {
+                        m_done = true; // trailing garbage, which gzip ignores too
+                    }
+                } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                    error = "Corrupt gzip data";
+                    m_done = true;
+                }
+            }
+            return produced;
+        }
+
+    private:
+        bool refill()
+        {
+            ssize_t n;
+            do {
+                n = ::pread(m_fd, m_in.data(), m_in.size(), static_cast<off_t>(m_offset));
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                if (n < 0 || !m_memberEnded) error = "Truncated gzip data";
+                m_done = true;
+                return false;
+            }
+            m_offset += static_cast<uint64_t>(n);
+            m_zs.next_in = reinterpret_cast<Bytef*>(m_in.data());
+            m_zs.avail_in = static_cast<uInt>(n);
+            return true;
+        }
+
+        int m_fd;
+        uint64_t m_offset{0};
+        std::string m_in;
+        z_stream m_zs{};
+        bool m_ready{false};
+        bool m_memberEnded{false};
+        bool m_done{false};
+    };
+
+#ifdef ARCHIVEMANAGER_ZSTD
+    class ZstdStream : public TarStream {
+    public:
+        explicit ZstdStream(int fd) : m_fd(fd), m_in(ZSTD_DStreamInSize(), '\0'), m_dctx(ZSTD_createDCtx())
+        {
+            if (!m_dctx) error = "Out of memory";
+        }
+
+        ~ZstdStream() override
+        {
+            ZSTD_freeDCtx(m_dctx);
+        }
+
+        size_t Read(char* data, size_t size) override
+        {
+            ZSTD_outBuffer output{data, size, 0};
+            while (output.pos < output.size && m_dctx && !m_done) {
+                if (m_input.pos == m_input.size) {
+                    ssize_t n;
+                    do {
+                        n = ::pread(m_fd, m_in.data(), m_in.size(), static_cast<off_t>(m_offset));
+                    } while (n < 0 && errno == EINTR);
+                    if (n <= 0) {
+                        // A frame left unfinished means the file was cut short
+                        if (n < 0 || m_pending != 0) error = "Truncated zstd data";
+                        m_done = true;
+                        break;
+                    }
+                    m_offset += static_cast<uint64_t>(n);
+                    m_input = ZSTD_inBuffer{m_in.data(), static_cast<size_t>(n), 0};
+                }
+
+                m_pending = ZSTD_decompressStream(m_dctx, &output, &m_input);
+                if (ZSTD_isError(m_pending)) {
+                    error = std::string("Corrupt zstd data: ") + ZSTD_getErrorName(m_pending);
+                    m_done = true;
+                }
+            }
+            return output.pos;
+        }
+
+    private:
+        int m_fd;
+        uint64_t m_offset{0};
+        std::string m_in;
+        ZSTD_inBuffer m_input{nullptr, 0, 0};
+        ZSTD_DCtx* m_dctx;
+        size_t m_pending{0}; // non-zero within a frame
+        bool m_done{false};
+    };
+#endif
+}
+
+bool TarReader::Detect(const std::string& path, Compression& compression)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    unsigned char head[TarFormat::kBlockSize] = {};
+    ssize_t n = ::pread(fd, head, sizeof(head), 0);
+    bool tar = n > 0 && TarFormat::DetectCompression(head, static_cast<size_t>(n), compression);
+
+    // A seekable archive is a zstd stream that ends in a seek table
+    struct stat st{};
+    unsigned char footer[TarFormat::kSeekTableFooterSize];
+    if (tar && compression == Compression::Zstd && ::fstat(fd, &st) == 0 &&
+        static_cast<uint64_t>(st.st_size) >= sizeof(footer) &&
+        readFully(fd, reinterpret_cast<char*>(footer), sizeof(footer), st.st_size - sizeof(footer)) &&
+        TarFormat::IsSeekTableFooter(footer)) {
+        compression = Compression::SeekableZstd;
+    }
+    ::close(fd);
+    return tar;
+}
+
+TarReader::~TarReader()
+{
+    Close();
+}
+
+void TarReader::Close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_entries.clear();
+    m_frames.clear();
+    m_skipped = 0;
+    m_failed = 0;
+}
+
+bool TarReader::fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = message;
+    return false;
+}
+
+std::string TarReader::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
+
+bool TarReader::IsSeekable() const
+{
+    return m_compression == Compression::None || m_compression == Compression::SeekableZstd;
+}
+
+bool TarReader::Open(const std::string& path)
+{
+    Close();
+    Trace::Span span("tar open");
+    if (!Detect(path, m_compression)) {
+        return fail("Not a tar archive: " + path);
+    }
+#ifndef ARCHIVEMANAGER_ZSTD
+    if (m_compression == Compression::Zstd || m_compression == Compression::SeekableZstd) {
+        return fail(std::string("This build cannot read ") + TarFormat::Name(m_compression) + "; it needs libzstd");
+    }
+#endif
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (m_fd < 0 || ::fstat(m_fd, &st) != 0) {
+        return fail("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    m_path = path;
+    m_fileSize = static_cast<uint64_t>(st.st_size);
+    m_id = g_nextId++;
+
+    if (m_compression == Compression::SeekableZstd && !readSeekTable()) return false;
+
+    auto stream = openStream();
+    if (!scan(*stream)) {
+        Close();
+        return false;
+    }
+    span.AddBytes(m_fileSize);
+    return true;
+}
+
+bool TarReader::readSeekTable()
+{
+    using namespace TarFormat;
+    unsigned char footer[kSeekTableFooterSize];
+    if (!readFully(m_fd, reinterpret_cast<char*>(footer), sizeof(footer), m_fileSize - sizeof(footer))) {
+        return fail("Failed to read the seek table");
+    }
+
+    uint64_t count = GetU32(footer);
+    size_t entrySize = kSeekTableEntrySize + ((footer[4] & kSeekTableChecksumFlag) ? 4 : 0);
+    uint64_t tableSize = count * entrySize + kSeekTableFooterSize;
+    if (8 + tableSize > m_fileSize) {
+        return fail("Corrupt seek table");
+    }
+
+    uint64_t tableStart = m_fileSize - tableSize - 8;
+    std::string table(static_cast<size_t>(tableSize + 8), '\0');
+    if (!readFully(m_fd, table.data(), table.size(), tableStart)) {
+        return fail("Failed to read the seek table");
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(table.data());
+    if (GetU32(p) != kSeekTableFrameMagic || GetU32(p + 4) != tableSize) {
+        return fail("Corrupt seek table");
+    }
+
+    m_frames.resize(static_cast<size_t>(count));
+    uint64_t compressedOffset = 0;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < m_frames.size(); ++i) {
+        const unsigned char* e = p + 8 + i * entrySize;
+        m_frames[i] = Frame{compressedOffset, offset, GetU32(e), GetU32(e + 4)};
+        compressedOffset += m_frames[i].compressedSize;
+        offset += m_frames[i].size;
+    }
+    if (compressedOffset > tableStart) {
+        return fail("Corrupt seek table");
+    }
+    return true;
+}
+
+std::unique_ptr<TarStream> TarReader::openStream()
+{
+    auto readAt = [this](uint64_t offset, uint64_t size, const Sink& sink) { return this->readAt(offset, size, sink); };
+    switch (m_compression) {
+    case Compression::Gzip:
+        return std::make_unique<GzipStream>(m_fd);
+#ifdef ARCHIVEMANAGER_ZSTD
+    case Compression::Zstd:
+        return std::make_unique<ZstdStream>(m_fd);
+#endif
+    case Compression::SeekableZstd:
+        return std::make_unique<RandomAccessStream>(
+            m_frames.empty() ? 0 : m_frames.back().offset + m_frames.back().size, readAt);
+    default:
+        return std::make_unique<RandomAccessStream>(m_fileSize, readAt);
+    }
+}
+
+bool TarReader::scan(TarStream& stream)
+{
+    using namespace TarFormat;
+    char header[kBlockSize];
+    uint64_t position = 0;
+
+    // Set by the pax or GNU header before the entry they describe
+    std::string longName;
+    uint64_t paxSize = UINT64_MAX;
+    int64_t paxMtime = -1;
+
+    for (;;) {
+        size_t got = stream.Read(header, sizeof(header));
+        if (!stream.error.empty()) return fail(stream.error);
+        // Ending without the zero blocks is common enough to accept
+        if (got == 0 && position > 0) break;
+        if (got < sizeof(header)) return fail("Truncated tar archive");
+        position += got;
+
+        if (std::all_of(header, header + sizeof(header), [](char c) { return c == '\0'; })) break;
+        if (GetNumber(header + kChecksumOffset, kChecksumSize) != Checksum(header)) {
+            return fail(position == kBlockSize ? "Not a tar archive: " + m_path
+                                               : "Corrupt tar header at offset " + std::to_string(position - kBlockSize));
+        }
+
+        char type = header[kTypeOffset];
+        uint64_t size = GetNumber(header + kSizeOffset, kSizeSize);
+        if (type == kTypePax || type == kTypeGnuLongName) {
+            if (size > kMaxMetadataSize) return fail("Corrupt tar header at offset " + std::to_string(position));
+            std::string data(static_cast<size_t>(size), '\0');
+            if (stream.Read(data.data(), data.size()) != data.size() || !stream.Skip(PaddedSize(size) - size)) {
+                return fail(stream.error.empty() ? "Truncated tar archive" : stream.error);
+            }
+            position += PaddedSize(size);
+            if (type == kTypePax) {
+                parsePax(data, longName, paxSize, paxMtime);
+            } else {
+                longName = data.substr(0, strnlen(data.c_str(), data.size()));
+            }
+            continue;
+        }
+
+        if (paxSize != UINT64_MAX) size = paxSize;
+        std::string name = longName;
+        if (name.empty()) {
+            name = field(header, kNameOffset, kNameSize);
+            std::string prefix = std::memcmp(header + kMagicOffset, kMagic, 5) == 0
+                                     ? field(header, kPrefixOffset, kPrefixSize) : "";
+            if (!prefix.empty()) name = prefix + "/" + name;
+        }
+        int64_t mtime = paxMtime >= 0 ? paxMtime : static_cast<int64_t>(GetNumber(header + kMtimeOffset, kMtimeSize));
+        longName.clear();
+        paxSize = UINT64_MAX;
+        paxMtime = -1;
+
+        bool file = type == kTypeFile || type == kTypeFileOld || type == kTypeContiguous;
+        bool directory = type == kTypeDirectory || (type == kTypeFileOld && !name.empty() && name.back() == '/');
+        name = cleanName(name);
+        if ((file || directory) && !name.empty()) {
+            ZipEntryInfo entry;
+            entry.name = name;
+            if (directory && entry.name.back() != '/') entry.name += '/';
+            entry.method = ZipFormat::kMethodStore;
+            entry.uncompressedSize = entry.compressedSize = directory ? 0 : size;
+            entry.localHeaderOffset = position;
+            entry.dosDateTime = ZipFormat::ToDosDateTime(static_cast<std::time_t>(mtime));
+            uint32_t mode = static_cast<uint32_t>(GetNumber(header + kModeOffset, kModeSize)) & 07777;
+            entry.externalAttributes = ((directory ? S_IFDIR : S_IFREG) | mode) << 16;
+            m_entries.push_back(std::move(entry));
+        } else if (!directory && !name.empty() && type != kTypePaxGlobal && type != kTypeGnuLongLink) {
+            ++m_skipped;
+        }
+
+        // Links and directories have no data; a hard link's size field says so too
+        uint64_t data = type == kTypeHardLink || type == kTypeSymlink ? 0 : PaddedSize(size);
+        if (!stream.Skip(data)) {
+            return fail(stream.error.empty() ? "Truncated tar archive" : stream.error);
+        }
+        position += data;
+    }
+
+    // The rest of a compressed stream is padding, decoded only to check its trailer
+    if (!IsSeekable()) {
+        char rest[kBlockSize * 8];
+        while (stream.Read(rest, sizeof(rest)) > 0) {
+        }
+        if (!stream.error.empty()) return fail(stream.error);
+    }
+    return true;
+}
+
+bool TarReader::decodeFrame(size_t index, const std::string*& data)
+{
+#ifdef ARCHIVEMANAGER_ZSTD
+    // Consecutive reads mostly stay within one frame
+    struct Cache {
+        uint64_t id{0};
+        size_t frame{SIZE_MAX};
+        std::string data;
+        std::string compressed;
+        ZSTD_DCtx* dctx{ZSTD_createDCtx()};
+        ~Cache() { ZSTD_freeDCtx(dctx); }
+    };
+    thread_local Cache cache;
+    if (cache.id == m_id && cache.frame == index) {
+        data = &cache.data;
+        return true;
+    }
+
+    Trace::Span span("zstd frame");
+    const Frame& frame = m_frames[index];
+    cache.frame = SIZE_MAX;
+    cache.compressed.resize(frame.compressedSize);
+    if (!readFully(m_fd, cache.compressed.data(), cache.compressed.size(), frame.compressedOffset)) {
+        return fail("Failed to read zstd frame " + std::to_string(index));
+    }
+    cache.data.resize(frame.size);
+    size_t decoded = ZSTD_decompressDCtx(cache.dctx, cache.data.data(), cache.data.size(),
+                                         cache.compressed.data(), cache.compressed.size());
+    if (ZSTD_isError(decoded) || decoded != frame.size) {
+        return fail("Corrupt zstd frame " + std::to_string(index));
+    }
+    span.AddBytes(frame.size);
+    cache.id = m_id;
+    cache.frame = index;
+    data = &cache.data;
+    return true;
+#else
+    return fail("zstd is not available");
+#endif
+}
+
+bool TarReader::readAt(uint64_t offset, uint64_t size, const Sink& sink)
+{
+    if (m_compression == Compression::None) {
+        thread_local std::string buffer(kChunkSize, '\0');
+        while (size > 0) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+            if (!readFully(m_fd, buffer.data(), want, offset)) {
+                return fail("Truncated tar archive");
+            }
+            if (!sink(buffer.data(), want)) return false;
+            offset += want;
+            size -= want;
+        }
+        return true;
+    }
+
+    // The frame holding offset, then the ones after it
+    auto it = std::upper_bound(m_frames.begin(), m_frames.end(), offset,
+                               [](uint64_t value, const Frame& frame) { return value < frame.offset; });
+    size_t index = static_cast<size_t>(it - m_frames.begin());
+    while (size > 0) {
+        if (index == 0 || index > m_frames.size()) return fail("Truncated tar archive");
+        const Frame& frame = m_frames[index - 1];
+        const std::string* data = nullptr;
+        if (!decodeFrame(index - 1, data)) return false;
+
+        uint64_t within = offset - frame.offset;
+        size_t take = static_cast<size_t>(std::min<uint64_t>(size, frame.size - within));
+        if (!sink(data->data() + within, take)) return false;
+        offset += take;
+        size -= take;
+        ++index;
+    }
+    return true;
+}
+
+bool TarReader::ReadEntry(const ZipEntryInfo& entry, const Sink& sink)
+{
+    if (!IsSeekable()) {
+        return fail(std::string("Entries of a ") + TarFormat::Name(m_compression) + " are only read in order");
+    }
+    return readAt(entry.localHeaderOffset, entry.uncompressedSize, sink);
+}
+
+bool TarReader::extractOne(const ZipEntryInfo& entry, ExtractionWriter& writer, const FillFn& fill)
+{
+    std::string path = writer.Prepare(entry);
+    if (path.empty()) {
+        ++m_failed;
+        return fail(writer.GetLastError());
+    }
+    if (entry.IsDir()) return true;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ++m_failed;
+        return fail("Failed to create " + path + ": " + std::strerror(errno));
+    }
+    bool written = true;
+    bool ok = fill([&](const char* data, size_t size) {
+        written = writeFully(fd, data, size);
+        return written;
+    });
+    ::close(fd);
+    if (!ok) {
+        ++m_failed;
+        return fail(written ? "Failed to extract " + entry.name + ": " + GetLastError()
+                            : "Failed to write " + path + ": " + std::strerror(errno));
+    }
+    return true;
+}
+
+bool TarReader::ExtractEntries(const std::vector<size_t>& entries, ExtractionWriter& writer, unsigned threads,
+                               const ProgressFn& progress)
+{
+    Trace::Span span("tar extract");
+
+    // In stream order: the only order a compressed stream can be read in,
+    // and forward-moving reads for the rest
+    std::vector<size_t> order(entries);
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return m_entries[a].localHeaderOffset < m_entries[b].localHeaderOffset;
+    });
+    std::atomic<size_t> done{0};
+    auto finished = [&]() {
+        size_t count = ++done;
+        if (progress) progress(count, order.size());
+    };
+    for (size_t index : order) {
+        span.AddBytes(m_entries[index].uncompressedSize);
+    }
+
+    if (IsSeekable()) {
+        ParallelFor(order.size(), threads, [&](size_t k) {
+            const ZipEntryInfo& entry = m_entries[order[k]];
+            extractOne(entry, writer, [&](const Sink& sink) {
+                return readAt(entry.localHeaderOffset, entry.uncompressedSize, sink);
+            });
+            finished();
+        });
+    } else {
+        auto stream = openStream();
+        thread_local std::string buffer(kChunkSize, '\0');
+        uint64_t position = 0;
+        for (size_t index : order) {
+            const ZipEntryInfo& entry = m_entries[index];
+            if (!stream->Skip(entry.localHeaderOffset - position)) {
+                m_failed += order.size() - done;
+                fail(stream->error.empty() ? "Truncated tar archive" : stream->error);
+                break;
+            }
+            position = entry.localHeaderOffset;
+
+            extractOne(entry, writer, [&](const Sink& sink) {
+                uint64_t left = entry.uncompressedSize;
+                while (left > 0) {
+                    size_t want = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+                    size_t got = stream->Read(buffer.data(), want);
+                    position += got;
+                    if (got != want) return fail(stream->error.empty() ? "Truncated tar archive" : stream->error);
+                    if (!sink(buffer.data(), got)) return false;
+                    left -= got;
+                }
+                return true;
+            });
+            finished();
+        }
+    }
+
+    bool applied = writer.Finish(threads);
+    return m_failed == 0 && applied;
+}
@@ -0,0 +1,103 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Parallel.h"
+#include "TarFormat.h"
+#include "ZipReader.h"
+
+class ExtractionWriter;
+class TarStream;
+
+// Reader for tar, tar.gz, tar.zst and seekable tar.zst (see TarFormat.h),
+// told apart by content rather than by name.
+//
+// Files and directories are listed as ZipEntryInfo, so EntryIndex and
+// ExtractionWriter take them as they are: method STORE, both sizes the file
+// size, localHeaderOffset the offset of the data in the uncompressed tar
+// stream, and the mode in the upper half of externalAttributes. Links,
+// devices and FIFOs are counted in GetSkippedCount() but not listed.
+//
+// Plain and seekable archives are random access: listing reads only the
+// headers (for seekable ones, only the frames holding them), and entries are
+// extracted on several threads, each decoding just the frames it needs.
+// gzip and plain zstd streams are decoded front to back, once to list them
+// (which also verifies their checksums) and once more to extract.
+class TarReader {
+public:
+    using Compression = TarFormat::Compression;
+
+    // Whether path holds a tar archive, plain or compressed, and how
+    static bool Detect(const std::string& path, Compression& compression);
+
+    TarReader() = default;
+    ~TarReader();
+
+    TarReader(const TarReader&) = delete;
+    TarReader& operator=(const TarReader&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    Compression GetCompression() const { return m_compression; }
+    bool IsSeekable() const;
+
+    const std::vector<ZipEntryInfo>& GetEntries() const { return m_entries; }
+    uint64_t GetSkippedCount() const { return m_skipped; }
+
+    // Hands an entry's data to sink in pieces; seekable archives only.
+    // May be called from several threads at once.
+    using Sink = std::function<bool(const char* data, size_t size)>;
+    bool ReadEntry(const ZipEntryInfo& entry, const Sink& sink);
+
+    // Extracts the given entries (indices into GetEntries()) through writer,
+    // then calls its Finish. progress(done, total) is called from the
+    // worker threads.
+    using ProgressFn = std::function<void(size_t done, size_t total)>;
+    bool ExtractEntries(const std::vector<size_t>& entries, ExtractionWriter& writer,
+                        unsigned threads = DefaultThreadCount(), const ProgressFn& progress = {});
+
+    uint64_t GetFailedCount() const { return m_failed; }
+    std::string GetLastError() const;
+
+private:
+    struct Frame {
+        uint64_t compressedOffset{0};
+        uint64_t offset{0}; // in the tar stream
+        uint32_t compressedSize{0};
+        uint32_t size{0};
+    };
+
+    // Produces an entry's data through the sink it is given
+    using FillFn = std::function<bool(const Sink& sink)>;
+
+    std::unique_ptr<TarStream> openStream();
+    bool readSeekTable();
+    bool scan(TarStream& stream);
+    bool readAt(uint64_t offset, uint64_t size, const Sink& sink);
+    bool decodeFrame(size_t index, const std::string*& data);
+    bool extractOne(const ZipEntryInfo& entry, ExtractionWriter& writer, const FillFn& fill);
+    bool fail(const std::string& message);
+
+    std::string m_path;
+    Compression m_compression{Compression::None};
+    int m_fd{-1};
+    uint64_t m_fileSize{0};
+    uint64_t m_id{0}; // tells the per-thread frame caches of successive opens apart
+    std::vector<Frame> m_frames;
+
+    std::vector<ZipEntryInfo> m_entries;
+    uint64_t m_skipped{0};
+    std::atomic<uint64_t> m_failed{0};
+
+    mutable std::mutex m_errorMutex;
+    std::string m_lastError;
+};
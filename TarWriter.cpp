@@ -0,0 +1,413 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "TarWriter.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "zlib.h"
+#ifdef ARCHIVEMANAGER_ZSTD
+#include <zstd.h>
+#endif
+#include "Codec.h"
+#include "Trace.h"
+
+namespace {
+    constexpr size_t kReadSize = 256 * 1024;
+    constexpr size_t kGzipBlockSize = 128 * 1024; // pigz's default
+    constexpr size_t kPlainBlockSize = 256 * 1024;
+
+    // Uncompressed bytes gathered before a wave of blocks is compressed
+    constexpr size_t kWaveBytes = 16 * 1024 * 1024;
+
+    // gzip header: deflate, no name or time, Unix
+    constexpr unsigned char kGzipHeader[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+
+#ifdef ARCHIVEMANAGER_ZSTD
+    bool zstdFrame(const char* data, size_t size, int level, std::string& out)
+    {
+        struct Context {
+            ZSTD_CCtx* cctx{ZSTD_createCCtx()};
+            ~Context() { ZSTD_freeCCtx(cctx); }
+        };
+        thread_local Context context;
+        if (!context.cctx) return false;
+
+        ZSTD_CCtx_reset(context.cctx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_compressionLevel, TarFormat::ZstdLevel(level));
+        ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_checksumFlag, 1);
+        out.resize(ZSTD_compressBound(size));
+        size_t written = ZSTD_compress2(context.cctx, out.data(), out.size(), data, size);
+        if (ZSTD_isError(written)) return false;
+        out.resize(written);
+        return true;
+    }
+#endif
+
+    // Raw deflate of one block, ending byte-aligned on a sync flush so the
+    // next block's output can follow it, or as the final block
+    bool gzipBlock(const std::string& data, int level, bool last, std::string& out)
+    {
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        // A sync flush adds at most an empty stored block
+        out.resize(deflateBound(&zs, static_cast<uLong>(data.size())) + 16);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        zs.avail_in = static_cast<uInt>(data.size());
+        zs.next_out = reinterpret_cast<Bytef*>(out.data());
+        zs.avail_out = static_cast<uInt>(out.size());
+        int status = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool ok = last ? status == Z_STREAM_END : status == Z_OK && zs.avail_in == 0;
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return ok;
+    }
+}
+
+bool TarWriter::Supports(Compression compression)
+{
+#ifdef ARCHIVEMANAGER_ZSTD
+    return true;
+#else
+    return compression == Compression::None || compression == Compression::Gzip;
+#endif
+}
+
+TarWriter::TarWriter(Compression compression, int level, unsigned threads)
+    : m_compression(compression)
+    , m_level(std::clamp(level, 0, 9))
+    , m_threads(std::max(1u, threads))
+    , m_blockSize(compression == Compression::Gzip           ? kGzipBlockSize
+                  : compression == Compression::SeekableZstd ? TarFormat::kSeekableFrameSize
+                                                             : kPlainBlockSize)
+{
+}
+
+TarWriter::~TarWriter()
+{
+    if (m_file) {
+        std::fclose(m_file);
+    }
+#ifdef ARCHIVEMANAGER_ZSTD
+    ZSTD_freeCCtx(m_zstdStream);
+#endif
+}
+
+bool TarWriter::fail(const std::string& message)
+{
+    m_lastError = message;
+    return false;
+}
+
+bool TarWriter::Open(const std::string& path)
+{
+    if (!Supports(m_compression)) {
+        return fail(std::string("This build cannot write ") + TarFormat::Name(m_compression) +
+                    "; it needs libzstd");
+    }
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return fail("Failed to create archive: " + std::string(std::strerror(errno)));
+    }
+    m_wave.assign(1, Block{});
+    m_wave.back().data.reserve(m_blockSize);
+    m_tarBytes = 0;
+    m_written = 0;
+    m_crc = 0;
+    m_frames.clear();
+
+    if (m_compression == Compression::Gzip) {
+        return writeRaw(kGzipHeader, sizeof(kGzipHeader));
+    }
+#ifdef ARCHIVEMANAGER_ZSTD
+    if (m_compression == Compression::Zstd) {
+        if (!m_zstdStream) m_zstdStream = ZSTD_createCCtx();
+        if (!m_zstdStream) return fail("Out of memory");
+        ZSTD_CCtx_reset(m_zstdStream, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(m_zstdStream, ZSTD_c_compressionLevel, TarFormat::ZstdLevel(m_level));
+        ZSTD_CCtx_setParameter(m_zstdStream, ZSTD_c_checksumFlag, 1);
+        // Refused by a libzstd built without threads; it then compresses on this one
+        if (m_threads > 1) {
+            ZSTD_CCtx_setParameter(m_zstdStream, ZSTD_c_nbWorkers, static_cast<int>(m_threads));
+        }
+    }
+#endif
+    return true;
+}
+
+bool TarWriter::writeRaw(const void* data, size_t size)
+{
+    if (size > 0 && std::fwrite(data, 1, size, m_file) != size) {
+        return fail("Write failed: " + std::string(std::strerror(errno)));
+    }
+    m_written += size;
+    return true;
+}
+
+bool TarWriter::zstdStream(const char* data, size_t size, bool end)
+{
+#ifdef ARCHIVEMANAGER_ZSTD
+    thread_local std::string out(ZSTD_CStreamOutSize(), '\0');
+    ZSTD_inBuffer input{data, size, 0};
+    for (;;) {
+        ZSTD_outBuffer output{out.data(), out.size(), 0};
+        size_t remaining = ZSTD_compressStream2(m_zstdStream, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining)) {
+            return fail(std::string("zstd: ") + ZSTD_getErrorName(remaining));
+        }
+        if (!writeRaw(out.data(), output.pos)) return false;
+        if (end ? remaining == 0 : input.pos == input.size) return true;
+    }
+#else
+    return fail("zstd is not available");
+#endif
+}
+
+bool TarWriter::append(const char* data, size_t size)
+{
+    m_tarBytes += size;
+    if (m_compression == Compression::None) {
+        return writeRaw(data, size);
+    }
+    if (m_compression == Compression::Zstd) {
+        return zstdStream(data, size, false);
+    }
+
+    while (size > 0) {
+        std::string& block = m_wave.back().data;
+        size_t take = std::min(size, m_blockSize - block.size());
+        block.append(data, take);
+        data += take;
+        size -= take;
+        if (block.size() < m_blockSize) break;
+
+        // A full block either starts the next one or, with a full wave, is compressed
+        if (m_wave.size() * m_blockSize >= std::max(kWaveBytes, m_threads * 2 * m_blockSize)) {
+            if (!flushWave(false)) return false;
+        } else {
+            m_wave.emplace_back();
+            m_wave.back().data.reserve(m_blockSize);
+        }
+    }
+    return true;
+}
+
+bool TarWriter::compressBlock(Block& block, bool last) const
+{
+    if (m_compression == Compression::Gzip) {
+        block.crc = Codec::Crc32(0, block.data.data(), block.data.size());
+        return gzipBlock(block.data, m_level, last, block.compressed);
+    }
+#ifdef ARCHIVEMANAGER_ZSTD
+    return zstdFrame(block.data.data(), block.data.size(), m_level, block.compressed);
+#else
+    return false;
+#endif
+}
+
+bool TarWriter::flushWave(bool last)
+{
+    Trace::Span span("tar wave");
+
+    // The block being filled waits for the next wave, unless this is the end
+    size_t count = last ? m_wave.size() : m_wave.size() - 1;
+    if (m_wave.back().data.size() == m_blockSize) count = m_wave.size();
+    // The final gzip block ends the deflate stream; it may be empty, a seekable frame may not
+    if (last && m_compression == Compression::SeekableZstd && m_wave.back().data.empty()) {
+        --count;
+    }
+
+    ParallelFor(count, m_threads, [&](size_t i) {
+        m_wave[i].ok = compressBlock(m_wave[i], last && i + 1 == m_wave.size());
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+        Block& block = m_wave[i];
+        if (!block.ok) return fail(std::string("Compressing ") + TarFormat::Name(m_compression) + " failed");
+        if (!writeRaw(block.compressed.data(), block.compressed.size())) return false;
+        span.AddBytes(block.data.size());
+
+        if (m_compression == Compression::Gzip) {
+            m_crc = static_cast<uint32_t>(crc32_combine(m_crc, block.crc, static_cast<z_off_t>(block.data.size())));
+        } else {
+            m_frames.emplace_back(static_cast<uint32_t>(block.compressed.size()),
+                                  static_cast<uint32_t>(block.data.size()));
+        }
+    }
+
+    m_wave.erase(m_wave.begin(), m_wave.begin() + static_cast<std::ptrdiff_t>(count));
+    if (m_wave.empty()) {
+        m_wave.emplace_back();
+        m_wave.back().data.reserve(m_blockSize);
+    }
+    return true;
+}
+
+bool TarWriter::writeHeader(const std::string& name, uint64_t size, uint32_t mode, int64_t mtime, char type)
+{
+    using namespace TarFormat;
+    char header[kBlockSize] = {};
+    std::string stored = name;
+    std::string prefix;
+
+    if (name.size() > kNameSize) {
+        // ustar splits a long path at a slash into prefix and name
+        size_t slash = name.find('/', name.size() > kNameSize + 1 ? name.size() - kNameSize - 1 : 0);
+        if (slash != std::string::npos && slash > 0 && slash <= kPrefixSize && name.size() - slash - 1 <= kNameSize) {
+            prefix = name.substr(0, slash);
+            stored = name.substr(slash + 1);
+        } else {
+            // Otherwise a pax header carries it: "<length> path=<name>\n"
+            std::string record = " path=" + name + "\n";
+            size_t length = record.size() + 1;
+            while (std::to_string(length).size() + record.size() != length) ++length;
+            record = std::to_string(length) + record;
+
+            if (!writeHeader("PaxHeaders/" + name.substr(name.find_last_of('/') + 1).substr(0, 80),
+                             record.size(), 0644, mtime, kTypePax)) {
+                return false;
+            }
+            record.resize(static_cast<size_t>(PaddedSize(record.size())), '\0');
+            if (!append(record.data(), record.size())) return false;
+            stored = name.substr(0, kNameSize);
+        }
+    }
+
+    std::memcpy(header + kNameOffset, stored.data(), std::min(stored.size(), kNameSize));
+    PutNumber(header + kModeOffset, kModeSize, mode & 07777);
+    PutNumber(header + kUidOffset, kUidSize, 0);
+    PutNumber(header + kGidOffset, kGidSize, 0);
+    PutNumber(header + kSizeOffset, kSizeSize, size);
+    PutNumber(header + kMtimeOffset, kMtimeSize, static_cast<uint64_t>(std::max<int64_t>(0, mtime)));
+    header[kTypeOffset] = type;
+    std::memcpy(header + kMagicOffset, kMagic, sizeof(kMagic));
+    std::memcpy(header + kVersionOffset, "00", 2);
+    std::memcpy(header + kPrefixOffset, prefix.data(), std::min(prefix.size(), kPrefixSize));
+
+    // Six octal digits, NUL, space, as tar has always written it
+    std::snprintf(header + kChecksumOffset, kChecksumSize, "%06o", Checksum(header));
+    header[kChecksumOffset + 7] = ' ';
+    return append(header, sizeof(header));
+}
+
+bool TarWriter::AddFile(const std::string& sourcePath, const std::string& entryName)
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    std::FILE* in = std::fopen(sourcePath.c_str(), "rb");
+    struct stat st{};
+    if (!in || ::fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (in) std::fclose(in);
+        return fail("File not found: " + sourcePath);
+    }
+
+    Trace::Span span("tar file");
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (!writeHeader(entryName, size, static_cast<uint32_t>(st.st_mode), st.st_mtime, TarFormat::kTypeFile)) {
+        std::fclose(in);
+        return false;
+    }
+
+    // The header has promised size bytes: a file that shrank meanwhile is padded with zeros
+    thread_local std::string buffer(kReadSize, '\0');
+    uint64_t left = size;
+    bool complete = true;
+    while (left > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        size_t got = std::fread(buffer.data(), 1, want, in);
+        if (got < want) {
+            std::memset(buffer.data() + got, 0, want - got);
+            complete = false;
+        }
+        if (!append(buffer.data(), want)) {
+            std::fclose(in);
+            return false;
+        }
+        left -= want;
+        if (!complete) break;
+    }
+    std::fclose(in);
+    span.AddBytes(size - left);
+
+    while (left > 0) {
+        size_t zeros = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        std::memset(buffer.data(), 0, zeros);
+        if (!append(buffer.data(), zeros)) return false;
+        left -= zeros;
+    }
+
+    static const char padding[TarFormat::kBlockSize] = {};
+    if (!append(padding, static_cast<size_t>(TarFormat::PaddedSize(size) - size))) return false;
+    return complete || fail("File changed while being archived: " + sourcePath);
+}
+
+bool TarWriter::AddDirectory(const std::string& sourcePath, const std::string& entryName)
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    struct stat st{};
+    if (::stat(sourcePath.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return fail("Directory not found: " + sourcePath);
+    }
+
+    std::string name = entryName;
+    if (name.empty() || name.back() != '/') name += '/';
+    return writeHeader(name, 0, static_cast<uint32_t>(st.st_mode), st.st_mtime, TarFormat::kTypeDirectory);
+}
+
+bool TarWriter::Close()
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+    Trace::Span span("finalize");
+
+    // Two zero blocks end the archive; tar pads the last record out with more
+    uint64_t end = m_tarBytes + 2 * TarFormat::kBlockSize;
+    end = (end + TarFormat::kRecordSize - 1) / TarFormat::kRecordSize * TarFormat::kRecordSize;
+    std::string zeros(static_cast<size_t>(end - m_tarBytes), '\0');
+    bool ok = append(zeros.data(), zeros.size());
+
+    if (ok && m_compression == Compression::Zstd) {
+        ok = zstdStream(nullptr, 0, true);
+    } else if (ok && m_compression != Compression::None) {
+        ok = flushWave(true);
+    }
+
+    if (ok && m_compression == Compression::Gzip) {
+        std::string trailer;
+        TarFormat::PutU32(trailer, m_crc);
+        TarFormat::PutU32(trailer, static_cast<uint32_t>(m_tarBytes));
+        ok = writeRaw(trailer.data(), trailer.size());
+    } else if (ok && m_compression == Compression::SeekableZstd) {
+        std::string table;
+        TarFormat::PutU32(table, TarFormat::kSeekTableFrameMagic);
+        TarFormat::PutU32(table, static_cast<uint32_t>(m_frames.size() * TarFormat::kSeekTableEntrySize +
+                                                       TarFormat::kSeekTableFooterSize));
+        for (const auto& [compressed, decompressed] : m_frames) {
+            TarFormat::PutU32(table, compressed);
+            TarFormat::PutU32(table, decompressed);
+        }
+        TarFormat::PutU32(table, static_cast<uint32_t>(m_frames.size()));
+        table.push_back('\0');
+        TarFormat::PutU32(table, TarFormat::kSeekableMagic);
+        ok = writeRaw(table.data(), table.size());
+    }
+
+    int result = std::fclose(m_file);
+    m_file = nullptr;
+    if (!ok) return false;
+    if (result != 0) {
+        return fail("Failed to finalize archive");
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Parallel.h"
+#include "TarFormat.h"
+
+struct ZSTD_CCtx_s;
+
+// Streaming tar writer (see TarFormat.h). Files are read once, in the order
+// they are added, and never held in memory whole.
+//
+// The tar stream is cut into blocks that are compressed on several threads
+// a wave at a time and written in order:
+//   Gzip          pigz --independent style: 128 KB blocks, each a fresh
+//                 raw deflate ending in a sync flush, CRCs combined
+//   SeekableZstd  one zstd frame per kSeekableFrameSize block
+//   Zstd          libzstd's own worker threads on a single frame
+// zlib levels 0-9 map onto zstd's, so 6 gets zstd's default and 9 its 19.
+// zstd needs ARCHIVEMANAGER_ZSTD (CMake finds libzstd when installed).
+class TarWriter {
+public:
+    using Compression = TarFormat::Compression;
+
+    static bool Supports(Compression compression);
+
+    explicit TarWriter(Compression compression, int level = 6, unsigned threads = DefaultThreadCount());
+    ~TarWriter();
+
+    TarWriter(const TarWriter&) = delete;
+    TarWriter& operator=(const TarWriter&) = delete;
+
+    bool Open(const std::string& path);
+
+    // A regular file, with its mode and modification time
+    bool AddFile(const std::string& sourcePath, const std::string& entryName);
+
+    // A directory, so that empty ones survive; entryName gets a trailing '/'
+    bool AddDirectory(const std::string& sourcePath, const std::string& entryName);
+
+    // Ends the tar stream and the compressed stream around it
+    bool Close();
+
+    uint64_t GetTarBytes() const { return m_tarBytes; }          // uncompressed
+    uint64_t GetBytesWritten() const { return m_written; }       // to the file
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct Block {
+        std::string data;
+        std::string compressed;
+        uint32_t crc{0};
+        bool ok{false};
+    };
+
+    bool writeHeader(const std::string& name, uint64_t size, uint32_t mode, int64_t mtime, char type);
+    bool append(const char* data, size_t size);
+    bool flushWave(bool last);
+    bool compressBlock(Block& block, bool last) const;
+    bool writeRaw(const void* data, size_t size);
+    bool zstdStream(const char* data, size_t size, bool end);
+    bool fail(const std::string& message);
+
+    Compression m_compression;
+    int m_level;
+    unsigned m_threads;
+    size_t m_blockSize;
+
+    std::FILE* m_file{nullptr};
+    std::vector<Block> m_wave;    // full blocks plus the one being filled
+    uint64_t m_tarBytes{0};
+    uint64_t m_written{0};
+
+    // Gzip trailer
+    uint32_t m_crc{0};
+
+    // Seek table: compressed and decompressed size of every frame
+    std::vector<std::pair<uint32_t, uint32_t>> m_frames;
+
+    ZSTD_CCtx_s* m_zstdStream{nullptr}; // Compression::Zstd only
+
+    std::string m_lastError;
+};
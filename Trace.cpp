@@ -0,0 +1,241 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "Trace.h"
+
+#ifdef ARCHIVEMANAGER_TRACING
+
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace {
+
+namespace {
+    // 32 bytes per event: 2 MB per thread that ever records a span
+    constexpr size_t kRingCapacity = 1 << 16;
+
+    struct Event {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+        uint64_t bytes;
+    };
+
+    // Written only by its own thread. The count is published with release
+    // order so an exporter sees complete events.
+    struct Ring {
+        explicit Ring(uint32_t id) : threadId(id), events(kRingCapacity) {}
+
+        uint32_t threadId;
+        std::vector<Event> events;
+        std::atomic<uint64_t> written{0};
+    };
+
+    std::atomic<bool> g_enabled{false};
+    std::mutex g_registryMutex;
+    std::vector<std::unique_ptr<Ring>> g_rings; // rings outlive their threads
+    std::vector<Ring*> g_freeRings;
+    std::string g_outputPath;
+
+    // Worker pools are short-lived, so a finished thread hands its ring (and
+    // the events in it) to the next new thread instead of leaking 2 MB each.
+    // Trace "tid"s therefore name ring slots rather than OS threads.
+    struct RingLease {
+        Ring* ring{nullptr};
+        ~RingLease()
+        {
+            if (!ring) return;
+            std::lock_guard<std::mutex> lock(g_registryMutex);
+            g_freeRings.push_back(ring);
+        }
+    };
+
+    Ring& threadRing()
+    {
+        thread_local RingLease lease;
+        if (!lease.ring) {
+            std::lock_guard<std::mutex> lock(g_registryMutex);
+            if (!g_freeRings.empty()) {
+                lease.ring = g_freeRings.back();
+                g_freeRings.pop_back();
+            } else {
+                g_rings.push_back(std::make_unique<Ring>(static_cast<uint32_t>(g_rings.size() + 1)));
+                lease.ring = g_rings.back().get();
+            }
+        }
+        return *lease.ring;
+    }
+
+    // Copies the events still held in every ring, oldest first
+    std::vector<std::pair<uint32_t, Event>> snapshot()
+    {
+        std::vector<std::pair<uint32_t, Event>> events;
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        for (const auto& ring : g_rings) {
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > kRingCapacity ? written - kRingCapacity : 0;
+            for (uint64_t i = first; i < written; ++i) {
+                events.emplace_back(ring->threadId, ring->events[i % kRingCapacity]);
+            }
+        }
+        return events;
+    }
+
+    void appendJsonString(std::string& out, const char* text)
+    {
+        out += '"';
+        for (; *text; ++text) {
+            if (*text == '"' || *text == '\\') out += '\\';
+            out += *text;
+        }
+        out += '"';
+    }
+}
+
+bool IsEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t NowNs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void Record(const char* name, uint64_t startNs, uint64_t endNs, uint64_t bytes)
+{
+    Ring& ring = threadRing();
+    uint64_t index = ring.written.load(std::memory_order_relaxed);
+    ring.events[index % kRingCapacity] = Event{name, startNs, endNs - startNs, bytes};
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+void EnableFromEnvironment()
+{
+    const char* path = std::getenv("ARCHIVEMANAGER_TRACE");
+    if (path && *path) {
+        Enable(path);
+    }
+}
+
+void Enable(const std::string& outputPath)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        g_outputPath = outputPath;
+    }
+    g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void Reset()
+{
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (auto& ring : g_rings) {
+        ring->written.store(0, std::memory_order_release);
+    }
+}
+
+bool WriteChromeTrace(const std::string& path)
+{
+    auto events = snapshot();
+    uint64_t origin = UINT64_MAX;
+    for (const auto& [thread, event] : events) {
+        origin = std::min(origin, event.startNs);
+    }
+
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) return false;
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char number[160];
+    for (size_t i = 0; i < events.size(); ++i) {
+        const auto& [thread, event] = events[i];
+        json += "{\"name\":";
+        appendJsonString(json, event.name);
+        std::snprintf(number, sizeof(number),
+                      ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                      "\"args\":{\"bytes\":%llu}}%s\n",
+                      thread, (event.startNs - origin) / 1000.0, event.durationNs / 1000.0,
+                      static_cast<unsigned long long>(event.bytes),
+                      i + 1 < events.size() ? "," : "");
+        json += number;
+
+        if (json.size() > (1 << 20)) {
+            std::fwrite(json.data(), 1, json.size(), out);
+            json.clear();
+        }
+    }
+    json += "]}\n";
+    std::fwrite(json.data(), 1, json.size(), out);
+    return std::fclose(out) == 0;
+}
+
+std::string Summary()
+{
+    struct Totals {
+        uint64_t calls{0};
+        uint64_t ns{0};
+        uint64_t bytes{0};
+    };
+    // Thread 0 holds the sum over all threads
+    std::map<std::string, std::map<uint32_t, Totals>> phases;
+    for (const auto& [thread, event] : snapshot()) {
+        for (uint32_t slot : {0u, thread}) {
+            Totals& t = phases[event.name][slot];
+            ++t.calls;
+            t.ns += event.durationNs;
+            t.bytes += event.bytes;
+        }
+    }
+
+    std::string table;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-24s %7s %10s %12s %12s %10s\n",
+                  "phase", "thread", "calls", "time ms", "MB", "MB/s");
+    table += line;
+    for (const auto& [name, threads] : phases) {
+        for (const auto& [thread, t] : threads) {
+            double ms = t.ns / 1e6;
+            double mb = t.bytes / (1024.0 * 1024.0);
+            std::snprintf(line, sizeof(line), "%-24s %7s %10llu %12.2f %12.2f %10.1f\n",
+                          thread == 0 ? name.c_str() : "",
+                          thread == 0 ? "all" : std::to_string(thread).c_str(),
+                          static_cast<unsigned long long>(t.calls), ms, mb,
+                          t.ns > 0 ? mb / (t.ns / 1e9) : 0.0);
+            table += line;
+        }
+    }
+    return table;
+}
+
+bool Dump()
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        path = g_outputPath;
+    }
+    if (!IsEnabled() || path.empty()) return true;
+
+    if (!WriteChromeTrace(path)) return false;
+
+    std::string summary = Summary();
+    std::FILE* out = std::fopen((path + ".txt").c_str(), "w");
+    if (!out) return false;
+    std::fwrite(summary.data(), 1, summary.size(), out);
+    return std::fclose(out) == 0;
+}
+
+}
+
+#endif
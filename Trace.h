@@ -0,0 +1,88 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Scoped-span tracing of archive jobs. Spans are recorded into a fixed-size
+// ring buffer per thread (no locks, no allocation after the first span on a
+// thread) and can be exported as Chrome trace-event JSON, which loads in
+// chrome://tracing or https://ui.perfetto.dev, plus a per-phase summary.
+//
+//     Trace::Span span("compress");
+//     ...
+//     span.AddBytes(size);
+//
+// Tracing is compiled in with ARCHIVEMANAGER_TRACING (CMake option of the
+// same name) and switched on at runtime by pointing the ARCHIVEMANAGER_TRACE
+// environment variable at the JSON file to write. A disabled span costs one
+// relaxed atomic load; without ARCHIVEMANAGER_TRACING the calls are empty
+// inline functions and compile to nothing.
+//
+// Span names must be string literals (only the pointer is stored). Spans
+// measure inclusive time, so nested phases are also part of their parent.
+namespace Trace {
+
+#ifdef ARCHIVEMANAGER_TRACING
+
+    bool IsEnabled();
+    uint64_t NowNs();
+    void Record(const char* name, uint64_t startNs, uint64_t endNs, uint64_t bytes);
+
+    class Span {
+    public:
+        explicit Span(const char* name)
+            : m_name(IsEnabled() ? name : nullptr)
+            , m_start(m_name ? NowNs() : 0)
+        {
+        }
+        ~Span()
+        {
+            if (m_name) Record(m_name, m_start, NowNs(), m_bytes);
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        void AddBytes(uint64_t bytes) { m_bytes += bytes; }
+
+    private:
+        const char* m_name;
+        uint64_t m_start;
+        uint64_t m_bytes{0};
+    };
+
+    // Reads ARCHIVEMANAGER_TRACE; call once at startup
+    void EnableFromEnvironment();
+    void Enable(const std::string& outputPath);
+
+    // Writes the trace JSON to the configured path and the summary next to
+    // it (path + ".txt"). Meant for the end of a job; spans still running on
+    // other threads are simply not included yet.
+    bool Dump();
+
+    bool WriteChromeTrace(const std::string& path);
+    std::string Summary();
+    void Reset();
+
+#else
+
+    class Span {
+    public:
+        explicit Span(const char*) {}
+        void AddBytes(uint64_t) {}
+    };
+
+    inline bool IsEnabled() { return false; }
+    inline void EnableFromEnvironment() {}
+    inline void Enable(const std::string&) {}
+    inline bool Dump() { return true; }
+    inline bool WriteChromeTrace(const std::string&) { return false; }
+    inline std::string Summary() { return {}; }
+    inline void Reset() {}
+
+#endif
+
+}
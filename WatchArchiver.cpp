@@ -0,0 +1,289 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "WatchArchiver.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include "ContentType.h"
+#include "PathOptimizer.h"
+#include "Trace.h"
+
+namespace {
+    // How often Run() looks at the stop flag while idle; a signal or a
+    // change wakes it sooner
+    constexpr int kStopCheckMs = 1000;
+
+    int64_t nowNs()
+    {
+        timespec now{};
+        clock_gettime(CLOCK_REALTIME, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    int64_t mtimeNs(const struct stat& st)
+    {
+        return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    std::string megabytes(uint64_t bytes)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f MB", static_cast<double>(bytes) / (1 << 20));
+        return text;
+    }
+}
+
+WatchArchiver::WatchArchiver(std::string archivePath, WatchOptions options)
+    : m_archivePath(std::move(archivePath))
+    , m_options(options)
+    , m_startNs(nowNs())
+{
+}
+
+WatchArchiver::~WatchArchiver()
+{
+    if (m_open) {
+        Close();
+    }
+}
+
+bool WatchArchiver::fail(const std::string& message)
+{
+    m_lastError = message;
+    return false;
+}
+
+bool WatchArchiver::AddDirectory(const std::string& root)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path normal = fs::absolute(root, ec).lexically_normal();
+    if (!normal.has_filename() && normal.has_parent_path() && normal != normal.root_path()) {
+        normal = normal.parent_path();
+    }
+
+    std::string path = normal.string();
+    if (!m_watcher.Add(path)) return fail(m_watcher.GetLastError());
+    m_roots.push_back(path);
+    return true;
+}
+
+std::string WatchArchiver::entryName(const std::string& path) const
+{
+    namespace fs = std::filesystem;
+    for (const auto& root : m_roots) {
+        if (path.size() > root.size() && path.compare(0, root.size(), root) == 0 && path[root.size()] == '/') {
+            std::string prefix = fs::path(root).filename().string();
+            return prefix.empty() ? path.substr(root.size() + 1) : prefix + path.substr(root.size());
+        }
+    }
+    return fs::path(path).filename().string();
+}
+
+std::string WatchArchiver::datedPath(const char* suffix) const
+{
+    namespace fs = std::filesystem;
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+
+    fs::path archive(m_archivePath);
+    std::string base = (archive.parent_path() / archive.stem()).string() + "-" + stamp + suffix;
+    std::string extension = archive.extension().string();
+    std::string path = base + extension;
+    std::error_code ec;
+    for (int n = 2; fs::exists(path, ec); ++n) {
+        path = base + "-" + std::to_string(n) + extension;
+    }
+    return path;
+}
+
+bool WatchArchiver::openArchive()
+{
+    std::error_code ec;
+    bool appended = false;
+    if (std::filesystem::exists(m_archivePath, ec)) {
+        appended = m_writer.OpenAppend(m_archivePath);
+        if (!appended) {
+            // Cut short while a batch was written; kept aside rather than lost
+            std::string aside = datedPath(".incomplete");
+            if (std::rename(m_archivePath.c_str(), aside.c_str()) != 0) {
+                return fail("Cannot append to " + m_archivePath + ": " + m_writer.GetLastError());
+            }
+        }
+    }
+    if (!appended && !m_writer.Open(m_archivePath)) {
+        return fail(m_writer.GetLastError());
+    }
+    m_open = true;
+    return true;
+}
+
+bool WatchArchiver::rotate()
+{
+    m_open = false;
+    if (!m_writer.Close()) return fail(m_writer.GetLastError());
+
+    std::string rotated = datedPath("");
+    if (std::rename(m_archivePath.c_str(), rotated.c_str()) != 0) {
+        return fail("Cannot rotate " + m_archivePath + " to " + rotated);
+    }
+    ++m_stats.rotations;
+    return openArchive();
+}
+
+bool WatchArchiver::Close()
+{
+    if (!m_open) return true;
+    m_open = false;
+    if (!m_writer.Close()) return fail(m_writer.GetLastError());
+    return true;
+}
+
+bool WatchArchiver::ArchiveBatch(std::vector<std::string> paths)
+{
+    Trace::Span span("watch batch");
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    // Reported files that are gone again, or unchanged since archived, drop out
+    std::vector<std::string> files;
+    std::vector<FileState> states;
+    for (auto& path : paths) {
+        struct stat st{};
+        if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        FileState state{static_cast<uint64_t>(st.st_size), mtimeNs(st)};
+        auto it = m_archived.find(path);
+        if (it != m_archived.end() && it->second == state) {
+            ++m_stats.unchanged;
+            continue;
+        }
+        files.push_back(std::move(path));
+        states.push_back(state);
+    }
+    if (files.empty()) return true;
+
+    auto kinds = ContentType::ClassifyAll(files);
+    std::vector<size_t> order(files.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    if (m_options.optimizeOrder && files.size() > 2) {
+        PathOptimizer optimizer;
+        for (size_t i = 0; i < files.size(); ++i) {
+            optimizer.AddFile(i, static_cast<size_t>(states[i].size), kinds[i]);
+        }
+        RefinedOrder refined = optimizer.RefineOrder(std::chrono::milliseconds(200));
+        for (size_t i = 0; i < refined.order.size(); ++i) {
+            order[i] = optimizer.GetFile(refined.order[i]).id;
+        }
+    }
+
+    if (!m_open && !openArchive()) return false;
+
+    bool ok = true;
+    for (size_t i : order) {
+        if (m_options.rotateBytes > 0 && m_writer.GetBytesWritten() >= m_options.rotateBytes && !rotate()) {
+            return false;
+        }
+
+        int level = ContentType::IsCompressed(kinds[i]) ? 0 : m_options.compressionLevel;
+        if (!m_writer.AddFile(files[i], entryName(files[i]), level)) {
+            fail(m_writer.GetLastError());
+            ++m_stats.failed;
+            ok = false;
+            continue;
+        }
+        m_archived[files[i]] = states[i];
+        ++m_stats.files;
+        m_stats.bytes += states[i].size;
+        span.AddBytes(states[i].size);
+    }
+
+    ++m_stats.batches;
+    if (!m_writer.Checkpoint()) return fail(m_writer.GetLastError());
+    return ok;
+}
+
+void WatchArchiver::modifiedSinceStart(std::vector<std::string>& paths) const
+{
+    namespace fs = std::filesystem;
+    for (const auto& root : m_roots) {
+        std::error_code ec;
+        fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            struct stat st{};
+            if (::lstat(it->path().c_str(), &st) == 0 && S_ISREG(st.st_mode) && mtimeNs(st) >= m_startNs) {
+                paths.push_back(it->path().string());
+            }
+        }
+    }
+}
+
+bool WatchArchiver::Run(const std::atomic<bool>& stop, const LogFn& log)
+{
+    using Clock = std::chrono::steady_clock;
+    auto report = [&log](const std::string& message) {
+        if (log) log(message);
+    };
+    auto flush = [&](std::vector<std::string>& pending) {
+        Stats before = m_stats;
+        if (!ArchiveBatch(std::move(pending))) {
+            report("Batch failed: " + m_lastError);
+        }
+        pending.clear();
+        uint64_t files = m_stats.files - before.files;
+        if (files > 0) {
+            report("Archived " + std::to_string(files) + " files (" + megabytes(m_stats.bytes - before.bytes) +
+                   ") to " + m_archivePath);
+        }
+        if (m_stats.rotations > before.rotations) {
+            report("Rotated " + m_archivePath);
+        }
+    };
+
+    std::vector<std::string> pending;
+    Clock::time_point deadline = Clock::time_point::max();
+    while (!stop) {
+        int timeout = kStopCheckMs;
+        if (!pending.empty()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            timeout = static_cast<int>(std::clamp<int64_t>(left, 0, kStopCheckMs));
+        }
+
+        size_t before = pending.size();
+        switch (m_watcher.Wait(timeout, pending)) {
+        case DirectoryWatcher::Result::Error:
+            fail(m_watcher.GetLastError());
+            if (!pending.empty()) flush(pending);
+            Close();
+            return false;
+        case DirectoryWatcher::Result::Overflowed:
+            ++m_stats.overflows;
+            report("inotify queue overflowed; checking files modified since watching began");
+            modifiedSinceStart(pending);
+            break;
+        default:
+            break;
+        }
+
+        // The window starts with the first change of a batch
+        if (before == 0 && !pending.empty()) {
+            deadline = Clock::now() + std::chrono::seconds(m_options.windowSeconds);
+        }
+        if (!pending.empty() && Clock::now() >= deadline) {
+            flush(pending);
+            deadline = Clock::time_point::max();
+        }
+    }
+
+    if (!pending.empty()) flush(pending);
+    return Close();
+}
@@ -0,0 +1,99 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DirectoryWatcher.h"
+#include "ZipWriter.h"
+
+struct WatchOptions {
+    unsigned windowSeconds{10};        // changes are collected this long after the first one
+    uint64_t rotateBytes{1ull << 30};  // 0 never rotates
+    int compressionLevel{6};
+    bool optimizeOrder{true};          // PathOptimizer order within each batch
+};
+
+// Long-running incremental archiving: files written under the watched
+// directories are appended, one batch per window, to a rolling archive.
+// Nothing is rescanned; only the files inotify reports are looked at, and
+// the process sleeps in poll() while nothing changes.
+//
+// The archive stays open between batches with its central directory
+// rewritten after each one (ZipWriter::Checkpoint), so it is complete on
+// disk whenever no batch is being written. Once it reaches rotateBytes it is
+// renamed to "<name>-<YYYYmmdd-HHMMSS>.zip" and a new one started; an
+// existing archive at the path is appended to on start-up.
+//
+// A file is archived again when it changes; entries are named
+// "<watched directory name>/<path below it>", so extraction keeps the
+// newest copy. When the inotify queue overflows, directories created in the
+// meantime are watched, then files modified since watching began are
+// checked against what was archived.
+class WatchArchiver {
+public:
+    struct Stats {
+        uint64_t batches{0};
+        uint64_t files{0};
+        uint64_t bytes{0};      // uncompressed
+        uint64_t unchanged{0};  // reported but identical to the archived copy
+        uint64_t failed{0};
+        uint64_t rotations{0};
+        uint64_t overflows{0};
+    };
+
+    using LogFn = std::function<void(const std::string& message)>;
+
+    explicit WatchArchiver(std::string archivePath, WatchOptions options = {});
+    ~WatchArchiver();
+
+    WatchArchiver(const WatchArchiver&) = delete;
+    WatchArchiver& operator=(const WatchArchiver&) = delete;
+
+    bool AddDirectory(const std::string& root);
+
+    // Watches and archives until stop becomes true, then archives what is
+    // pending and closes the archive. Returns false if watching fails;
+    // failed batches are logged and counted, and watching goes on.
+    bool Run(const std::atomic<bool>& stop, const LogFn& log = {});
+
+    // Appends the files that are new or changed since they were last archived
+    bool ArchiveBatch(std::vector<std::string> paths);
+
+    bool Close();
+
+    Stats GetStats() const { return m_stats; }
+    const std::string& GetLastError() const { return m_lastError; }
+
+private:
+    struct FileState {
+        uint64_t size{0};
+        int64_t mtimeNs{0};
+        bool operator==(const FileState& other) const { return size == other.size && mtimeNs == other.mtimeNs; }
+    };
+
+    bool openArchive();
+    bool rotate();
+    std::string datedPath(const char* suffix) const;
+    std::string entryName(const std::string& path) const;
+    void modifiedSinceStart(std::vector<std::string>& paths) const;
+    bool fail(const std::string& message);
+
+    std::string m_archivePath;
+    WatchOptions m_options;
+    DirectoryWatcher m_watcher;
+    std::vector<std::string> m_roots;
+    int64_t m_startNs{0};
+
+    ZipWriter m_writer;
+    bool m_open{false};
+    std::unordered_map<std::string, FileState> m_archived;
+
+    Stats m_stats;
+    std::string m_lastError;
+};
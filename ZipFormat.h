@@ -0,0 +1,192 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <ctime>
+
+// On-disk constants of the PKWARE ZIP format (APPNOTE.TXT) shared by
+// ZipWriter and ZipReader, plus the ArchiveManager private extensions.
+//
+// ArchiveManager extensions
+// -------------------------
+// Shared dictionaries: small files of the same compressionType bucket can be
+// deflated with a preset dictionary (zlib deflateSetDictionary). Such entries
+// use the private method kMethodDeflateDictionary so that other tools report
+// "unsupported method" instead of producing garbage, and carry an extra field
+// kExtraDictionaryRef holding the Adler-32 id of their dictionary. Each
+// dictionary is stored as a STORED entry under kInternalPrefix with an extra
+// field kExtraDictionary holding the same id.
+//
+// Solid blocks: in solid mode the member files are concatenated in archive
+// order into one logical stream that is cut into fixed-size blocks. Every
+// block is an ordinary DEFLATE entry kSolidBlockPrefix + six-digit number,
+// and kSolidIndexName maps members to their offset in the stream:
+//   u32 magic 'AMSI', u16 version, u64 block size, u32 block count,
+//   u32 member count, then per member:
+//   u16 name length, name, u64 offset, u64 size, u32 crc,
+//   u32 dos date/time, u32 external attributes.
+//
+// Split archives follow the PKWARE layout: name.z01, name.z02, ... name.zip,
+// where the .zip is the last volume and holds the end records. Offsets are
+// relative to the start of their own volume and headers never straddle two.
+namespace ZipFormat {
+    constexpr uint32_t kLocalHeaderSignature = 0x04034b50;
+    constexpr uint32_t kCentralHeaderSignature = 0x02014b50;
+    constexpr uint32_t kEndOfCentralDirSignature = 0x06054b50;
+    constexpr uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+    constexpr uint32_t kZip64LocatorSignature = 0x07064b50;
+    constexpr uint32_t kSplitSignature = 0x08074b50;
+    constexpr uint32_t kDataDescriptorSignature = 0x08074b50; // the same bytes
+    constexpr uint32_t kSingleSegmentMarker = 0x30304b50; // "PK00"
+
+    constexpr size_t kLocalHeaderSize = 30;
+    constexpr size_t kCentralHeaderSize = 46;
+    constexpr size_t kEndOfCentralDirSize = 22;
+    constexpr size_t kZip64EndOfCentralDirSize = 56;
+    constexpr size_t kZip64LocatorSize = 20;
+
+    // Header fields set to these values are stored in the ZIP64 extra field
+    constexpr uint32_t kZip64Marker32 = 0xffffffff;
+    constexpr uint16_t kZip64Marker16 = 0xffff;
+    constexpr uint16_t kExtraZip64 = 0x0001;
+
+    // The local header must be written before the compressed size is known,
+    // so entries this large reserve ZIP64 fields up front: deflate can expand
+    // incompressible data slightly past the input size.
+    constexpr uint64_t kZip64Threshold = 0xf0000000;
+
+    constexpr uint16_t kMethodStore = 0;
+    constexpr uint16_t kMethodDeflate = 8;
+    constexpr uint16_t kMethodDeflateDictionary = 0xAD08;
+
+    constexpr uint16_t kFlagEncrypted = 0x0001;
+    constexpr uint16_t kFlagDataDescriptor = 0x0008;
+    constexpr uint16_t kFlagUtf8 = 0x0800;
+
+    // Flag bits 1-2 of a DEFLATE entry name the compression option used
+    // (APPNOTE 4.4.4); the level itself is not recorded. These are the
+    // classes Info-ZIP and libzip write for each zlib level.
+    constexpr uint16_t kFlagDeflateOptionMask = 0x0006;
+    constexpr uint16_t DeflateOptionFlags(int level) {
+        if (level >= 8) return 0x0002; // maximum
+        if (level == 2) return 0x0004; // fast
+        if (level == 1) return 0x0006; // super fast
+        return 0;                      // normal
+    }
+
+    constexpr uint16_t kExtraDictionary = 0xAD01;
+    constexpr uint16_t kExtraDictionaryRef = 0xAD02;
+
+    constexpr uint16_t kVersionMadeBy = (3 << 8) | 20; // Unix, spec 2.0
+    constexpr uint16_t kVersionNeeded = 20;
+    constexpr uint16_t kVersionNeededZip64 = 45;
+
+    const std::string kInternalPrefix = ".archivemanager/";
+    const std::string kSolidBlockPrefix = kInternalPrefix + "solid/block-";
+    const std::string kSolidIndexName = kInternalPrefix + "solid/index";
+    constexpr uint32_t kSolidIndexMagic = 0x49534D41; // "AMSI"
+    constexpr uint16_t kSolidIndexVersion = 1;
+
+    inline bool IsInternalName(const std::string& name) {
+        return name.compare(0, kInternalPrefix.size(), kInternalPrefix) == 0;
+    }
+
+    // Path of volume number disk (zero based) for every volume but the last,
+    // which is archivePath itself
+    inline std::string SplitVolumePath(const std::string& archivePath, uint32_t disk) {
+        std::string base = archivePath;
+        if (base.size() >= 4 && base.compare(base.size() - 4, 4, ".zip") == 0) {
+            base.resize(base.size() - 4);
+        }
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), ".z%02u", disk + 1);
+        return base + suffix;
+    }
+
+    inline void PutU16(std::string& out, uint16_t v) {
+        out.push_back(static_cast<char>(v & 0xff));
+        out.push_back(static_cast<char>((v >> 8) & 0xff));
+    }
+
+    inline void PutU32(std::string& out, uint32_t v) {
+        PutU16(out, static_cast<uint16_t>(v & 0xffff));
+        PutU16(out, static_cast<uint16_t>(v >> 16));
+    }
+
+    inline void PutU64(std::string& out, uint64_t v) {
+        PutU32(out, static_cast<uint32_t>(v & 0xffffffffu));
+        PutU32(out, static_cast<uint32_t>(v >> 32));
+    }
+
+    inline uint16_t GetU16(const unsigned char* p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    inline uint32_t GetU32(const unsigned char* p) {
+        return GetU16(p) | (static_cast<uint32_t>(GetU16(p + 2)) << 16);
+    }
+
+    inline uint64_t GetU64(const unsigned char* p) {
+        return GetU32(p) | (static_cast<uint64_t>(GetU32(p + 4)) << 32);
+    }
+
+    // Finds an extra field block by header id; returns false if absent
+    inline bool FindExtraField(const std::string& extra, uint16_t id,
+                               std::string& payload) {
+        const auto* p = reinterpret_cast<const unsigned char*>(extra.data());
+        size_t pos = 0;
+        while (pos + 4 <= extra.size()) {
+            uint16_t headerId = GetU16(p + pos);
+            uint16_t size = GetU16(p + pos + 2);
+            if (pos + 4 + size > extra.size()) break;
+            if (headerId == id) {
+                payload.assign(extra, pos + 4, size);
+                return true;
+            }
+            pos += 4 + size;
+        }
+        return false;
+    }
+
+    // Copy of extra without the blocks with this header id
+    inline std::string RemoveExtraField(const std::string& extra, uint16_t id) {
+        const auto* p = reinterpret_cast<const unsigned char*>(extra.data());
+        std::string kept;
+        size_t pos = 0;
+        while (pos + 4 <= extra.size()) {
+            uint16_t size = GetU16(p + pos + 2);
+            if (pos + 4 + size > extra.size()) break;
+            if (GetU16(p + pos) != id) kept.append(extra, pos, 4 + size);
+            pos += 4 + size;
+        }
+        return kept;
+    }
+
+    // MS-DOS date/time as stored in ZIP headers: high word date, low word time
+    inline uint32_t ToDosDateTime(std::time_t t) {
+        std::tm tmv{};
+        localtime_r(&t, &tmv);
+        if (tmv.tm_year < 80) return (1 << 5 | 1) << 16; // 1980-01-01
+        uint32_t date = ((tmv.tm_year - 80) << 9) | ((tmv.tm_mon + 1) << 5) | tmv.tm_mday;
+        uint32_t time = (tmv.tm_hour << 11) | (tmv.tm_min << 5) | (tmv.tm_sec / 2);
+        return (date << 16) | time;
+    }
+
+    inline std::time_t FromDosDateTime(uint32_t dos) {
+        std::tm tmv{};
+        uint32_t date = dos >> 16;
+        uint32_t time = dos & 0xffff;
+        tmv.tm_year = static_cast<int>((date >> 9) & 0x7f) + 80;
+        tmv.tm_mon = static_cast<int>((date >> 5) & 0x0f) - 1;
+        tmv.tm_mday = static_cast<int>(date & 0x1f);
+        tmv.tm_hour = static_cast<int>((time >> 11) & 0x1f);
+        tmv.tm_min = static_cast<int>((time >> 5) & 0x3f);
+        tmv.tm_sec = static_cast<int>((time & 0x1f) * 2);
+        tmv.tm_isdst = -1;
+        return std::mktime(&tmv);
+    }
+}
@@ -0,0 +1,766 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ZipReader.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "zlib.h"
+#include "Codec.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+namespace {
+    constexpr size_t kBufferSize = 256 * 1024;
+    constexpr size_t kMaxCommentSize = 0xffff;
+    constexpr uint32_t kMaxVolumes = 1u << 20;
+}
+
+ZipReader::~ZipReader()
+{
+    Close();
+}
+
+bool ZipReader::fail(const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = message;
+    return false;
+}
+
+std::string ZipReader::GetLastError() const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
+
+void ZipReader::Close()
+{
+    m_volumes.clear();
+    m_entries.clear();
+    m_dictionaries.clear();
+    m_zip64 = false;
+    m_centralOffset = 0;
+    m_solidBlockSize = 0;
+    m_solidBlocks.clear();
+    m_solidCache.clear();
+}
+
+std::string ZipReader::GetVolumePath(uint32_t disk) const
+{
+    if (m_path.empty() || disk >= m_volumes.size()) return "";
+    return disk + 1 == m_volumes.size() ? m_path : ZipFormat::SplitVolumePath(m_path, disk);
+}
+
+ArchiveSource* ZipReader::volumeSource(uint32_t disk)
+{
+    std::lock_guard<std::mutex> lock(m_volumeMutex);
+    if (disk >= m_volumes.size()) return nullptr;
+    if (!m_volumes[disk] && m_openVolume) {
+        m_volumes[disk] = m_openVolume(ZipFormat::SplitVolumePath(m_path, disk));
+    }
+    return m_volumes[disk].get();
+}
+
+// Reads size bytes starting at (disk, offset) and advances both, continuing
+// on the next volume when data runs past the end of the current one
+bool ZipReader::readAt(uint32_t& disk, uint64_t& offset, void* buffer, size_t size)
+{
+    auto* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        ArchiveSource* source = volumeSource(disk);
+        if (!source) {
+            return fail("Missing volume: " + ZipFormat::SplitVolumePath(m_path, disk));
+        }
+
+        uint64_t volumeSize = source->Size();
+        if (offset >= volumeSize) {
+            if (disk + 1 < m_volumes.size()) {
+                ++disk;
+                offset = 0;
+                continue;
+            }
+            return fail("Unexpected end of archive");
+        }
+
+        size_t n = static_cast<size_t>(std::min<uint64_t>(size, volumeSize - offset));
+        if (!source->ReadAt(offset, out, n)) {
+            return fail(source->GetLastError());
+        }
+        out += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+void ZipReader::Prefetch(const std::vector<const ZipEntryInfo*>& entries)
+{
+    using namespace ZipFormat;
+
+    // The local header repeats the name and usually the extra field
+    std::vector<std::vector<ArchiveSource::Range>> ranges(m_volumes.size());
+    for (const ZipEntryInfo* entry : entries) {
+        if (entry->solid || entry->disk >= ranges.size()) continue;
+        uint64_t size = kLocalHeaderSize + entry->name.size() + entry->extra.size() + entry->compressedSize;
+        ranges[entry->disk].push_back({entry->localHeaderOffset, size});
+    }
+
+    for (uint32_t disk = 0; disk < ranges.size(); ++disk) {
+        if (ranges[disk].empty()) continue;
+        if (ArchiveSource* source = volumeSource(disk)) source->Prefetch(ranges[disk]);
+    }
+}
+
+bool ZipReader::Open(const std::string& path, SourceFactory openVolume)
+{
+    Close();
+
+    m_path = path;
+    m_openVolume = openVolume ? std::move(openVolume) : [](const std::string& volumePath) {
+        auto source = std::make_unique<FileSource>();
+        return source->Open(volumePath) ? std::unique_ptr<ArchiveSource>(std::move(source)) : nullptr;
+    };
+
+    auto source = m_openVolume(path);
+    if (!source) {
+        return fail("Failed to open archive: " + std::string(std::strerror(errno)));
+    }
+    return openSource(std::move(source));
+}
+
+bool ZipReader::Open(std::unique_ptr<ArchiveSource> source)
+{
+    Close();
+
+    m_path.clear();
+    m_openVolume = nullptr;
+    return openSource(std::move(source));
+}
+
+bool ZipReader::openSource(std::unique_ptr<ArchiveSource> source)
+{
+    m_fileSize = source->Size();
+    m_volumes.clear();
+    m_volumes.push_back(std::move(source));
+    return readCentralDirectory() && loadDictionaries() && loadSolidIndex();
+}
+
+bool ZipReader::readCentralDirectory()
+{
+    using namespace ZipFormat;
+    Trace::Span span("read central directory");
+
+    if (m_fileSize < kEndOfCentralDirSize) {
+        return fail("Not a zip archive");
+    }
+
+    // The end record sits at the very end, possibly followed by a comment
+    size_t tailSize = static_cast<size_t>(
+        std::min<uint64_t>(m_fileSize, kEndOfCentralDirSize + kMaxCommentSize));
+    std::vector<unsigned char> tail(tailSize);
+    uint32_t disk = 0;
+    uint64_t offset = m_fileSize - tailSize;
+    if (!readAt(disk, offset, tail.data(), tailSize)) return false;
+
+    size_t eocd = SIZE_MAX;
+    for (size_t i = tailSize - kEndOfCentralDirSize + 1; i-- > 0;) {
+        if (GetU32(&tail[i]) == kEndOfCentralDirSignature) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == SIZE_MAX) {
+        return fail("End of central directory not found");
+    }
+
+    uint32_t lastDisk = GetU16(&tail[eocd + 4]);
+    uint32_t centralDisk = GetU16(&tail[eocd + 6]);
+    uint64_t entryCount = GetU16(&tail[eocd + 10]);
+    uint64_t centralSize = GetU32(&tail[eocd + 12]);
+    uint64_t centralOffset = GetU32(&tail[eocd + 16]);
+
+    // A ZIP64 locator right before the end record points at the 64-bit values
+    uint64_t eocdOffset = m_fileSize - tailSize + eocd;
+    unsigned char locator[kZip64LocatorSize];
+    if (eocdOffset >= kZip64LocatorSize) {
+        disk = 0;
+        offset = eocdOffset - kZip64LocatorSize;
+        if (!readAt(disk, offset, locator, sizeof(locator))) return false;
+        m_zip64 = GetU32(locator) == kZip64LocatorSignature;
+        if (m_zip64) {
+            uint32_t totalDisks = GetU32(locator + 16);
+            if (totalDisks == 0 || totalDisks > kMaxVolumes) {
+                return fail("Corrupt ZIP64 end of central directory");
+            }
+            lastDisk = totalDisks - 1;
+        }
+    }
+
+    // Only the last volume is open so far; the others open on first use
+    auto last = std::move(m_volumes[0]);
+    m_volumes.clear();
+    m_volumes.resize(lastDisk + 1);
+    m_volumes[lastDisk] = std::move(last);
+
+    if (m_zip64) {
+        unsigned char record[kZip64EndOfCentralDirSize];
+        disk = GetU32(locator + 4);
+        offset = GetU64(locator + 8);
+        if (disk > lastDisk || (disk == lastDisk && offset + sizeof(record) > m_fileSize) ||
+            !readAt(disk, offset, record, sizeof(record)) ||
+            GetU32(record) != kZip64EndOfCentralDirSignature) {
+            return fail("Corrupt ZIP64 end of central directory");
+        }
+        centralDisk = GetU32(record + 20);
+        entryCount = GetU64(record + 32);
+        centralSize = GetU64(record + 40);
+        centralOffset = GetU64(record + 48);
+    }
+
+    if (centralDisk > lastDisk ||
+        (centralDisk == lastDisk && centralOffset + centralSize > m_fileSize)) {
+        return fail("Corrupt central directory");
+    }
+
+    m_centralOffset = centralOffset;
+    std::vector<unsigned char> central(static_cast<size_t>(centralSize));
+    disk = centralDisk;
+    offset = centralOffset;
+    if (!readAt(disk, offset, central.data(), central.size())) return false;
+
+    m_entries.clear();
+    m_entries.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, centralSize / kCentralHeaderSize)));
+
+    size_t pos = 0;
+    while (pos + kCentralHeaderSize <= central.size()) {
+        const unsigned char* p = &central[pos];
+        if (GetU32(p) != kCentralHeaderSignature) {
+            return fail("Corrupt central directory entry");
+        }
+
+        ZipEntryInfo entry;
+        entry.flags = GetU16(p + 8);
+        entry.method = GetU16(p + 10);
+        entry.dosDateTime = GetU32(p + 12);
+        entry.crc = GetU32(p + 16);
+        entry.compressedSize = GetU32(p + 20);
+        entry.uncompressedSize = GetU32(p + 24);
+        uint16_t nameLength = GetU16(p + 28);
+        uint16_t extraLength = GetU16(p + 30);
+        uint16_t commentLength = GetU16(p + 32);
+        entry.disk = GetU16(p + 34);
+        entry.externalAttributes = GetU32(p + 38);
+        entry.localHeaderOffset = GetU32(p + 42);
+
+        size_t next = pos + kCentralHeaderSize + nameLength + extraLength + commentLength;
+        if (next > central.size()) {
+            return fail("Corrupt central directory entry");
+        }
+        entry.name.assign(reinterpret_cast<const char*>(p + kCentralHeaderSize), nameLength);
+        entry.extra.assign(reinterpret_cast<const char*>(p + kCentralHeaderSize + nameLength),
+                           extraLength);
+
+        // Only the fields saturated in the header are present, in this order
+        std::string zip64;
+        if (FindExtraField(entry.extra, kExtraZip64, zip64)) {
+            const auto* z = reinterpret_cast<const unsigned char*>(zip64.data());
+            size_t zpos = 0;
+            auto take = [&](uint64_t& field) {
+                if (field != kZip64Marker32) return true;
+                if (zpos + 8 > zip64.size()) return false;
+                field = GetU64(z + zpos);
+                zpos += 8;
+                return true;
+            };
+            if (!take(entry.uncompressedSize) || !take(entry.compressedSize) ||
+                !take(entry.localHeaderOffset)) {
+                return fail("Corrupt ZIP64 extra field: " + entry.name);
+            }
+            if (entry.disk == kZip64Marker16) {
+                if (zpos + 4 > zip64.size()) {
+                    return fail("Corrupt ZIP64 extra field: " + entry.name);
+                }
+                entry.disk = GetU32(z + zpos);
+            }
+        }
+        if (entry.disk > lastDisk) {
+            return fail("Corrupt central directory entry: " + entry.name);
+        }
+
+        m_entries.push_back(std::move(entry));
+        pos = next;
+    }
+    return true;
+}
+
+bool ZipReader::loadDictionaries()
+{
+    for (const auto& entry : m_entries) {
+        std::string payload;
+        if (!entry.IsInternal() ||
+            !ZipFormat::FindExtraField(entry.extra, ZipFormat::kExtraDictionary, payload) ||
+            payload.size() < 4) {
+            continue;
+        }
+
+        std::string dictionary;
+        bool ok = ReadEntry(entry, [&dictionary](const char* data, size_t size) {
+            dictionary.append(data, size);
+            return true;
+        });
+        if (!ok) return false;
+
+        uint32_t id = ZipFormat::GetU32(reinterpret_cast<const unsigned char*>(payload.data()));
+        m_dictionaries[id] = std::move(dictionary);
+    }
+    return true;
+}
+
+bool ZipReader::loadSolidIndex()
+{
+    using namespace ZipFormat;
+
+    std::string index;
+    std::unordered_map<size_t, size_t> blocks;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const auto& entry = m_entries[i];
+        if (entry.name == kSolidIndexName) {
+            bool ok = ReadEntry(entry, [&index](const char* data, size_t size) {
+                index.append(data, size);
+                return true;
+            });
+            if (!ok) return false;
+        } else if (entry.name.compare(0, kSolidBlockPrefix.size(), kSolidBlockPrefix) == 0) {
+            blocks[std::strtoul(entry.name.c_str() + kSolidBlockPrefix.size(), nullptr, 10)] = i;
+        }
+    }
+    if (index.empty()) return true;
+
+    const auto* p = reinterpret_cast<const unsigned char*>(index.data());
+    const auto* end = p + index.size();
+    if (index.size() < 22 || GetU32(p) != kSolidIndexMagic || GetU16(p + 4) != kSolidIndexVersion) {
+        return fail("Unsupported solid index");
+    }
+    m_solidBlockSize = GetU64(p + 6);
+    if (m_solidBlockSize == 0) {
+        return fail("Corrupt solid index");
+    }
+    uint32_t blockCount = GetU32(p + 14);
+    uint32_t memberCount = GetU32(p + 18);
+    p += 22;
+
+    m_solidBlocks.resize(blockCount);
+    for (uint32_t b = 0; b < blockCount; ++b) {
+        auto it = blocks.find(b);
+        if (it == blocks.end()) {
+            return fail("Missing solid block " + std::to_string(b));
+        }
+        m_solidBlocks[b] = it->second;
+    }
+
+    for (uint32_t i = 0; i < memberCount; ++i) {
+        if (end - p < 2 || end - p < 2 + GetU16(p) + 28) {
+            return fail("Corrupt solid index");
+        }
+        ZipEntryInfo member;
+        uint16_t nameLength = GetU16(p);
+        member.name.assign(reinterpret_cast<const char*>(p + 2), nameLength);
+        p += 2 + nameLength;
+        member.solid = true;
+        member.solidOffset = GetU64(p);
+        member.uncompressedSize = GetU64(p + 8);
+        member.crc = GetU32(p + 16);
+        member.dosDateTime = GetU32(p + 20);
+        member.externalAttributes = GetU32(p + 24);
+        p += 28;
+
+        if (member.uncompressedSize > 0 &&
+            (member.solidOffset + member.uncompressedSize - 1) / m_solidBlockSize >= blockCount) {
+            return fail("Corrupt solid index");
+        }
+        m_entries.push_back(std::move(member));
+    }
+    return true;
+}
+
+bool ZipReader::readSolidBlock(size_t block, std::shared_ptr<const std::string>& data)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_solidCacheMutex);
+        auto it = std::find_if(m_solidCache.begin(), m_solidCache.end(),
+                               [block](const auto& cached) { return cached.first == block; });
+        if (it != m_solidCache.end()) {
+            std::rotate(m_solidCache.begin(), it, it + 1); // most recently used first
+            data = m_solidCache.front().second;
+            return true;
+        }
+    }
+
+    auto decoded = std::make_shared<std::string>();
+    decoded->reserve(static_cast<size_t>(m_entries[m_solidBlocks[block]].uncompressedSize));
+    bool ok = ReadEntry(m_entries[m_solidBlocks[block]], [&decoded](const char* chunk, size_t size) {
+        decoded->append(chunk, size);
+        return true;
+    });
+    if (!ok) return false;
+    data = std::move(decoded);
+
+    // Another thread may have decoded the same block meanwhile
+    std::lock_guard<std::mutex> lock(m_solidCacheMutex);
+    if (std::none_of(m_solidCache.begin(), m_solidCache.end(),
+                     [block](const auto& cached) { return cached.first == block; })) {
+        if (m_solidCache.size() == kSolidCacheBlocks) m_solidCache.pop_back();
+        m_solidCache.emplace(m_solidCache.begin(), block, data);
+    }
+    return true;
+}
+
+bool ZipReader::readSolidMember(const ZipEntryInfo& entry, const SinkFn& sink)
+{
+    uint32_t crc = 0;
+    uint64_t position = entry.solidOffset;
+    uint64_t end = entry.solidOffset + entry.uncompressedSize;
+    std::shared_ptr<const std::string> data;
+
+    while (position < end) {
+        size_t block = static_cast<size_t>(position / m_solidBlockSize);
+        if (!readSolidBlock(block, data)) return false;
+
+        // Only this member's slice goes out, straight from the shared block
+        uint64_t blockStart = block * m_solidBlockSize;
+        size_t from = static_cast<size_t>(position - blockStart);
+        size_t to = static_cast<size_t>(std::min<uint64_t>(end - blockStart, data->size()));
+        if (to <= from) {
+            return fail("Truncated solid block: " + entry.name);
+        }
+
+        crc = Codec::Crc32(crc, data->data() + from, to - from);
+        if (!sink(data->data() + from, to - from)) {
+            return fail("Write failed: " + entry.name);
+        }
+        position = blockStart + to;
+    }
+
+    if (crc != entry.crc) {
+        return fail("CRC mismatch: " + entry.name);
+    }
+    return true;
+}
+
+bool ZipReader::ExtractSolid(const std::function<std::string(const ZipEntryInfo&)>& destPathFor,
+                             unsigned threads)
+{
+    // Members are stored in stream order, so each block maps to a contiguous range
+    std::vector<const ZipEntryInfo*> members;
+    std::vector<std::string> paths;
+    for (const auto& entry : m_entries) {
+        if (!entry.solid) continue;
+        std::string path = destPathFor(entry);
+        if (path.empty()) continue;
+
+        // Create (and truncate) every output up front; blocks then write in place
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return fail("Failed to create: " + path);
+        }
+        ::close(fd);
+
+        members.push_back(&entry);
+        paths.push_back(std::move(path));
+    }
+
+    std::vector<std::vector<uint32_t>> sliceCrcs(members.size());
+    for (size_t i = 0; i < members.size(); ++i) {
+        const auto* m = members[i];
+        if (m->uncompressedSize == 0) continue;
+        uint64_t first = m->solidOffset / m_solidBlockSize;
+        uint64_t last = (m->solidOffset + m->uncompressedSize - 1) / m_solidBlockSize;
+        sliceCrcs[i].assign(static_cast<size_t>(last - first + 1), 0);
+    }
+
+    // Blocks holding none of the requested members are not decoded at all
+    auto firstMember = [&](size_t block) {
+        uint64_t blockStart = block * m_solidBlockSize;
+        auto it = std::partition_point(members.begin(), members.end(),
+            [blockStart](const ZipEntryInfo* m) { return m->solidOffset + m->uncompressedSize <= blockStart; });
+        bool needed = it != members.end() && (*it)->solidOffset < blockStart + m_solidBlockSize;
+        return needed ? it : members.end();
+    };
+    std::vector<const ZipEntryInfo*> needed;
+    for (size_t block = 0; block < m_solidBlocks.size(); ++block) {
+        if (firstMember(block) != members.end()) needed.push_back(&m_entries[m_solidBlocks[block]]);
+    }
+    Prefetch(needed);
+
+    std::atomic<bool> ok{true};
+    ParallelFor(m_solidBlocks.size(), threads, [&](size_t block) {
+        if (!ok) return;
+
+        auto it = firstMember(block);
+        if (it == members.end()) return;
+        uint64_t blockStart = block * m_solidBlockSize;
+
+        std::string data;
+        bool read = ReadEntry(m_entries[m_solidBlocks[block]], [&data](const char* chunk, size_t size) {
+            data.append(chunk, size);
+            return true;
+        });
+        if (!read) {
+            ok = false;
+            return;
+        }
+
+        uint64_t blockEnd = blockStart + data.size();
+
+        for (; it != members.end() && (*it)->solidOffset < blockEnd; ++it) {
+            const ZipEntryInfo* m = *it;
+            if (m->uncompressedSize == 0) continue;
+
+            size_t i = static_cast<size_t>(it - members.begin());
+            uint64_t from = std::max(blockStart, m->solidOffset);
+            uint64_t to = std::min(blockEnd, m->solidOffset + m->uncompressedSize);
+            const char* slice = data.data() + (from - blockStart);
+
+            int fd = ::open(paths[i].c_str(), O_WRONLY);
+            bool written = fd >= 0 &&
+                ::pwrite(fd, slice, static_cast<size_t>(to - from),
+                         static_cast<off_t>(from - m->solidOffset)) == static_cast<ssize_t>(to - from);
+            if (fd >= 0) ::close(fd);
+            if (!written) {
+                fail("Failed to write: " + paths[i]);
+                ok = false;
+                return;
+            }
+
+            sliceCrcs[i][static_cast<size_t>(block - m->solidOffset / m_solidBlockSize)] =
+                Codec::Crc32(0, slice, static_cast<size_t>(to - from));
+        }
+    });
+    if (!ok) return false;
+
+    for (size_t i = 0; i < members.size(); ++i) {
+        const auto* m = members[i];
+        uint64_t position = m->solidOffset;
+        uint64_t end = m->solidOffset + m->uncompressedSize;
+        uLong crc = 0;
+        for (uint32_t sliceCrc : sliceCrcs[i]) {
+            uint64_t sliceEnd = std::min(end, (position / m_solidBlockSize + 1) * m_solidBlockSize);
+            crc = crc32_combine(crc, sliceCrc, static_cast<z_off_t>(sliceEnd - position));
+            position = sliceEnd;
+        }
+        if (static_cast<uint32_t>(crc) != m->crc) {
+            return fail("CRC mismatch: " + m->name);
+        }
+    }
+    return true;
+}
+
+bool ZipReader::skipLocalHeader(const ZipEntryInfo& entry, uint32_t& disk, uint64_t& offset)
+{
+    using namespace ZipFormat;
+
+    unsigned char local[kLocalHeaderSize];
+    if (!readAt(disk, offset, local, sizeof(local))) return false;
+    if (GetU32(local) != kLocalHeaderSignature) {
+        return fail("Corrupt local header: " + entry.name);
+    }
+    offset += GetU16(local + 26) + GetU16(local + 28);
+    return true;
+}
+
+bool ZipReader::ReadRaw(const ZipEntryInfo& entry, const SinkFn& sink)
+{
+    if (entry.solid) {
+        return fail("Solid members have no data of their own: " + entry.name);
+    }
+    Trace::Span span("read raw");
+
+    uint32_t disk = entry.disk;
+    uint64_t dataOffset = entry.localHeaderOffset;
+    if (!skipLocalHeader(entry, disk, dataOffset)) return false;
+
+    std::vector<char> buffer(static_cast<size_t>(std::clamp<uint64_t>(entry.compressedSize, 1, kBufferSize)));
+    uint64_t remaining = entry.compressedSize;
+    while (remaining > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        if (!readAt(disk, dataOffset, buffer.data(), n)) return false;
+        span.AddBytes(n);
+        if (!sink(buffer.data(), n)) return fail("Write failed: " + entry.name);
+        remaining -= n;
+    }
+    return true;
+}
+
+bool ZipReader::SameRawData(const ZipEntryInfo& a, const ZipEntryInfo& b)
+{
+    if (a.solid || b.solid || a.compressedSize != b.compressedSize) return false;
+    Trace::Span span("compare raw");
+
+    uint32_t diskA = a.disk, diskB = b.disk;
+    uint64_t offsetA = a.localHeaderOffset, offsetB = b.localHeaderOffset;
+    if (!skipLocalHeader(a, diskA, offsetA) || !skipLocalHeader(b, diskB, offsetB)) return false;
+    if (diskA == diskB && offsetA == offsetB) return true;
+
+    size_t size = static_cast<size_t>(std::clamp<uint64_t>(a.compressedSize, 1, kBufferSize));
+    std::vector<char> bufferA(size), bufferB(size);
+    uint64_t remaining = a.compressedSize;
+    while (remaining > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, size));
+        if (!readAt(diskA, offsetA, bufferA.data(), n) || !readAt(diskB, offsetB, bufferB.data(), n)) {
+            return false;
+        }
+        span.AddBytes(2 * n);
+        if (std::memcmp(bufferA.data(), bufferB.data(), n) != 0) return false;
+        remaining -= n;
+    }
+    return true;
+}
+
+bool ZipReader::ReadEntry(const ZipEntryInfo& entry, const SinkFn& sink)
+{
+    using namespace ZipFormat;
+
+    if (entry.solid) {
+        return readSolidMember(entry, sink);
+    }
+    Trace::Span span("inflate");
+
+    uint32_t disk = entry.disk;
+    uint64_t dataOffset = entry.localHeaderOffset;
+    if (!skipLocalHeader(entry, disk, dataOffset)) return false;
+    if (entry.method == kMethodDeflate && Codec::PrefersWholeBuffers() &&
+        std::max(entry.compressedSize, entry.uncompressedSize) <= Codec::kWholeBufferLimit) {
+        span.AddBytes(entry.uncompressedSize);
+        return inflateWhole(entry, disk, dataOffset, sink);
+    }
+
+    // Sized to the entry: most entries are small, and zeroing and faulting in
+    // full-size buffers for each one costs more than inflating it
+    std::vector<char> in(static_cast<size_t>(std::clamp<uint64_t>(entry.compressedSize, 1, kBufferSize)));
+    uint64_t remaining = entry.compressedSize;
+    uint32_t crc = 0;
+
+    if (entry.method == kMethodStore) {
+        while (remaining > 0) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, in.size()));
+            if (!readAt(disk, dataOffset, in.data(), n)) return false;
+            crc = Codec::Crc32(crc, in.data(), n);
+            span.AddBytes(n);
+            if (!sink(in.data(), n)) return fail("Write failed: " + entry.name);
+            remaining -= n;
+        }
+    } else if (entry.method == kMethodDeflate || entry.method == kMethodDeflateDictionary) {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            return fail("Failed to initialise inflate for: " + entry.name);
+        }
+
+        if (entry.method == kMethodDeflateDictionary) {
+            std::string payload;
+            if (!FindExtraField(entry.extra, kExtraDictionaryRef, payload) || payload.size() < 4) {
+                inflateEnd(&zs);
+                return fail("Missing dictionary reference: " + entry.name);
+            }
+            uint32_t id = GetU32(reinterpret_cast<const unsigned char*>(payload.data()));
+            auto it = m_dictionaries.find(id);
+            if (it == m_dictionaries.end()) {
+                inflateEnd(&zs);
+                return fail("Dictionary not found for: " + entry.name);
+            }
+            inflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(it->second.data()),
+                                 static_cast<uInt>(it->second.size()));
+        }
+
+        std::vector<char> out(static_cast<size_t>(std::clamp<uint64_t>(entry.uncompressedSize, 4096, kBufferSize)));
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (zs.avail_in == 0) {
+                if (remaining == 0) break;
+                size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, in.size()));
+                if (!readAt(disk, dataOffset, in.data(), n)) {
+                    inflateEnd(&zs);
+                    return false;
+                }
+                remaining -= n;
+                zs.next_in = reinterpret_cast<Bytef*>(in.data());
+                zs.avail_in = static_cast<uInt>(n);
+            }
+
+            zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            zs.avail_out = static_cast<uInt>(out.size());
+            status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                inflateEnd(&zs);
+                return fail("Corrupt compressed data: " + entry.name);
+            }
+
+            size_t produced = out.size() - zs.avail_out;
+            span.AddBytes(produced);
+            crc = Codec::Crc32(crc, out.data(), produced);
+            if (produced > 0 && !sink(out.data(), produced)) {
+                inflateEnd(&zs);
+                return fail("Write failed: " + entry.name);
+            }
+        }
+        inflateEnd(&zs);
+
+        if (status != Z_STREAM_END) {
+            return fail("Truncated compressed data: " + entry.name);
+        }
+    } else {
+        return fail("Unsupported compression method: " + entry.name);
+    }
+
+    if (crc != entry.crc) {
+        return fail("CRC mismatch: " + entry.name);
+    }
+    return true;
+}
+
+bool ZipReader::inflateWhole(const ZipEntryInfo& entry, uint32_t disk, uint64_t offset, const SinkFn& sink)
+{
+    // Only ever grown, so a buffer is not cleared again for every entry
+    thread_local std::vector<char> in;
+    thread_local std::vector<char> out;
+    size_t compressedSize = static_cast<size_t>(entry.compressedSize);
+    size_t uncompressedSize = static_cast<size_t>(entry.uncompressedSize);
+    if (in.size() < compressedSize) in.resize(compressedSize);
+    if (out.size() < uncompressedSize) out.resize(uncompressedSize);
+
+    if (!readAt(disk, offset, in.data(), compressedSize)) return false;
+    if (!Codec::Decompress(in.data(), compressedSize, out.data(), uncompressedSize)) {
+        return fail("Corrupt compressed data: " + entry.name);
+    }
+    if (Codec::Crc32(0, out.data(), uncompressedSize) != entry.crc) {
+        return fail("CRC mismatch: " + entry.name);
+    }
+
+    // Handed on in the same pieces as a streamed entry
+    for (size_t from = 0; from < uncompressedSize; from += kBufferSize) {
+        size_t n = std::min(kBufferSize, uncompressedSize - from);
+        if (!sink(out.data() + from, n)) return fail("Write failed: " + entry.name);
+    }
+    return true;
+}
+
+bool ZipReader::ExtractToFile(const ZipEntryInfo& entry, const std::string& destPath)
+{
+    std::FILE* out = std::fopen(destPath.c_str(), "wb");
+    if (!out) {
+        return fail("Failed to create: " + destPath);
+    }
+
+    bool ok = ReadEntry(entry, [out](const char* data, size_t size) {
+        return std::fwrite(data, 1, size, out) == size;
+    });
+
+    if (std::fclose(out) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,127 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ArchiveSource.h"
+#include "ZipFormat.h"
+
+struct ZipEntryInfo {
+    std::string name;
+    uint16_t method{0};
+    uint16_t flags{0};
+    uint32_t crc{0};
+    uint64_t compressedSize{0};
+    uint64_t uncompressedSize{0};
+    uint64_t localHeaderOffset{0};
+    uint32_t dosDateTime{0};
+    uint32_t externalAttributes{0};
+    std::string extra;
+    uint32_t disk{0}; // volume holding the local header in split archives
+
+    // Members of a solid stream have no ZIP entry of their own
+    bool solid{false};
+    uint64_t solidOffset{0};
+
+    bool IsDir() const { return !name.empty() && name.back() == '/'; }
+    bool IsInternal() const { return ZipFormat::IsInternalName(name); }
+};
+
+// Central-directory based ZIP reader. Understands STORE, DEFLATE and the
+// ArchiveManager dictionary and solid-block extensions described in ZipFormat.h.
+// ReadEntry may be called from several threads at once. Split archives are
+// opened through their last volume (the .zip); the other volumes are only
+// opened once an entry stored on them is read. Volumes are read through
+// ArchiveSource, local files by default.
+class ZipReader {
+public:
+    ZipReader() = default;
+    ~ZipReader();
+
+    ZipReader(const ZipReader&) = delete;
+    ZipReader& operator=(const ZipReader&) = delete;
+
+    // openVolume opens the source for a volume path; the default is a FileSource
+    using SourceFactory = std::function<std::unique_ptr<ArchiveSource>(const std::string& path)>;
+    bool Open(const std::string& path, SourceFactory openVolume = {});
+    bool Open(std::unique_ptr<ArchiveSource> source); // a single-volume archive
+    void Close();
+
+    // All entries in central directory order, including internal ones
+    const std::vector<ZipEntryInfo>& GetEntries() const { return m_entries; }
+
+    // Decompresses an entry, handing the data to sink in chunks; verifies CRC-32
+    using SinkFn = std::function<bool(const char* data, size_t size)>;
+    bool ReadEntry(const ZipEntryInfo& entry, const SinkFn& sink);
+    bool ExtractToFile(const ZipEntryInfo& entry, const std::string& destPath);
+
+    // The entry's data exactly as stored (compressed, not verified), for
+    // copying it into another archive unchanged; not for solid members
+    bool ReadRaw(const ZipEntryInfo& entry, const SinkFn& sink);
+
+    // True when two entries store exactly the same bytes, read side by side
+    // as ReadRaw would; false for solid members and on read errors
+    bool SameRawData(const ZipEntryInfo& a, const ZipEntryInfo& b);
+
+    // Tells the volume sources which entries are about to be read, in order,
+    // so they can fetch ahead. Solid members are skipped; see ExtractSolid.
+    void Prefetch(const std::vector<const ZipEntryInfo*>& entries);
+
+    // Extracts every solid member, decoding each block exactly once and
+    // blocks in parallel. destPathFor returns "" to skip a member; blocks
+    // holding only skipped members are not decoded.
+    bool HasSolidMembers() const { return m_solidBlockSize != 0; }
+    bool ExtractSolid(const std::function<std::string(const ZipEntryInfo&)>& destPathFor,
+                      unsigned threads);
+
+    // True when the archive uses ZIP64 end-of-central-directory records
+    bool IsZip64() const { return m_zip64; }
+    uint32_t GetVolumeCount() const { return static_cast<uint32_t>(m_volumes.size()); }
+    // The path a volume is read from; "" for an archive opened from a source
+    std::string GetVolumePath(uint32_t disk) const;
+    // Where the central directory starts, on the volume holding it
+    uint64_t GetCentralDirectoryOffset() const { return m_centralOffset; }
+
+    std::string GetLastError() const;
+
+private:
+    bool readCentralDirectory();
+    bool loadDictionaries();
+    bool loadSolidIndex();
+    bool readSolidBlock(size_t block, std::shared_ptr<const std::string>& data);
+    bool readSolidMember(const ZipEntryInfo& entry, const SinkFn& sink);
+    bool openSource(std::unique_ptr<ArchiveSource> source);
+    bool skipLocalHeader(const ZipEntryInfo& entry, uint32_t& disk, uint64_t& offset);
+    bool inflateWhole(const ZipEntryInfo& entry, uint32_t disk, uint64_t offset, const SinkFn& sink);
+    ArchiveSource* volumeSource(uint32_t disk);
+    bool readAt(uint32_t& disk, uint64_t& offset, void* buffer, size_t size);
+    bool fail(const std::string& message);
+
+    std::string m_path;
+    SourceFactory m_openVolume;
+    std::mutex m_volumeMutex;
+    std::vector<std::unique_ptr<ArchiveSource>> m_volumes; // null until first used
+    uint64_t m_fileSize{0};     // size of the last volume
+    bool m_zip64{false};
+    uint64_t m_centralOffset{0};
+    std::vector<ZipEntryInfo> m_entries;
+    std::unordered_map<uint32_t, std::string> m_dictionaries;
+
+    uint64_t m_solidBlockSize{0};
+    std::vector<size_t> m_solidBlocks; // entry index of each block
+    // Recently decoded blocks for reads of single members, most recent first;
+    // readers keep a block alive while the cache moves on
+    static constexpr size_t kSolidCacheBlocks = 4;
+    std::mutex m_solidCacheMutex;
+    std::vector<std::pair<size_t, std::shared_ptr<const std::string>>> m_solidCache;
+
+    mutable std::mutex m_errorMutex;
+    std::string m_lastError;
+};
@@ -0,0 +1,607 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#include "ZipWriter.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "zlib.h"
+#include "Codec.h"
+#include "Trace.h"
+#include "ZipReader.h"
+
+namespace {
+    constexpr size_t kBufferSize = 256 * 1024;
+}
+
+ZipWriter::~ZipWriter()
+{
+    if (m_file) {
+        std::fclose(m_file);
+    }
+}
+
+bool ZipWriter::fail(const std::string& message)
+{
+    m_lastError = message;
+    return false;
+}
+
+bool ZipWriter::Open(const std::string& path)
+{
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return fail("Failed to create archive: " + std::string(std::strerror(errno)));
+    }
+    std::setvbuf(m_file, nullptr, _IOFBF, kBufferSize);
+
+    m_offset = 0;
+    m_entries.clear();
+    m_outBuffer.resize(kBufferSize);
+    return true;
+}
+
+bool ZipWriter::OpenAppend(const std::string& path)
+{
+    ZipReader reader;
+    if (!reader.Open(path)) {
+        return fail(path + ": " + reader.GetLastError());
+    }
+    if (reader.GetVolumeCount() != 1) {
+        return fail("Cannot append to a split archive: " + path);
+    }
+    // The solid index is written with the members, not after them
+    if (reader.HasSolidMembers()) {
+        return fail("Cannot append to a solid archive: " + path);
+    }
+
+    m_entries.clear();
+    for (const auto& info : reader.GetEntries()) {
+        ZipWriterEntry entry;
+        entry.name = info.name;
+        entry.method = info.method;
+        entry.flags = info.flags;
+        entry.crc = info.crc;
+        entry.compressedSize = info.compressedSize;
+        entry.uncompressedSize = info.uncompressedSize;
+        entry.localHeaderOffset = info.localHeaderOffset;
+        entry.dosDateTime = info.dosDateTime;
+        entry.externalAttributes = info.externalAttributes;
+        entry.extra = ZipFormat::RemoveExtraField(info.extra, ZipFormat::kExtraZip64);
+        m_entries.push_back(std::move(entry));
+    }
+    uint64_t centralOffset = reader.GetCentralDirectoryOffset();
+    reader.Close();
+
+    // New entries overwrite the old central directory; Close() writes the whole one
+    m_file = std::fopen(path.c_str(), "r+b");
+    if (!m_file) {
+        return fail("Failed to open archive: " + std::string(std::strerror(errno)));
+    }
+    std::setvbuf(m_file, nullptr, _IOFBF, kBufferSize);
+    if (fseeko(m_file, static_cast<off_t>(centralOffset), SEEK_SET) != 0) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return fail("Seek failed: " + std::string(std::strerror(errno)));
+    }
+
+    m_offset = centralOffset;
+    m_outBuffer.resize(kBufferSize);
+    return true;
+}
+
+bool ZipWriter::writeRaw(const void* data, size_t size)
+{
+    if (size > 0 && std::fwrite(data, 1, size, m_file) != size) {
+        return fail("Write failed: " + std::string(std::strerror(errno)));
+    }
+    m_offset += size;
+    return true;
+}
+
+bool ZipWriter::rewind(uint64_t offset)
+{
+    if (fseeko(m_file, static_cast<off_t>(offset), SEEK_SET) != 0) {
+        return fail("Seek failed: " + std::string(std::strerror(errno)));
+    }
+    m_offset = offset;
+    return true;
+}
+
+bool ZipWriter::RemoveLastEntry()
+{
+    if (!m_file || m_entries.empty()) {
+        return fail("No entry to remove");
+    }
+    uint64_t offset = m_entries.back().localHeaderOffset;
+    m_entries.pop_back();
+    return rewind(offset);
+}
+
+bool ZipWriter::AddFile(const std::string& sourcePath, const std::string& entryName,
+                        int level, const std::string& dictionary)
+{
+    struct stat st{};
+    if (::stat(sourcePath.c_str(), &st) != 0) {
+        return fail("File not found: " + sourcePath);
+    }
+
+    std::FILE* in = std::fopen(sourcePath.c_str(), "rb");
+    if (!in) {
+        return fail("Failed to open: " + sourcePath);
+    }
+
+    ZipWriterEntry entry;
+    entry.name = entryName;
+    entry.dosDateTime = ZipFormat::ToDosDateTime(st.st_mtime);
+    entry.externalAttributes = static_cast<uint32_t>(st.st_mode & 0xffff) << 16;
+
+    bool ok = writeEntry(entry, [in](char* buffer, size_t size) {
+        return std::fread(buffer, 1, size, in);
+    }, level, dictionary, static_cast<uint64_t>(st.st_size));
+
+    std::fclose(in);
+    return ok;
+}
+
+bool ZipWriter::AddBuffer(const std::string& entryName, const std::string& data,
+                          int level, const std::string& extra)
+{
+    ZipWriterEntry entry;
+    entry.name = entryName;
+    entry.dosDateTime = ZipFormat::ToDosDateTime(std::time(nullptr));
+    entry.externalAttributes = static_cast<uint32_t>(S_IFREG | 0644) << 16;
+    entry.extra = extra;
+
+    size_t position = 0;
+    return writeEntry(entry, [&data, &position](char* buffer, size_t size) {
+        size_t n = std::min(size, data.size() - position);
+        std::memcpy(buffer, data.data() + position, n);
+        position += n;
+        return n;
+    }, level, {}, data.size());
+}
+
+bool ZipWriter::AddStream(ZipWriterEntry entry, const ReadFn& read, int level, uint64_t sizeHint)
+{
+    entry.extra = ZipFormat::RemoveExtraField(entry.extra, ZipFormat::kExtraZip64);
+    return writeEntry(entry, read, level, {}, sizeHint);
+}
+
+uint32_t ZipWriter::DictionaryId(const std::string& dictionary)
+{
+    uLong id = adler32(0L, Z_NULL, 0);
+    id = adler32(id, reinterpret_cast<const Bytef*>(dictionary.data()),
+                 static_cast<uInt>(dictionary.size()));
+    return static_cast<uint32_t>(id);
+}
+
+bool ZipWriter::AddDictionary(const std::string& entryName, const std::string& dictionary)
+{
+    std::string extra;
+    ZipFormat::PutU16(extra, ZipFormat::kExtraDictionary);
+    ZipFormat::PutU16(extra, 4);
+    ZipFormat::PutU32(extra, DictionaryId(dictionary));
+    return AddBuffer(ZipFormat::kInternalPrefix + entryName, dictionary, Z_NO_COMPRESSION, extra);
+}
+
+std::string ZipWriter::BuildLocalHeader(const ZipWriterEntry& entry)
+{
+    using namespace ZipFormat;
+
+    std::string extra;
+    if (entry.zip64) {
+        PutU16(extra, kExtraZip64);
+        PutU16(extra, 16);
+        PutU64(extra, entry.uncompressedSize);
+        PutU64(extra, entry.compressedSize);
+    }
+    extra += entry.extra;
+
+    std::string header;
+    PutU32(header, kLocalHeaderSignature);
+    PutU16(header, entry.zip64 ? kVersionNeededZip64 : kVersionNeeded);
+    PutU16(header, entry.flags);
+    PutU16(header, entry.method);
+    PutU32(header, entry.dosDateTime);
+    PutU32(header, entry.crc);
+    PutU32(header, entry.zip64 ? kZip64Marker32 : static_cast<uint32_t>(entry.compressedSize));
+    PutU32(header, entry.zip64 ? kZip64Marker32 : static_cast<uint32_t>(entry.uncompressedSize));
+    PutU16(header, static_cast<uint16_t>(entry.name.size()));
+    PutU16(header, static_cast<uint16_t>(extra.size()));
+    header += entry.name;
+    header += extra;
+    return header;
+}
+
+std::string ZipWriter::BuildCentralHeader(const ZipWriterEntry& entry)
+{
+    using namespace ZipFormat;
+
+    bool bigSizes = entry.zip64 || entry.uncompressedSize >= kZip64Marker32 ||
+                    entry.compressedSize >= kZip64Marker32;
+    bool bigOffset = entry.localHeaderOffset >= kZip64Marker32;
+    bool bigDisk = entry.disk >= kZip64Marker16;
+
+    std::string extra;
+    if (bigSizes || bigOffset || bigDisk) {
+        PutU16(extra, kExtraZip64);
+        PutU16(extra, static_cast<uint16_t>((bigSizes ? 16 : 0) + (bigOffset ? 8 : 0) +
+                                            (bigDisk ? 4 : 0)));
+        if (bigSizes) {
+            PutU64(extra, entry.uncompressedSize);
+            PutU64(extra, entry.compressedSize);
+        }
+        if (bigOffset) {
+            PutU64(extra, entry.localHeaderOffset);
+        }
+        if (bigDisk) {
+            PutU32(extra, entry.disk);
+        }
+    }
+    extra += entry.extra;
+
+    std::string central;
+    PutU32(central, kCentralHeaderSignature);
+    PutU16(central, kVersionMadeBy);
+    PutU16(central, extra.size() > entry.extra.size() ? kVersionNeededZip64 : kVersionNeeded);
+    PutU16(central, entry.flags);
+    PutU16(central, entry.method);
+    PutU32(central, entry.dosDateTime);
+    PutU32(central, entry.crc);
+    PutU32(central, bigSizes ? kZip64Marker32 : static_cast<uint32_t>(entry.compressedSize));
+    PutU32(central, bigSizes ? kZip64Marker32 : static_cast<uint32_t>(entry.uncompressedSize));
+    PutU16(central, static_cast<uint16_t>(entry.name.size()));
+    PutU16(central, static_cast<uint16_t>(extra.size()));
+    PutU16(central, 0); // comment
+    PutU16(central, bigDisk ? kZip64Marker16 : static_cast<uint16_t>(entry.disk));
+    PutU16(central, 0); // internal attributes
+    PutU32(central, entry.externalAttributes);
+    PutU32(central, bigOffset ? kZip64Marker32 : static_cast<uint32_t>(entry.localHeaderOffset));
+    central += entry.name;
+    central += extra;
+    return central;
+}
+
+std::string ZipWriter::BuildEndRecords(uint64_t entryCount, uint64_t entriesOnDisk,
+                                       uint64_t centralSize, uint64_t centralOffset,
+                                       uint32_t centralDisk, uint32_t thisDisk,
+                                       uint64_t recordsOffset)
+{
+    using namespace ZipFormat;
+
+    bool zip64 = entryCount >= kZip64Marker16 || centralSize >= kZip64Marker32 ||
+                 centralOffset >= kZip64Marker32 || thisDisk >= kZip64Marker16;
+
+    std::string end;
+    if (zip64) {
+        PutU32(end, kZip64EndOfCentralDirSignature);
+        PutU64(end, kZip64EndOfCentralDirSize - 12);
+        PutU16(end, kVersionMadeBy);
+        PutU16(end, kVersionNeededZip64);
+        PutU32(end, thisDisk);
+        PutU32(end, centralDisk);
+        PutU64(end, entriesOnDisk);
+        PutU64(end, entryCount);
+        PutU64(end, centralSize);
+        PutU64(end, centralOffset);
+
+        PutU32(end, kZip64LocatorSignature);
+        PutU32(end, thisDisk);
+        PutU64(end, recordsOffset);
+        PutU32(end, thisDisk + 1);
+    }
+
+    PutU32(end, kEndOfCentralDirSignature);
+    PutU16(end, zip64 ? kZip64Marker16 : static_cast<uint16_t>(thisDisk));
+    PutU16(end, zip64 ? kZip64Marker16 : static_cast<uint16_t>(centralDisk));
+    PutU16(end, zip64 ? kZip64Marker16 : static_cast<uint16_t>(entriesOnDisk));
+    PutU16(end, zip64 ? kZip64Marker16 : static_cast<uint16_t>(entryCount));
+    PutU32(end, zip64 ? kZip64Marker32 : static_cast<uint32_t>(centralSize));
+    PutU32(end, zip64 ? kZip64Marker32 : static_cast<uint32_t>(centralOffset));
+    PutU16(end, 0);
+    return end;
+}
+
+bool ZipWriter::writeLocalHeader(ZipWriterEntry& entry)
+{
+    entry.localHeaderOffset = m_offset;
+    std::string header = BuildLocalHeader(entry);
+    return writeRaw(header.data(), header.size());
+}
+
+bool ZipWriter::AddCompressed(ZipWriterEntry entry, const std::string& compressed)
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    entry.compressedSize = compressed.size();
+    entry.zip64 = entry.compressedSize >= ZipFormat::kZip64Marker32 ||
+                  entry.uncompressedSize >= ZipFormat::kZip64Marker32;
+    if (!writeLocalHeader(entry) || !writeRaw(compressed.data(), compressed.size()) ||
+        !writeDataDescriptor(entry)) {
+        return false;
+    }
+
+    m_entries.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::AddCompressed(ZipWriterEntry entry, const ReadFn& read)
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    entry.zip64 = entry.compressedSize >= ZipFormat::kZip64Marker32 ||
+                  entry.uncompressedSize >= ZipFormat::kZip64Marker32;
+    if (!writeLocalHeader(entry)) return false;
+
+    thread_local std::vector<char> buffer(kBufferSize);
+    uint64_t remaining = entry.compressedSize;
+    while (remaining > 0) {
+        size_t n = read(buffer.data(), static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size())));
+        if (n == 0 || n == kReadError) {
+            rewind(entry.localHeaderOffset);
+            return fail((n == 0 ? "Compressed data ended early: " : "Failed to read: ") + entry.name);
+        }
+        if (!writeRaw(buffer.data(), n)) return false;
+        remaining -= n;
+    }
+    if (!writeDataDescriptor(entry)) return false;
+
+    m_entries.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::writeDataDescriptor(const ZipWriterEntry& entry)
+{
+    using namespace ZipFormat;
+    if (!(entry.flags & kFlagDataDescriptor)) return true;
+
+    std::string descriptor;
+    PutU32(descriptor, kDataDescriptorSignature);
+    PutU32(descriptor, entry.crc);
+    if (entry.zip64) {
+        PutU64(descriptor, entry.compressedSize);
+        PutU64(descriptor, entry.uncompressedSize);
+    } else {
+        PutU32(descriptor, static_cast<uint32_t>(entry.compressedSize));
+        PutU32(descriptor, static_cast<uint32_t>(entry.uncompressedSize));
+    }
+    return writeRaw(descriptor.data(), descriptor.size());
+}
+
+bool ZipWriter::CompressStream(const ReadFn& read, const WriteFn& write, uint16_t method,
+                               int level, const std::string& dictionary,
+                               uint32_t& crc, uint64_t& size)
+{
+    // Reused across entries; archives are often millions of tiny files
+    thread_local std::vector<char> in(kBufferSize);
+    thread_local std::vector<char> out(kBufferSize);
+    uint32_t runningCrc = 0;
+    size = 0;
+    Trace::Span span("compress");
+
+    if (method == ZipFormat::kMethodStore) {
+        size_t n;
+        while ((n = read(in.data(), in.size())) > 0) {
+            if (n == kReadError) return false;
+            runningCrc = Codec::Crc32(runningCrc, in.data(), n);
+            size += n;
+            span.AddBytes(n);
+            if (!write(in.data(), n)) return false;
+        }
+        crc = runningCrc;
+        return true;
+    }
+
+    // A whole-buffer backend gets the entry in one piece when it fits;
+    // whatever was read of a larger one goes through zlib first
+    thread_local std::string whole;
+    whole.clear();
+    if (dictionary.empty() && Codec::PrefersWholeBuffers()) {
+        bool ended = false;
+        while (!ended && whole.size() < Codec::kWholeBufferLimit) {
+            size_t offset = whole.size();
+            whole.resize(offset + kBufferSize);
+            size_t n = read(whole.data() + offset, kBufferSize);
+            if (n == kReadError) return false;
+            whole.resize(offset + n);
+            ended = n < kBufferSize;
+        }
+        runningCrc = Codec::Crc32(0, whole.data(), whole.size());
+        size = whole.size();
+        span.AddBytes(size);
+
+        if (ended) {
+            thread_local std::string compressed;
+            if (!Codec::Compress(whole.data(), whole.size(), level, compressed)) return false;
+            crc = runningCrc;
+            return write(compressed.data(), compressed.size());
+        }
+    }
+
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    if (!dictionary.empty()) {
+        deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dictionary.data()),
+                             static_cast<uInt>(dictionary.size()));
+    }
+
+    // Drains zs.next_in into write()
+    auto deflateInput = [&](int flush) {
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            zs.avail_out = static_cast<uInt>(out.size());
+            deflate(&zs, flush);
+            size_t produced = out.size() - zs.avail_out;
+            if (produced > 0 && !write(out.data(), produced)) {
+                return false;
+            }
+        } while (zs.avail_out == 0);
+        return true;
+    };
+
+    zs.next_in = reinterpret_cast<Bytef*>(whole.data());
+    zs.avail_in = static_cast<uInt>(whole.size());
+    bool ok = deflateInput(Z_NO_FLUSH);
+
+    int flush = Z_NO_FLUSH;
+    while (ok && flush != Z_FINISH) {
+        size_t n = read(in.data(), in.size());
+        if (n == kReadError) {
+            ok = false;
+            break;
+        }
+        flush = (n < in.size()) ? Z_FINISH : Z_NO_FLUSH;
+        runningCrc = Codec::Crc32(runningCrc, in.data(), n);
+        size += n;
+        span.AddBytes(n);
+
+        zs.next_in = reinterpret_cast<Bytef*>(in.data());
+        zs.avail_in = static_cast<uInt>(n);
+        ok = deflateInput(flush);
+    }
+
+    deflateEnd(&zs);
+    crc = runningCrc;
+    return ok;
+}
+
+bool ZipWriter::writeEntry(ZipWriterEntry& entry, const ReadFn& read, int level,
+                           const std::string& dictionary, uint64_t sizeHint)
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    if (level == Z_NO_COMPRESSION) {
+        entry.method = ZipFormat::kMethodStore;
+    } else if (!dictionary.empty()) {
+        entry.method = ZipFormat::kMethodDeflateDictionary;
+        ZipFormat::PutU16(entry.extra, ZipFormat::kExtraDictionaryRef);
+        ZipFormat::PutU16(entry.extra, 4);
+        ZipFormat::PutU32(entry.extra, DictionaryId(dictionary));
+    } else {
+        entry.method = ZipFormat::kMethodDeflate;
+    }
+    if (entry.method != ZipFormat::kMethodStore) {
+        entry.flags |= ZipFormat::DeflateOptionFlags(level);
+    }
+
+    // Local header goes out with zero sizes and is patched once the data is written
+    entry.zip64 = sizeHint >= ZipFormat::kZip64Threshold;
+    if (!writeLocalHeader(entry)) return false;
+
+    uint64_t dataStart = m_offset;
+    bool ok = CompressStream(read, [this](const char* data, size_t size) {
+        return writeRaw(data, size);
+    }, entry.method, level, dictionary, entry.crc, entry.uncompressedSize);
+    if (!ok) {
+        rewind(entry.localHeaderOffset);
+        return fail("Failed to compress: " + entry.name);
+    }
+    entry.compressedSize = m_offset - dataStart;
+
+    if (!entry.zip64 && (entry.compressedSize >= ZipFormat::kZip64Marker32 ||
+                         entry.uncompressedSize >= ZipFormat::kZip64Marker32)) {
+        rewind(entry.localHeaderOffset);
+        return fail("File grew beyond 4 GB while archiving: " + entry.name);
+    }
+
+    // Patch crc and sizes in the local header
+    std::string sizes;
+    ZipFormat::PutU32(sizes, entry.crc);
+    uint64_t sizesOffset = entry.localHeaderOffset + 14;
+    if (entry.zip64) {
+        ZipFormat::PutU32(sizes, ZipFormat::kZip64Marker32);
+        ZipFormat::PutU32(sizes, ZipFormat::kZip64Marker32);
+        ZipFormat::PutU16(sizes, static_cast<uint16_t>(entry.name.size()));
+        ZipFormat::PutU16(sizes, static_cast<uint16_t>(20 + entry.extra.size()));
+        sizes += entry.name;
+        ZipFormat::PutU16(sizes, ZipFormat::kExtraZip64);
+        ZipFormat::PutU16(sizes, 16);
+        ZipFormat::PutU64(sizes, entry.uncompressedSize);
+        ZipFormat::PutU64(sizes, entry.compressedSize);
+    } else {
+        ZipFormat::PutU32(sizes, static_cast<uint32_t>(entry.compressedSize));
+        ZipFormat::PutU32(sizes, static_cast<uint32_t>(entry.uncompressedSize));
+    }
+    if (fseeko(m_file, static_cast<off_t>(sizesOffset), SEEK_SET) != 0 ||
+        std::fwrite(sizes.data(), 1, sizes.size(), m_file) != sizes.size() ||
+        fseeko(m_file, static_cast<off_t>(m_offset), SEEK_SET) != 0) {
+        return fail("Failed to update header for: " + entry.name);
+    }
+
+    m_entries.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::writeCentralDirectory()
+{
+    Trace::Span span("finalize");
+
+    uint64_t centralStart = m_offset;
+    std::string central;
+    for (const auto& entry : m_entries) {
+        central += BuildCentralHeader(entry);
+
+        // Flush in chunks so million-entry directories do not sit in memory twice
+        if (central.size() >= m_outBuffer.size()) {
+            if (!writeRaw(central.data(), central.size())) return false;
+            central.clear();
+        }
+    }
+    if (!writeRaw(central.data(), central.size())) return false;
+
+    std::string end = BuildEndRecords(m_entries.size(), m_entries.size(),
+                                      m_offset - centralStart, centralStart, 0, 0, m_offset);
+    if (!writeRaw(end.data(), end.size())) return false;
+
+    // An appended archive may have had a longer directory or a comment
+    if (std::fflush(m_file) != 0 || ::ftruncate(fileno(m_file), static_cast<off_t>(m_offset)) != 0) {
+        return fail("Write failed: " + std::string(std::strerror(errno)));
+    }
+    return true;
+}
+
+bool ZipWriter::Checkpoint()
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    uint64_t centralStart = m_offset;
+    if (!writeCentralDirectory()) return false;
+
+    // The next entry goes where this directory starts
+    if (fseeko(m_file, static_cast<off_t>(centralStart), SEEK_SET) != 0) {
+        return fail("Seek failed: " + std::string(std::strerror(errno)));
+    }
+    m_offset = centralStart;
+    return true;
+}
+
+bool ZipWriter::Close()
+{
+    if (!m_file) {
+        return fail("Archive is not open");
+    }
+
+    bool ok = writeCentralDirectory();
+    int result = std::fclose(m_file);
+    m_file = nullptr;
+    if (!ok) return false;
+    if (result != 0) {
+        return fail("Failed to finalize archive");
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ZipFormat.h"
+
+struct ZipWriterEntry {
+    std::string name;
+    uint16_t method{ZipFormat::kMethodStore};
+    uint16_t flags{ZipFormat::kFlagUtf8};
+    uint32_t crc{0};
+    uint64_t compressedSize{0};
+    uint64_t uncompressedSize{0};
+    uint64_t localHeaderOffset{0};
+    uint32_t dosDateTime{0};
+    uint32_t externalAttributes{0};
+    std::string extra;
+    bool zip64{false}; // local header carries a ZIP64 size field
+    uint32_t disk{0};  // volume holding the local header in split archives
+};
+
+// Streaming ZIP writer on top of the Codec backends, for every archive the
+// panel creates, plain ones as well as those using extensions such as
+// preset-dictionary deflate.
+// Switches to ZIP64 records per entry and for the end of central directory
+// as soon as sizes, offsets or the entry count no longer fit the classic format.
+class ZipWriter {
+public:
+    ZipWriter() = default;
+    ~ZipWriter();
+
+    ZipWriter(const ZipWriter&) = delete;
+    ZipWriter& operator=(const ZipWriter&) = delete;
+
+    bool Open(const std::string& path);
+
+    // Opens an existing single-volume archive to add entries after the
+    // ones it has; they overwrite its central directory, which Close() or
+    // Checkpoint() writes again with everything in it
+    bool OpenAppend(const std::string& path);
+
+    // Level 0 stores the data. A non-empty dictionary primes the deflate
+    // window and marks the entry with the ArchiveManager dictionary extension.
+    bool AddFile(const std::string& sourcePath, const std::string& entryName,
+                 int level, const std::string& dictionary = {});
+    bool AddBuffer(const std::string& entryName, const std::string& data,
+                   int level, const std::string& extra = {});
+
+    // Compresses everything read() returns under entry's name, time and
+    // attributes; method, crc and sizes are filled in. read() must fill the
+    // buffer completely until the end of the data, or return kReadError to
+    // fail the entry. A failed entry is taken back out: the next one is
+    // written over it and it is not in the central directory.
+    using ReadFn = std::function<size_t(char* buffer, size_t size)>;
+    static constexpr size_t kReadError = SIZE_MAX;
+    bool AddStream(ZipWriterEntry entry, const ReadFn& read, int level, uint64_t sizeHint);
+
+    // Stores a preset dictionary under ZipFormat::kInternalPrefix so that
+    // entries added with it can be decoded by ZipReader
+    bool AddDictionary(const std::string& entryName, const std::string& dictionary);
+    static uint32_t DictionaryId(const std::string& dictionary);
+
+    // Writes data that is already compressed with entry.method; crc and
+    // uncompressedSize must be filled in by the caller. With
+    // kFlagDataDescriptor in entry.flags a data descriptor follows the data
+    // (the local header has the sizes as well).
+    bool AddCompressed(ZipWriterEntry entry, const std::string& compressed);
+
+    // Same, streaming entry.compressedSize bytes from read()
+    bool AddCompressed(ZipWriterEntry entry, const ReadFn& read);
+
+    // Takes the last entry added back out, for data found bad after it was written
+    bool RemoveLastEntry();
+
+    // Writes the central directory so the archive on disk is complete, and
+    // stays open to add more entries over it
+    bool Checkpoint();
+
+    bool Close();
+
+    const std::string& GetLastError() const { return m_lastError; }
+    uint64_t GetBytesWritten() const { return m_offset; }
+
+    // Compresses everything read() returns with the given method and hands
+    // the output to write(); crc and size describe the uncompressed input
+    using WriteFn = std::function<bool(const char* data, size_t size)>;
+    static bool CompressStream(const ReadFn& read, const WriteFn& write, uint16_t method,
+                               int level, const std::string& dictionary,
+                               uint32_t& crc, uint64_t& size);
+
+    // Record serialisation, shared with SplitArchiveWriter
+    static std::string BuildLocalHeader(const ZipWriterEntry& entry);
+    static std::string BuildCentralHeader(const ZipWriterEntry& entry);
+    static std::string BuildEndRecords(uint64_t entryCount, uint64_t entriesOnDisk,
+                                       uint64_t centralSize, uint64_t centralOffset,
+                                       uint32_t centralDisk, uint32_t thisDisk,
+                                       uint64_t recordsOffset);
+
+private:
+    bool writeEntry(ZipWriterEntry& entry, const ReadFn& read, int level,
+                    const std::string& dictionary, uint64_t sizeHint);
+    bool writeLocalHeader(ZipWriterEntry& entry);
+    bool writeCentralDirectory();
+    bool writeRaw(const void* data, size_t size);
+    bool writeDataDescriptor(const ZipWriterEntry& entry);
+    bool rewind(uint64_t offset);
+    bool fail(const std::string& message);
+
+    std::FILE* m_file{nullptr};
+    uint64_t m_offset{0};
+    std::vector<ZipWriterEntry> m_entries;
+    std::vector<char> m_outBuffer;
+    std::string m_lastError;
+};
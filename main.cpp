@@ -6,6 +6,8 @@
 #include <wx/notebook.h>
 #include "EnhancedZipPanel.h"
 #include "EnhancedUnZipPanel.h"
+#include "Codec.h"
+#include "Trace.h"
 
 class ArchiveApp : public wxApp
 {
@@ -39,6 +41,9 @@ wxIMPLEMENT_APP(ArchiveApp);
 
 bool ArchiveApp::OnInit()
 {
+    Trace::EnableFromEnvironment();
+    Codec::SelectFromEnvironment();
+
     MainFrame* frame = new MainFrame();
     frame->Show(true);
     return true;
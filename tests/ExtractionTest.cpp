@@ -0,0 +1,167 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+// ExtractionWriter::ExtractEntries must write a name given more than once
+// (an archive appended to) once, from its last entry, not from all of them
+// at the same time, and must not take entries that merely share a CRC-32,
+// size and method for copies of each other.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "zlib.h"
+#include "ExtractionWriter.h"
+#include "ZipReader.h"
+#include "ZipWriter.h"
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what)
+    {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+            ++failures;
+        }
+    }
+
+    std::string contents(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream data;
+        data << file.rdbuf();
+        return data.str();
+    }
+
+    void extractRepeatedNames(const std::string& dir)
+    {
+        std::string archive = dir + "/repeated.zip";
+        std::string output = dir + "/out";
+
+        // Earlier versions larger than the last, so they would still be
+        // written when it is done
+        std::string first(8u << 20, 'a');
+        std::string second(4u << 20, 'b');
+        std::string last = "last version\n";
+
+        ZipWriter writer;
+        check(writer.Open(archive), "open " + archive);
+        check(writer.AddBuffer("log.txt", first, 0), "add first log.txt");
+        check(writer.AddBuffer("other.txt", "other\n", 6), "add other.txt");
+        check(writer.AddBuffer("log.txt", second, 6), "add second log.txt");
+        check(writer.AddBuffer("sub/", "", 0), "add sub/");
+        check(writer.AddBuffer("log.txt", last, 6), "add last log.txt");
+        check(writer.Close(), "close " + archive);
+
+        ZipReader reader;
+        check(reader.Open(archive), "reopen " + archive);
+        std::vector<size_t> all;
+        for (size_t i = 0; i < reader.GetEntries().size(); ++i) all.push_back(i);
+
+        ExtractionWriter extraction(output);
+        check(extraction.ExtractEntries(reader, all, 4), "extract: " + extraction.GetLastError());
+        ExtractionWriter::Stats stats = extraction.GetStats();
+        check(stats.files == 2, "each name written once, got " + std::to_string(stats.files));
+        check(contents(output + "/log.txt") == last, "log.txt holds its last entry");
+        check(contents(output + "/other.txt") == "other\n", "other.txt extracted");
+        check(::access((output + "/sub").c_str(), F_OK) == 0, "sub/ created");
+    }
+
+    uint32_t crcOf(const std::string& data)
+    {
+        return static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(data.data()),
+                                           static_cast<uInt>(data.size())));
+    }
+
+    // Flips bits of data's last four bytes until its CRC-32 is target. For
+    // messages of one length CRC-32 is affine, so this is a 32x32 system over
+    // GF(2): column i is what flipping bit i does to the CRC.
+    bool forgeCrc(std::string& data, uint32_t target)
+    {
+        size_t tail = data.size() - 4;
+        uint32_t base = crcOf(data);
+        uint32_t columns[32];
+        for (int bit = 0; bit < 32; ++bit) {
+            data[tail + bit / 8] ^= static_cast<char>(1 << (bit % 8));
+            columns[bit] = crcOf(data) ^ base;
+            data[tail + bit / 8] ^= static_cast<char>(1 << (bit % 8));
+        }
+
+        // Eliminate with the columns as rows, tracking which bits make each one
+        uint32_t want = base ^ target;
+        uint32_t rows[32], flips[32];
+        for (int bit = 0; bit < 32; ++bit) {
+            rows[bit] = columns[bit];
+            flips[bit] = 1u << bit;
+        }
+        uint32_t chosen = 0;
+        for (int pivot = 31, row = 0; pivot >= 0; --pivot) {
+            int found = -1;
+            for (int r = row; r < 32 && found < 0; ++r) {
+                if (rows[r] >> pivot & 1) found = r;
+            }
+            if (found < 0) continue;
+            std::swap(rows[row], rows[found]);
+            std::swap(flips[row], flips[found]);
+            for (int r = 0; r < 32; ++r) {
+                if (r != row && (rows[r] >> pivot & 1)) {
+                    rows[r] ^= rows[row];
+                    flips[r] ^= flips[row];
+                }
+            }
+            if (want >> pivot & 1) {
+                want ^= rows[row];
+                chosen ^= flips[row];
+            }
+            ++row;
+        }
+        if (want != 0) return false;
+        for (int bit = 0; bit < 32; ++bit) {
+            if (chosen >> bit & 1) data[tail + bit / 8] ^= static_cast<char>(1 << (bit % 8));
+        }
+        return crcOf(data) == target;
+    }
+
+    void extractForgedCopy(const std::string& dir)
+    {
+        std::string archive = dir + "/forged.zip";
+        std::string output = dir + "/forged";
+
+        // Stored, so both also have the same compressed size and method
+        std::string original(4096, 'a');
+        std::string forged(4096, 'b');
+        check(forgeCrc(forged, crcOf(original)), "forge a CRC-32 collision");
+
+        ZipWriter writer;
+        check(writer.Open(archive), "open " + archive);
+        check(writer.AddBuffer("original.txt", original, 0), "add original.txt");
+        check(writer.AddBuffer("forged.txt", forged, 0), "add forged.txt");
+        check(writer.Close(), "close " + archive);
+
+        ZipReader reader;
+        check(reader.Open(archive), "reopen " + archive);
+        ExtractionWriter extraction(output);
+        check(extraction.ExtractEntries(reader, {0, 1}, 2), "extract: " + extraction.GetLastError());
+        check(extraction.GetStats().duplicates == 0, "no duplicate made");
+        check(contents(output + "/original.txt") == original, "original.txt extracted");
+        check(contents(output + "/forged.txt") == forged, "forged.txt holds its own data");
+    }
+}
+
+int main()
+{
+    char dir[] = "/tmp/extraction-test-XXXXXX";
+    if (!::mkdtemp(dir)) return 1;
+
+    extractRepeatedNames(dir);
+    extractForgedCopy(dir);
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    std::system(cleanup.c_str());
+    if (failures == 0) std::printf("ExtractionTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
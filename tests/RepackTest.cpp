@@ -0,0 +1,138 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+// ArchiveRepacker must leave out entries whose data turns out bad, also
+// when they are large enough to be streamed into the new archive.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "ArchiveRepacker.h"
+#include "ZipReader.h"
+#include "ZipWriter.h"
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string& what)
+    {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+            ++failures;
+        }
+    }
+
+    // Flips one byte in the middle of an entry's stored data
+    void corrupt(const std::string& path, const ZipEntryInfo& entry)
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(entry.localHeaderOffset + 26));
+        unsigned char lengths[4];
+        file.read(reinterpret_cast<char*>(lengths), 4);
+        uint64_t headerSize = 30 + (lengths[0] | lengths[1] << 8) + (lengths[2] | lengths[3] << 8);
+        std::streamoff middle = static_cast<std::streamoff>(entry.localHeaderOffset + headerSize +
+                                                            entry.compressedSize / 2);
+        file.seekg(middle);
+        char byte = 0;
+        file.read(&byte, 1);
+        byte ^= 0x20;
+        file.seekp(middle);
+        file.write(&byte, 1);
+    }
+
+    // A large entry with corrupted data among good ones; level decides
+    // whether it is stored (read back with a CRC check at the end) or deflated
+    void repackCorrupt(const std::string& dir, int sourceLevel)
+    {
+        std::string source = dir + "/source-" + std::to_string(sourceLevel) + ".zip";
+        std::string output = dir + "/output-" + std::to_string(sourceLevel) + ".zip";
+
+        std::string large;
+        large.reserve(30u << 20);
+        for (unsigned i = 0; large.size() < (30u << 20); ++i) {
+            large += "line " + std::to_string(i * 2654435761u) + "\n";
+        }
+
+        ZipWriter writer;
+        check(writer.Open(source), "open " + source);
+        check(writer.AddBuffer("before.txt", "first entry\n", 6), "add before.txt");
+        check(writer.AddBuffer("large.txt", large, sourceLevel), "add large.txt");
+        check(writer.AddBuffer("after.txt", "last entry\n", 6), "add after.txt");
+        check(writer.Close(), "close " + source);
+
+        {
+            ZipReader reader;
+            check(reader.Open(source), "reopen " + source);
+            corrupt(source, reader.GetEntries()[1]);
+        }
+
+        ZipReader reader;
+        check(reader.Open(source), "open corrupted " + source);
+        RepackOptions options;
+        options.compressionLevel = 1;
+        ArchiveRepacker repacker(options);
+        bool ok = repacker.Repack(reader, {0, 1, 2}, output);
+        check(!ok, "repack reports the corrupt entry");
+        check(repacker.GetStats().failed == 1, "one entry failed");
+
+        ZipReader result;
+        check(result.Open(output), "open " + output);
+        const auto& entries = result.GetEntries();
+        check(entries.size() == 2, "output holds the two good entries");
+        for (const auto& entry : entries) {
+            check(entry.name != "large.txt", "corrupt entry left out");
+            std::string data;
+            bool read = result.ReadEntry(entry, [&data](const char* chunk, size_t size) {
+                data.append(chunk, size);
+                return true;
+            });
+            check(read, "good entry reads back: " + entry.name);
+        }
+        check(entries.size() < 2 || entries[1].localHeaderOffset < (1u << 20),
+              "corrupt entry's data was rewound over");
+    }
+
+    // Repacking onto the file being read must leave it as it was
+    void repackOntoItself(const std::string& dir)
+    {
+        std::string source = dir + "/self.zip";
+        ZipWriter writer;
+        check(writer.Open(source), "open " + source);
+        check(writer.AddBuffer("a.txt", std::string(100000, 'a'), 6), "add a.txt");
+        check(writer.AddBuffer("b.txt", "second entry\n", 6), "add b.txt");
+        check(writer.Close(), "close " + source);
+
+        std::string link = dir + "/self-link.zip";
+        check(::link(source.c_str(), link.c_str()) == 0, "link " + link);
+
+        for (const std::string& output : {source, link}) {
+            ZipReader reader;
+            check(reader.Open(source), "open " + source);
+            RepackOptions options;
+            options.compressionLevel = 1;
+            ArchiveRepacker repacker(options);
+            check(!repacker.Repack(reader, {0, 1}, output), "repack into " + output + " refused");
+        }
+
+        ZipReader result;
+        check(result.Open(source) && result.GetEntries().size() == 2, "source still readable");
+    }
+}
+
+int main()
+{
+    char dir[] = "/tmp/repack-test-XXXXXX";
+    if (!::mkdtemp(dir)) return 1;
+
+    repackCorrupt(dir, 0);
+    repackCorrupt(dir, 6);
+    repackOntoItself(dir);
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    std::system(cleanup.c_str());
+    if (failures == 0) std::printf("RepackTest passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// Author: Erkhembileg Ariunbold
+// Project: ArchiveManager
+// Date: 2025.06.06
+
+// An archive past both classic limits: an entry over 4 GB (from a sparse
+// file, so the test stays fast) and more than 65,535 entries. ZipWriter
+// must switch to ZIP64 records, and ZipReader and ExtractionWriter must
+// read everything back with its CRC-32 checked.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ExtractionWriter.h"
+#include "ZipFormat.h"
+#include "ZipReader.h"
+#include "ZipWriter.h"
+
+namespace {
+    int failures = 0;
+
+    constexpr uint64_t kLargeSize = (4ull << 30) + (64ull << 20);
+    constexpr size_t kSmallEntries = 70000;
+    const std::string kTail = "end of the sparse file\n";
+
+    void check(bool condition, const std::string& what)
+    {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+            ++failures;
+        }
+    }
+
+    std::string contents(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream data;
+        data << file.rdbuf();
+        return data.str();
+    }
+
+    // All holes but the last bytes, so the CRC covers real data too
+    bool makeSparse(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = ::ftruncate(fd, static_cast<off_t>(kLargeSize)) == 0 &&
+                  ::pwrite(fd, kTail.data(), kTail.size(), static_cast<off_t>(kLargeSize - kTail.size())) ==
+                      static_cast<ssize_t>(kTail.size());
+        return ::close(fd) == 0 && ok;
+    }
+
+    std::string smallName(size_t i) { return "small/" + std::to_string(i % 100) + "/" + std::to_string(i) + ".txt"; }
+    std::string smallData(size_t i) { return "entry " + std::to_string(i) + "\n"; }
+
+    // The end of central directory is preceded by the ZIP64 locator, which
+    // points at the ZIP64 end of central directory record
+    void checkEndRecords(const std::string& path)
+    {
+        using namespace ZipFormat;
+        std::string data = contents(path);
+        check(data.size() > 22 + 20, "archive has end records");
+        if (data.size() <= 22 + 20) return;
+
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+        size_t end = data.size() - 22;
+        check(GetU32(bytes + end) == kEndOfCentralDirSignature, "end of central directory at the end");
+        check(GetU16(bytes + end + 8) == 0xffff, "classic entry count saturated");
+
+        size_t locator = end - 20;
+        check(GetU32(bytes + locator) == kZip64LocatorSignature, "ZIP64 locator before it");
+        uint64_t record = GetU64(bytes + locator + 8);
+        check(record + 56 <= locator && GetU32(bytes + record) == kZip64EndOfCentralDirSignature,
+              "locator points at the ZIP64 end of central directory");
+        if (record + 56 <= locator) {
+            check(GetU64(bytes + record + 32) == kSmallEntries + 1, "ZIP64 record holds the entry count");
+        }
+    }
+
+    void largeArchive(const std::string& dir)
+    {
+        std::string source = dir + "/large.bin";
+        std::string archive = dir + "/large.zip";
+        std::string output = dir + "/out";
+        check(makeSparse(source), "create sparse " + source);
+
+        ZipWriter writer;
+        check(writer.Open(archive), "open " + archive);
+        check(writer.AddFile(source, "large.bin", 1), "add large.bin: " + writer.GetLastError());
+        for (size_t i = 0; i < kSmallEntries; ++i) {
+            if (!writer.AddBuffer(smallName(i), smallData(i), 6)) {
+                check(false, "add " + smallName(i) + ": " + writer.GetLastError());
+                break;
+            }
+        }
+        check(writer.Close(), "close " + archive);
+        checkEndRecords(archive);
+
+        ZipReader reader;
+        check(reader.Open(archive), "reopen " + archive + ": " + reader.GetLastError());
+        check(reader.IsZip64(), "read as ZIP64");
+        const auto& entries = reader.GetEntries();
+        check(entries.size() == kSmallEntries + 1, "all entries listed, got " + std::to_string(entries.size()));
+        if (entries.size() != kSmallEntries + 1) return;
+        check(entries[0].uncompressedSize == kLargeSize, "64-bit size of large.bin");
+        check(entries[kSmallEntries].name == smallName(kSmallEntries - 1), "last entry's name");
+
+        // ReadEntry and ExtractEntries both verify every CRC-32
+        uint64_t read = 0;
+        std::string tail;
+        bool ok = reader.ReadEntry(entries[0], [&](const char* data, size_t size) {
+            read += size;
+            tail.append(data, size);
+            if (tail.size() > kTail.size()) tail.erase(0, tail.size() - kTail.size());
+            return true;
+        });
+        check(ok && read == kLargeSize, "large.bin reads back: " + reader.GetLastError());
+        check(tail == kTail, "large.bin ends with its data");
+
+        std::vector<size_t> all(entries.size());
+        for (size_t i = 0; i < all.size(); ++i) all[i] = i;
+        ExtractionWriter extraction(output);
+        check(extraction.ExtractEntries(reader, all), "extract: " + extraction.GetLastError());
+        check(extraction.GetStats().files == kSmallEntries + 1, "every file extracted");
+
+        struct stat st{};
+        check(::stat((output + "/large.bin").c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == kLargeSize,
+              "extracted large.bin has its size");
+        check(static_cast<uint64_t>(st.st_blocks) * 512 < (64ull << 20), "extracted large.bin stays sparse");
+        for (size_t i : {size_t{0}, size_t{65535}, kSmallEntries - 1}) {
+            check(contents(output + "/" + smallName(i)) == smallData(i), "extracted " + smallName(i));
+        }
+    }
+}
+
+int main()
+{
+    char dir[] = "/tmp/zip64-test-XXXXXX";
+    if (!::mkdtemp(dir)) return 1;
+
+    largeArchive(dir);
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    std::system(cleanup.c_str());
+    if (failures == 0) std::printf("Zip64Test passed\n");
+    return failures == 0 ? 0 : 1;
+}